@@ -1,29 +1,60 @@
 #include "gattlib_internal.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
 #include <bluetooth/hci_lib.h>
 
-#define LE_SCAN_PASSIVE                 0x00
-#define LE_SCAN_ACTIVE                  0x01
-
 /* These LE scan and inquiry parameters were chosen according to LE General
  * Discovery Procedure specification.
  */
 #define DISCOV_LE_SCAN_WIN              0x12
 #define DISCOV_LE_SCAN_INT              0x12
 
-#define BLE_EVENT_TYPE     0x05
-#define BLE_SCAN_RESPONSE  0x04
+/* Timeout (in ms) of the HCI commands sent to configure the scan */
+#define HCI_COMMAND_TIMEOUT             2000
+
+/* Size of the HCI socket receive buffer while scanning. A large buffer lets the
+ * kernel queue bursts of advertising reports while we are dispatching callbacks. */
+#define SCAN_SOCKET_RCVBUF              (1024 * 1024)
+/* Maximum number of HCI events read per wakeup before checking the timeout again */
+#define SCAN_MAX_EVENTS_PER_WAKEUP      256
+
+#define EVT_LE_ADVERTISING_REPORT       0x02
+
+/* RSSI value reported by the controller when the RSSI is not available */
+#define HCI_RSSI_NOT_AVAILABLE 127
 
-#define EIR_NAME_SHORT     0x08  /* shortened local name */
-#define EIR_NAME_COMPLETE  0x09  /* complete local name */
+struct ble_scan_arg {
+	struct gattlib_adapter *adapter;
+	uuid_t **uuid_list;
+	int16_t rssi_threshold;
+	uint32_t enabled_filters;
+	gattlib_discovered_device_t discovered_device_cb;
+	gattlib_discovered_advertisement_t discovered_advertisement_cb;
+	void *user_data;
+	// Set of the devices already reported to 'discovered_device_cb', keyed by their 48-bit address
+	GHashTable *discovered_devices;
+
+	// Scratch memory used to parse the advertising reports
+	struct gattlib_advertisement_storage storage;
+
+	// Socket state restored when the scan is stopped
+	struct hci_filter old_hci_filter;
+	int old_flags;
+
+	// Set while the callbacks of a non-blocking scan are dispatched
+	bool dispatching;
+};
 
 int gattlib_adapter_open(const char* adapter_name, void** adapter) {
+	struct gattlib_adapter *gattlib_adapter;
 	int dev_id;
 
 	if (adapter == NULL) {
@@ -41,66 +72,268 @@ int gattlib_adapter_open(const char* adapter_name, void** adapter) {
 		return GATTLIB_NOT_FOUND;
 	}
 
-	int* device_desc = malloc(sizeof(int));
-	if (device_desc == NULL) {
+	gattlib_adapter = calloc(1, sizeof(struct gattlib_adapter));
+	if (gattlib_adapter == NULL) {
 		return GATTLIB_OUT_OF_MEMORY;
-	} else {
-		*adapter = device_desc;
 	}
 
-	*device_desc = hci_open_dev(dev_id);
-	if (device_desc < 0) {
+	gattlib_adapter->dev_id = dev_id;
+	gattlib_adapter->device_desc = hci_open_dev(dev_id);
+	if (gattlib_adapter->device_desc < 0) {
 		fprintf(stderr, "ERROR: Could not open device.\n");
+		free(gattlib_adapter);
 		return GATTLIB_DEVICE_ERROR;
 	}
 
+	// Default scan parameters
+	gattlib_adapter->scan_type = GATTLIB_SCAN_TYPE_ACTIVE;
+	gattlib_adapter->scan_interval = DISCOV_LE_SCAN_INT;
+	gattlib_adapter->scan_window = DISCOV_LE_SCAN_WIN;
+	gattlib_adapter->scan_filter_duplicates = true;
+
+	*adapter = gattlib_adapter;
 	return GATTLIB_SUCCESS;
 }
 
-static char* parse_name(uint8_t* data, size_t size) {
-	size_t offset = 0;
+int gattlib_adapter_scan_set_parameters(void *adapter, uint8_t scan_type, uint16_t interval, uint16_t window, bool filter_duplicates) {
+	struct gattlib_adapter *gattlib_adapter = adapter;
+
+	if (gattlib_adapter == NULL) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	if ((scan_type != GATTLIB_SCAN_TYPE_PASSIVE) && (scan_type != GATTLIB_SCAN_TYPE_ACTIVE)) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	// Range defined by the Bluetooth Core Specification for 'LE Set Scan Parameters'
+	if ((interval < 0x0004) || (interval > 0x4000) || (window < 0x0004) || (window > interval)) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	gattlib_adapter->scan_type = scan_type;
+	gattlib_adapter->scan_interval = interval;
+	gattlib_adapter->scan_window = window;
+	gattlib_adapter->scan_filter_duplicates = filter_duplicates;
+
+	return GATTLIB_SUCCESS;
+}
 
-	while (offset < size) {
-		uint8_t field_len = data[0];
-		size_t name_len;
+int gattlib_adapter_scan_set_address_filter(void *adapter, const char **mac_address_list) {
+	struct gattlib_adapter *gattlib_adapter = adapter;
+	bdaddr_t *address_filter = NULL;
+	size_t count = 0;
 
-		if (field_len == 0 || offset + field_len > size)
-			return NULL;
+	if (gattlib_adapter == NULL) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
 
-		switch (data[1]) {
-		case EIR_NAME_SHORT:
-		case EIR_NAME_COMPLETE:
-			name_len = field_len - 1;
-			if (name_len > size)
-				return NULL;
+	if (mac_address_list != NULL) {
+		while (mac_address_list[count] != NULL) {
+			if (bachk(mac_address_list[count]) < 0) {
+				return GATTLIB_INVALID_PARAMETER;
+			}
+			count++;
+		}
+	}
 
-			return strndup((const char*)(data + 2), name_len);
+	if (count > 0) {
+		address_filter = malloc(count * sizeof(bdaddr_t));
+		if (address_filter == NULL) {
+			return GATTLIB_OUT_OF_MEMORY;
 		}
 
-		offset += field_len + 1;
-		data += field_len + 1;
+		for (size_t i = 0; i < count; i++) {
+			str2ba(mac_address_list[i], &address_filter[i]);
+		}
 	}
 
-	return NULL;
+	free(gattlib_adapter->address_filter);
+	gattlib_adapter->address_filter = address_filter;
+	gattlib_adapter->address_filter_count = count;
+
+	return GATTLIB_SUCCESS;
 }
 
-static int ble_scan(void *adapter, int device_desc, gattlib_discovered_device_t discovered_device_cb, int timeout, void *user_data) {
-	struct hci_filter old_options;
-	socklen_t slen = sizeof(old_options);
-	struct hci_filter new_options;
+static bool address_filter_match(struct gattlib_adapter *gattlib_adapter, const bdaddr_t *bdaddr) {
+	if (gattlib_adapter->address_filter_count == 0) {
+		return true;
+	}
+
+	for (size_t i = 0; i < gattlib_adapter->address_filter_count; i++) {
+		if (bacmp(&gattlib_adapter->address_filter[i], bdaddr) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static int64_t get_monotonic_time_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Check the scan of 'arg' is still running. The callbacks might have stopped the scan or restarted
+ * it with a new argument.
+ */
+static bool ble_scan_is_running(const struct ble_scan_arg *arg) {
+	if (arg->dispatching) {
+		return arg->adapter->scan_arg == arg;
+	} else {
+		return arg->adapter->scan_running;
+	}
+}
+
+static void ble_scan_report(struct ble_scan_arg *arg, const le_advertising_info *info, int8_t rssi) {
+	gattlib_advertisement_t *advertisement = &arg->storage.advertisement;
+	gint64 key;
+
+	if (!address_filter_match(arg->adapter, &info->bdaddr)) {
+		return;
+	}
+
+	if (arg->enabled_filters & GATTLIB_DISCOVER_FILTER_USE_RSSI) {
+		if ((rssi == HCI_RSSI_NOT_AVAILABLE) || (rssi < arg->rssi_threshold)) {
+			return;
+		}
+	}
+
+	// Like the D-Bus backend, a device is reported once unless the changes are notified. The
+	// controller does not filter the duplicates of all the devices. They are dropped before the
+	// rules: these only count the reported advertisements.
+	key = (gint64)gattlib_bdaddr_to_uint64(&info->bdaddr);
+	if ((arg->discovered_advertisement_cb == NULL) && (arg->adapter->scan_cache == NULL) &&
+	    ((arg->enabled_filters & GATTLIB_DISCOVER_FILTER_NOTIFY_CHANGE) == 0) &&
+	    g_hash_table_contains(arg->discovered_devices, &key)) {
+		return;
+	}
+
+	// The storage is reused by the reports of the scan
+	gattlib_advertisement_storage_release(&arg->storage);
+	gattlib_advertisement_storage_init(&arg->storage);
+	// A malformed advertising data is still reported with the fields parsed before the error
+	gattlib_advertisement_parse(info->data, info->length, &arg->storage);
+
+	if (arg->enabled_filters & GATTLIB_DISCOVER_FILTER_USE_UUID) {
+		if (!gattlib_advertisement_match_uuid(advertisement, arg->uuid_list)) {
+			return;
+		}
+	}
+
+	bacpy(&advertisement->addr, &info->bdaddr);
+	if (rssi != HCI_RSSI_NOT_AVAILABLE) {
+		advertisement->rssi = rssi;
+		advertisement->present |= GATTLIB_ADVERTISEMENT_HAS_RSSI;
+	}
+
+	if ((arg->adapter->match_program != NULL) && !gattlib_match_eval(arg->adapter->match_program, advertisement)) {
+		return;
+	}
+
+	if ((arg->adapter->scan_cache != NULL) &&
+	    !gattlib_scan_cache_update(arg->adapter->scan_cache, advertisement, get_monotonic_time_ms())) {
+		return;
+	}
+
+	if (arg->discovered_advertisement_cb) {
+		advertisement->addr_type = (info->bdaddr_type == LE_PUBLIC_ADDRESS) ? BDADDR_LE_PUBLIC : BDADDR_LE_RANDOM;
+		arg->discovered_advertisement_cb(arg->adapter, advertisement, arg->user_data);
+	} else {
+		char addr[18];
+
+		if (!g_hash_table_contains(arg->discovered_devices, &key)) {
+			gint64 *new_key = g_new(gint64, 1);
+			*new_key = key;
+			g_hash_table_add(arg->discovered_devices, new_key);
+		}
+
+		ba2str(&info->bdaddr, addr);
+		arg->discovered_device_cb(arg->adapter, addr, advertisement->name, arg->user_data);
+	}
+}
+
+/*
+ * Process one HCI event. An LE Advertising Report event might contain several reports.
+ */
+static void ble_scan_process_event(struct ble_scan_arg *arg, const uint8_t *buffer, size_t len) {
+	const evt_le_meta_event* meta = (const evt_le_meta_event*)(buffer + HCI_EVENT_HDR_SIZE + 1);
+	const uint8_t *ptr, *end = buffer + len;
+	uint8_t num_reports;
+
+	if (len < HCI_EVENT_HDR_SIZE + 1 + EVT_LE_META_EVENT_SIZE + 1) {
+		return;
+	}
+
+	if (meta->subevent != EVT_LE_ADVERTISING_REPORT) {
+		return;
+	}
+
+	num_reports = meta->data[0];
+	ptr = meta->data + 1;
+
+	for (uint8_t i = 0; i < num_reports; i++) {
+		const le_advertising_info *info = (const le_advertising_info *)ptr;
+
+		// Each report is followed by its advertising data and a 1-byte RSSI
+		if ((ptr + LE_ADVERTISING_INFO_SIZE > end) || (ptr + LE_ADVERTISING_INFO_SIZE + info->length + 1 > end)) {
+			break;
+		}
+
+		ble_scan_report(arg, info, (int8_t)info->data[info->length]);
+
+		// Callback might have disabled the scan
+		if (!ble_scan_is_running(arg)) {
+			break;
+		}
+
+		ptr += LE_ADVERTISING_INFO_SIZE + info->length + 1;
+	}
+}
+
+/*
+ * Read all the pending HCI events. The socket is non-blocking.
+ *
+ * @return 0 when the socket has been drained, 1 when there might be more events and -1 on error
+ */
+static int ble_scan_drain(struct ble_scan_arg *arg, int device_desc) {
 	unsigned char buffer[HCI_MAX_EVENT_SIZE];
-	evt_le_meta_event* meta = (evt_le_meta_event*)(buffer + HCI_EVENT_HDR_SIZE + 1);
-	le_advertising_info* info;
-	char addr[18];
-	int len;
-#if BLUEZ_VERSION_MAJOR == 4
-	struct timeval wait;
-	fd_set read_set;
-#endif
-
-	if (getsockopt(device_desc, SOL_HCI, HCI_FILTER, &old_options, &slen) < 0) {
+
+	for (int i = 0; i < SCAN_MAX_EVENTS_PER_WAKEUP; i++) {
+		ssize_t len = read(device_desc, buffer, sizeof(buffer));
+		if (len < 0) {
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				return 0;
+			} else if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Read error\n");
+			return -1;
+		}
+
+		ble_scan_process_event(arg, buffer, len);
+
+		if (!ble_scan_is_running(arg)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Configure the HCI socket to receive the advertising reports
+ */
+static int ble_scan_setup(struct ble_scan_arg *arg, int device_desc) {
+	socklen_t slen = sizeof(arg->old_hci_filter);
+	struct hci_filter new_options;
+	int rcvbuf = SCAN_SOCKET_RCVBUF;
+
+	if (getsockopt(device_desc, SOL_HCI, HCI_FILTER, &arg->old_hci_filter, &slen) < 0) {
 		fprintf(stderr, "ERROR: Could not get socket options.\n");
-		return 1;
+		return GATTLIB_DEVICE_ERROR;
 	}
 
 	hci_filter_clear(&new_options);
@@ -110,109 +343,183 @@ static int ble_scan(void *adapter, int device_desc, gattlib_discovered_device_t
 	if (setsockopt(device_desc, SOL_HCI, HCI_FILTER,
 				   &new_options, sizeof(new_options)) < 0) {
 		fprintf(stderr, "ERROR: Could not set socket options.\n");
-		return 1;
+		return GATTLIB_DEVICE_ERROR;
 	}
 
-#if BLUEZ_VERSION_MAJOR == 4
-	wait.tv_sec = timeout;
-	int ts = time(NULL);
+	// Not fatal if it fails, we would only have a smaller buffer
+	setsockopt(device_desc, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
 
-	while(1) {
-		FD_ZERO(&read_set);
-		FD_SET(device_desc, &read_set);
+	arg->old_flags = fcntl(device_desc, F_GETFL, 0);
+	fcntl(device_desc, F_SETFL, arg->old_flags | O_NONBLOCK);
 
-		int err = select(FD_SETSIZE, &read_set, NULL, NULL, &wait);
-		if (err <= 0) {
-			break;
-		}
+	// Drop the advertising reports we are not interested in as early as possible. If the kernel
+	// does not accept the program, all the reports are filtered by ble_scan_report().
+	gattlib_scan_filter_attach(device_desc, arg->adapter->address_filter, arg->adapter->address_filter_count,
+			arg->uuid_list, arg->rssi_threshold, arg->enabled_filters);
 
-		len = read(device_desc, buffer, sizeof(buffer));
-		if (len < 0) {
-			fprintf(stderr, "Read error\n");
-			break;
+	if (arg->adapter->scan_cache != NULL) {
+		gattlib_scan_cache_clear(arg->adapter->scan_cache);
+	}
+
+	arg->adapter->scan_running = true;
+	return GATTLIB_SUCCESS;
+}
+
+/*
+ * Report a lost device. The argument is read again for each device: a previous callback might
+ * have stopped the scan or restarted it.
+ */
+static void on_scan_device_lost(void *adapter, const bdaddr_t *addr, void *user_data) {
+	struct gattlib_adapter *gattlib_adapter = adapter;
+	struct ble_scan_arg *arg = user_data;
+
+	if (!ble_scan_is_running(arg)) {
+		arg = gattlib_adapter->scan_arg;
+		if (arg == NULL) {
+			return;
 		}
+	}
 
-		if (meta->subevent != 0x02 || (uint8_t)buffer[BLE_EVENT_TYPE] != BLE_SCAN_RESPONSE)
-			continue;
+	if (gattlib_adapter->device_lost_cb != NULL) {
+		gattlib_adapter->device_lost_cb(adapter, addr, arg->user_data);
+	}
+}
 
-		info = (le_advertising_info*) (meta->data + 1);
-		ba2str(&info->bdaddr, addr);
+static void ble_scan_expire(struct ble_scan_arg *arg) {
+	struct gattlib_adapter *gattlib_adapter = arg->adapter;
 
-		char* name = parse_name(info->data, info->length);
-		discovered_device_cb(adapter, addr, name, user_data);
-		if (name) {
-			free(name);
-		}
+	gattlib_scan_cache_expire(gattlib_adapter->scan_cache, get_monotonic_time_ms(),
+			on_scan_device_lost, gattlib_adapter, arg);
+}
 
-		int elapsed = time(NULL) - ts;
-		if (elapsed >= timeout) {
-			fprintf(stderr, "Timeout error\n");
-			break;
-		}
+static void ble_scan_teardown(struct ble_scan_arg *arg, int device_desc) {
+	arg->adapter->scan_running = false;
+	gattlib_advertisement_storage_release(&arg->storage);
+
+	gattlib_scan_filter_detach(device_desc);
+	fcntl(device_desc, F_SETFL, arg->old_flags);
+	setsockopt(device_desc, SOL_HCI, HCI_FILTER, &arg->old_hci_filter, sizeof(arg->old_hci_filter));
+}
+
+static int ble_scan(struct ble_scan_arg *arg, int device_desc, size_t timeout) {
+	int64_t deadline = 0, next_expire = 0;
+	uint32_t expire_period = 0;
+	int ret;
 
-		wait.tv_sec = timeout - elapsed;
+	ret = ble_scan_setup(arg, device_desc);
+	if (ret != GATTLIB_SUCCESS) {
+		return ret;
 	}
-#else
-	while (1) {
+
+	if (timeout > 0) {
+		deadline = get_monotonic_time_ms() + (int64_t)timeout * 1000;
+	}
+
+	if (arg->adapter->scan_cache != NULL) {
+		expire_period = gattlib_scan_cache_expire_period(arg->adapter->scan_cache);
+		next_expire = get_monotonic_time_ms() + expire_period;
+	}
+
+	while (arg->adapter->scan_running) {
 		struct pollfd fds;
+		int poll_timeout = -1;
+		int64_t now = get_monotonic_time_ms();
+
+		if (timeout > 0) {
+			int64_t remaining = deadline - now;
+			if (remaining <= 0) {
+				break;
+			}
+			poll_timeout = (int)remaining;
+		}
+
+		// Wake up to report the lost devices
+		if (expire_period > 0) {
+			if (now >= next_expire) {
+				ble_scan_expire(arg);
+				next_expire = now + expire_period;
+				continue;
+			} else if ((poll_timeout < 0) || (next_expire - now < poll_timeout)) {
+				poll_timeout = (int)(next_expire - now);
+			}
+		}
+
 		fds.fd     = device_desc;
 		fds.events = POLLIN;
 
-		int err = poll(&fds, 1, timeout * 1000);
-		if (err <= 0) {
+		int err = poll(&fds, 1, poll_timeout);
+		if (err < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
 			break;
-		} else if ((fds.revents & POLLIN) == 0) {
+		} else if (err == 0) {
+			// Timeout. The deadline and the expiration are checked on the next iteration.
 			continue;
-		}
-
-		len = read(device_desc, buffer, sizeof(buffer));
-		if (len < 0) {
-			fprintf(stderr, "Read error\n");
+		} else if ((fds.revents & POLLIN) == 0) {
 			break;
 		}
 
-		if (meta->subevent != 0x02 || (uint8_t)buffer[BLE_EVENT_TYPE] != BLE_SCAN_RESPONSE)
-			continue;
-
-		info = (le_advertising_info*) (meta->data + 1);
-		ba2str(&info->bdaddr, addr);
-
-		char* name = parse_name(info->data, info->length);
-		discovered_device_cb(adapter, addr, name, user_data);
-		if (name) {
-			free(name);
+		if (ble_scan_drain(arg, device_desc) < 0) {
+			break;
 		}
 	}
-#endif
 
-	setsockopt(device_desc, SOL_HCI, HCI_FILTER, &old_options, sizeof(old_options));
+	ble_scan_teardown(arg, device_desc);
 	return GATTLIB_SUCCESS;
 }
 
-int gattlib_adapter_scan_enable(void* adapter, gattlib_discovered_device_t discovered_device_cb, size_t timeout, void *user_data) {
-	int device_desc = *(int*)adapter;
-
-	uint16_t interval = htobs(DISCOV_LE_SCAN_INT);
-	uint16_t window = htobs(DISCOV_LE_SCAN_WIN);
-	uint8_t own_address_type = 0x00;
-	uint8_t filter_policy = 0x00;
+static int hci_scan_enable(struct gattlib_adapter *gattlib_adapter) {
+	int device_desc = gattlib_adapter->device_desc;
 
-	int ret = hci_le_set_scan_parameters(device_desc, LE_SCAN_ACTIVE, interval, window, own_address_type, filter_policy, 10000);
+	int ret = hci_le_set_scan_parameters(device_desc, gattlib_adapter->scan_type,
+			htobs(gattlib_adapter->scan_interval), htobs(gattlib_adapter->scan_window),
+			0x00 /* own_address_type */, 0x00 /* filter_policy */, HCI_COMMAND_TIMEOUT);
 	if (ret < 0) {
 		fprintf(stderr, "ERROR: Set scan parameters failed (are you root?).\n");
-		return 1;
+		return GATTLIB_DEVICE_ERROR;
 	}
 
-	ret = hci_le_set_scan_enable(device_desc, 0x01, 1, 10000);
+	ret = hci_le_set_scan_enable(device_desc, 0x01, gattlib_adapter->scan_filter_duplicates ? 0x01 : 0x00, HCI_COMMAND_TIMEOUT);
 	if (ret < 0) {
 		fprintf(stderr, "ERROR: Enable scan failed.\n");
-		return 1;
+		return GATTLIB_DEVICE_ERROR;
+	}
+
+	return GATTLIB_SUCCESS;
+}
+
+static int hci_scan_disable(struct gattlib_adapter *gattlib_adapter) {
+	int result = hci_le_set_scan_enable(gattlib_adapter->device_desc, 0x00, 1, HCI_COMMAND_TIMEOUT);
+	if (result < 0) {
+		fprintf(stderr, "ERROR: Disable scan failed.\n");
+		return GATTLIB_DEVICE_ERROR;
+	}
+	return GATTLIB_SUCCESS;
+}
+
+static int ble_scan_enable(struct ble_scan_arg *arg, size_t timeout) {
+	struct gattlib_adapter *gattlib_adapter = arg->adapter;
+	int ret;
+
+	if ((arg->enabled_filters & GATTLIB_DISCOVER_FILTER_USE_UUID) && (arg->uuid_list == NULL)) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	if (gattlib_adapter->scan_running) {
+		fprintf(stderr, "ERROR: Scan is already running.\n");
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	ret = hci_scan_enable(gattlib_adapter);
+	if (ret != GATTLIB_SUCCESS) {
+		return ret;
 	}
 
-	ret = ble_scan(adapter, device_desc, discovered_device_cb, timeout, user_data);
+	ret = ble_scan(arg, gattlib_adapter->device_desc, timeout);
 	if (ret != 0) {
 		fprintf(stderr, "ERROR: Advertisement fail.\n");
-		return 1;
+		return GATTLIB_DEVICE_ERROR;
 	}
 
 	return GATTLIB_SUCCESS;
@@ -221,26 +528,277 @@ int gattlib_adapter_scan_enable(void* adapter, gattlib_discovered_device_t disco
 int gattlib_adapter_scan_enable_with_filter(void *adapter, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
 		gattlib_discovered_device_t discovered_device_cb, size_t timeout, void *user_data)
 {
-	return GATTLIB_NOT_SUPPORTED;
+	struct ble_scan_arg arg = {
+		.adapter = adapter,
+		.uuid_list = uuid_list,
+		.rssi_threshold = rssi_threshold,
+		.enabled_filters = enabled_filters,
+		.discovered_device_cb = discovered_device_cb,
+		.user_data = user_data,
+	};
+	int ret;
+
+	arg.discovered_devices = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+
+	ret = ble_scan_enable(&arg, timeout);
+
+	g_hash_table_destroy(arg.discovered_devices);
+	return ret;
+}
+
+int gattlib_adapter_scan_advertisements(void *adapter, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
+		gattlib_discovered_advertisement_t discovered_advertisement_cb, size_t timeout, void *user_data)
+{
+	struct ble_scan_arg arg = {
+		.adapter = adapter,
+		.uuid_list = uuid_list,
+		.rssi_threshold = rssi_threshold,
+		.enabled_filters = enabled_filters,
+		.discovered_advertisement_cb = discovered_advertisement_cb,
+		.user_data = user_data,
+	};
+
+	return ble_scan_enable(&arg, timeout);
+}
+
+/*
+ * Copy the NULL-terminated UUID list in a single allocation. The list of the caller might not
+ * live as long as the scan.
+ */
+static uuid_t **copy_uuid_list(uuid_t **uuid_list) {
+	uuid_t **uuid_list_copy;
+	uuid_t *uuids;
+	size_t count = 0;
+
+	while (uuid_list[count] != NULL) {
+		count++;
+	}
+
+	uuid_list_copy = malloc((count + 1) * sizeof(uuid_t*) + count * sizeof(uuid_t));
+	if (uuid_list_copy == NULL) {
+		return NULL;
+	}
+
+	uuids = (uuid_t*)(uuid_list_copy + count + 1);
+	for (size_t i = 0; i < count; i++) {
+		uuids[i] = *uuid_list[i];
+		uuid_list_copy[i] = &uuids[i];
+	}
+	uuid_list_copy[count] = NULL;
+
+	return uuid_list_copy;
+}
+
+static gboolean on_scan_io(GIOChannel *io, GIOCondition condition, gpointer user_data) {
+	struct gattlib_adapter *gattlib_adapter = user_data;
+	struct ble_scan_arg *arg = gattlib_adapter->scan_arg;
+	int ret = -1;
+
+	if (condition & G_IO_IN) {
+		arg->dispatching = true;
+		ret = ble_scan_drain(arg, gattlib_adapter->device_desc);
+		arg->dispatching = false;
+
+		// The scan has been stopped by the callback
+		if (gattlib_adapter->scan_arg != arg) {
+			free(arg->uuid_list);
+			free(arg);
+			return FALSE;
+		}
+	}
+
+	if (ret < 0) {
+		gattlib_adapter_scan_stop(gattlib_adapter);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean on_scan_expire(gpointer user_data) {
+	struct gattlib_adapter *gattlib_adapter = user_data;
+	struct ble_scan_arg *arg = gattlib_adapter->scan_arg;
+
+	arg->dispatching = true;
+	ble_scan_expire(arg);
+	arg->dispatching = false;
+
+	// The scan has been stopped by the callback
+	if (gattlib_adapter->scan_arg != arg) {
+		free(arg->uuid_list);
+		free(arg);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean on_scan_timeout(gpointer user_data) {
+	gattlib_adapter_scan_stop(user_data);
+	return FALSE;
+}
+
+int gattlib_adapter_scan_start(void *adapter, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
+		gattlib_discovered_advertisement_t discovered_advertisement_cb, size_t timeout, void *main_context, void *user_data)
+{
+	struct gattlib_adapter *gattlib_adapter = adapter;
+	GMainContext *context = main_context;
+	struct ble_scan_arg *arg;
+	GIOChannel *io;
+	int ret;
+
+	if ((gattlib_adapter == NULL) || (discovered_advertisement_cb == NULL)) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	if ((enabled_filters & GATTLIB_DISCOVER_FILTER_USE_UUID) && (uuid_list == NULL)) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	if (gattlib_adapter->scan_running) {
+		fprintf(stderr, "ERROR: Scan is already running.\n");
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	arg = calloc(1, sizeof(struct ble_scan_arg));
+	if (arg == NULL) {
+		return GATTLIB_OUT_OF_MEMORY;
+	}
+
+	arg->adapter = gattlib_adapter;
+	arg->rssi_threshold = rssi_threshold;
+	arg->enabled_filters = enabled_filters;
+	arg->discovered_advertisement_cb = discovered_advertisement_cb;
+	arg->user_data = user_data;
+
+	if (enabled_filters & GATTLIB_DISCOVER_FILTER_USE_UUID) {
+		arg->uuid_list = copy_uuid_list(uuid_list);
+		if (arg->uuid_list == NULL) {
+			free(arg);
+			return GATTLIB_OUT_OF_MEMORY;
+		}
+	}
+
+	ret = hci_scan_enable(gattlib_adapter);
+	if (ret != GATTLIB_SUCCESS) {
+		goto FREE_ARG;
+	}
+
+	ret = ble_scan_setup(arg, gattlib_adapter->device_desc);
+	if (ret != GATTLIB_SUCCESS) {
+		hci_le_set_scan_enable(gattlib_adapter->device_desc, 0x00, 1, HCI_COMMAND_TIMEOUT);
+		goto FREE_ARG;
+	}
+
+	gattlib_adapter->scan_arg = arg;
+
+	io = g_io_channel_unix_new(gattlib_adapter->device_desc);
+	gattlib_adapter->scan_io_source = g_io_create_watch(io, G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL);
+	g_source_set_callback(gattlib_adapter->scan_io_source, (GSourceFunc)on_scan_io, gattlib_adapter, NULL);
+	g_source_attach(gattlib_adapter->scan_io_source, context);
+	// The watch holds a reference on the channel
+	g_io_channel_unref(io);
+
+	if (timeout > 0) {
+		gattlib_adapter->scan_timeout_source = g_timeout_source_new_seconds(timeout);
+		g_source_set_callback(gattlib_adapter->scan_timeout_source, on_scan_timeout, gattlib_adapter, NULL);
+		g_source_attach(gattlib_adapter->scan_timeout_source, context);
+	}
+
+	if ((gattlib_adapter->scan_cache != NULL) && (gattlib_scan_cache_expire_period(gattlib_adapter->scan_cache) > 0)) {
+		gattlib_adapter->scan_expire_source = g_timeout_source_new(gattlib_scan_cache_expire_period(gattlib_adapter->scan_cache));
+		g_source_set_callback(gattlib_adapter->scan_expire_source, on_scan_expire, gattlib_adapter, NULL);
+		g_source_attach(gattlib_adapter->scan_expire_source, context);
+	}
+
+	return GATTLIB_SUCCESS;
+
+FREE_ARG:
+	free(arg->uuid_list);
+	free(arg);
+	return ret;
+}
+
+int gattlib_adapter_scan_stop(void *adapter) {
+	struct gattlib_adapter *gattlib_adapter = adapter;
+	struct ble_scan_arg *arg = gattlib_adapter->scan_arg;
+
+	if (arg == NULL) {
+		// Not started by gattlib_adapter_scan_start(). Stop the blocking scan if any.
+		if (gattlib_adapter->scan_running) {
+			gattlib_adapter->scan_running = false;
+			gattlib_scan_filter_detach(gattlib_adapter->device_desc);
+			return hci_scan_disable(gattlib_adapter);
+		}
+		return GATTLIB_SUCCESS;
+	}
+	gattlib_adapter->scan_arg = NULL;
+
+	if (gattlib_adapter->scan_io_source) {
+		g_source_destroy(gattlib_adapter->scan_io_source);
+		g_source_unref(gattlib_adapter->scan_io_source);
+		gattlib_adapter->scan_io_source = NULL;
+	}
+	if (gattlib_adapter->scan_timeout_source) {
+		g_source_destroy(gattlib_adapter->scan_timeout_source);
+		g_source_unref(gattlib_adapter->scan_timeout_source);
+		gattlib_adapter->scan_timeout_source = NULL;
+	}
+	if (gattlib_adapter->scan_expire_source) {
+		g_source_destroy(gattlib_adapter->scan_expire_source);
+		g_source_unref(gattlib_adapter->scan_expire_source);
+		gattlib_adapter->scan_expire_source = NULL;
+	}
+
+	ble_scan_teardown(arg, gattlib_adapter->device_desc);
+
+	// If we are called from the callback, the argument is released by on_scan_io()
+	if (!arg->dispatching) {
+		free(arg->uuid_list);
+		free(arg);
+	}
+
+	return hci_scan_disable(gattlib_adapter);
+}
+
+int gattlib_adapter_scan_enable(void* adapter, gattlib_discovered_device_t discovered_device_cb, size_t timeout, void *user_data) {
+	return gattlib_adapter_scan_enable_with_filter(adapter,
+			NULL, 0 /* RSSI Threshold */,
+			GATTLIB_DISCOVER_FILTER_USE_NONE,
+			discovered_device_cb, timeout, user_data);
 }
 
 int gattlib_adapter_scan_disable(void* adapter) {
-	int device_desc = *(int*)adapter;
+	struct gattlib_adapter *gattlib_adapter = adapter;
 
-	if (device_desc == -1) {
+	if (gattlib_adapter->device_desc == -1) {
 		fprintf(stderr, "ERROR: Could not disable scan, not enabled yet.\n");
-		return 1;
+		return GATTLIB_INVALID_PARAMETER;
 	}
 
-	int result = hci_le_set_scan_enable(device_desc, 0x00, 1, 10000);
-	if (result < 0) {
-		fprintf(stderr, "ERROR: Disable scan failed.\n");
+	// Scan started by gattlib_adapter_scan_start()
+	if (gattlib_adapter->scan_arg != NULL) {
+		return gattlib_adapter_scan_stop(adapter);
 	}
-	return result;
+
+	// Leave ble_scan() if we are called from the discovered device callback
+	gattlib_adapter->scan_running = false;
+
+	// The scan filter would drop the HCI command responses
+	gattlib_scan_filter_detach(gattlib_adapter->device_desc);
+
+	return hci_scan_disable(gattlib_adapter);
 }
 
 int gattlib_adapter_close(void* adapter) {
-	hci_close_dev(*(int*)adapter);
-	free(adapter);
+	struct gattlib_adapter *gattlib_adapter = adapter;
+
+	gattlib_adapter_scan_stop(adapter);
+
+	hci_close_dev(gattlib_adapter->device_desc);
+	free(gattlib_adapter->address_filter);
+	gattlib_match_free(gattlib_adapter->match_program);
+	gattlib_scan_cache_free(gattlib_adapter->scan_cache);
+	free(gattlib_adapter);
 	return GATTLIB_SUCCESS;
 }
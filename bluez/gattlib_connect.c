@@ -40,15 +40,36 @@
 
 struct gattlib_thread_t g_gattlib_thread = { 0 };
 
+// Protect the start of 'g_gattlib_thread' and its reference counter against concurrent connections
+static pthread_mutex_t m_gattlib_thread_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Protect the completion flags and the cancellations the threads of gattlib_wait_completion() sleep on
+static GMutex m_completion_mutex;
+static GCond m_completion_cond;
+
 typedef struct {
 	gatt_connection_t* conn;
 	gatt_connect_cb_t  connect_cb;
 	int                connected;
-	int                timeout;
+	// Discover the characteristics once connected (unset with GATTLIB_CONNECTION_OPTIONS_LEGACY_NO_DISCOVERY)
+	int                discover;
+	// Set once the connection attempt has completed (connected or failed) or has been aborted
+	int                completed;
 	GError*            error;
 	void*              user_data;
+	// Connection watch of btio. It is kept to be removed when the connection is aborted.
+	GSource*           watch;
 } io_connect_arg_t;
 
+// Last watch created by the thread. It gives the connection watch added by bt_io_connect().
+static __thread GSource* m_last_watch;
+
+struct gattlib_thread_call {
+	GSourceFunc func;
+	gpointer    data;
+	int         done;
+};
+
 static void events_handler(const uint8_t *pdu, uint16_t len, gpointer user_data) {
 	gatt_connection_t *conn = user_data;
 	uint8_t opdu[ATT_MAX_MTU];
@@ -119,7 +140,7 @@ static void io_connect_cb(GIOChannel *io, GError *err, gpointer user_data) {
 	io_connect_arg_t* io_connect_arg = user_data;
 
 	if (err) {
-		io_connect_arg->error = err;
+		io_connect_arg->error = g_error_copy(err);
 
 		// Call callback if defined
 		if (io_connect_arg->connect_cb) {
@@ -150,7 +171,9 @@ static void io_connect_cb(GIOChannel *io, GError *err, gpointer user_data) {
 		//
 		// Save list of characteristics to do the correspondence handle/UUID
 		//
-		gattlib_discover_char(io_connect_arg->conn, &conn_context->characteristics, &conn_context->characteristic_count);
+		if (io_connect_arg->discover) {
+			gattlib_discover_char(io_connect_arg->conn, &conn_context->characteristics, &conn_context->characteristic_count);
+		}
 
 		//
 		// Call callback if defined
@@ -162,7 +185,11 @@ static void io_connect_cb(GIOChannel *io, GError *err, gpointer user_data) {
 		io_connect_arg->connected = TRUE;
 	}
 	if (io_connect_arg->connect_cb) {
+		g_clear_error(&io_connect_arg->error);
 		free(io_connect_arg);
+	} else {
+		// The synchronous connection owns 'io_connect_arg': it must not be used after this point
+		gattlib_signal_completion(&io_connect_arg->completed);
 	}
 }
 
@@ -172,53 +199,205 @@ static void *connection_thread(void* arg) {
 	loop_thread->loop_context = g_main_context_new();
 	loop_thread->loop = g_main_loop_new(loop_thread->loop_context, TRUE);
 
+	// The loop keeps running for the lifetime of the process
 	g_main_loop_run(loop_thread->loop);
-	g_main_loop_unref(loop_thread->loop);
-	assert(0);
 	return NULL;
 }
 
-static gatt_connection_t *initialize_gattlib_connection(const gchar *src, const gchar *dst,
-		uint8_t dest_type, BtIOSecLevel sec_level, int psm, int mtu,
+gattlib_cancellable_t *gattlib_cancellable_new(void) {
+	return calloc(1, sizeof(gattlib_cancellable_t));
+}
+
+void gattlib_cancellable_cancel(gattlib_cancellable_t *cancellable) {
+	if (cancellable == NULL) {
+		return;
+	}
+
+	g_mutex_lock(&m_completion_mutex);
+	g_atomic_int_set(&cancellable->cancelled, TRUE);
+	g_cond_broadcast(&m_completion_cond);
+	g_mutex_unlock(&m_completion_mutex);
+
+	// The waiter might be the thread dispatching the context
+	if (g_gattlib_thread.loop_context != NULL) {
+		g_main_context_wakeup(g_gattlib_thread.loop_context);
+	}
+}
+
+void gattlib_cancellable_free(gattlib_cancellable_t *cancellable) {
+	free(cancellable);
+}
+
+gint64 gattlib_deadline_from_timeout(unsigned int timeout_ms) {
+	if (timeout_ms == 0) {
+		return 0;
+	} else {
+		return g_get_monotonic_time() + (gint64)timeout_ms * 1000;
+	}
+}
+
+static gboolean wait_timeout(gpointer user_data) {
+	int *timed_out = user_data;
+
+	*timed_out = TRUE;
+	return FALSE;
+}
+
+int gattlib_wait_completion(int *completed, gint64 deadline, gattlib_cancellable_t *cancellable) {
+	GMainContext *context = g_gattlib_thread.loop_context;
+	int ret = GATTLIB_SUCCESS;
+
+	if (g_main_context_acquire(context)) {
+		// We are the thread dispatching the context (eg: from a callback or with an external
+		// event loop). The completion can only be signalled if we dispatch the context ourself.
+		GSource *timeout_source = NULL;
+		int timed_out = FALSE;
+
+		if (deadline > 0) {
+			gint64 remaining = deadline - g_get_monotonic_time();
+
+			// Round up to not wake up before the deadline
+			timeout_source = g_timeout_source_new(remaining > 0 ? (remaining + 999) / 1000 : 0);
+			g_source_set_callback(timeout_source, wait_timeout, &timed_out, NULL);
+			g_source_attach(timeout_source, context);
+		}
+
+		while (!g_atomic_int_get(completed)) {
+			if ((cancellable != NULL) && g_atomic_int_get(&cancellable->cancelled)) {
+				ret = GATTLIB_CANCELLED;
+				break;
+			}
+			if (timed_out) {
+				ret = GATTLIB_TIMEOUT;
+				break;
+			}
+			g_main_context_iteration(context, TRUE);
+		}
+
+		if (timeout_source != NULL) {
+			g_source_destroy(timeout_source);
+			g_source_unref(timeout_source);
+		}
+		g_main_context_release(context);
+		return ret;
+	}
+
+	// The gattlib thread dispatches the context: sleep until it signals the completion
+	g_mutex_lock(&m_completion_mutex);
+	while (!*completed) {
+		if ((cancellable != NULL) && g_atomic_int_get(&cancellable->cancelled)) {
+			ret = GATTLIB_CANCELLED;
+			break;
+		}
+		if (deadline == 0) {
+			g_cond_wait(&m_completion_cond, &m_completion_mutex);
+		} else if (!g_cond_wait_until(&m_completion_cond, &m_completion_mutex, deadline)) {
+			ret = *completed ? GATTLIB_SUCCESS : GATTLIB_TIMEOUT;
+			break;
+		}
+	}
+	g_mutex_unlock(&m_completion_mutex);
+	return ret;
+}
+
+void gattlib_signal_completion(int *completed) {
+	g_mutex_lock(&m_completion_mutex);
+	g_atomic_int_set(completed, TRUE);
+	g_cond_broadcast(&m_completion_cond);
+	g_mutex_unlock(&m_completion_mutex);
+}
+
+static gboolean thread_call(gpointer user_data) {
+	struct gattlib_thread_call *call = user_data;
+
+	call->func(call->data);
+	gattlib_signal_completion(&call->done);
+	return FALSE;
+}
+
+void gattlib_thread_invoke(GSourceFunc func, gpointer data) {
+	struct gattlib_thread_call call = { .func = func, .data = data, .done = FALSE };
+
+	if (g_main_context_acquire(g_gattlib_thread.loop_context)) {
+		// The context is not dispatched by another thread. We can run the function from here.
+		func(data);
+		g_main_context_release(g_gattlib_thread.loop_context);
+		return;
+	}
+
+	GSource *source = g_idle_source_new();
+	assert(source != NULL);
+
+	g_source_set_priority(source, G_PRIORITY_HIGH);
+	g_source_set_callback(source, thread_call, &call, NULL);
+
+	// Attaches it to the main loop context
+	guint id = g_source_attach(source, g_gattlib_thread.loop_context);
+	g_source_unref(source);
+	assert(id != 0);
+
+	gattlib_wait_completion(&call.done, 0, NULL);
+}
+
+/*
+ * Release the reference to the gattlib thread taken by initialize_gattlib_connection()
+ */
+static void gattlib_thread_release(void) {
+	if (g_gattlib_thread.external) {
+		/* The loop context is owned by the application */
+		return;
+	}
+
+	/* Decrease the reference counter of the loop. The thread is kept for the next connections:
+	   the last connection might be disconnected from a callback running in the thread itself. */
+	pthread_mutex_lock(&m_gattlib_thread_mutex);
+	g_gattlib_thread.ref--;
+	pthread_mutex_unlock(&m_gattlib_thread_mutex);
+}
+
+static gatt_connection_t *initialize_gattlib_connection(const gchar *src, const bdaddr_t *dst,
+		uint8_t dest_type, BtIOSecLevel sec_level, int psm, int mtu, int discover,
 		gatt_connect_cb_t connect_cb,
 		io_connect_arg_t* io_connect_arg)
 {
-	bdaddr_t sba, dba;
+	bdaddr_t sba;
 	GError *err = NULL;
 	int ret;
 
 	io_connect_arg->error = NULL;
+	io_connect_arg->watch = NULL;
 
 	/* Check if the GattLib thread has been started */
-	if (g_gattlib_thread.ref == 0) {
-		/* Start it */
-
-		/* Create a thread that will handle Bluetooth events */
-		int error = pthread_create(&g_gattlib_thread.thread, NULL, &connection_thread, &g_gattlib_thread);
-		if (error != 0) {
-			fprintf(stderr, "Cannot create connection thread: %s", strerror(error));
-			return NULL;
-		}
+	pthread_mutex_lock(&m_gattlib_thread_mutex);
+	if (g_gattlib_thread.external) {
+		/* The application dispatches the events with gattlib_dispatch() */
+	} else {
+		if (g_gattlib_thread.loop == NULL) {
+			/* Start it */
+
+			/* Create a thread that will handle Bluetooth events */
+			int error = pthread_create(&g_gattlib_thread.thread, NULL, &connection_thread, &g_gattlib_thread);
+			if (error != 0) {
+				fprintf(stderr, "Cannot create connection thread: %s", strerror(error));
+				pthread_mutex_unlock(&m_gattlib_thread_mutex);
+				return NULL;
+			}
 
-		/* Wait for the loop to be started */
-		while (!g_gattlib_thread.loop || !g_main_loop_is_running (g_gattlib_thread.loop)) {
-			usleep(1000);
+			/* Wait for the loop to be started */
+			while (!g_gattlib_thread.loop || !g_main_loop_is_running (g_gattlib_thread.loop)) {
+				usleep(1000);
+			}
 		}
-	} else {
+
 		/* Increase the reference to know how many GATT connection use the loop */
 		g_gattlib_thread.ref++;
 	}
+	pthread_mutex_unlock(&m_gattlib_thread_mutex);
 
 	/* Remote device */
 	if (dst == NULL) {
 		fprintf(stderr, "Remote Bluetooth address required\n");
-		return NULL;
-	}
-
-	ret = str2ba(dst, &dba);
-	if (ret != 0) {
-		fprintf(stderr, "Destination address '%s' is not valid.\n", dst);
-		return NULL;
+		goto RELEASE_THREAD;
 	}
 
 	/* Local adapter */
@@ -229,7 +408,7 @@ static gatt_connection_t *initialize_gattlib_connection(const gchar *src, const
 			ret = str2ba(src, &sba);
 			if (ret != 0) {
 				fprintf(stderr, "Source address '%s' is not valid.\n", src);
-				return NULL;
+				goto RELEASE_THREAD;
 			}
 		}
 	} else {
@@ -238,22 +417,22 @@ static gatt_connection_t *initialize_gattlib_connection(const gchar *src, const
 
 	/* Not used for BR/EDR */
 	if ((dest_type != BDADDR_LE_PUBLIC) && (dest_type != BDADDR_LE_RANDOM)) {
-		return NULL;
+		goto RELEASE_THREAD;
 	}
 
 	if ((sec_level != BT_IO_SEC_LOW) && (sec_level != BT_IO_SEC_MEDIUM) && (sec_level != BT_IO_SEC_HIGH)) {
-		return NULL;
+		goto RELEASE_THREAD;
 	}
 
 	gattlib_context_t* conn_context = calloc(sizeof(gattlib_context_t), 1);
 	if (conn_context == NULL) {
-		return NULL;
+		goto RELEASE_THREAD;
 	}
 
 	gatt_connection_t* conn = calloc(sizeof(gatt_connection_t), 1);
 	if (conn == NULL) {
 		free(conn_context);
-		return NULL;
+		goto RELEASE_THREAD;
 	}
 
 	conn->context = conn_context;
@@ -262,9 +441,12 @@ static gatt_connection_t *initialize_gattlib_connection(const gchar *src, const
 	io_connect_arg->conn       = conn;
 	io_connect_arg->connect_cb = connect_cb;
 	io_connect_arg->connected  = FALSE;
-	io_connect_arg->timeout    = FALSE;
+	io_connect_arg->discover   = discover;
+	io_connect_arg->completed  = FALSE;
 	io_connect_arg->error      = NULL;
 
+	m_last_watch = NULL;
+
 	if (psm == 0) {
 		conn_context->io = bt_io_connect(
 #if BLUEZ_VERSION_MAJOR == 4
@@ -275,7 +457,7 @@ static gatt_connection_t *initialize_gattlib_connection(const gchar *src, const
 #if BLUEZ_VERSION_MAJOR == 5
 				BT_IO_OPT_SOURCE_TYPE, BDADDR_LE_PUBLIC,
 #endif
-				BT_IO_OPT_DEST_BDADDR, &dba,
+				BT_IO_OPT_DEST_BDADDR, dst,
 				BT_IO_OPT_DEST_TYPE, dest_type,
 				BT_IO_OPT_CID, ATT_CID,
 				BT_IO_OPT_SEC_LEVEL, sec_level,
@@ -291,7 +473,7 @@ static gatt_connection_t *initialize_gattlib_connection(const gchar *src, const
 #if BLUEZ_VERSION_MAJOR == 5
 				BT_IO_OPT_SOURCE_TYPE, BDADDR_LE_PUBLIC,
 #endif
-				BT_IO_OPT_DEST_BDADDR, &dba,
+				BT_IO_OPT_DEST_BDADDR, dst,
 				BT_IO_OPT_PSM, psm,
 				BT_IO_OPT_IMTU, mtu,
 				BT_IO_OPT_SEC_LEVEL, sec_level,
@@ -304,10 +486,18 @@ static gatt_connection_t *initialize_gattlib_connection(const gchar *src, const
 		g_error_free(err);
 		free(conn_context);
 		free(conn);
-		return NULL;
-	} else {
-		return conn;
+		goto RELEASE_THREAD;
 	}
+
+	// Only the synchronous connections are aborted. The asynchronous ones might already be freed.
+	if ((connect_cb == NULL) && (m_last_watch != NULL)) {
+		io_connect_arg->watch = g_source_ref(m_last_watch);
+	}
+	return conn;
+
+RELEASE_THREAD:
+	gattlib_thread_release();
+	return NULL;
 }
 
 static void get_connection_options(unsigned long options, BtIOSecLevel *bt_io_sec_level, int *psm, int *mtu) {
@@ -332,7 +522,8 @@ gatt_connection_t *gattlib_connect_async(void *adapter, const char *dst,
 	const char *adapter_mac_address;
 	gatt_connection_t *conn;
 	BtIOSecLevel bt_io_sec_level;
-	int psm, mtu;
+	bdaddr_t dba;
+	int psm, mtu, discover;
 
 	if (adapter != NULL) {
 		fprintf(stderr, "Missing support");
@@ -350,6 +541,11 @@ gatt_connection_t *gattlib_connect_async(void *adapter, const char *dst,
 		return NULL;
 	}
 
+	if ((dst == NULL) || (str2ba(dst, &dba) != 0)) {
+		fprintf(stderr, "Destination address '%s' is not valid.\n", dst ? dst : "(null)");
+		return NULL;
+	}
+
 	get_connection_options(options, &bt_io_sec_level, &psm, &mtu);
 
 	io_connect_arg_t* io_connect_arg = malloc(sizeof(io_connect_arg_t));
@@ -358,30 +554,58 @@ gatt_connection_t *gattlib_connect_async(void *adapter, const char *dst,
 	}
 	io_connect_arg->user_data = data;
 
+	discover = (options & GATTLIB_CONNECTION_OPTIONS_LEGACY_NO_DISCOVERY) == 0;
+
 	if (options & GATTLIB_CONNECTION_OPTIONS_LEGACY_BDADDR_LE_PUBLIC) {
-		conn = initialize_gattlib_connection(adapter_mac_address, dst, BDADDR_LE_PUBLIC, bt_io_sec_level,
-						     psm, mtu, connect_cb, io_connect_arg);
+		conn = initialize_gattlib_connection(adapter_mac_address, &dba, BDADDR_LE_PUBLIC, bt_io_sec_level,
+						     psm, mtu, discover, connect_cb, io_connect_arg);
 		if (conn != NULL) {
 			return conn;
 		}
 	}
 
 	if (options & GATTLIB_CONNECTION_OPTIONS_LEGACY_BDADDR_LE_RANDOM) {
-		conn = initialize_gattlib_connection(adapter_mac_address, dst, BDADDR_LE_RANDOM, bt_io_sec_level,
-						     psm, mtu, connect_cb, io_connect_arg);
+		conn = initialize_gattlib_connection(adapter_mac_address, &dba, BDADDR_LE_RANDOM, bt_io_sec_level,
+						     psm, mtu, discover, connect_cb, io_connect_arg);
 	}
 
 	return conn;
 }
 
-static gboolean connection_timeout(gpointer user_data) {
+/*
+ * Abort a pending connection. It must run from the gattlib thread to not race with io_connect_cb().
+ */
+static gboolean abort_connection(gpointer user_data) {
 	io_connect_arg_t* io_connect_arg = user_data;
+	gattlib_context_t* conn_context = io_connect_arg->conn->context;
 
-	io_connect_arg->timeout = TRUE;
-
+	if (!io_connect_arg->completed) {
+		// The watch must not fire on a new socket reusing the file descriptor
+		if (io_connect_arg->watch != NULL) {
+			g_source_destroy(io_connect_arg->watch);
+		}
+		// Closing the socket cancels the connection
+		g_io_channel_shutdown(conn_context->io, FALSE, NULL);
+		io_connect_arg->completed = TRUE;
+	}
 	return FALSE;
 }
 
+/*
+ * Free a connection that has failed or has been aborted
+ */
+static void free_connection(gatt_connection_t *conn) {
+	gattlib_context_t* conn_context = conn->context;
+
+	if (conn_context->io != NULL) {
+		g_io_channel_unref(conn_context->io);
+	}
+	free(conn_context);
+	free(conn);
+
+	gattlib_thread_release();
+}
+
 /**
  * @brief Function to connect to a BLE device
  *
@@ -391,66 +615,87 @@ static gboolean connection_timeout(gpointer user_data) {
  * @param sec_level    Set security level (either BT_IO_SEC_LOW, BT_IO_SEC_MEDIUM, BT_IO_SEC_HIGH)
  * @param psm          Specify the PSM for GATT/ATT over BR/EDR
  * @param mtu          Specify the MTU size
+ * @param deadline     Monotonic time to abort the connection at. 0 for the default timeout.
+ * @param cancellable  Optional cancellation token
+ * @param connection   Connection returned on success
+ *
+ * @return GATTLIB_SUCCESS on success, GATTLIB_TIMEOUT, GATTLIB_CANCELLED or GATTLIB_* error code
  */
-static gatt_connection_t *gattlib_connect_with_options(const char *src, const char *dst,
-						       uint8_t dest_type, BtIOSecLevel bt_io_sec_level, int psm, int mtu)
+static int gattlib_connect_with_options(const char *src, const bdaddr_t *dst,
+					uint8_t dest_type, BtIOSecLevel bt_io_sec_level, int psm, int mtu, int discover,
+					gint64 deadline, gattlib_cancellable_t *cancellable, gatt_connection_t **connection)
 {
-	GSource* timeout;
 	gatt_connection_t *conn;
 	io_connect_arg_t io_connect_arg;
+	int ret;
+
+	if ((cancellable != NULL) && g_atomic_int_get(&cancellable->cancelled)) {
+		return GATTLIB_CANCELLED;
+	}
 
 	conn = initialize_gattlib_connection(src, dst, dest_type, bt_io_sec_level,
-			psm, mtu, NULL, &io_connect_arg);
+			psm, mtu, discover, NULL, &io_connect_arg);
 	if (conn == NULL) {
 		if (io_connect_arg.error) {
 			fprintf(stderr, "Error: gattlib_connect - initialization error:%s\n", io_connect_arg.error->message);
 		} else {
 			fprintf(stderr, "Error: gattlib_connect - initialization\n");
 		}
-		return NULL;
+		return GATTLIB_ERROR_INTERNAL;
 	}
 
-	// Timeout of 'CONNECTION_TIMEOUT+4' seconds
-	timeout = gattlib_timeout_add_seconds(CONNECTION_TIMEOUT + 4, connection_timeout, &io_connect_arg);
+	// Timeout of 'CONNECTION_TIMEOUT+4' seconds if the caller did not give any
+	if (deadline == 0) {
+		deadline = gattlib_deadline_from_timeout((CONNECTION_TIMEOUT + 4) * 1000);
+	}
 
 	// Wait for the connection to be done
-	while ((io_connect_arg.connected == FALSE) && (io_connect_arg.timeout == FALSE)) {
-		g_main_context_iteration(g_gattlib_thread.loop_context, FALSE);
+	ret = gattlib_wait_completion(&io_connect_arg.completed, deadline, cancellable);
+	if (ret != GATTLIB_SUCCESS) {
+		gattlib_thread_invoke(abort_connection, &io_connect_arg);
+	}
+	// The watch has fired or has been removed
+	if (io_connect_arg.watch != NULL) {
+		g_source_unref(io_connect_arg.watch);
 	}
-	// Disconnect the timeout source
-	g_source_destroy(timeout);
 
-	if (io_connect_arg.timeout) {
-		return NULL;
+	if ((ret != GATTLIB_SUCCESS) && !io_connect_arg.connected) {
+		g_clear_error(&io_connect_arg.error);
+		free_connection(conn);
+		return ret;
 	}
+	// Otherwise the connection has completed before being aborted
 
 	if (io_connect_arg.error) {
 		fprintf(stderr, "gattlib_connect - connection error:%s\n", io_connect_arg.error->message);
-		return NULL;
-	} else {
-		return conn;
+		g_error_free(io_connect_arg.error);
+		free_connection(conn);
+		return GATTLIB_ERROR_BLUEZ;
 	}
+
+	*connection = conn;
+	return GATTLIB_SUCCESS;
 }
 
 
-/**
- * @brief Function to connect to a BLE device
- *
- * @param src		Local Adaptater interface
- * @param dst		Remote Bluetooth address
- * @param options	Options to connect to BLE device. See `GATTLIB_CONNECTION_OPTIONS_*`
- */
-gatt_connection_t *gattlib_connect(void* adapter, const char *dst, unsigned long options)
+int gattlib_connect_with_timeout(void *adapter, const char *dst, unsigned long options,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable, gatt_connection_t **connection)
 {
 	const char* adapter_mac_address;
-	gatt_connection_t *conn;
 	BtIOSecLevel bt_io_sec_level;
-	int psm, mtu;
+	bdaddr_t dba;
+	gint64 deadline;
+	int psm, mtu, discover;
+	int ret = GATTLIB_INVALID_PARAMETER;
+
+	if (connection == NULL) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
 
 	if (adapter != NULL) {
 		fprintf(stderr, "Missing support");
 		assert(0); // Need to add support
-		return NULL;
+		return GATTLIB_NOT_SUPPORTED;
 	} else {
 		adapter_mac_address = NULL;
 	}
@@ -460,22 +705,82 @@ gatt_connection_t *gattlib_connect(void* adapter, const char *dst, unsigned long
 		// Please, set GATTLIB_CONNECTION_OPTIONS_LEGACY_BDADDR_LE_PUBLIC or
 		// GATTLIB_CONNECTION_OPTIONS_LEGACY_BDADDR_LE_RANDMON
 		fprintf(stderr, "gattlib_connect() expects address type.\n");
-		return NULL;
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	if ((dst == NULL) || (str2ba(dst, &dba) != 0)) {
+		fprintf(stderr, "Destination address '%s' is not valid.\n", dst ? dst : "(null)");
+		return GATTLIB_INVALID_PARAMETER;
 	}
 
 	get_connection_options(options, &bt_io_sec_level, &psm, &mtu);
 
+	discover = (options & GATTLIB_CONNECTION_OPTIONS_LEGACY_NO_DISCOVERY) == 0;
+
+	// The timeout covers both address types
+	deadline = gattlib_deadline_from_timeout(timeout_ms);
+
 	if (options & GATTLIB_CONNECTION_OPTIONS_LEGACY_BDADDR_LE_PUBLIC) {
-		conn = gattlib_connect_with_options(adapter_mac_address, dst, BDADDR_LE_PUBLIC, bt_io_sec_level, psm, mtu);
-		if (conn != NULL) {
-			return conn;
+		ret = gattlib_connect_with_options(adapter_mac_address, &dba, BDADDR_LE_PUBLIC, bt_io_sec_level, psm, mtu,
+				discover, deadline, cancellable, connection);
+		if ((ret == GATTLIB_SUCCESS) || (ret == GATTLIB_CANCELLED)) {
+			return ret;
 		}
 	}
 
 	if (options & GATTLIB_CONNECTION_OPTIONS_LEGACY_BDADDR_LE_RANDOM) {
-		conn = gattlib_connect_with_options(adapter_mac_address, dst, BDADDR_LE_RANDOM, bt_io_sec_level, psm, mtu);
+		if ((deadline > 0) && (g_get_monotonic_time() >= deadline)) {
+			return GATTLIB_TIMEOUT;
+		}
+		ret = gattlib_connect_with_options(adapter_mac_address, &dba, BDADDR_LE_RANDOM, bt_io_sec_level, psm, mtu,
+				discover, deadline, cancellable, connection);
 	}
 
+	return ret;
+}
+
+/**
+ * @brief Function to connect to a BLE device
+ *
+ * @param src		Local Adaptater interface
+ * @param dst		Remote Bluetooth address
+ * @param options	Options to connect to BLE device. See `GATTLIB_CONNECTION_OPTIONS_*`
+ */
+gatt_connection_t *gattlib_connect(void* adapter, const char *dst, unsigned long options)
+{
+	gatt_connection_t *conn = NULL;
+
+	if (gattlib_connect_with_timeout(adapter, dst, options, 0, NULL, &conn) != GATTLIB_SUCCESS) {
+		return NULL;
+	}
+	return conn;
+}
+
+gatt_connection_t *gattlib_connect_bdaddr(void *adapter, const bdaddr_t *dst, uint8_t dst_type, unsigned long options)
+{
+	gatt_connection_t *conn = NULL;
+	BtIOSecLevel bt_io_sec_level;
+	int psm, mtu, discover;
+
+	if (adapter != NULL) {
+		fprintf(stderr, "Missing support");
+		assert(0); // Need to add support
+		return NULL;
+	}
+
+	// The address type is given explicitly. GATTLIB_CONNECTION_OPTIONS_LEGACY_BDADDR_LE_* are ignored.
+	if ((dst == NULL) || ((dst_type != BDADDR_LE_PUBLIC) && (dst_type != BDADDR_LE_RANDOM))) {
+		fprintf(stderr, "gattlib_connect_bdaddr() expects an address and its LE address type.\n");
+		return NULL;
+	}
+
+	get_connection_options(options, &bt_io_sec_level, &psm, &mtu);
+
+	discover = (options & GATTLIB_CONNECTION_OPTIONS_LEGACY_NO_DISCOVERY) == 0;
+
+	if (gattlib_connect_with_options(NULL, dst, dst_type, bt_io_sec_level, psm, mtu, discover, 0, NULL, &conn) != GATTLIB_SUCCESS) {
+		return NULL;
+	}
 	return conn;
 }
 
@@ -495,20 +800,27 @@ int gattlib_disconnect(gatt_connection_t* connection) {
 	free(connection->context);
 	free(connection);
 
-	//TODO: Add a mutex around this code to avoid a race condition
-	/* Decrease the reference counter of the loop */
-	g_gattlib_thread.ref--;
-	/* Check if we are the last one */
-	if (g_gattlib_thread.ref == 0) {
-		g_main_loop_quit(g_gattlib_thread.loop);
-		g_main_loop_unref(g_gattlib_thread.loop);
-		g_main_context_unref(g_gattlib_thread.loop_context);
+	gattlib_thread_release();
+
+	return GATTLIB_SUCCESS;
+}
+
+GMainContext *gattlib_get_main_context(void) {
+	GMainContext *context = NULL;
 
-		// Detach the thread
-		pthread_detach(g_gattlib_thread.thread);
+	pthread_mutex_lock(&m_gattlib_thread_mutex);
+	if (g_gattlib_thread.external) {
+		context = g_gattlib_thread.loop_context;
+	} else if (g_gattlib_thread.loop == NULL) {
+		// No internal thread will be started. The application dispatches the events.
+		g_gattlib_thread.loop_context = g_main_context_new();
+		g_gattlib_thread.external = true;
+		context = g_gattlib_thread.loop_context;
 	}
+	// Otherwise the internal thread has already been started by a connection
+	pthread_mutex_unlock(&m_gattlib_thread_mutex);
 
-	return GATTLIB_SUCCESS;
+	return context;
 }
 
 GSource* gattlib_watch_connection_full(GIOChannel* io, GIOCondition condition,
@@ -525,6 +837,7 @@ GSource* gattlib_watch_connection_full(GIOChannel* io, GIOCondition condition,
 	g_source_unref (source);
 	assert(id != 0);
 
+	m_last_watch = source;
 	return source;
 }
 
@@ -542,6 +855,51 @@ GSource* gattlib_timeout_add_seconds(guint interval, GSourceFunc function, gpoin
 	return source;
 }
 
+struct set_characteristics_arg {
+	gattlib_context_t*        conn_context;
+	gattlib_characteristic_t* characteristics;
+	int                       characteristic_count;
+};
+
+/*
+ * Swap the list of characteristics. It runs from the gattlib thread that uses the list to dispatch
+ * the notifications.
+ */
+static gboolean set_characteristics(gpointer user_data) {
+	struct set_characteristics_arg *arg = user_data;
+	gattlib_characteristic_t* previous = arg->conn_context->characteristics;
+
+	arg->conn_context->characteristics = arg->characteristics;
+	arg->conn_context->characteristic_count = arg->characteristic_count;
+	arg->characteristics = previous;
+	return FALSE;
+}
+
+int gattlib_set_characteristics(gatt_connection_t* connection, const gattlib_characteristic_t* characteristics, int characteristics_count) {
+	struct set_characteristics_arg arg;
+
+	if ((connection == NULL) || (characteristics_count < 0) || ((characteristics == NULL) && (characteristics_count > 0))) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	arg.conn_context = connection->context;
+	arg.characteristics = NULL;
+	arg.characteristic_count = characteristics_count;
+	if (characteristics_count > 0) {
+		arg.characteristics = malloc(characteristics_count * sizeof(gattlib_characteristic_t));
+		if (arg.characteristics == NULL) {
+			return GATTLIB_OUT_OF_MEMORY;
+		}
+		memcpy(arg.characteristics, characteristics, characteristics_count * sizeof(gattlib_characteristic_t));
+	}
+
+	gattlib_thread_invoke(set_characteristics, &arg);
+
+	// Free the previous list
+	free(arg.characteristics);
+	return GATTLIB_SUCCESS;
+}
+
 int get_uuid_from_handle(gatt_connection_t* connection, uint16_t handle, uuid_t* uuid) {
 	gattlib_context_t* conn_context = connection->context;
 	int i;
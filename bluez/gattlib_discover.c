@@ -71,7 +71,7 @@ static void primary_all_cb(uint8_t status, GSList *services, void *user_data) {
 	}
 
 done:
-	data->discovered = TRUE;
+	gattlib_signal_completion(&data->discovered);
 }
 
 int gattlib_discover_primary(gatt_connection_t* connection, gattlib_primary_service_t** services, int* services_count) {
@@ -89,9 +89,7 @@ int gattlib_discover_primary(gatt_connection_t* connection, gattlib_primary_serv
 	}
 
 	// Wait for completion
-	while(user_data.discovered == FALSE) {
-		g_main_context_iteration(g_gattlib_thread.loop_context, FALSE);
-	}
+	gattlib_wait_completion(&user_data.discovered, 0, NULL);
 
 	if (services != NULL) {
 		*services = user_data.services;
@@ -143,7 +141,7 @@ static void characteristic_cb(uint8_t status, GSList *characteristics, void *use
 	}
 
 done:
-	data->discovered = TRUE;
+	gattlib_signal_completion(&data->discovered);
 }
 
 int gattlib_discover_char_range(gatt_connection_t* connection, int start, int end, gattlib_characteristic_t** characteristics, int* characteristics_count) {
@@ -161,9 +159,7 @@ int gattlib_discover_char_range(gatt_connection_t* connection, int start, int en
 	}
 
 	// Wait for completion
-	while(user_data.discovered == FALSE) {		
-		g_main_context_iteration(g_gattlib_thread.loop_context, FALSE);
-	}
+	gattlib_wait_completion(&user_data.discovered, 0, NULL);
 	*characteristics       = user_data.characteristics;
 	*characteristics_count = user_data.characteristics_count;
 
@@ -227,7 +223,7 @@ static void char_desc_cb(guint8 status, const guint8 *pdu, guint16 plen, gpointe
 	att_data_list_free(list);
 
 done:
-	data->discovered = TRUE;
+	gattlib_signal_completion(&data->discovered);
 }
 #else
 static void char_desc_cb(uint8_t status, GSList *descriptors, void *user_data)
@@ -260,7 +256,7 @@ static void char_desc_cb(uint8_t status, GSList *descriptors, void *user_data)
 	}
 
 done:
-	data->discovered = TRUE;
+	gattlib_signal_completion(&data->discovered);
 }
 #endif
 
@@ -282,9 +278,7 @@ int gattlib_discover_desc_range(gatt_connection_t* connection, int start, int en
 	}
 
 	// Wait for completion
-	while(descriptor_data.discovered == FALSE) {
-		g_main_context_iteration(g_gattlib_thread.loop_context, FALSE);
-	}
+	gattlib_wait_completion(&descriptor_data.discovered, 0, NULL);
 
 	*descriptors      = descriptor_data.descriptors;
 	*descriptor_count = descriptor_data.descriptors_count;
@@ -335,3 +329,13 @@ int gattlib_get_advertisement_data_from_mac(void *adapter, const char *mac_addre
 {
 	return GATTLIB_NOT_SUPPORTED;
 }
+
+int gattlib_get_advertisement(gatt_connection_t *connection, gattlib_advertisement_t **advertisement)
+{
+	return GATTLIB_NOT_SUPPORTED;
+}
+
+int gattlib_get_advertisement_from_mac(void *adapter, const char *mac_address, gattlib_advertisement_t **advertisement)
+{
+	return GATTLIB_NOT_SUPPORTED;
+}
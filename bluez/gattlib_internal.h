@@ -46,6 +46,39 @@ struct gattlib_thread_t {
 	pthread_t     thread;
 	GMainContext* loop_context;
 	GMainLoop*    loop;
+	// True when 'loop_context' is dispatched by the application (see gattlib_dispatch())
+	bool          external;
+};
+
+struct gattlib_adapter {
+	int      dev_id;
+	int      device_desc;
+
+	// Scan parameters (see gattlib_adapter_scan_set_parameters())
+	uint8_t  scan_type;
+	uint16_t scan_interval;
+	uint16_t scan_window;
+	bool     scan_filter_duplicates;
+
+	// Address allow-list (see gattlib_adapter_scan_set_address_filter())
+	bdaddr_t *address_filter;
+	size_t    address_filter_count;
+
+	// Rules set by gattlib_adapter_scan_set_match_rules()
+	struct gattlib_match_program *match_program;
+
+	// Change detection (see gattlib_adapter_scan_enable_change_detection())
+	struct gattlib_scan_cache *scan_cache;
+	gattlib_device_lost_t device_lost_cb;
+
+	// Cleared by gattlib_adapter_scan_disable() to leave the scan loop
+	volatile bool scan_running;
+
+	// Non-blocking scan started by gattlib_adapter_scan_start()
+	struct ble_scan_arg *scan_arg;
+	GSource *scan_io_source;
+	GSource *scan_timeout_source;
+	GSource *scan_expire_source;
 };
 
 typedef struct {
@@ -57,8 +90,38 @@ typedef struct {
 	int                       characteristic_count;
 } gattlib_context_t;
 
+struct _gattlib_cancellable_t {
+	gint cancelled;
+};
+
 extern struct gattlib_thread_t g_gattlib_thread;
 
+/**
+ * Wait for '*completed' to be set with gattlib_signal_completion() from the gattlib thread.
+ * The caller sleeps unless it is the thread dispatching the gattlib context.
+ *
+ * @param deadline is the monotonic time (see g_get_monotonic_time()) to give up at. 0 to wait forever.
+ *
+ * @return GATTLIB_SUCCESS, GATTLIB_TIMEOUT or GATTLIB_CANCELLED
+ */
+int gattlib_wait_completion(int *completed, gint64 deadline, gattlib_cancellable_t *cancellable);
+
+/**
+ * Set '*completed' and wake up the threads waiting in gattlib_wait_completion().
+ * The waiter might release the memory of '*completed' as soon as it is set.
+ */
+void gattlib_signal_completion(int *completed);
+
+/**
+ * Run 'func' from the gattlib thread and wait for its completion
+ */
+void gattlib_thread_invoke(GSourceFunc func, gpointer data);
+
+/**
+ * Convert a timeout in ms into a deadline for gattlib_wait_completion(). 0 means no deadline.
+ */
+gint64 gattlib_deadline_from_timeout(unsigned int timeout_ms);
+
 /**
  * Watch the GATT connection for conditions
  */
@@ -69,6 +132,14 @@ GSource* gattlib_timeout_add_seconds(guint interval, GSourceFunc function, gpoin
 void uuid_to_bt_uuid(uuid_t* uuid, bt_uuid_t* bt_uuid);
 void bt_uuid_to_uuid(bt_uuid_t* bt_uuid, uuid_t* uuid);
 
+/**
+ * Attach a classic BPF program to the HCI socket to drop in the kernel the advertising
+ * reports that do not match the scan filters.
+ */
+int gattlib_scan_filter_attach(int device_desc, const bdaddr_t *addresses, size_t address_count,
+		uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters);
+void gattlib_scan_filter_detach(int device_desc);
+
 int get_uuid_from_handle(gatt_connection_t* connection, uint16_t handle, uuid_t* uuid);
 int get_handle_from_uuid(gatt_connection_t* connection, const uuid_t* uuid, uint16_t* handle);
 
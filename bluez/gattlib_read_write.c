@@ -85,10 +85,46 @@ done:
 	if (gattlib_result->callback) {
 		free(gattlib_result);
 	} else {
-		gattlib_result->completed = TRUE;
+		gattlib_signal_completion(&gattlib_result->completed);
 	}
 }
 
+struct gattlib_request_abort_t {
+	GAttrib* attrib;
+	guint    id;
+	int*     completed;
+};
+
+/*
+ * Cancel a pending ATT request. It runs from the gattlib thread to not race with its completion.
+ */
+static gboolean gattlib_request_abort(gpointer user_data) {
+	struct gattlib_request_abort_t* request = user_data;
+
+	if (!*request->completed) {
+		// The result callback is not called for a cancelled request
+		g_attrib_cancel(request->attrib, request->id);
+		gattlib_signal_completion(request->completed);
+	}
+	return FALSE;
+}
+
+/*
+ * Wait for the completion of the request 'id'. It is cancelled on timeout or cancellation.
+ */
+static int gattlib_request_wait(GAttrib* attrib, guint id, int* completed,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable)
+{
+	struct gattlib_request_abort_t request = { .attrib = attrib, .id = id, .completed = completed };
+	int ret;
+
+	ret = gattlib_wait_completion(completed, gattlib_deadline_from_timeout(timeout_ms), cancellable);
+	if (ret != GATTLIB_SUCCESS) {
+		gattlib_thread_invoke(gattlib_request_abort, &request);
+	}
+	return ret;
+}
+
 void uuid_to_bt_uuid(uuid_t* uuid, bt_uuid_t* bt_uuid) {
 	memcpy(&bt_uuid->value, &uuid->value, sizeof(bt_uuid->value));
 	if (uuid->type == SDP_UUID16) {
@@ -102,14 +138,20 @@ void uuid_to_bt_uuid(uuid_t* uuid, bt_uuid_t* bt_uuid) {
 	}
 }
 
-int gattlib_read_char_by_uuid(gatt_connection_t* connection, uuid_t* uuid,
-			      void **buffer, size_t* buffer_len)
+int gattlib_read_char_by_uuid_with_timeout(gatt_connection_t* connection, uuid_t* uuid,
+			      void **buffer, size_t* buffer_len,
+			      unsigned int timeout_ms, gattlib_cancellable_t *cancellable)
 {
 	gattlib_context_t* conn_context = connection->context;
 	struct gattlib_result_read_uuid_t* gattlib_result;
 	bt_uuid_t bt_uuid;
 	const int start = 0x0001;
 	const int end   = 0xffff;
+	int ret;
+
+	if ((cancellable != NULL) && g_atomic_int_get(&cancellable->cancelled)) {
+		return GATTLIB_CANCELLED;
+	}
 
 	gattlib_result = malloc(sizeof(struct gattlib_result_read_uuid_t));
 	if (gattlib_result == NULL) {
@@ -122,16 +164,24 @@ int gattlib_read_char_by_uuid(gatt_connection_t* connection, uuid_t* uuid,
 
 	uuid_to_bt_uuid(uuid, &bt_uuid);
 
-	gatt_read_char_by_uuid(conn_context->attrib, start, end, &bt_uuid,
-			       gattlib_result_read_uuid_cb, gattlib_result);
+	guint id = gatt_read_char_by_uuid(conn_context->attrib, start, end, &bt_uuid,
+					  gattlib_result_read_uuid_cb, gattlib_result);
+	if (id == 0) {
+		free(gattlib_result);
+		return GATTLIB_NOT_FOUND;
+	}
 
 	// Wait for completion of the event
-	while(gattlib_result->completed == FALSE) {
-		g_main_context_iteration(g_gattlib_thread.loop_context, FALSE);
-	}
+	ret = gattlib_request_wait(conn_context->attrib, id, &gattlib_result->completed, timeout_ms, cancellable);
 
 	free(gattlib_result);
-	return GATTLIB_SUCCESS;
+	return ret;
+}
+
+int gattlib_read_char_by_uuid(gatt_connection_t* connection, uuid_t* uuid,
+			      void **buffer, size_t* buffer_len)
+{
+	return gattlib_read_char_by_uuid_with_timeout(connection, uuid, buffer, buffer_len, 0, NULL);
 }
 
 int gattlib_read_char_by_uuid_async(gatt_connection_t* connection, uuid_t* uuid,
@@ -167,27 +217,36 @@ int gattlib_read_char_by_uuid_async(gatt_connection_t* connection, uuid_t* uuid,
 void gattlib_write_result_cb(guint8 status, const guint8 *pdu, guint16 len, gpointer user_data) {
 	int* write_completed = user_data;
 
-	*write_completed = TRUE;
+	gattlib_signal_completion(write_completed);
 }
 
-int gattlib_write_char_by_handle(gatt_connection_t* connection, uint16_t handle, const void* buffer, size_t buffer_len) {
+static int write_char_by_handle(gatt_connection_t* connection, uint16_t handle, const void* buffer, size_t buffer_len,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable)
+{
 	gattlib_context_t* conn_context = connection->context;
 	int write_completed = FALSE;
 
-	guint ret = gatt_write_char(conn_context->attrib, handle, (void*)buffer, buffer_len,
+	if ((cancellable != NULL) && g_atomic_int_get(&cancellable->cancelled)) {
+		return GATTLIB_CANCELLED;
+	}
+
+	guint id = gatt_write_char(conn_context->attrib, handle, (void*)buffer, buffer_len,
 				    gattlib_write_result_cb, &write_completed);
-	if (ret == 0) {
+	if (id == 0) {
 		return 1;
 	}
 
 	// Wait for completion of the event
-	while(write_completed == FALSE) {
-		g_main_context_iteration(g_gattlib_thread.loop_context, FALSE);
-	}
-	return 0;
+	return gattlib_request_wait(conn_context->attrib, id, &write_completed, timeout_ms, cancellable);
 }
 
-int gattlib_write_char_by_uuid(gatt_connection_t* connection, uuid_t* uuid, const void* buffer, size_t buffer_len) {
+int gattlib_write_char_by_handle(gatt_connection_t* connection, uint16_t handle, const void* buffer, size_t buffer_len) {
+	return write_char_by_handle(connection, handle, buffer, buffer_len, 0, NULL);
+}
+
+int gattlib_write_char_by_uuid_with_timeout(gatt_connection_t* connection, uuid_t* uuid, const void* buffer, size_t buffer_len,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable)
+{
 	uint16_t handle = 0;
 	int ret;
 
@@ -197,7 +256,11 @@ int gattlib_write_char_by_uuid(gatt_connection_t* connection, uuid_t* uuid, cons
 		return ret;
 	}
 
-	return gattlib_write_char_by_handle(connection, handle, buffer, buffer_len);
+	return write_char_by_handle(connection, handle, buffer, buffer_len, timeout_ms, cancellable);
+}
+
+int gattlib_write_char_by_uuid(gatt_connection_t* connection, uuid_t* uuid, const void* buffer, size_t buffer_len) {
+	return gattlib_write_char_by_uuid_with_timeout(connection, uuid, buffer, buffer_len, 0, NULL);
 }
 
 int gattlib_write_without_response_char_by_uuid(gatt_connection_t* connection, uuid_t* uuid, const void* buffer, size_t buffer_len)
@@ -212,7 +275,9 @@ int gattlib_write_without_response_char_by_handle(gatt_connection_t* connection,
 	return GATTLIB_NOT_SUPPORTED;
 }
 
-int gattlib_notification_start(gatt_connection_t* connection, const uuid_t* uuid) {
+int gattlib_notification_start_with_timeout(gatt_connection_t* connection, const uuid_t* uuid,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable)
+{
 	uint16_t handle;
 	uint16_t enable_notification = 0x0001;
 
@@ -222,7 +287,12 @@ int gattlib_notification_start(gatt_connection_t* connection, const uuid_t* uuid
 	}
 
 	// Enable Status Notification
-	return gattlib_write_char_by_handle(connection, handle + 1, &enable_notification, sizeof(enable_notification));
+	return write_char_by_handle(connection, handle + 1, &enable_notification, sizeof(enable_notification),
+			timeout_ms, cancellable);
+}
+
+int gattlib_notification_start(gatt_connection_t* connection, const uuid_t* uuid) {
+	return gattlib_notification_start_with_timeout(connection, uuid, 0, NULL);
 }
 
 int gattlib_notification_stop(gatt_connection_t* connection, const uuid_t* uuid) {
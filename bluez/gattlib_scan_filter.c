@@ -0,0 +1,308 @@
+/*
+ *
+ *  GattLib - GATT Library
+ *
+ *  Copyright (C) 2016-2019 Olivier Martin <olivier@labapart.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Classic BPF program attached to the HCI socket while scanning.
+ *
+ * The program drops in the kernel the advertising reports that cannot match the active scan
+ * filters. It is only a pre-filter: the advertising reports that pass it are still checked
+ * by the scan loop. It must never drop a report that would match the filters.
+ *
+ * Layout of an LE Advertising Report as read from the HCI socket:
+ *
+ *   [0]      HCI_EVENT_PKT
+ *   [1]      EVT_LE_META_EVENT
+ *   [2]      Parameter length
+ *   [3]      Subevent (LE Advertising Report)
+ *   [4]      Number of reports
+ *   [5]      Event type
+ *   [6]      Address type
+ *   [7..12]  Address (little-endian)
+ *   [13]     Advertising data length
+ *   [14..]   Advertising data
+ *   [14+len] RSSI
+ */
+
+#include "gattlib_internal.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+
+#define ADV_OFFSET_PKT_TYPE      0
+#define ADV_OFFSET_EVENT         1
+#define ADV_OFFSET_SUBEVENT      3
+#define ADV_OFFSET_NUM_REPORTS   4
+#define ADV_OFFSET_ADDRESS       7
+#define ADV_OFFSET_DATA_LENGTH   13
+#define ADV_OFFSET_DATA          14
+
+#define EVT_LE_ADVERTISING_REPORT 0x02
+
+/* Maximum length of the legacy advertising data */
+#define ADV_DATA_MAX_LENGTH      31
+
+/* Above these limits, the program would be too long to be worth it. We let the scan loop filter. */
+#define SCAN_FILTER_MAX_ADDRESSES 64
+#define SCAN_FILTER_MAX_UUID16    8
+
+#define SCAN_FILTER_MAX_INSNS     1024
+
+/* Scratch memory slot used to store the advertising data length */
+#define MEM_DATA_LENGTH           0
+
+enum scan_filter_label {
+	LABEL_ACCEPT = 0,
+	LABEL_REJECT,
+	LABEL_ADDRESS_MATCH,
+	LABEL_UUID_MATCH,
+	LABEL_COUNT
+};
+
+struct scan_filter_program {
+	struct sock_filter insns[SCAN_FILTER_MAX_INSNS];
+	unsigned int len;
+	bool overflow;
+
+	// Label of the 'ja' instructions that need to be resolved
+	int8_t jump_label[SCAN_FILTER_MAX_INSNS];
+	int label_position[LABEL_COUNT];
+};
+
+static void emit(struct scan_filter_program *prog, uint16_t code, uint8_t jt, uint8_t jf, uint32_t k) {
+	if (prog->len >= SCAN_FILTER_MAX_INSNS) {
+		prog->overflow = true;
+		return;
+	}
+
+	prog->insns[prog->len].code = code;
+	prog->insns[prog->len].jt = jt;
+	prog->insns[prog->len].jf = jf;
+	prog->insns[prog->len].k = k;
+	prog->jump_label[prog->len] = -1;
+	prog->len++;
+}
+
+/*
+ * Conditional jumps only have 8-bit offsets. To jump to a label, we use a conditional jump
+ * over an unconditional 'ja' that has a 32-bit offset.
+ */
+static void emit_jump(struct scan_filter_program *prog, enum scan_filter_label label) {
+	emit(prog, BPF_JMP | BPF_JA, 0, 0, 0);
+	if (!prog->overflow) {
+		prog->jump_label[prog->len - 1] = label;
+	}
+}
+
+static void emit_jump_if_equal(struct scan_filter_program *prog, uint32_t k, enum scan_filter_label label) {
+	emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 0, 1, k);
+	emit_jump(prog, label);
+}
+
+static void emit_jump_if_not_equal(struct scan_filter_program *prog, uint32_t k, enum scan_filter_label label) {
+	emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 1, 0, k);
+	emit_jump(prog, label);
+}
+
+static void set_label(struct scan_filter_program *prog, enum scan_filter_label label) {
+	prog->label_position[label] = prog->len;
+}
+
+static int resolve_labels(struct scan_filter_program *prog) {
+	for (unsigned int i = 0; i < prog->len; i++) {
+		int label = prog->jump_label[i];
+
+		if (label < 0) {
+			continue;
+		}
+		if (prog->label_position[label] <= (int)i) {
+			// BPF only supports forward jumps
+			return GATTLIB_ERROR_INTERNAL;
+		}
+		prog->insns[i].k = prog->label_position[label] - i - 1;
+	}
+	return GATTLIB_SUCCESS;
+}
+
+static void emit_address_filter(struct scan_filter_program *prog, const bdaddr_t *addresses, size_t address_count) {
+	for (size_t i = 0; i < address_count; i++) {
+		const uint8_t *b = addresses[i].b;
+
+		// BPF loads are big-endian. Compare the address bytes in the order they are in the packet.
+		emit(prog, BPF_LD | BPF_W | BPF_ABS, 0, 0, ADV_OFFSET_ADDRESS);
+		emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 0, 3,
+				((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3]);
+		emit(prog, BPF_LD | BPF_H | BPF_ABS, 0, 0, ADV_OFFSET_ADDRESS + 4);
+		emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 0, 1, ((uint32_t)b[4] << 8) | b[5]);
+		emit_jump(prog, LABEL_ADDRESS_MATCH);
+	}
+	emit_jump(prog, LABEL_REJECT);
+	set_label(prog, LABEL_ADDRESS_MATCH);
+}
+
+static void emit_rssi_filter(struct scan_filter_program *prog, int16_t rssi_threshold) {
+	int8_t threshold;
+
+	if (rssi_threshold < -128) {
+		threshold = -128;
+	} else if (rssi_threshold > 126) {
+		threshold = 126;
+	} else {
+		threshold = rssi_threshold;
+	}
+
+	// The RSSI follows the advertising data: X = data length, A = RSSI
+	emit(prog, BPF_LD | BPF_B | BPF_ABS, 0, 0, ADV_OFFSET_DATA_LENGTH);
+	emit(prog, BPF_MISC | BPF_TAX, 0, 0, 0);
+	emit(prog, BPF_LD | BPF_B | BPF_IND, 0, 0, ADV_OFFSET_DATA);
+
+	// RSSI not available
+	emit_jump_if_equal(prog, 127, LABEL_REJECT);
+
+	// BPF comparisons are unsigned. Flip the sign bit to compare signed 8-bit values.
+	emit(prog, BPF_ALU | BPF_XOR | BPF_K, 0, 0, 0x80);
+	emit(prog, BPF_JMP | BPF_JGE | BPF_K, 1, 0, ((uint8_t)threshold) ^ 0x80);
+	emit_jump(prog, LABEL_REJECT);
+}
+
+/*
+ * Look for the little-endian 16-bit UUIDs at any position of the advertising data.
+ * It covers 16-bit UUID lists, 16-bit Service Data and 128-bit UUIDs derived from the
+ * Bluetooth Base UUID. A match on unrelated bytes is possible but it is filtered later.
+ */
+static void emit_uuid16_filter(struct scan_filter_program *prog, const uint16_t *uuid16, size_t uuid16_count) {
+	emit(prog, BPF_LD | BPF_B | BPF_ABS, 0, 0, ADV_OFFSET_DATA_LENGTH);
+	emit(prog, BPF_ST, 0, 0, MEM_DATA_LENGTH);
+
+	for (unsigned int offset = 0; offset + 1 < ADV_DATA_MAX_LENGTH; offset++) {
+		// Stop when the 2 bytes are not in the advertising data (out of bound loads drop the packet)
+		emit(prog, BPF_LD | BPF_MEM, 0, 0, MEM_DATA_LENGTH);
+		emit(prog, BPF_JMP | BPF_JGT | BPF_K, 1, 0, offset + 1);
+		emit_jump(prog, LABEL_REJECT);
+
+		emit(prog, BPF_LD | BPF_H | BPF_ABS, 0, 0, ADV_OFFSET_DATA + offset);
+		for (size_t i = 0; i < uuid16_count; i++) {
+			emit_jump_if_equal(prog, ((uuid16[i] & 0xFF) << 8) | (uuid16[i] >> 8), LABEL_UUID_MATCH);
+		}
+	}
+	emit_jump(prog, LABEL_REJECT);
+	set_label(prog, LABEL_UUID_MATCH);
+}
+
+/*
+ * Return the number of 16-bit UUIDs of the list or -1 if the UUID filter cannot be done with
+ * 16-bit UUIDs only
+ */
+static int get_uuid16_list(uuid_t **uuid_list, uint16_t *uuid16) {
+	int count = 0;
+
+	for (uuid_t **uuid_ptr = uuid_list; *uuid_ptr != NULL; uuid_ptr++) {
+		if (((*uuid_ptr)->type != SDP_UUID16) || (count >= SCAN_FILTER_MAX_UUID16)) {
+			return -1;
+		}
+		uuid16[count++] = (*uuid_ptr)->value.uuid16;
+	}
+
+	return count;
+}
+
+int gattlib_scan_filter_attach(int device_desc, const bdaddr_t *addresses, size_t address_count,
+		uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters)
+{
+	struct scan_filter_program *prog;
+	struct sock_fprog fprog;
+	uint16_t uuid16[SCAN_FILTER_MAX_UUID16];
+	int uuid16_count = -1;
+	int ret;
+
+	if ((enabled_filters & GATTLIB_DISCOVER_FILTER_USE_UUID) && (uuid_list != NULL)) {
+		uuid16_count = get_uuid16_list(uuid_list, uuid16);
+	}
+
+	prog = calloc(1, sizeof(struct scan_filter_program));
+	if (prog == NULL) {
+		return GATTLIB_OUT_OF_MEMORY;
+	}
+
+	// Only keep LE Advertising Reports
+	emit(prog, BPF_LD | BPF_B | BPF_ABS, 0, 0, ADV_OFFSET_PKT_TYPE);
+	emit_jump_if_not_equal(prog, HCI_EVENT_PKT, LABEL_REJECT);
+	emit(prog, BPF_LD | BPF_B | BPF_ABS, 0, 0, ADV_OFFSET_EVENT);
+	emit_jump_if_not_equal(prog, EVT_LE_META_EVENT, LABEL_REJECT);
+	emit(prog, BPF_LD | BPF_B | BPF_ABS, 0, 0, ADV_OFFSET_SUBEVENT);
+	emit_jump_if_not_equal(prog, EVT_LE_ADVERTISING_REPORT, LABEL_REJECT);
+
+	// Events with several reports are left to the scan loop
+	emit(prog, BPF_LD | BPF_B | BPF_ABS, 0, 0, ADV_OFFSET_NUM_REPORTS);
+	emit_jump_if_not_equal(prog, 1, LABEL_ACCEPT);
+
+	if ((addresses != NULL) && (address_count > 0) && (address_count <= SCAN_FILTER_MAX_ADDRESSES)) {
+		emit_address_filter(prog, addresses, address_count);
+	}
+
+	if (enabled_filters & GATTLIB_DISCOVER_FILTER_USE_RSSI) {
+		emit_rssi_filter(prog, rssi_threshold);
+	}
+
+	if (uuid16_count > 0) {
+		emit_uuid16_filter(prog, uuid16, uuid16_count);
+	}
+
+	set_label(prog, LABEL_ACCEPT);
+	emit(prog, BPF_RET | BPF_K, 0, 0, 0xFFFFFFFF);
+	set_label(prog, LABEL_REJECT);
+	emit(prog, BPF_RET | BPF_K, 0, 0, 0);
+
+	if (prog->overflow) {
+		free(prog);
+		return GATTLIB_OUT_OF_MEMORY;
+	}
+
+	ret = resolve_labels(prog);
+	if (ret != GATTLIB_SUCCESS) {
+		free(prog);
+		return ret;
+	}
+
+	fprog.len = prog->len;
+	fprog.filter = prog->insns;
+
+	// The kernel copies the program
+	if (setsockopt(device_desc, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0) {
+		ret = GATTLIB_NOT_SUPPORTED;
+	} else {
+		ret = GATTLIB_SUCCESS;
+	}
+
+	free(prog);
+	return ret;
+}
+
+void gattlib_scan_filter_detach(int device_desc) {
+	int dummy = 0;
+
+	setsockopt(device_desc, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy));
+}
@@ -0,0 +1,413 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gattlib_internal.h"
+
+/* AD types as defined by the Bluetooth Core Specification Supplement */
+#define EIR_FLAGS          0x01  /* flags */
+#define EIR_UUID16_SOME    0x02  /* 16-bit UUID, more available */
+#define EIR_UUID16_ALL     0x03  /* 16-bit UUID, all listed */
+#define EIR_UUID32_SOME    0x04  /* 32-bit UUID, more available */
+#define EIR_UUID32_ALL     0x05  /* 32-bit UUID, all listed */
+#define EIR_UUID128_SOME   0x06  /* 128-bit UUID, more available */
+#define EIR_UUID128_ALL    0x07  /* 128-bit UUID, all listed */
+#define EIR_NAME_SHORT     0x08  /* shortened local name */
+#define EIR_NAME_COMPLETE  0x09  /* complete local name */
+#define EIR_TX_POWER       0x0A  /* transmit power level */
+#define EIR_SVC_DATA16     0x16  /* LE: Service data, 16-bit UUID */
+#define EIR_SVC_DATA32     0x20  /* LE: Service data, 32-bit UUID */
+#define EIR_SVC_DATA128    0x21  /* LE: Service data, 128-bit UUID */
+#define EIR_MANUFACTURER_DATA 0xFF /* Manufacturer Specific Data */
+
+void gattlib_advertisement_storage_init(struct gattlib_advertisement_storage *storage) {
+	memset(&storage->advertisement, 0, sizeof(storage->advertisement));
+
+	storage->advertisement.service_uuids = storage->service_uuids;
+	storage->advertisement.service_data = storage->service_data;
+	storage->advertisement.manufacturer_data = storage->manufacturer_data;
+	storage->service_uuid_capacity = GATTLIB_ADVERTISEMENT_MAX_UUIDS;
+	storage->service_data_capacity = GATTLIB_ADVERTISEMENT_MAX_SERVICE_DATA;
+	storage->manufacturer_data_capacity = GATTLIB_ADVERTISEMENT_MAX_MANUFACTURER_DATA;
+}
+
+static void storage_free_array(const void *array, const void *inline_array) {
+	if ((array != NULL) && (array != inline_array)) {
+		free((void*)array);
+	}
+}
+
+void gattlib_advertisement_storage_release(struct gattlib_advertisement_storage *storage) {
+	storage_free_array(storage->advertisement.service_uuids, storage->service_uuids);
+	storage_free_array(storage->advertisement.service_data, storage->service_data);
+	storage_free_array(storage->advertisement.manufacturer_data, storage->manufacturer_data);
+
+	storage->advertisement.service_uuids = NULL;
+	storage->advertisement.service_data = NULL;
+	storage->advertisement.manufacturer_data = NULL;
+}
+
+/*
+ * Double the capacity of a full array. The inline array of the storage is copied to the heap.
+ *
+ * @return the new array or NULL if it cannot grow (the array is unchanged)
+ */
+static void *storage_grow(const void *array, const void *inline_array, size_t *capacity, size_t element_size) {
+	size_t new_capacity = *capacity * 2;
+	void *new_array;
+
+	if (array == inline_array) {
+		new_array = malloc(new_capacity * element_size);
+		if (new_array != NULL) {
+			memcpy(new_array, array, *capacity * element_size);
+		}
+	} else {
+		new_array = realloc((void*)array, new_capacity * element_size);
+	}
+
+	if (new_array != NULL) {
+		*capacity = new_capacity;
+	}
+	return new_array;
+}
+
+void gattlib_advertisement_add_service_uuid(struct gattlib_advertisement_storage *storage, const uuid_t *uuid) {
+	gattlib_advertisement_t *advertisement = &storage->advertisement;
+	uuid_t *service_uuids = (uuid_t*)advertisement->service_uuids;
+
+	if (advertisement->service_uuid_count == storage->service_uuid_capacity) {
+		service_uuids = storage_grow(service_uuids, storage->service_uuids,
+				&storage->service_uuid_capacity, sizeof(uuid_t));
+		if (service_uuids == NULL) {
+			return;
+		}
+		advertisement->service_uuids = service_uuids;
+	}
+
+	service_uuids[advertisement->service_uuid_count++] = *uuid;
+}
+
+void gattlib_advertisement_add_service_data(struct gattlib_advertisement_storage *storage, const uuid_t *uuid,
+		const uint8_t *data, size_t data_length)
+{
+	gattlib_advertisement_t *advertisement = &storage->advertisement;
+	gattlib_advertisement_data_t *service_data = (gattlib_advertisement_data_t*)advertisement->service_data;
+
+	if (advertisement->service_data_count == storage->service_data_capacity) {
+		service_data = storage_grow(service_data, storage->service_data,
+				&storage->service_data_capacity, sizeof(gattlib_advertisement_data_t));
+		if (service_data == NULL) {
+			return;
+		}
+		advertisement->service_data = service_data;
+	}
+
+	service_data += advertisement->service_data_count++;
+	service_data->uuid = *uuid;
+	service_data->data = (uint8_t*)data;
+	service_data->data_length = data_length;
+}
+
+void gattlib_advertisement_add_manufacturer_data(struct gattlib_advertisement_storage *storage, uint16_t manufacturer_id,
+		const uint8_t *data, size_t data_length)
+{
+	gattlib_advertisement_t *advertisement = &storage->advertisement;
+	gattlib_manufacturer_data_t *manufacturer_data = (gattlib_manufacturer_data_t*)advertisement->manufacturer_data;
+
+	if (advertisement->manufacturer_data_count == storage->manufacturer_data_capacity) {
+		manufacturer_data = storage_grow(manufacturer_data, storage->manufacturer_data,
+				&storage->manufacturer_data_capacity, sizeof(gattlib_manufacturer_data_t));
+		if (manufacturer_data == NULL) {
+			return;
+		}
+		advertisement->manufacturer_data = manufacturer_data;
+	}
+
+	manufacturer_data += advertisement->manufacturer_data_count++;
+	manufacturer_data->manufacturer_id = manufacturer_id;
+	manufacturer_data->data = data;
+	manufacturer_data->data_length = data_length;
+}
+
+void gattlib_advertisement_set_name(struct gattlib_advertisement_storage *storage, const char *name, size_t name_length) {
+	if (name_length > GATTLIB_ADVERTISEMENT_MAX_NAME) {
+		name_length = GATTLIB_ADVERTISEMENT_MAX_NAME;
+	}
+
+	memcpy(storage->name, name, name_length);
+	storage->name[name_length] = '\0';
+	storage->advertisement.name = storage->name;
+}
+
+/*
+ * Convert a little-endian UUID from the advertising data into 'uuid_t'.
+ * 128-bit UUIDs derived from the Bluetooth Base UUID are reduced to their 16-bit form
+ * to be consistent with gattlib_string_to_uuid().
+ */
+static void ad_uuid_to_uuid(const uint8_t *data, size_t len, uuid_t *uuid) {
+	static const uint8_t base_uuid_le[12] = {
+		0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00
+	};
+
+	if (len == 2) {
+		uuid->type = SDP_UUID16;
+		uuid->value.uuid16 = data[0] | (data[1] << 8);
+	} else if (len == 4) {
+		uuid->type = SDP_UUID32;
+		uuid->value.uuid32 = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+	} else if ((memcmp(data, base_uuid_le, sizeof(base_uuid_le)) == 0) && (data[14] == 0) && (data[15] == 0)) {
+		uuid->type = SDP_UUID16;
+		uuid->value.uuid16 = data[12] | (data[13] << 8);
+	} else {
+		uuid->type = SDP_UUID128;
+		for (int i = 0; i < 16; i++) {
+			uuid->value.uuid128.data[i] = data[15 - i];
+		}
+	}
+}
+
+static void parse_uuid_list(struct gattlib_advertisement_storage *storage, const uint8_t *data, size_t len, size_t uuid_len) {
+	uuid_t uuid;
+
+	for (size_t i = 0; i + uuid_len <= len; i += uuid_len) {
+		ad_uuid_to_uuid(data + i, uuid_len, &uuid);
+		gattlib_advertisement_add_service_uuid(storage, &uuid);
+	}
+}
+
+static void parse_service_data(struct gattlib_advertisement_storage *storage, const uint8_t *data, size_t len, size_t uuid_len) {
+	uuid_t uuid;
+
+	if (len < uuid_len) {
+		return;
+	}
+
+	ad_uuid_to_uuid(data, uuid_len, &uuid);
+	gattlib_advertisement_add_service_data(storage, &uuid, data + uuid_len, len - uuid_len);
+}
+
+int gattlib_advertisement_parse(const uint8_t *data, size_t size, struct gattlib_advertisement_storage *storage) {
+	gattlib_advertisement_t *advertisement = &storage->advertisement;
+	size_t offset = 0;
+
+	while (offset < size) {
+		uint8_t field_len = data[offset];
+		const uint8_t *field;
+		size_t len;
+
+		// A zero-length field marks the end of the significant part of the advertising data
+		if (field_len == 0) {
+			break;
+		}
+		if (offset + 1 + field_len > size) {
+			return GATTLIB_INVALID_PARAMETER;
+		}
+
+		field = &data[offset + 2];
+		len = field_len - 1;
+
+		switch (data[offset + 1]) {
+		case EIR_FLAGS:
+			if (len >= 1) {
+				advertisement->flags = field[0];
+				advertisement->present |= GATTLIB_ADVERTISEMENT_HAS_FLAGS;
+			}
+			break;
+		case EIR_UUID16_SOME:
+		case EIR_UUID16_ALL:
+			parse_uuid_list(storage, field, len, 2);
+			break;
+		case EIR_UUID32_SOME:
+		case EIR_UUID32_ALL:
+			parse_uuid_list(storage, field, len, 4);
+			break;
+		case EIR_UUID128_SOME:
+		case EIR_UUID128_ALL:
+			parse_uuid_list(storage, field, len, 16);
+			break;
+		case EIR_NAME_SHORT:
+			// Prefer the complete name if both are advertised
+			if (advertisement->name != NULL) {
+				break;
+			}
+			gattlib_advertisement_set_name(storage, (const char*)field, len);
+			break;
+		case EIR_NAME_COMPLETE:
+			gattlib_advertisement_set_name(storage, (const char*)field, len);
+			break;
+		case EIR_TX_POWER:
+			if (len >= 1) {
+				advertisement->tx_power = (int8_t)field[0];
+				advertisement->present |= GATTLIB_ADVERTISEMENT_HAS_TX_POWER;
+			}
+			break;
+		case EIR_SVC_DATA16:
+			parse_service_data(storage, field, len, 2);
+			break;
+		case EIR_SVC_DATA32:
+			parse_service_data(storage, field, len, 4);
+			break;
+		case EIR_SVC_DATA128:
+			parse_service_data(storage, field, len, 16);
+			break;
+		case EIR_MANUFACTURER_DATA:
+			if (len >= 2) {
+				gattlib_advertisement_add_manufacturer_data(storage, field[0] | (field[1] << 8), field + 2, len - 2);
+			}
+			break;
+		}
+
+		offset += field_len + 1;
+	}
+
+	return GATTLIB_SUCCESS;
+}
+
+static bool uuid_in_list(const uuid_t *uuid, uuid_t **uuid_list) {
+	for (uuid_t **uuid_ptr = uuid_list; *uuid_ptr != NULL; uuid_ptr++) {
+		if (gattlib_uuid_cmp(uuid, *uuid_ptr) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool gattlib_advertisement_match_uuid(const gattlib_advertisement_t *advertisement, uuid_t **uuid_list) {
+	if (uuid_list == NULL) {
+		return false;
+	}
+
+	for (size_t i = 0; i < advertisement->service_uuid_count; i++) {
+		if (uuid_in_list(&advertisement->service_uuids[i], uuid_list)) {
+			return true;
+		}
+	}
+
+	for (size_t i = 0; i < advertisement->service_data_count; i++) {
+		if (uuid_in_list(&advertisement->service_data[i].uuid, uuid_list)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+gattlib_advertisement_t *gattlib_advertisement_dup(const gattlib_advertisement_t *advertisement) {
+	gattlib_advertisement_t *copy;
+	gattlib_advertisement_data_t *service_data;
+	gattlib_manufacturer_data_t *manufacturer_data;
+	uuid_t *service_uuids;
+	uint8_t *bytes;
+	size_t size;
+
+	// The arrays are laid out by decreasing alignment after the record, followed by the bytes
+	size = sizeof(gattlib_advertisement_t) +
+		advertisement->service_data_count * sizeof(gattlib_advertisement_data_t) +
+		advertisement->manufacturer_data_count * sizeof(gattlib_manufacturer_data_t) +
+		advertisement->service_uuid_count * sizeof(uuid_t);
+	for (size_t i = 0; i < advertisement->service_data_count; i++) {
+		size += advertisement->service_data[i].data_length;
+	}
+	for (size_t i = 0; i < advertisement->manufacturer_data_count; i++) {
+		size += advertisement->manufacturer_data[i].data_length;
+	}
+	if (advertisement->name != NULL) {
+		size += strlen(advertisement->name) + 1;
+	}
+
+	copy = malloc(size);
+	if (copy == NULL) {
+		return NULL;
+	}
+	*copy = *advertisement;
+
+	service_data = (gattlib_advertisement_data_t*)(copy + 1);
+	manufacturer_data = (gattlib_manufacturer_data_t*)(service_data + advertisement->service_data_count);
+	service_uuids = (uuid_t*)(manufacturer_data + advertisement->manufacturer_data_count);
+	bytes = (uint8_t*)(service_uuids + advertisement->service_uuid_count);
+
+	memcpy(service_uuids, advertisement->service_uuids, advertisement->service_uuid_count * sizeof(uuid_t));
+	copy->service_uuids = service_uuids;
+
+	for (size_t i = 0; i < advertisement->service_data_count; i++) {
+		service_data[i].uuid = advertisement->service_data[i].uuid;
+		service_data[i].data = bytes;
+		service_data[i].data_length = advertisement->service_data[i].data_length;
+		memcpy(bytes, advertisement->service_data[i].data, service_data[i].data_length);
+		bytes += service_data[i].data_length;
+	}
+	copy->service_data = service_data;
+
+	for (size_t i = 0; i < advertisement->manufacturer_data_count; i++) {
+		manufacturer_data[i].manufacturer_id = advertisement->manufacturer_data[i].manufacturer_id;
+		manufacturer_data[i].data = bytes;
+		manufacturer_data[i].data_length = advertisement->manufacturer_data[i].data_length;
+		memcpy(bytes, advertisement->manufacturer_data[i].data, manufacturer_data[i].data_length);
+		bytes += manufacturer_data[i].data_length;
+	}
+	copy->manufacturer_data = manufacturer_data;
+
+	if (advertisement->name != NULL) {
+		strcpy((char*)bytes, advertisement->name);
+		copy->name = (const char*)bytes;
+	}
+
+	return copy;
+}
+
+void gattlib_advertisement_free(gattlib_advertisement_t *advertisement) {
+	// The record and all its data are a single allocation (see gattlib_advertisement_dup())
+	free(advertisement);
+}
+
+static uint8_t hex_value(char c) {
+	if (isdigit((unsigned char)c)) {
+		return c - '0';
+	} else {
+		return tolower((unsigned char)c) - 'a' + 10;
+	}
+}
+
+int gattlib_string_to_bdaddr(const char *str, bdaddr_t *bdaddr) {
+	uint8_t b[6];
+
+	if ((str == NULL) || (strlen(str) != 17)) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	for (int i = 0; i < 6; i++) {
+		const char *byte_str = str + i * 3;
+
+		if (!isxdigit((unsigned char)byte_str[0]) || !isxdigit((unsigned char)byte_str[1])) {
+			return GATTLIB_INVALID_PARAMETER;
+		}
+		if ((i < 5) && (byte_str[2] != ':')) {
+			return GATTLIB_INVALID_PARAMETER;
+		}
+
+		b[i] = (hex_value(byte_str[0]) << 4) | hex_value(byte_str[1]);
+	}
+
+	// 'bdaddr_t' stores the address in little-endian
+	for (int i = 0; i < 6; i++) {
+		bdaddr->b[i] = b[5 - i];
+	}
+
+	return GATTLIB_SUCCESS;
+}
+
+uint64_t gattlib_bdaddr_to_uint64(const bdaddr_t *bdaddr) {
+	uint64_t value = 0;
+
+	for (int i = 5; i >= 0; i--) {
+		value = (value << 8) | bdaddr->b[i];
+	}
+	return value;
+}
+
+void gattlib_uint64_to_bdaddr(uint64_t value, bdaddr_t *bdaddr) {
+	for (int i = 0; i < 6; i++) {
+		bdaddr->b[i] = value & 0xFF;
+		value >>= 8;
+	}
+}
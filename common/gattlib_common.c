@@ -3,6 +3,7 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "gattlib_internal.h"
 
@@ -44,6 +45,143 @@ void gattlib_register_on_disconnect_python(gatt_connection_t *connection, PyObje
 }
 #endif
 
+struct on_bdaddr_discovered_device_arg {
+	uint32_t enabled_filters;
+	gattlib_discovered_device_bdaddr_t discovered_device_cb;
+	// Set of the devices already reported, keyed by their 48-bit address
+	GHashTable *discovered_devices;
+	void *user_data;
+};
+
+static void on_bdaddr_discovered_advertisement(void *adapter, const gattlib_advertisement_t *advertisement, void *user_data)
+{
+	struct on_bdaddr_discovered_device_arg *callback_data = user_data;
+	struct gattlib_adapter *gattlib_adapter = adapter;
+	gint64 key;
+
+	// With change detection, the scan cache has already decided whether the device must be reported
+	if (((gattlib_adapter == NULL) || (gattlib_adapter->scan_cache == NULL)) &&
+	    ((callback_data->enabled_filters & GATTLIB_DISCOVER_FILTER_NOTIFY_CHANGE) == 0)) {
+		key = (gint64)gattlib_bdaddr_to_uint64(&advertisement->addr);
+		if (g_hash_table_contains(callback_data->discovered_devices, &key)) {
+			return;
+		}
+
+		gint64 *new_key = g_new(gint64, 1);
+		*new_key = key;
+		g_hash_table_add(callback_data->discovered_devices, new_key);
+	}
+
+	callback_data->discovered_device_cb(adapter, &advertisement->addr, advertisement->addr_type,
+			advertisement->name, callback_data->user_data);
+}
+
+int gattlib_adapter_scan_enable_bdaddr(void *adapter, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
+		gattlib_discovered_device_bdaddr_t discovered_device_cb, size_t timeout, void *user_data)
+{
+	struct on_bdaddr_discovered_device_arg callback_data = {
+			.enabled_filters = enabled_filters,
+			.discovered_device_cb = discovered_device_cb,
+			.user_data = user_data
+	};
+	int ret;
+
+	if (discovered_device_cb == NULL) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	callback_data.discovered_devices = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+
+	ret = gattlib_adapter_scan_advertisements(adapter, uuid_list, rssi_threshold, enabled_filters,
+			on_bdaddr_discovered_advertisement, timeout, &callback_data);
+
+	g_hash_table_destroy(callback_data.discovered_devices);
+	return ret;
+}
+
+struct connect_many_arg {
+	void *adapter;
+	const char **dst_list;
+	gint dst_count;
+	unsigned long options;
+	// Index of the next device to connect. Shared by the connection threads.
+	gint next;
+	// Serialize the calls to 'per_device_cb'
+	GMutex callback_mutex;
+	gattlib_connect_many_cb_t per_device_cb;
+	void *user_data;
+};
+
+static gpointer connect_many_thread(gpointer data) {
+	struct connect_many_arg *arg = data;
+	gatt_connection_t *connection;
+	gint index;
+
+	while ((index = g_atomic_int_add(&arg->next, 1)) < arg->dst_count) {
+		connection = gattlib_connect(arg->adapter, arg->dst_list[index], arg->options);
+
+		g_mutex_lock(&arg->callback_mutex);
+		arg->per_device_cb(arg->adapter, arg->dst_list[index], connection, arg->user_data);
+		g_mutex_unlock(&arg->callback_mutex);
+	}
+	return NULL;
+}
+
+int gattlib_connect_many(void *adapter, const char *dst_list[], size_t dst_count, unsigned long options,
+		size_t max_in_flight, gattlib_connect_many_cb_t per_device_cb, void *user_data)
+{
+	struct connect_many_arg arg = {
+			.adapter = adapter,
+			.dst_list = dst_list,
+			.dst_count = dst_count,
+			.options = options,
+			.next = 0,
+			.per_device_cb = per_device_cb,
+			.user_data = user_data
+	};
+	GThread **threads;
+	size_t thread_count = 0;
+
+	if ((dst_list == NULL) || (dst_count > G_MAXINT) || (max_in_flight == 0) || (per_device_cb == NULL)) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	if (max_in_flight > dst_count) {
+		max_in_flight = dst_count;
+	}
+
+	// The calling thread is one of the connection threads
+	threads = calloc(max_in_flight, sizeof(GThread*));
+	if ((threads == NULL) && (max_in_flight > 0)) {
+		return GATTLIB_OUT_OF_MEMORY;
+	}
+
+	g_mutex_init(&arg.callback_mutex);
+
+	for (size_t i = 1; i < max_in_flight; i++) {
+		GError *error = NULL;
+
+		threads[thread_count] = g_thread_try_new("gattlib-connect", connect_many_thread, &arg, &error);
+		if (threads[thread_count] == NULL) {
+			// Carry on with the threads already created
+			fprintf(stderr, "Failed to create connection thread: %s\n", error->message);
+			g_error_free(error);
+			break;
+		}
+		thread_count++;
+	}
+
+	connect_many_thread(&arg);
+
+	for (size_t i = 0; i < thread_count; i++) {
+		g_thread_join(threads[i]);
+	}
+
+	g_mutex_clear(&arg.callback_mutex);
+	free(threads);
+	return GATTLIB_SUCCESS;
+}
+
 bool gattlib_has_valid_handler(struct gattlib_handler *handler) {
 	return ((handler->type != UNKNOWN) && (handler->notification_handler != NULL));
 }
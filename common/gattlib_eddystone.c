@@ -2,8 +2,6 @@
 
 #include "gattlib_internal.h"
 
-#define EDDYSTONE_SERVICE_UUID	"0000FEAA-0000-1000-8000-00805F9B34FB"
-
 const uuid_t gattlib_eddystone_common_data_uuid = CREATE_UUID16(0xFEAA);
 
 const char *gattlib_eddystone_url_scheme_prefix[] = {
@@ -13,59 +11,247 @@ const char *gattlib_eddystone_url_scheme_prefix[] = {
     "https://"
 };
 
+/* Expansion of the encoded URL bytes 0x00 to 0x0D */
+static const char *eddystone_url_expansion[] = {
+    ".com/", ".org/", ".edu/", ".net/", ".info/", ".biz/", ".gov/",
+    ".com", ".org", ".edu", ".net", ".info", ".biz", ".gov"
+};
+
+#define EDDYSTONE_UID_FRAME_LENGTH      18
+#define EDDYSTONE_URL_FRAME_MIN_LENGTH  3
+#define EDDYSTONE_URL_FRAME_MAX_LENGTH  20
+#define EDDYSTONE_TLM_FRAME_LENGTH      14
+#define EDDYSTONE_EID_FRAME_LENGTH      10
+
+/* Version of the unencrypted TLM frame */
+#define EDDYSTONE_TLM_VERSION_PLAIN     0x00
+
+static uint16_t eddystone_get_be16(const uint8_t *data) {
+	return (data[0] << 8) | data[1];
+}
+
+static uint32_t eddystone_get_be32(const uint8_t *data) {
+	return ((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+static int eddystone_parse_url(const uint8_t *data, size_t data_length, char *url) {
+	size_t scheme_count = sizeof(gattlib_eddystone_url_scheme_prefix) / sizeof(gattlib_eddystone_url_scheme_prefix[0]);
+	size_t expansion_count = sizeof(eddystone_url_expansion) / sizeof(eddystone_url_expansion[0]);
+	size_t length;
+
+	if (data[2] >= scheme_count) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	strcpy(url, gattlib_eddystone_url_scheme_prefix[data[2]]);
+	length = strlen(url);
+
+	for (size_t i = 3; i < data_length; i++) {
+		uint8_t c = data[i];
+
+		if (c < expansion_count) {
+			size_t expansion_length = strlen(eddystone_url_expansion[c]);
+			memcpy(url + length, eddystone_url_expansion[c], expansion_length);
+			length += expansion_length;
+		} else if ((c > 0x20) && (c < 0x7F)) {
+			url[length++] = c;
+		} else {
+			// Reserved for future use
+			return GATTLIB_INVALID_PARAMETER;
+		}
+	}
+	url[length] = '\0';
+
+	return GATTLIB_SUCCESS;
+}
+
+int gattlib_eddystone_parse_frame(const uint8_t *data, size_t data_length, gattlib_eddystone_frame_t *frame) {
+	if ((data == NULL) || (frame == NULL) || (data_length < 1)) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	memset(frame, 0, sizeof(*frame));
+	frame->frame_type = data[0];
+
+	switch (data[0]) {
+	case EDDYSTONE_TYPE_UID:
+		// The two last bytes are reserved and might be omitted
+		if (data_length < EDDYSTONE_UID_FRAME_LENGTH) {
+			return GATTLIB_INVALID_PARAMETER;
+		}
+		frame->tx_power = (int8_t)data[1];
+		memcpy(frame->uid.namespace_id, data + 2, sizeof(frame->uid.namespace_id));
+		memcpy(frame->uid.instance_id, data + 12, sizeof(frame->uid.instance_id));
+		return GATTLIB_SUCCESS;
+	case EDDYSTONE_TYPE_URL:
+		if ((data_length < EDDYSTONE_URL_FRAME_MIN_LENGTH) || (data_length > EDDYSTONE_URL_FRAME_MAX_LENGTH)) {
+			return GATTLIB_INVALID_PARAMETER;
+		}
+		frame->tx_power = (int8_t)data[1];
+		return eddystone_parse_url(data, data_length, frame->url.url);
+	case EDDYSTONE_TYPE_TLM:
+		if (data_length < 2) {
+			return GATTLIB_INVALID_PARAMETER;
+		} else if (data[1] != EDDYSTONE_TLM_VERSION_PLAIN) {
+			// Encrypted TLM frames require the Ephemeral Identity Key
+			return GATTLIB_NOT_SUPPORTED;
+		} else if (data_length < EDDYSTONE_TLM_FRAME_LENGTH) {
+			return GATTLIB_INVALID_PARAMETER;
+		}
+		frame->tlm.version = data[1];
+		frame->tlm.battery_voltage = eddystone_get_be16(data + 2);
+		frame->tlm.temperature = (int16_t)eddystone_get_be16(data + 4);
+		frame->tlm.advertising_count = eddystone_get_be32(data + 6);
+		frame->tlm.uptime = eddystone_get_be32(data + 10);
+		return GATTLIB_SUCCESS;
+	case EDDYSTONE_TYPE_EID:
+		if (data_length < EDDYSTONE_EID_FRAME_LENGTH) {
+			return GATTLIB_INVALID_PARAMETER;
+		}
+		frame->tx_power = (int8_t)data[1];
+		memcpy(frame->eid.eid, data + 2, sizeof(frame->eid.eid));
+		return GATTLIB_SUCCESS;
+	default:
+		return GATTLIB_NOT_SUPPORTED;
+	}
+}
+
+/*
+ * Convert the frame type into its GATTLIB_EDDYSTONE_TYPE_* bit
+ */
+static uint32_t eddystone_frame_type_mask(uint8_t frame_type) {
+	switch (frame_type) {
+	case EDDYSTONE_TYPE_UID: return GATTLIB_EDDYSTONE_TYPE_UID;
+	case EDDYSTONE_TYPE_URL: return GATTLIB_EDDYSTONE_TYPE_URL;
+	case EDDYSTONE_TYPE_TLM: return GATTLIB_EDDYSTONE_TYPE_TLM;
+	case EDDYSTONE_TYPE_EID: return GATTLIB_EDDYSTONE_TYPE_EID;
+	default:                 return 0;
+	}
+}
+
+/*
+ * Return the Eddystone Service Data of the advertisement if its frame type has been selected
+ */
+static const gattlib_advertisement_data_t *get_eddystone_service_data(const gattlib_advertisement_t *advertisement,
+		uint32_t eddystone_types)
+{
+	for (size_t i = 0; i < advertisement->service_data_count; i++) {
+		const gattlib_advertisement_data_t *service_data = &advertisement->service_data[i];
+
+		if ((service_data->data_length == 0) ||
+		    (gattlib_uuid_cmp(&service_data->uuid, &gattlib_eddystone_common_data_uuid) != 0)) {
+			continue;
+		}
+
+		if (eddystone_frame_type_mask(service_data->data[0]) & eddystone_types) {
+			return service_data;
+		} else {
+			return NULL;
+		}
+	}
+
+	return NULL;
+}
 
 struct on_eddystone_discovered_device_arg {
+	uint32_t eddystone_types;
 	gattlib_discovered_device_with_data_t discovered_device_cb;
+	gattlib_discovered_eddystone_t discovered_eddystone_cb;
+	GHashTable *reported_devices;  // Devices already passed to 'discovered_device_cb'
 	void *user_data;
 };
 
-static void on_eddystone_discovered_device(void *adapter, const char* addr, const char* name, void *user_data)
+static void on_eddystone_discovered_advertisement(void *adapter, const gattlib_advertisement_t *advertisement, void *user_data)
 {
 	struct on_eddystone_discovered_device_arg *callback_data = user_data;
-	gattlib_advertisement_data_t *advertisement_data;
-	size_t advertisement_data_count;
-	uint16_t manufacturer_id;
-	uint8_t *manufacturer_data;
-	size_t manufacturer_data_size;
-	int ret;
+	const gattlib_advertisement_data_t *service_data;
 
-	ret = gattlib_get_advertisement_data_from_mac(adapter, addr,
-			&advertisement_data, &advertisement_data_count,
-			&manufacturer_id, &manufacturer_data, &manufacturer_data_size);
-	if (ret != 0) {
+	service_data = get_eddystone_service_data(advertisement, callback_data->eddystone_types);
+	if (service_data == NULL) {
 		return;
 	}
 
-	callback_data->discovered_device_cb(adapter, addr, name,
-			advertisement_data, advertisement_data_count,
-			manufacturer_id, manufacturer_data, manufacturer_data_size,
-			callback_data->user_data);
-}
+	if (callback_data->discovered_eddystone_cb) {
+		gattlib_eddystone_frame_t frame;
 
-int gattlib_adapter_scan_eddystone(void *adapter, int16_t rssi_threshold, uint32_t eddystone_types,
-		gattlib_discovered_device_with_data_t discovered_device_cb, size_t timeout, void *user_data)
-{
-	uuid_t eddystone_uuid;
-	uint32_t enabled_filters = GATTLIB_DISCOVER_FILTER_USE_UUID;
-	int ret;
+		if (gattlib_eddystone_parse_frame(service_data->data, service_data->data_length, &frame) != GATTLIB_SUCCESS) {
+			return;
+		}
 
-	ret = gattlib_string_to_uuid(EDDYSTONE_SERVICE_UUID, strlen(EDDYSTONE_SERVICE_UUID) + 1, &eddystone_uuid);
-	if (ret != 0) {
-		fprintf(stderr, "Fail to convert characteristic TX to UUID.\n");
-		return GATTLIB_ERROR_INTERNAL;
+		callback_data->discovered_eddystone_cb(adapter, advertisement, &frame, callback_data->user_data);
+	} else {
+		const gattlib_manufacturer_data_t *manufacturer_data = NULL;
+		gint64 key = (gint64)gattlib_bdaddr_to_uint64(&advertisement->addr);
+		char addr[18];
+
+		// A device is only reported once as before the advertisement scans
+		if (g_hash_table_contains(callback_data->reported_devices, &key)) {
+			return;
+		}
+		gint64 *new_key = g_new(gint64, 1);
+		*new_key = key;
+		g_hash_table_add(callback_data->reported_devices, new_key);
+
+		if (advertisement->manufacturer_data_count > 0) {
+			manufacturer_data = &advertisement->manufacturer_data[0];
+		}
+
+		ba2str(&advertisement->addr, addr);
+
+		callback_data->discovered_device_cb(adapter, addr, advertisement->name,
+				(gattlib_advertisement_data_t*)advertisement->service_data, advertisement->service_data_count,
+				manufacturer_data ? manufacturer_data->manufacturer_id : 0,
+				manufacturer_data ? (uint8_t*)manufacturer_data->data : NULL,
+				manufacturer_data ? manufacturer_data->data_length : 0,
+				callback_data->user_data);
 	}
+}
 
+static int scan_eddystone(void *adapter, int16_t rssi_threshold, struct on_eddystone_discovered_device_arg *callback_data,
+		size_t timeout)
+{
+	uuid_t eddystone_uuid = gattlib_eddystone_common_data_uuid;
 	uuid_t *uuid_filter_list[] = { &eddystone_uuid, NULL };
+	uint32_t enabled_filters = GATTLIB_DISCOVER_FILTER_USE_UUID;
 
-	if (eddystone_types & GATTLIB_EDDYSTONE_LIMIT_RSSI) {
+	if (callback_data->eddystone_types & GATTLIB_EDDYSTONE_LIMIT_RSSI) {
 		enabled_filters |= GATTLIB_DISCOVER_FILTER_USE_RSSI;
 	}
 
+	// The advertisements carry the Service Data. There is no need to query each device.
+	return gattlib_adapter_scan_advertisements(adapter, uuid_filter_list, rssi_threshold, enabled_filters,
+			on_eddystone_discovered_advertisement, timeout, callback_data);
+}
+
+int gattlib_adapter_scan_eddystone(void *adapter, int16_t rssi_threshold, uint32_t eddystone_types,
+		gattlib_discovered_device_with_data_t discovered_device_cb, size_t timeout, void *user_data)
+{
 	struct on_eddystone_discovered_device_arg callback_data = {
+			.eddystone_types = eddystone_types,
 			.discovered_device_cb = discovered_device_cb,
+			.reported_devices = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL),
 			.user_data = user_data
 	};
+	int ret;
+
+	ret = scan_eddystone(adapter, rssi_threshold, &callback_data, timeout);
+
+	g_hash_table_destroy(callback_data.reported_devices);
+	return ret;
+}
+
+int gattlib_adapter_scan_eddystone_frames(void *adapter, int16_t rssi_threshold, uint32_t eddystone_types,
+		gattlib_discovered_eddystone_t discovered_eddystone_cb, size_t timeout, void *user_data)
+{
+	struct on_eddystone_discovered_device_arg callback_data = {
+			.eddystone_types = eddystone_types,
+			.discovered_eddystone_cb = discovered_eddystone_cb,
+			.user_data = user_data
+	};
+
+	if (discovered_eddystone_cb == NULL) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
 
-	return gattlib_adapter_scan_enable_with_filter(adapter, uuid_filter_list, rssi_threshold, enabled_filters,
-			on_eddystone_discovered_device, timeout, &callback_data);
+	return scan_eddystone(adapter, rssi_threshold, &callback_data, timeout);
 }
@@ -0,0 +1,257 @@
+/*
+ * Integration of the gattlib main context into an external event loop
+ *
+ * The file descriptors and the timeout of the GLib main context used by gattlib are mirrored
+ * into an epoll instance. A timerfd added to the same epoll instance expires with the timeout of
+ * the main context. The epoll file descriptor therefore becomes readable whenever the main
+ * context has something to dispatch.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "gattlib_internal.h"
+
+/* Maximum number of sources dispatched on each call of gattlib_dispatch() */
+#define EVENT_LOOP_MAX_ITERATIONS  16
+
+struct event_loop_fd {
+	int fd;
+	uint32_t events;
+};
+
+struct event_loop {
+	GMainContext *context;
+	int epoll_fd;
+	int timer_fd;
+
+	// File descriptors returned by g_main_context_query()
+	GPollFD *poll_fds;
+	gint poll_fd_allocated;
+
+	// File descriptors currently registered in 'epoll_fd' (one entry per file descriptor)
+	struct event_loop_fd *fds;
+	size_t fd_count;
+};
+
+static struct event_loop m_event_loop = { .epoll_fd = -1, .timer_fd = -1 };
+
+static uint32_t glib_to_epoll_events(gushort events) {
+	uint32_t epoll_events = 0;
+
+	if (events & G_IO_IN) {
+		epoll_events |= EPOLLIN;
+	}
+	if (events & G_IO_OUT) {
+		epoll_events |= EPOLLOUT;
+	}
+	if (events & G_IO_PRI) {
+		epoll_events |= EPOLLPRI;
+	}
+	return epoll_events;
+}
+
+static struct event_loop_fd *find_fd(struct event_loop_fd *fds, size_t count, int fd) {
+	for (size_t i = 0; i < count; i++) {
+		if (fds[i].fd == fd) {
+			return &fds[i];
+		}
+	}
+	return NULL;
+}
+
+static int epoll_update(int epoll_fd, int op, int fd, uint32_t events) {
+	struct epoll_event event = { .events = events, .data.fd = fd };
+
+	if (epoll_ctl(epoll_fd, op, fd, &event) < 0) {
+		fprintf(stderr, "Failed to update the gattlib poll file descriptor: %s\n", strerror(errno));
+		return GATTLIB_ERROR_INTERNAL;
+	}
+	return GATTLIB_SUCCESS;
+}
+
+/*
+ * Mirror the file descriptors and the timeout of the main context into the epoll instance.
+ * The caller must own the main context.
+ */
+static int event_loop_sync(struct event_loop *loop) {
+	struct itimerspec timer = { { 0, 0 }, { 0, 0 } };
+	struct event_loop_fd *fds;
+	size_t fd_count = 0;
+	gint max_priority, timeout, n_fds;
+	int ret = GATTLIB_SUCCESS;
+
+	g_main_context_prepare(loop->context, &max_priority);
+
+	while (1) {
+		n_fds = g_main_context_query(loop->context, max_priority, &timeout, loop->poll_fds, loop->poll_fd_allocated);
+		if (n_fds <= loop->poll_fd_allocated) {
+			break;
+		}
+
+		GPollFD *poll_fds = realloc(loop->poll_fds, n_fds * sizeof(GPollFD));
+		if (poll_fds == NULL) {
+			return GATTLIB_OUT_OF_MEMORY;
+		}
+		loop->poll_fds = poll_fds;
+		loop->poll_fd_allocated = n_fds;
+	}
+
+	// Merge the entries sharing the same file descriptor. epoll only accepts a file descriptor once.
+	fds = malloc((n_fds > 0 ? n_fds : 1) * sizeof(struct event_loop_fd));
+	if (fds == NULL) {
+		return GATTLIB_OUT_OF_MEMORY;
+	}
+
+	for (gint i = 0; i < n_fds; i++) {
+		struct event_loop_fd *entry = find_fd(fds, fd_count, loop->poll_fds[i].fd);
+		if (entry == NULL) {
+			entry = &fds[fd_count++];
+			entry->fd = loop->poll_fds[i].fd;
+			entry->events = 0;
+		}
+		entry->events |= glib_to_epoll_events(loop->poll_fds[i].events);
+	}
+
+	// Only apply the differences with the registered file descriptors
+	for (size_t i = 0; i < loop->fd_count; i++) {
+		if (find_fd(fds, fd_count, loop->fds[i].fd) == NULL) {
+			// The file descriptor might have already been closed. It is then implicitly removed from epoll.
+			epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, loop->fds[i].fd, NULL);
+		}
+	}
+
+	for (size_t i = 0; (i < fd_count) && (ret == GATTLIB_SUCCESS); i++) {
+		struct event_loop_fd *registered = find_fd(loop->fds, loop->fd_count, fds[i].fd);
+
+		if (registered == NULL) {
+			ret = epoll_update(loop->epoll_fd, EPOLL_CTL_ADD, fds[i].fd, fds[i].events);
+		} else if (registered->events != fds[i].events) {
+			ret = epoll_update(loop->epoll_fd, EPOLL_CTL_MOD, fds[i].fd, fds[i].events);
+		}
+	}
+
+	free(loop->fds);
+	loop->fds = fds;
+	loop->fd_count = fd_count;
+
+	// A timeout of 0 means a source is ready: the timer expires immediately
+	if (timeout == 0) {
+		timer.it_value.tv_nsec = 1;
+	} else if (timeout > 0) {
+		timer.it_value.tv_sec = timeout / 1000;
+		timer.it_value.tv_nsec = (timeout % 1000) * 1000000;
+	}
+	timerfd_settime(loop->timer_fd, 0, &timer, NULL);
+
+	return ret;
+}
+
+int gattlib_get_pollfd(int *fd) {
+	struct event_loop *loop = &m_event_loop;
+	GMainContext *context;
+	int ret;
+
+	if (fd == NULL) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	if (loop->epoll_fd >= 0) {
+		*fd = loop->epoll_fd;
+		return GATTLIB_SUCCESS;
+	}
+
+	context = gattlib_get_main_context();
+	if (context == NULL) {
+		// The events are already dispatched by an internal thread
+		return GATTLIB_NOT_SUPPORTED;
+	}
+
+	if (!g_main_context_acquire(context)) {
+		fprintf(stderr, "The gattlib main context is owned by another thread.\n");
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	loop->context = context;
+	loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if ((loop->epoll_fd < 0) || (loop->timer_fd < 0)) {
+		fprintf(stderr, "Failed to create the gattlib poll file descriptor: %s\n", strerror(errno));
+		ret = GATTLIB_ERROR_INTERNAL;
+		goto ERROR;
+	}
+
+	ret = epoll_update(loop->epoll_fd, EPOLL_CTL_ADD, loop->timer_fd, EPOLLIN);
+	if (ret != GATTLIB_SUCCESS) {
+		goto ERROR;
+	}
+
+	ret = event_loop_sync(loop);
+	if (ret != GATTLIB_SUCCESS) {
+		goto ERROR;
+	}
+
+	g_main_context_release(context);
+
+	*fd = loop->epoll_fd;
+	return GATTLIB_SUCCESS;
+
+ERROR:
+	g_main_context_release(context);
+	if (loop->epoll_fd >= 0) {
+		close(loop->epoll_fd);
+	}
+	if (loop->timer_fd >= 0) {
+		close(loop->timer_fd);
+	}
+	free(loop->poll_fds);
+	free(loop->fds);
+	memset(loop, 0, sizeof(*loop));
+	loop->epoll_fd = -1;
+	loop->timer_fd = -1;
+	return ret;
+}
+
+int gattlib_dispatch(int timeout_ms) {
+	struct event_loop *loop = &m_event_loop;
+	uint64_t expirations;
+	int ret;
+
+	if (loop->epoll_fd < 0) {
+		// gattlib_get_pollfd() has not been called
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	if (timeout_ms != 0) {
+		struct epoll_event event;
+
+		if ((epoll_wait(loop->epoll_fd, &event, 1, timeout_ms) < 0) && (errno != EINTR)) {
+			return GATTLIB_ERROR_INTERNAL;
+		}
+	}
+
+	// Acknowledge the expiration of the timer. It is re-armed below.
+	if (read(loop->timer_fd, &expirations, sizeof(expirations)) < 0) {
+		// Timer has not expired
+	}
+
+	if (!g_main_context_acquire(loop->context)) {
+		fprintf(stderr, "The gattlib main context is owned by another thread.\n");
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	for (int i = 0; i < EVENT_LOOP_MAX_ITERATIONS; i++) {
+		if (!g_main_context_iteration(loop->context, FALSE)) {
+			break;
+		}
+	}
+
+	ret = event_loop_sync(loop);
+
+	g_main_context_release(loop->context);
+	return ret;
+}
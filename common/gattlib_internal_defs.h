@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 
+#include <glib.h>
+
 #include "gattlib.h"
 
 enum handler_type { UNKNOWN = 0, NATIVE_NOTIFICATION, NATIVE_DISCONNECTION, PYTHON };
@@ -29,4 +31,103 @@ bool gattlib_has_valid_handler(struct gattlib_handler *handler);
 void gattlib_call_disconnection_handler(struct gattlib_handler *handler);
 void gattlib_call_notification_handler(struct gattlib_handler *handler, const uuid_t* uuid, const uint8_t* data, size_t data_length);
 
+#define GATTLIB_ADVERTISEMENT_MAX_UUIDS              32
+#define GATTLIB_ADVERTISEMENT_MAX_SERVICE_DATA       8
+#define GATTLIB_ADVERTISEMENT_MAX_MANUFACTURER_DATA  8
+#define GATTLIB_ADVERTISEMENT_MAX_NAME               248
+
+/*
+ * Scratch memory used to build an advertisement record. The arrays of the record use the inline
+ * arrays of the storage and only move to the heap when an advertisement has more entries.
+ */
+struct gattlib_advertisement_storage {
+	gattlib_advertisement_t      advertisement;
+
+	uuid_t                       service_uuids[GATTLIB_ADVERTISEMENT_MAX_UUIDS];
+	gattlib_advertisement_data_t service_data[GATTLIB_ADVERTISEMENT_MAX_SERVICE_DATA];
+	gattlib_manufacturer_data_t  manufacturer_data[GATTLIB_ADVERTISEMENT_MAX_MANUFACTURER_DATA];
+	char                         name[GATTLIB_ADVERTISEMENT_MAX_NAME + 1];
+
+	size_t                       service_uuid_capacity;
+	size_t                       service_data_capacity;
+	size_t                       manufacturer_data_capacity;
+};
+
+void gattlib_advertisement_storage_init(struct gattlib_advertisement_storage *storage);
+/*
+ * Free the arrays moved to the heap. A storage initialized or zeroed can be released.
+ */
+void gattlib_advertisement_storage_release(struct gattlib_advertisement_storage *storage);
+void gattlib_advertisement_add_service_uuid(struct gattlib_advertisement_storage *storage, const uuid_t *uuid);
+void gattlib_advertisement_add_service_data(struct gattlib_advertisement_storage *storage, const uuid_t *uuid,
+		const uint8_t *data, size_t data_length);
+void gattlib_advertisement_add_manufacturer_data(struct gattlib_advertisement_storage *storage, uint16_t manufacturer_id,
+		const uint8_t *data, size_t data_length);
+void gattlib_advertisement_set_name(struct gattlib_advertisement_storage *storage, const char *name, size_t name_length);
+
+/*
+ * Parse the advertising data (AD structures) of a BLE advertisement into the storage.
+ * Data pointers of the record point into 'data'.
+ */
+int gattlib_advertisement_parse(const uint8_t *data, size_t size, struct gattlib_advertisement_storage *storage);
+
+/*
+ * Return true if the advertisement contains one of the UUIDs of the NULL-terminated list either
+ * as a Service UUID or as the UUID of a Service Data
+ */
+bool gattlib_advertisement_match_uuid(const gattlib_advertisement_t *advertisement, uuid_t **uuid_list);
+
+/*
+ * Copy the advertisement record and all the data it points to into a single allocation.
+ * The copy is released with gattlib_advertisement_free().
+ */
+gattlib_advertisement_t *gattlib_advertisement_dup(const gattlib_advertisement_t *advertisement);
+
+/*
+ * Advertisement match rules compiled by gattlib_match_compile() (see gattlib_match.c)
+ */
+struct gattlib_match_program;
+
+int gattlib_match_compile(const char *rules, struct gattlib_match_program **program);
+void gattlib_match_free(struct gattlib_match_program *program);
+
+/*
+ * Return true if the advertisement is accepted by one of the rules. The rule counters are updated.
+ */
+bool gattlib_match_eval(struct gattlib_match_program *program, const gattlib_advertisement_t *advertisement);
+
+/*
+ * Per-device scan cache used to only report the advertisements that changed (see gattlib_scan_cache.c).
+ * Times are in milliseconds from a monotonic clock.
+ */
+struct gattlib_scan_cache;
+
+struct gattlib_scan_cache *gattlib_scan_cache_new(uint8_t rssi_delta, uint32_t ttl);
+void gattlib_scan_cache_free(struct gattlib_scan_cache *cache);
+void gattlib_scan_cache_clear(struct gattlib_scan_cache *cache);
+
+/*
+ * Return true if the advertisement must be reported: new device, payload change, RSSI change
+ * above the threshold or device back after having expired.
+ */
+bool gattlib_scan_cache_update(struct gattlib_scan_cache *cache, const gattlib_advertisement_t *advertisement, int64_t now);
+
+/*
+ * Period (in ms) gattlib_scan_cache_expire() must be called with. 0 if the devices never expire.
+ */
+uint32_t gattlib_scan_cache_expire_period(struct gattlib_scan_cache *cache);
+
+/*
+ * Remove the devices not seen for the TTL and report them with 'device_lost_cb'. The devices are
+ * reported once the cache is updated: the callback can free the cache. 'cache' can be NULL.
+ */
+void gattlib_scan_cache_expire(struct gattlib_scan_cache *cache, int64_t now,
+		gattlib_device_lost_t device_lost_cb, void *adapter, void *user_data);
+
+/*
+ * Main context dispatched by gattlib_dispatch(). NULL if the backend already dispatches its events
+ * from an internal thread.
+ */
+GMainContext *gattlib_get_main_context(void);
+
 #endif
@@ -0,0 +1,446 @@
+/*
+ * Advertisement match rules
+ *
+ * The rules are compiled into a flat list of instructions. A rule is a list of instructions that
+ * must all succeed (AND). The advertisement is accepted by the first rule that succeeds (OR).
+ *
+ * Rule syntax: rules are separated by ';' or new lines, terms by spaces. A term prefixed by '!' is negated.
+ *
+ *   rssi>=<dBm>, rssi<=<dBm>         RSSI bounds
+ *   uuid=<uuid>                      Advertised Service UUID or Service Data UUID
+ *   name=<pattern>                   Name matching the shell wildcard pattern (see fnmatch())
+ *   mfg=<id>[:<hex prefix>]          Manufacturer Specific Data with optional payload prefix
+ *   ibeacon                          Apple iBeacon advertisement
+ *   ibeacon.uuid=<uuid>              iBeacon Proximity UUID
+ *   ibeacon.major=<min>[-<max>]      iBeacon Major range
+ *   ibeacon.minor=<min>[-<max>]      iBeacon Minor range
+ *
+ * Example: "ibeacon.major=100-199 rssi>=-80; mfg=0x0059:0102; name=Sensor-*"
+ */
+
+#include <ctype.h>
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gattlib_internal.h"
+
+#define MATCH_RULE_SEPARATORS  ";\n"
+#define MATCH_TERM_SEPARATORS  " \t\r"
+
+/* Maximum length of a payload prefix of a 'mfg=' term */
+#define MATCH_MAX_PREFIX_LENGTH  27
+
+/* iBeacon: Apple Company Identifier followed by the type 0x02 and the length 0x15 */
+#define IBEACON_MANUFACTURER_ID  0x004C
+#define IBEACON_DATA_LENGTH      23
+
+enum match_opcode {
+	MATCH_OP_RSSI_MIN,
+	MATCH_OP_RSSI_MAX,
+	MATCH_OP_UUID,
+	MATCH_OP_NAME,
+	MATCH_OP_MANUFACTURER,
+	MATCH_OP_IBEACON,
+	MATCH_OP_IBEACON_UUID,
+	MATCH_OP_IBEACON_MAJOR,
+	MATCH_OP_IBEACON_MINOR,
+};
+
+struct match_insn {
+	uint8_t opcode;
+	bool    negate;
+	union {
+		int16_t rssi;
+		uuid_t  uuid;
+		uint8_t ibeacon_uuid[16];
+		const char *name_pattern;
+		struct {
+			uint16_t min;
+			uint16_t max;
+		} range;
+		struct {
+			uint16_t id;
+			uint8_t  prefix_length;
+			uint8_t  prefix[MATCH_MAX_PREFIX_LENGTH];
+		} manufacturer;
+	};
+};
+
+struct match_rule {
+	size_t first_insn;
+	size_t insn_count;
+	gattlib_match_rule_stats_t stats;
+};
+
+struct gattlib_match_program {
+	struct match_insn *insns;
+	size_t insn_count;
+	struct match_rule *rules;
+	size_t rule_count;
+
+	// Copy of the rule source. The name patterns point into it.
+	char *source;
+};
+
+static int parse_hex(const char *str, uint8_t *buffer, size_t buffer_size, size_t *length) {
+	size_t str_length = strlen(str);
+
+	if ((str_length % 2 != 0) || (str_length / 2 > buffer_size)) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	for (size_t i = 0; i < str_length; i += 2) {
+		char byte_str[3] = { str[i], str[i + 1], '\0' };
+
+		if (!isxdigit((unsigned char)byte_str[0]) || !isxdigit((unsigned char)byte_str[1])) {
+			return GATTLIB_INVALID_PARAMETER;
+		}
+		buffer[i / 2] = strtoul(byte_str, NULL, 16);
+	}
+
+	*length = str_length / 2;
+	return GATTLIB_SUCCESS;
+}
+
+static int parse_number(const char *str, long min, long max, long *value) {
+	char *end;
+
+	*value = strtol(str, &end, 0);
+	if ((end == str) || (*end != '\0') || (*value < min) || (*value > max)) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+	return GATTLIB_SUCCESS;
+}
+
+static int parse_range(char *str, struct match_insn *insn) {
+	char *separator = strchr(str + 1, '-');
+	long min, max;
+
+	if (separator != NULL) {
+		*separator = '\0';
+		if ((parse_number(str, 0, 0xFFFF, &min) != GATTLIB_SUCCESS) ||
+		    (parse_number(separator + 1, min, 0xFFFF, &max) != GATTLIB_SUCCESS)) {
+			return GATTLIB_INVALID_PARAMETER;
+		}
+	} else {
+		if (parse_number(str, 0, 0xFFFF, &min) != GATTLIB_SUCCESS) {
+			return GATTLIB_INVALID_PARAMETER;
+		}
+		max = min;
+	}
+
+	insn->range.min = min;
+	insn->range.max = max;
+	return GATTLIB_SUCCESS;
+}
+
+static int compile_term(char *term, struct match_insn *insn) {
+	char *value;
+	long number;
+
+	memset(insn, 0, sizeof(*insn));
+
+	if (term[0] == '!') {
+		insn->negate = true;
+		term++;
+	}
+
+	if (strncmp(term, "rssi>=", 6) == 0) {
+		insn->opcode = MATCH_OP_RSSI_MIN;
+		value = term + 6;
+	} else if (strncmp(term, "rssi<=", 6) == 0) {
+		insn->opcode = MATCH_OP_RSSI_MAX;
+		value = term + 6;
+	} else if (strcmp(term, "ibeacon") == 0) {
+		insn->opcode = MATCH_OP_IBEACON;
+		return GATTLIB_SUCCESS;
+	} else {
+		value = strchr(term, '=');
+		if (value == NULL) {
+			return GATTLIB_INVALID_PARAMETER;
+		}
+		*value++ = '\0';
+
+		if (strcmp(term, "uuid") == 0) {
+			insn->opcode = MATCH_OP_UUID;
+		} else if (strcmp(term, "name") == 0) {
+			insn->opcode = MATCH_OP_NAME;
+		} else if (strcmp(term, "mfg") == 0) {
+			insn->opcode = MATCH_OP_MANUFACTURER;
+		} else if (strcmp(term, "ibeacon.uuid") == 0) {
+			insn->opcode = MATCH_OP_IBEACON_UUID;
+		} else if (strcmp(term, "ibeacon.major") == 0) {
+			insn->opcode = MATCH_OP_IBEACON_MAJOR;
+		} else if (strcmp(term, "ibeacon.minor") == 0) {
+			insn->opcode = MATCH_OP_IBEACON_MINOR;
+		} else {
+			return GATTLIB_INVALID_PARAMETER;
+		}
+	}
+
+	switch (insn->opcode) {
+	case MATCH_OP_RSSI_MIN:
+	case MATCH_OP_RSSI_MAX:
+		if (parse_number(value, -128, 127, &number) != GATTLIB_SUCCESS) {
+			return GATTLIB_INVALID_PARAMETER;
+		}
+		insn->rssi = number;
+		return GATTLIB_SUCCESS;
+	case MATCH_OP_UUID:
+		return gattlib_string_to_uuid(value, strlen(value) + 1, &insn->uuid) == 0 ? GATTLIB_SUCCESS : GATTLIB_INVALID_PARAMETER;
+	case MATCH_OP_NAME:
+		insn->name_pattern = value;
+		return GATTLIB_SUCCESS;
+	case MATCH_OP_MANUFACTURER: {
+		char *prefix = strchr(value, ':');
+		size_t prefix_length = 0;
+
+		if (prefix != NULL) {
+			*prefix++ = '\0';
+			if (parse_hex(prefix, insn->manufacturer.prefix, sizeof(insn->manufacturer.prefix), &prefix_length) != GATTLIB_SUCCESS) {
+				return GATTLIB_INVALID_PARAMETER;
+			}
+		}
+		if (parse_number(value, 0, 0xFFFF, &number) != GATTLIB_SUCCESS) {
+			return GATTLIB_INVALID_PARAMETER;
+		}
+		insn->manufacturer.id = number;
+		insn->manufacturer.prefix_length = prefix_length;
+		return GATTLIB_SUCCESS;
+	}
+	case MATCH_OP_IBEACON_UUID: {
+		uuid_t uuid;
+
+		if ((gattlib_string_to_uuid(value, strlen(value) + 1, &uuid) != 0) || (uuid.type != SDP_UUID128)) {
+			return GATTLIB_INVALID_PARAMETER;
+		}
+		// The Proximity UUID is transmitted in big-endian like 'uuid_t' stores it
+		memcpy(insn->ibeacon_uuid, &uuid.value.uuid128, sizeof(insn->ibeacon_uuid));
+		return GATTLIB_SUCCESS;
+	}
+	case MATCH_OP_IBEACON_MAJOR:
+	case MATCH_OP_IBEACON_MINOR:
+		return parse_range(value, insn);
+	default:
+		return GATTLIB_INVALID_PARAMETER;
+	}
+}
+
+void gattlib_match_free(struct gattlib_match_program *program) {
+	if (program == NULL) {
+		return;
+	}
+
+	free(program->insns);
+	free(program->rules);
+	free(program->source);
+	free(program);
+}
+
+int gattlib_match_compile(const char *rules, struct gattlib_match_program **program) {
+	struct gattlib_match_program *new_program;
+	char *rule_saveptr, *rule;
+	size_t max_terms = 1, max_rules = 1;
+	int ret = GATTLIB_SUCCESS;
+
+	new_program = calloc(1, sizeof(struct gattlib_match_program));
+	if (new_program == NULL) {
+		return GATTLIB_OUT_OF_MEMORY;
+	}
+
+	new_program->source = strdup(rules);
+	if (new_program->source == NULL) {
+		ret = GATTLIB_OUT_OF_MEMORY;
+		goto ERROR;
+	}
+
+	// Upper bounds of the number of terms and rules
+	for (const char *c = rules; *c != '\0'; c++) {
+		if (strchr(MATCH_TERM_SEPARATORS, *c)) {
+			max_terms++;
+		} else if (strchr(MATCH_RULE_SEPARATORS, *c)) {
+			max_terms++;
+			max_rules++;
+		}
+	}
+
+	new_program->insns = calloc(max_terms, sizeof(struct match_insn));
+	new_program->rules = calloc(max_rules, sizeof(struct match_rule));
+	if ((new_program->insns == NULL) || (new_program->rules == NULL)) {
+		ret = GATTLIB_OUT_OF_MEMORY;
+		goto ERROR;
+	}
+
+	for (rule = strtok_r(new_program->source, MATCH_RULE_SEPARATORS, &rule_saveptr); rule != NULL;
+	     rule = strtok_r(NULL, MATCH_RULE_SEPARATORS, &rule_saveptr))
+	{
+		struct match_rule *match_rule = &new_program->rules[new_program->rule_count];
+		char *term_saveptr, *term;
+
+		match_rule->first_insn = new_program->insn_count;
+
+		for (term = strtok_r(rule, MATCH_TERM_SEPARATORS, &term_saveptr); term != NULL;
+		     term = strtok_r(NULL, MATCH_TERM_SEPARATORS, &term_saveptr))
+		{
+			if (compile_term(term, &new_program->insns[new_program->insn_count]) != GATTLIB_SUCCESS) {
+				// The term has been modified by the parser. Report the original text of the term only.
+				const char *original = rules + (term - new_program->source);
+
+				fprintf(stderr, "Invalid match rule at offset %zu: '%.*s'\n",
+						(size_t)(term - new_program->source),
+						(int)strcspn(original, MATCH_TERM_SEPARATORS MATCH_RULE_SEPARATORS), original);
+				ret = GATTLIB_INVALID_PARAMETER;
+				goto ERROR;
+			}
+			new_program->insn_count++;
+			match_rule->insn_count++;
+		}
+
+		// Ignore empty rules
+		if (match_rule->insn_count > 0) {
+			new_program->rule_count++;
+		}
+	}
+
+	*program = new_program;
+	return GATTLIB_SUCCESS;
+
+ERROR:
+	gattlib_match_free(new_program);
+	return ret;
+}
+
+static const uint8_t *get_manufacturer_data(const gattlib_advertisement_t *advertisement, uint16_t manufacturer_id, size_t *length) {
+	for (size_t i = 0; i < advertisement->manufacturer_data_count; i++) {
+		if (advertisement->manufacturer_data[i].manufacturer_id == manufacturer_id) {
+			*length = advertisement->manufacturer_data[i].data_length;
+			return advertisement->manufacturer_data[i].data;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Return the iBeacon payload following the type and the length: Proximity UUID, Major, Minor and TX Power
+ */
+static const uint8_t *get_ibeacon(const gattlib_advertisement_t *advertisement) {
+	size_t length;
+	const uint8_t *data = get_manufacturer_data(advertisement, IBEACON_MANUFACTURER_ID, &length);
+
+	if ((data == NULL) || (length < IBEACON_DATA_LENGTH) || (data[0] != 0x02) || (data[1] != 0x15)) {
+		return NULL;
+	}
+	return data + 2;
+}
+
+static bool match_insn(const struct match_insn *insn, const gattlib_advertisement_t *advertisement) {
+	const uint8_t *ibeacon;
+	uint16_t value;
+
+	switch (insn->opcode) {
+	case MATCH_OP_RSSI_MIN:
+		return (advertisement->present & GATTLIB_ADVERTISEMENT_HAS_RSSI) && (advertisement->rssi >= insn->rssi);
+	case MATCH_OP_RSSI_MAX:
+		return (advertisement->present & GATTLIB_ADVERTISEMENT_HAS_RSSI) && (advertisement->rssi <= insn->rssi);
+	case MATCH_OP_UUID: {
+		uuid_t uuid = insn->uuid;
+		uuid_t *uuid_list[] = { &uuid, NULL };
+		return gattlib_advertisement_match_uuid(advertisement, uuid_list);
+	}
+	case MATCH_OP_NAME:
+		return (advertisement->name != NULL) && (fnmatch(insn->name_pattern, advertisement->name, 0) == 0);
+	case MATCH_OP_MANUFACTURER: {
+		size_t length;
+		const uint8_t *data = get_manufacturer_data(advertisement, insn->manufacturer.id, &length);
+
+		return (data != NULL) && (length >= insn->manufacturer.prefix_length) &&
+		       (memcmp(data, insn->manufacturer.prefix, insn->manufacturer.prefix_length) == 0);
+	}
+	case MATCH_OP_IBEACON:
+		return get_ibeacon(advertisement) != NULL;
+	case MATCH_OP_IBEACON_UUID:
+		ibeacon = get_ibeacon(advertisement);
+		return (ibeacon != NULL) && (memcmp(ibeacon, insn->ibeacon_uuid, sizeof(insn->ibeacon_uuid)) == 0);
+	case MATCH_OP_IBEACON_MAJOR:
+	case MATCH_OP_IBEACON_MINOR:
+		ibeacon = get_ibeacon(advertisement);
+		if (ibeacon == NULL) {
+			return false;
+		}
+		// Major and Minor are big-endian and follow the 16-byte Proximity UUID
+		ibeacon += (insn->opcode == MATCH_OP_IBEACON_MAJOR) ? 16 : 18;
+		value = (ibeacon[0] << 8) | ibeacon[1];
+		return (value >= insn->range.min) && (value <= insn->range.max);
+	default:
+		return false;
+	}
+}
+
+bool gattlib_match_eval(struct gattlib_match_program *program, const gattlib_advertisement_t *advertisement) {
+	for (size_t i = 0; i < program->rule_count; i++) {
+		struct match_rule *rule = &program->rules[i];
+		const struct match_insn *insn = &program->insns[rule->first_insn];
+		const struct match_insn *end = insn + rule->insn_count;
+
+		for (; insn < end; insn++) {
+			if (match_insn(insn, advertisement) == insn->negate) {
+				break;
+			}
+		}
+
+		if (insn == end) {
+			rule->stats.accepted++;
+			return true;
+		}
+		rule->stats.rejected++;
+	}
+
+	// A program without any rule accepts everything
+	return program->rule_count == 0;
+}
+
+int gattlib_adapter_scan_set_match_rules(void *adapter, const char *rules) {
+	struct gattlib_adapter *gattlib_adapter = adapter;
+	struct gattlib_match_program *program = NULL;
+	int ret;
+
+	if (gattlib_adapter == NULL) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	if (rules != NULL) {
+		ret = gattlib_match_compile(rules, &program);
+		if (ret != GATTLIB_SUCCESS) {
+			return ret;
+		}
+	}
+
+	gattlib_match_free(gattlib_adapter->match_program);
+	gattlib_adapter->match_program = program;
+	return GATTLIB_SUCCESS;
+}
+
+int gattlib_adapter_scan_get_match_rule_stats(void *adapter, gattlib_match_rule_stats_t *stats, size_t *stats_count) {
+	struct gattlib_adapter *gattlib_adapter = adapter;
+	struct gattlib_match_program *program;
+	size_t count;
+
+	if ((gattlib_adapter == NULL) || (stats_count == NULL) || ((stats == NULL) && (*stats_count > 0))) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	program = gattlib_adapter->match_program;
+	if (program == NULL) {
+		*stats_count = 0;
+		return GATTLIB_SUCCESS;
+	}
+
+	count = (*stats_count < program->rule_count) ? *stats_count : program->rule_count;
+	for (size_t i = 0; i < count; i++) {
+		stats[i] = program->rules[i].stats;
+	}
+
+	*stats_count = program->rule_count;
+	return GATTLIB_SUCCESS;
+}
@@ -0,0 +1,222 @@
+/*
+ * Scan cache used to only report the advertisements that changed
+ *
+ * The cache keeps, for each device, a digest of its advertisement payload, the last reported RSSI
+ * and the time it has been seen for the last time.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gattlib_internal.h"
+
+/* Minimum period (in ms) between two checks of the expired devices */
+#define SCAN_CACHE_MIN_EXPIRE_PERIOD  100
+
+#define FNV_OFFSET_BASIS  0xcbf29ce484222325ULL
+#define FNV_PRIME         0x100000001b3ULL
+
+struct scan_cache_entry {
+	gint64   key;           // 48-bit address. It must remain the first field (see g_int64_hash()).
+	bdaddr_t addr;
+	uint64_t digest;
+	int16_t  rssi;
+	bool     has_rssi;
+	int64_t  last_seen;
+};
+
+struct gattlib_scan_cache {
+	uint8_t  rssi_delta;
+	uint32_t ttl;
+	GHashTable *devices;
+};
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t length) {
+	const uint8_t *bytes = data;
+
+	for (size_t i = 0; i < length; i++) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+/*
+ * Hash the value of the UUID only. The padding of 'uuid_t' is not initialized.
+ */
+static uint64_t fnv1a_uuid(uint64_t hash, const uuid_t *uuid) {
+	hash = fnv1a(hash, &uuid->type, sizeof(uuid->type));
+	switch (uuid->type) {
+	case SDP_UUID16:
+		return fnv1a(hash, &uuid->value.uuid16, sizeof(uuid->value.uuid16));
+	case SDP_UUID32:
+		return fnv1a(hash, &uuid->value.uuid32, sizeof(uuid->value.uuid32));
+	default:
+		return fnv1a(hash, &uuid->value.uuid128, sizeof(uuid->value.uuid128));
+	}
+}
+
+/*
+ * Digest of the advertisement fields except the RSSI
+ */
+static uint64_t advertisement_digest(const gattlib_advertisement_t *advertisement) {
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	hash = fnv1a(hash, &advertisement->flags, sizeof(advertisement->flags));
+	hash = fnv1a(hash, &advertisement->tx_power, sizeof(advertisement->tx_power));
+	if (advertisement->name != NULL) {
+		hash = fnv1a(hash, advertisement->name, strlen(advertisement->name));
+	}
+	for (size_t i = 0; i < advertisement->service_uuid_count; i++) {
+		hash = fnv1a_uuid(hash, &advertisement->service_uuids[i]);
+	}
+	for (size_t i = 0; i < advertisement->service_data_count; i++) {
+		hash = fnv1a_uuid(hash, &advertisement->service_data[i].uuid);
+		hash = fnv1a(hash, advertisement->service_data[i].data, advertisement->service_data[i].data_length);
+	}
+	for (size_t i = 0; i < advertisement->manufacturer_data_count; i++) {
+		hash = fnv1a(hash, &advertisement->manufacturer_data[i].manufacturer_id, sizeof(uint16_t));
+		hash = fnv1a(hash, advertisement->manufacturer_data[i].data, advertisement->manufacturer_data[i].data_length);
+	}
+
+	return hash;
+}
+
+struct gattlib_scan_cache *gattlib_scan_cache_new(uint8_t rssi_delta, uint32_t ttl) {
+	struct gattlib_scan_cache *cache = calloc(1, sizeof(struct gattlib_scan_cache));
+	if (cache == NULL) {
+		return NULL;
+	}
+
+	cache->rssi_delta = rssi_delta;
+	cache->ttl = ttl;
+	cache->devices = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, free);
+	return cache;
+}
+
+void gattlib_scan_cache_free(struct gattlib_scan_cache *cache) {
+	if (cache == NULL) {
+		return;
+	}
+
+	g_hash_table_destroy(cache->devices);
+	free(cache);
+}
+
+void gattlib_scan_cache_clear(struct gattlib_scan_cache *cache) {
+	g_hash_table_remove_all(cache->devices);
+}
+
+uint32_t gattlib_scan_cache_expire_period(struct gattlib_scan_cache *cache) {
+	if (cache->ttl == 0) {
+		return 0;
+	} else if (cache->ttl / 2 < SCAN_CACHE_MIN_EXPIRE_PERIOD) {
+		return SCAN_CACHE_MIN_EXPIRE_PERIOD;
+	} else {
+		return cache->ttl / 2;
+	}
+}
+
+bool gattlib_scan_cache_update(struct gattlib_scan_cache *cache, const gattlib_advertisement_t *advertisement, int64_t now) {
+	gint64 key = (gint64)gattlib_bdaddr_to_uint64(&advertisement->addr);
+	bool has_rssi = (advertisement->present & GATTLIB_ADVERTISEMENT_HAS_RSSI) != 0;
+	struct scan_cache_entry *entry;
+	uint64_t digest = advertisement_digest(advertisement);
+	bool report;
+
+	entry = g_hash_table_lookup(cache->devices, &key);
+	if (entry == NULL) {
+		entry = malloc(sizeof(struct scan_cache_entry));
+		if (entry == NULL) {
+			// Better report too often than missing a device
+			return true;
+		}
+		entry->key = key;
+		bacpy(&entry->addr, &advertisement->addr);
+		g_hash_table_insert(cache->devices, &entry->key, entry);
+		report = true;
+	} else if ((cache->ttl > 0) && (now - entry->last_seen > cache->ttl)) {
+		// The device is back after having expired
+		report = true;
+	} else if (entry->digest != digest) {
+		report = true;
+	} else if ((cache->rssi_delta > 0) && has_rssi && entry->has_rssi &&
+	           (abs(advertisement->rssi - entry->rssi) >= cache->rssi_delta)) {
+		report = true;
+	} else {
+		report = false;
+	}
+
+	entry->last_seen = now;
+	if (report) {
+		entry->digest = digest;
+		entry->rssi = advertisement->rssi;
+		entry->has_rssi = has_rssi;
+	}
+
+	return report;
+}
+
+void gattlib_scan_cache_expire(struct gattlib_scan_cache *cache, int64_t now,
+		gattlib_device_lost_t device_lost_cb, void *adapter, void *user_data)
+{
+	GHashTableIter iter;
+	struct scan_cache_entry *entry;
+	GArray *lost;
+
+	// The cache might have been freed by the callback of the previous expiration
+	if ((cache == NULL) || (cache->ttl == 0)) {
+		return;
+	}
+
+	lost = g_array_new(FALSE, FALSE, sizeof(bdaddr_t));
+
+	g_hash_table_iter_init(&iter, cache->devices);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer*)&entry)) {
+		if (now - entry->last_seen > cache->ttl) {
+			g_array_append_val(lost, entry->addr);
+			g_hash_table_iter_remove(&iter);
+		}
+	}
+
+	// The callback might stop the scan or free the cache: it is called once the cache is no more used
+	if (device_lost_cb) {
+		for (guint i = 0; i < lost->len; i++) {
+			device_lost_cb(adapter, &g_array_index(lost, bdaddr_t, i), user_data);
+		}
+	}
+
+	g_array_free(lost, TRUE);
+}
+
+int gattlib_adapter_scan_enable_change_detection(void *adapter, uint8_t rssi_delta, uint32_t ttl, gattlib_device_lost_t device_lost_cb) {
+	struct gattlib_adapter *gattlib_adapter = adapter;
+	struct gattlib_scan_cache *cache;
+
+	if (gattlib_adapter == NULL) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	cache = gattlib_scan_cache_new(rssi_delta, ttl);
+	if (cache == NULL) {
+		return GATTLIB_OUT_OF_MEMORY;
+	}
+
+	gattlib_scan_cache_free(gattlib_adapter->scan_cache);
+	gattlib_adapter->scan_cache = cache;
+	gattlib_adapter->device_lost_cb = device_lost_cb;
+	return GATTLIB_SUCCESS;
+}
+
+int gattlib_adapter_scan_disable_change_detection(void *adapter) {
+	struct gattlib_adapter *gattlib_adapter = adapter;
+
+	if (gattlib_adapter == NULL) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	gattlib_scan_cache_free(gattlib_adapter->scan_cache);
+	gattlib_adapter->scan_cache = NULL;
+	gattlib_adapter->device_lost_cb = NULL;
+	return GATTLIB_SUCCESS;
+}
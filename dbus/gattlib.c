@@ -58,11 +58,8 @@ gboolean on_handle_device_property_change(
 				}
 			} else if (strcmp(key, "ServicesResolved") == 0) {
 				if (g_variant_get_boolean(value)) {
-					// Stop the timeout for connection
-					g_source_remove(conn_context->connection_timeout);
-
 					// Tell we are now connected
-					g_main_loop_quit(conn_context->connection_loop);
+					gattlib_dbus_thread_signal(&conn_context->services_resolved);
 				}
 			}
 		}
@@ -118,75 +115,139 @@ void get_device_path_from_mac(const char *adapter_name, const char *mac_address,
 	snprintf(object_path, object_path_len, "/org/bluez/%s/dev_%s", adapter, device_address_str);
 }
 
-/**
- * @param src		Local Adaptater interface
- * @param dst		Remote Bluetooth address
- * @param dst_type	Set LE address type (either BDADDR_LE_PUBLIC or BDADDR_LE_RANDOM)
- * @param sec_level	Set security level (either BT_IO_SEC_LOW, BT_IO_SEC_MEDIUM, BT_IO_SEC_HIGH)
- * @param psm       Specify the PSM for GATT/ATT over BR/EDR
- * @param mtu       Specify the MTU size
+void get_device_path_from_bdaddr(const char *adapter_name, const bdaddr_t *bdaddr, char *object_path, size_t object_path_len)
+{
+	static const char hex_digits[] = "0123456789ABCDEF";
+	char device_address_str[6 * 3];
+	char *ptr = device_address_str;
+
+	// Format the address as 'DA_94_40_95_E0_87' without going through its string representation.
+	// 'bdaddr_t' stores the address in little-endian.
+	for (int i = 5; i >= 0; i--) {
+		*ptr++ = hex_digits[bdaddr->b[i] >> 4];
+		*ptr++ = hex_digits[bdaddr->b[i] & 0xF];
+		*ptr++ = (i > 0) ? '_' : '\0';
+	}
+
+	// Generate object path like: /org/bluez/hci0/dev_DA_94_40_95_E0_87
+	snprintf(object_path, object_path_len, "/org/bluez/%s/dev_%s", adapter_name ? adapter_name : "hci0", device_address_str);
+}
+
+struct device_proxy_arg {
+	gatt_connection_t* connection;
+	const char *object_path;
+	GError *error;
+};
+
+/*
+ * Create the device proxy from the gattlib thread to receive its signals in the gattlib context
  */
-gatt_connection_t *gattlib_connect(void* adapter, const char *dst, unsigned long options)
+static gboolean create_device_proxy(gpointer user_data) {
+	struct device_proxy_arg *arg = user_data;
+	gattlib_context_t* conn_context = arg->connection->context;
+
+	conn_context->device = org_bluez_device1_proxy_new_for_bus_sync(
+			G_BUS_TYPE_SYSTEM,
+			G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,
+			"org.bluez",
+			arg->object_path,
+			NULL,
+			&arg->error);
+	if (conn_context->device != NULL) {
+		// Register a handle for notification
+		conn_context->device_signal_id = g_signal_connect(conn_context->device,
+			"g-properties-changed",
+			G_CALLBACK (on_handle_device_property_change),
+			arg->connection);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+/*
+ * Disconnect the device signal from the gattlib thread. Once done, the handler cannot be running anymore.
+ */
+static gboolean disconnect_device_signal(gpointer user_data) {
+	gattlib_context_t* conn_context = user_data;
+
+	g_signal_handler_disconnect(conn_context->device, conn_context->device_signal_id);
+	return G_SOURCE_REMOVE;
+}
+
+/*
+ * Abort a pending connection. Bluez cancels the connection attempt on 'Disconnect'.
+ */
+static void abort_device_connection(OrgBluezDevice1 *device)
 {
-	struct gattlib_adapter *gattlib_adapter = adapter;
-	const char* adapter_name = NULL;
-	GDBusObjectManager *device_manager;
 	GError *error = NULL;
-	char object_path[100];
 
-	// In case NULL is passed, we initialized default adapter
-	if (gattlib_adapter == NULL) {
-		gattlib_adapter = init_default_adapter();
-	} else {
-		adapter_name = gattlib_adapter->adapter_name;
+	set_dbus_proxy_timeout(device, 0);
+	org_bluez_device1_call_disconnect_sync(device, NULL, &error);
+	if (error) {
+		g_error_free(error);
 	}
+}
 
-	get_device_path_from_mac(adapter_name, dst, object_path, sizeof(object_path));
+/*
+ * Connect to the Bluez device exposed at 'object_path' and wait for its services to be resolved
+ *
+ * When 'timeout_ms' is 0, the connection relies on the D-Bus timeout and gives up waiting for the
+ * services after CONNECT_TIMEOUT.
+ */
+static int connect_device_path(struct gattlib_adapter *gattlib_adapter, const char *object_path,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable, gatt_connection_t **connection_ptr)
+{
+	struct device_proxy_arg device_proxy_arg = { .object_path = object_path, .error = NULL };
+	GCancellable *g_cancellable = GATTLIB_G_CANCELLABLE(cancellable);
+	gint64 deadline = g_get_monotonic_time() + (gint64)timeout_ms * G_TIME_SPAN_MILLISECOND;
+	GDBusObjectManager *device_manager;
+	GError *error = NULL;
+	guint services_timeout_ms;
+	int ret;
+
+	if (g_cancellable_is_cancelled(g_cancellable)) {
+		return GATTLIB_CANCELLED;
+	}
 
 	gattlib_context_t* conn_context = calloc(sizeof(gattlib_context_t), 1);
 	if (conn_context == NULL) {
-		return NULL;
+		return GATTLIB_OUT_OF_MEMORY;
 	}
 	conn_context->adapter = gattlib_adapter;
+	g_mutex_init(&conn_context->lock);
 
 	gatt_connection_t* connection = calloc(sizeof(gatt_connection_t), 1);
 	if (connection == NULL) {
+		ret = GATTLIB_OUT_OF_MEMORY;
 		goto FREE_CONN_CONTEXT;
 	} else {
 		connection->context = conn_context;
 	}
 
-	OrgBluezDevice1* device = org_bluez_device1_proxy_new_for_bus_sync(
-			G_BUS_TYPE_SYSTEM,
-			G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,
-			"org.bluez",
-			object_path,
-			NULL,
-			&error);
-	if (device == NULL) {
-		if (error) {
-			fprintf(stderr, "Failed to connect to DBus Bluez Device: %s\n", error->message);
-			g_error_free(error);
+	device_proxy_arg.connection = connection;
+	gattlib_dbus_thread_invoke(create_device_proxy, &device_proxy_arg);
+	if (conn_context->device == NULL) {
+		if (device_proxy_arg.error) {
+			fprintf(stderr, "Failed to connect to DBus Bluez Device: %s\n", device_proxy_arg.error->message);
+			g_error_free(device_proxy_arg.error);
 		}
+		ret = GATTLIB_ERROR_DBUS;
 		goto FREE_CONNECTION;
 	} else {
-		conn_context->device = device;
 		conn_context->device_object_path = strdup(object_path);
 	}
 
-	// Register a handle for notification
-	g_signal_connect(device,
-		"g-properties-changed",
-		G_CALLBACK (on_handle_device_property_change),
-		connection);
-
 	error = NULL;
-	org_bluez_device1_call_connect_sync(device, NULL, &error);
+	set_dbus_proxy_timeout(conn_context->device, timeout_ms);
+	org_bluez_device1_call_connect_sync(conn_context->device, g_cancellable, &error);
 	if (error) {
-		if (strncmp(error->message, m_dbus_error_unknown_object, strlen(m_dbus_error_unknown_object)) == 0) {
+		ret = get_error_from_dbus_error(error);
+		if (ret != GATTLIB_ERROR_DBUS) {
+			// The connection attempt might still be pending in Bluez
+			abort_device_connection(conn_context->device);
+		} else if (strncmp(error->message, m_dbus_error_unknown_object, strlen(m_dbus_error_unknown_object)) == 0) {
 			// You might have this error if the computer has not scanned or has not already had
 			// pairing information about the targetted device.
-			fprintf(stderr, "Device '%s' cannot be found\n", dst);
+			fprintf(stderr, "Device '%s' cannot be found\n", object_path);
 		}  else {
 			fprintf(stderr, "Device connected error (device:%s): %s\n",
 				conn_context->device_object_path,
@@ -197,24 +258,51 @@ gatt_connection_t *gattlib_connect(void* adapter, const char *dst, unsigned long
 		goto FREE_DEVICE;
 	}
 
+#if BLUEZ_VERSION >= BLUEZ_VERSIONS(5, 40)
+	// The services might have already been resolved (eg: the device was already connected)
+	if (org_bluez_device1_get_services_resolved(conn_context->device)) {
+		gattlib_dbus_thread_signal(&conn_context->services_resolved);
+	}
+#endif
+
 	// Wait for the property 'UUIDs' to be changed. We assume 'org.bluez.GattService1
 	// and 'org.bluez.GattCharacteristic1' to be advertised at that moment.
-	conn_context->connection_loop = g_main_loop_new(NULL, 0);
+	if (timeout_ms == 0) {
+		services_timeout_ms = CONNECT_TIMEOUT * 1000;
+	} else if (g_get_monotonic_time() < deadline) {
+		services_timeout_ms = (deadline - g_get_monotonic_time()) / G_TIME_SPAN_MILLISECOND;
+	} else {
+		services_timeout_ms = 0;
+	}
+
+	if (!gattlib_dbus_thread_wait(&conn_context->services_resolved, services_timeout_ms, g_cancellable)) {
+		if (g_cancellable_is_cancelled(g_cancellable)) {
+			ret = GATTLIB_CANCELLED;
+		} else if (timeout_ms > 0) {
+			ret = GATTLIB_TIMEOUT;
+		} else {
+			// Without explicit deadline, we carry on with the services resolved so far
+			ret = GATTLIB_SUCCESS;
+		}
 
-	conn_context->connection_timeout = g_timeout_add_seconds(CONNECT_TIMEOUT, stop_scan_func,
-								 conn_context->connection_loop);
-	g_main_loop_run(conn_context->connection_loop);
-	g_main_loop_unref(conn_context->connection_loop);
-	// Set the attribute to NULL even if not required
-	conn_context->connection_loop = NULL;
+		if (ret != GATTLIB_SUCCESS) {
+			abort_device_connection(conn_context->device);
+			goto FREE_DEVICE;
+		}
+	}
+
+	// Restore the default timeout for the next calls
+	set_dbus_proxy_timeout(conn_context->device, 0);
 
 	// Get list of objects belonging to Device Manager
 	device_manager = get_device_manager_from_adapter(conn_context->adapter);
 	conn_context->dbus_objects = g_dbus_object_manager_get_objects(device_manager);
 
-	return connection;
+	*connection_ptr = connection;
+	return GATTLIB_SUCCESS;
 
 FREE_DEVICE:
+	gattlib_dbus_thread_invoke(disconnect_device_signal, conn_context);
 	free(conn_context->device_object_path);
 	g_object_unref(conn_context->device);
 
@@ -222,8 +310,86 @@ FREE_CONNECTION:
 	free(connection);
 
 FREE_CONN_CONTEXT:
+	g_mutex_clear(&conn_context->lock);
 	free(conn_context);
-	return NULL;
+	return ret;
+}
+
+/**
+ * @param src		Local Adaptater interface
+ * @param dst		Remote Bluetooth address
+ * @param dst_type	Set LE address type (either BDADDR_LE_PUBLIC or BDADDR_LE_RANDOM)
+ * @param sec_level	Set security level (either BT_IO_SEC_LOW, BT_IO_SEC_MEDIUM, BT_IO_SEC_HIGH)
+ * @param psm       Specify the PSM for GATT/ATT over BR/EDR
+ * @param mtu       Specify the MTU size
+ */
+gatt_connection_t *gattlib_connect(void* adapter, const char *dst, unsigned long options)
+{
+	struct gattlib_adapter *gattlib_adapter = adapter;
+	gatt_connection_t *connection = NULL;
+	const char* adapter_name = NULL;
+	char object_path[100];
+
+	// In case NULL is passed, we initialized default adapter
+	if (gattlib_adapter == NULL) {
+		gattlib_adapter = init_default_adapter();
+	} else {
+		adapter_name = gattlib_adapter->adapter_name;
+	}
+
+	get_device_path_from_mac(adapter_name, dst, object_path, sizeof(object_path));
+
+	connect_device_path(gattlib_adapter, object_path, 0, NULL, &connection);
+	return connection;
+}
+
+int gattlib_connect_with_timeout(void *adapter, const char *dst, unsigned long options,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable, gatt_connection_t **connection)
+{
+	struct gattlib_adapter *gattlib_adapter = adapter;
+	const char* adapter_name = NULL;
+	char object_path[100];
+
+	if ((dst == NULL) || (connection == NULL)) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	// In case NULL is passed, we initialized default adapter
+	if (gattlib_adapter == NULL) {
+		gattlib_adapter = init_default_adapter();
+	} else {
+		adapter_name = gattlib_adapter->adapter_name;
+	}
+
+	get_device_path_from_mac(adapter_name, dst, object_path, sizeof(object_path));
+
+	return connect_device_path(gattlib_adapter, object_path, timeout_ms, cancellable, connection);
+}
+
+gatt_connection_t *gattlib_connect_bdaddr(void *adapter, const bdaddr_t *dst, uint8_t dst_type, unsigned long options)
+{
+	struct gattlib_adapter *gattlib_adapter = adapter;
+	gatt_connection_t *connection = NULL;
+	const char* adapter_name = NULL;
+	char object_path[100];
+
+	if ((dst == NULL) || ((dst_type != BDADDR_LE_PUBLIC) && (dst_type != BDADDR_LE_RANDOM))) {
+		fprintf(stderr, "gattlib_connect_bdaddr() expects an address and its LE address type.\n");
+		return NULL;
+	}
+
+	// In case NULL is passed, we initialized default adapter
+	if (gattlib_adapter == NULL) {
+		gattlib_adapter = init_default_adapter();
+	} else {
+		adapter_name = gattlib_adapter->adapter_name;
+	}
+
+	// Bluez already knows the address type of the device from the discovery
+	get_device_path_from_bdaddr(adapter_name, dst, object_path, sizeof(object_path));
+
+	connect_device_path(gattlib_adapter, object_path, 0, NULL, &connection);
+	return connection;
 }
 
 gatt_connection_t *gattlib_connect_async(void *adapter, const char *dst,
@@ -240,6 +406,36 @@ gatt_connection_t *gattlib_connect_async(void *adapter, const char *dst,
 	return connection;
 }
 
+gattlib_cancellable_t *gattlib_cancellable_new(void) {
+	return (gattlib_cancellable_t*)g_cancellable_new();
+}
+
+void gattlib_cancellable_cancel(gattlib_cancellable_t *cancellable) {
+	g_cancellable_cancel(GATTLIB_G_CANCELLABLE(cancellable));
+}
+
+void gattlib_cancellable_free(gattlib_cancellable_t *cancellable) {
+	if (cancellable != NULL) {
+		g_object_unref(GATTLIB_G_CANCELLABLE(cancellable));
+	}
+}
+
+void set_dbus_proxy_timeout(gpointer proxy, unsigned int timeout_ms) {
+	g_dbus_proxy_set_default_timeout(G_DBUS_PROXY(proxy), (timeout_ms > 0) ? (gint)timeout_ms : -1);
+}
+
+int get_error_from_dbus_error(const GError *error) {
+	if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		return GATTLIB_CANCELLED;
+	} else if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT) ||
+	           g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_NO_REPLY) ||
+	           g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_TIMEOUT)) {
+		return GATTLIB_TIMEOUT;
+	} else {
+		return GATTLIB_ERROR_DBUS;
+	}
+}
+
 int gattlib_disconnect(gatt_connection_t* connection) {
 	gattlib_context_t* conn_context = connection->context;
 	GError *error = NULL;
@@ -250,10 +446,14 @@ int gattlib_disconnect(gatt_connection_t* connection) {
 		g_error_free(error);
 	}
 
+	// Once the signals are disconnected, no callback can use the connection anymore
+	disconnect_all_notifications(conn_context);
+	gattlib_dbus_thread_invoke(disconnect_device_signal, conn_context);
+
 	free(conn_context->device_object_path);
 	g_object_unref(conn_context->device);
 	g_list_free_full(conn_context->dbus_objects, g_object_unref);
-	disconnect_all_notifications(conn_context);
+	g_mutex_clear(&conn_context->lock);
 
 	free(connection->context);
 	free(connection);
@@ -783,6 +983,12 @@ int gattlib_discover_char(gatt_connection_t* connection, gattlib_characteristic_
 	return gattlib_discover_char_range(connection, 0x00, 0xFF, characteristics, characteristics_count);
 }
 
+int gattlib_set_characteristics(gatt_connection_t* connection, const gattlib_characteristic_t* characteristics, int characteristics_count)
+{
+	// The characteristics are exposed by the objects of Bluez
+	return GATTLIB_NOT_SUPPORTED;
+}
+
 int gattlib_discover_desc_range(gatt_connection_t* connection, int start, int end, gattlib_descriptor_t** descriptors, int* descriptor_count) {
 	return GATTLIB_NOT_SUPPORTED;
 }
@@ -55,9 +55,6 @@ int gattlib_adapter_open(const char* adapter_name, void** adapter) {
 		return GATTLIB_ERROR_DBUS;
 	}
 
-	// Ensure the adapter is powered on
-	org_bluez_adapter1_set_powered(adapter_proxy, TRUE);
-
 	gattlib_adapter = calloc(1, sizeof(struct gattlib_adapter));
 	if (gattlib_adapter == NULL) {
 		return GATTLIB_OUT_OF_MEMORY;
@@ -66,6 +63,22 @@ int gattlib_adapter_open(const char* adapter_name, void** adapter) {
 	// Initialize stucture
 	gattlib_adapter->adapter_name = strdup(adapter_name);
 	gattlib_adapter->adapter_proxy = adapter_proxy;
+	gattlib_adapter->scan_filter_duplicates = true;
+
+#if defined(GATTLIB_MGMT)
+	// Control the adapter through the kernel when we are allowed to
+	gattlib_adapter->mgmt = gattlib_mgmt_open(adapter_name);
+	if ((gattlib_adapter->mgmt != NULL) && (gattlib_mgmt_set_powered(gattlib_adapter->mgmt, true) != GATTLIB_SUCCESS)) {
+		gattlib_mgmt_close(gattlib_adapter->mgmt);
+		gattlib_adapter->mgmt = NULL;
+	}
+
+	if (gattlib_adapter->mgmt == NULL)
+#endif
+	{
+		// Ensure the adapter is powered on
+		org_bluez_adapter1_set_powered(adapter_proxy, TRUE);
+	}
 
 	*adapter = gattlib_adapter;
 	return GATTLIB_SUCCESS;
@@ -115,6 +128,17 @@ GDBusObjectManager *get_device_manager_from_adapter(struct gattlib_adapter *gatt
 	return gattlib_adapter->device_manager;
 }
 
+gboolean address_filter_match(struct gattlib_adapter *gattlib_adapter, const bdaddr_t *bdaddr) {
+	gint64 key;
+
+	if (gattlib_adapter->address_filter == NULL) {
+		return TRUE;
+	}
+
+	key = (gint64)gattlib_bdaddr_to_uint64(bdaddr);
+	return g_hash_table_contains(gattlib_adapter->address_filter, &key);
+}
+
 /*
  * Internal structure to pass to Device Manager signal handlers
  */
@@ -122,46 +146,86 @@ struct discovered_device_arg {
 	void *adapter;
 	uint32_t enabled_filters;
 	gattlib_discovered_device_t callback;
+	gattlib_discovered_advertisement_t advertisement_callback;
 	void *user_data;
-	GSList** discovered_devices_ptr;
+	// Set of the devices already reported, keyed by their 48-bit address
+	GHashTable *discovered_devices;
 };
 
-static void device_manager_on_device1_signal(const char* device1_path, struct discovered_device_arg *arg)
+/*
+ * Return TRUE if the scan reports each device once: neither the change detection nor
+ * GATTLIB_DISCOVER_FILTER_NOTIFY_CHANGE is enabled.
+ */
+static gboolean scan_reports_once(struct discovered_device_arg *arg)
 {
-	GError *error = NULL;
-	OrgBluezDevice1* device1 = org_bluez_device1_proxy_new_for_bus_sync(
-			G_BUS_TYPE_SYSTEM,
-			G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,
-			"org.bluez",
-			device1_path,
-			NULL,
-			&error);
-	if (error) {
-		fprintf(stderr, "Failed to connection to new DBus Bluez Device: %s\n",
-			error->message);
-		g_error_free(error);
+	struct gattlib_adapter *gattlib_adapter = arg->adapter;
+
+	return (gattlib_adapter->scan_cache == NULL) && ((arg->enabled_filters & GATTLIB_DISCOVER_FILTER_NOTIFY_CHANGE) == 0);
+}
+
+static void device_manager_on_device1_signal(GDBusProxy *device_proxy, struct discovered_device_arg *arg)
+{
+	struct gattlib_adapter *gattlib_adapter = arg->adapter;
+	GVariant *address_variant;
+	GVariant *name_variant;
+	const gchar *address;
+	bdaddr_t bdaddr;
+	gint64 key;
+
+	// Use the properties cached by the proxy. It does not require any D-Bus round trip.
+	address_variant = g_dbus_proxy_get_cached_property(device_proxy, "Address");
+	if (address_variant == NULL) {
+		return;
+	}
+
+	address = g_variant_get_string(address_variant, NULL);
+	if (gattlib_string_to_bdaddr(address, &bdaddr) != GATTLIB_SUCCESS) {
+		goto EXIT;
 	}
 
-	if (device1) {
-		const gchar *address = org_bluez_device1_get_address(device1);
+	if (!address_filter_match(gattlib_adapter, &bdaddr)) {
+		goto EXIT;
+	}
+	key = (gint64)gattlib_bdaddr_to_uint64(&bdaddr);
 
-		// Check if the device is already part of the list
-		GSList *item = g_slist_find_custom(*arg->discovered_devices_ptr, address, (GCompareFunc)g_ascii_strcasecmp);
+	// Without change detection, the updates of a device already reported (eg: RSSI) are dropped
+	// before the rules: they would count advertisements that are not reported.
+	if (scan_reports_once(arg) && g_hash_table_contains(arg->discovered_devices, &key)) {
+		goto EXIT;
+	}
 
-		// First time this device is in the list
-		if (item == NULL) {
-			// Add the device to the list
-			*arg->discovered_devices_ptr = g_slist_append(*arg->discovered_devices_ptr, g_strdup(address));
-		}
+	// The device is only reported once it matches the rules. With change detection, the scan
+	// cache decides whether the device must be reported again.
+	if (!device_proxy_filter(gattlib_adapter, device_proxy)) {
+		goto EXIT;
+	}
 
-		if ((item == NULL) || (arg->enabled_filters & GATTLIB_DISCOVER_FILTER_NOTIFY_CHANGE)) {
-			arg->callback(
-				arg->adapter,
-				org_bluez_device1_get_address(device1),
-				org_bluez_device1_get_name(device1),
-				arg->user_data);
-		}
-		g_object_unref(device1);
+	if (!g_hash_table_contains(arg->discovered_devices, &key)) {
+		gint64 *new_key = g_new(gint64, 1);
+		*new_key = key;
+		g_hash_table_add(arg->discovered_devices, new_key);
+	}
+
+	name_variant = g_dbus_proxy_get_cached_property(device_proxy, "Name");
+	arg->callback(
+		arg->adapter,
+		address,
+		name_variant ? g_variant_get_string(name_variant, NULL) : NULL,
+		arg->user_data);
+	if (name_variant) {
+		g_variant_unref(name_variant);
+	}
+
+EXIT:
+	g_variant_unref(address_variant);
+}
+
+static void on_device1_signal(GDBusProxy *device_proxy, struct discovered_device_arg *arg)
+{
+	if (arg->advertisement_callback) {
+		report_advertisement_from_device_proxy(arg->adapter, device_proxy, arg->advertisement_callback, arg->user_data);
+	} else {
+		device_manager_on_device1_signal(device_proxy, arg);
 	}
 }
 
@@ -169,14 +233,13 @@ static void on_dbus_object_added(GDBusObjectManager *device_manager,
                      GDBusObject        *object,
                      gpointer            user_data)
 {
-	const char* object_path = g_dbus_object_get_object_path(G_DBUS_OBJECT(object));
-	GDBusInterface *interface = g_dbus_object_manager_get_interface(device_manager, object_path, "org.bluez.Device1");
+	GDBusInterface *interface = g_dbus_object_get_interface(object, "org.bluez.Device1");
 	if (!interface) {
 		return;
 	}
 
 	// It is a 'org.bluez.Device1'
-	device_manager_on_device1_signal(object_path, user_data);
+	on_device1_signal(G_DBUS_PROXY(interface), user_data);
 
 	g_object_unref(interface);
 }
@@ -195,20 +258,81 @@ on_interface_proxy_properties_changed (GDBusObjectManagerClient *device_manager,
 	}
 
 	// It is a 'org.bluez.Device1'
-	device_manager_on_device1_signal(g_dbus_proxy_get_object_path(interface_proxy), user_data);
+	on_device1_signal(interface_proxy, user_data);
 }
 
-int gattlib_adapter_scan_enable_with_filter(void *adapter, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
-		gattlib_discovered_device_t discovered_device_cb, size_t timeout, void *user_data)
+#if defined(GATTLIB_MGMT)
+/*
+ * Report the advertisement of a Device Found event once parsed
+ */
+static void report_advertisement_from_mgmt(struct discovered_device_arg *arg, const bdaddr_t *addr, uint8_t addr_type,
+		int8_t rssi, struct gattlib_advertisement_storage *storage)
+{
+	struct gattlib_adapter *gattlib_adapter = arg->adapter;
+	gattlib_advertisement_t *advertisement = &storage->advertisement;
+	char address[18];
+	gint64 key;
+
+	bacpy(&advertisement->addr, addr);
+	advertisement->addr_type = addr_type;
+	if (rssi != GATTLIB_MGMT_RSSI_INVALID) {
+		advertisement->rssi = rssi;
+		advertisement->present |= GATTLIB_ADVERTISEMENT_HAS_RSSI;
+	}
+
+	// A device already reported is dropped before the rules: they only count the reported advertisements
+	key = (gint64)gattlib_bdaddr_to_uint64(addr);
+	if ((arg->advertisement_callback == NULL) && scan_reports_once(arg) &&
+	    g_hash_table_contains(arg->discovered_devices, &key)) {
+		return;
+	}
+
+	if (!advertisement_filter(gattlib_adapter, advertisement)) {
+		return;
+	}
+
+	if (arg->advertisement_callback) {
+		arg->advertisement_callback(arg->adapter, advertisement, arg->user_data);
+		return;
+	}
+
+	if (!g_hash_table_contains(arg->discovered_devices, &key)) {
+		gint64 *new_key = g_new(gint64, 1);
+		*new_key = key;
+		g_hash_table_add(arg->discovered_devices, new_key);
+	}
+
+	ba2str(addr, address);
+	arg->callback(arg->adapter, address, advertisement->name, arg->user_data);
+}
+
+/*
+ * Report a Device Found event of the mgmt discovery. The kernel has already applied the UUID and
+ * RSSI filters.
+ */
+static void on_mgmt_device_found(const bdaddr_t *addr, uint8_t addr_type, int8_t rssi,
+		const uint8_t *eir, size_t eir_length, void *user_data)
+{
+	struct discovered_device_arg *arg = user_data;
+	struct gattlib_adapter *gattlib_adapter = arg->adapter;
+	struct gattlib_advertisement_storage storage;
+
+	if (!address_filter_match(gattlib_adapter, addr)) {
+		return;
+	}
+
+	gattlib_advertisement_storage_init(&storage);
+	// A malformed EIR is still reported with the fields parsed before the error
+	gattlib_advertisement_parse(eir, eir_length, &storage);
+	report_advertisement_from_mgmt(arg, addr, addr_type, rssi, &storage);
+	gattlib_advertisement_storage_release(&storage);
+}
+#endif
+
+static int set_discovery_filter(struct gattlib_adapter *gattlib_adapter, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters)
 {
-	struct gattlib_adapter *gattlib_adapter = adapter;
-	GDBusObjectManager *device_manager;
 	GError *error = NULL;
-	int ret = GATTLIB_SUCCESS;
-	int added_signal_id, changed_signal_id;
-	GSList *discovered_devices = NULL;
 	GVariantBuilder arg_properties_builder;
-	GVariant *rssi_variant = NULL;
 
 	g_variant_builder_init(&arg_properties_builder, G_VARIANT_TYPE("a{sv}"));
 
@@ -227,126 +351,445 @@ int gattlib_adapter_scan_enable_with_filter(void *adapter, uuid_t **uuid_list, i
 	}
 
 	if (enabled_filters & GATTLIB_DISCOVER_FILTER_USE_RSSI) {
-		GVariant *rssi_variant = g_variant_new_int16(rssi_threshold);
-		g_variant_builder_add(&arg_properties_builder, "{sv}", "RSSI", rssi_variant);
+		g_variant_builder_add(&arg_properties_builder, "{sv}", "RSSI", g_variant_new_int16(rssi_threshold));
 	}
 
-	org_bluez_adapter1_call_set_discovery_filter_sync(gattlib_adapter->adapter_proxy,
-			g_variant_builder_end(&arg_properties_builder), NULL, &error);
-
-	if (rssi_variant) {
-		g_variant_unref(rssi_variant);
+#if BLUEZ_VERSION >= BLUEZ_VERSIONS(5, 49)
+	// BlueZ filters duplicate advertisements by default. The change detection needs the repeated
+	// advertisements to refresh the last-seen time of the devices.
+	if (!gattlib_adapter->scan_filter_duplicates ||
+	    ((gattlib_adapter->scan_cache != NULL) && (gattlib_scan_cache_expire_period(gattlib_adapter->scan_cache) > 0))) {
+		g_variant_builder_add(&arg_properties_builder, "{sv}", "DuplicateData", g_variant_new_boolean(TRUE));
 	}
+#endif
 
+	org_bluez_adapter1_call_set_discovery_filter_sync(gattlib_adapter->adapter_proxy,
+			g_variant_builder_end(&arg_properties_builder), NULL, &error);
 	if (error) {
-		printf("error: %d.%d\n", error->domain, error->code);
 		fprintf(stderr, "Failed to set discovery filter: %s\n", error->message);
 		g_error_free(error);
 		return GATTLIB_ERROR_DBUS;
 	}
 
-	//
-	// Get notification when objects are removed from the Bluez ObjectManager.
-	// We should get notified when the connection is lost with the target to allow
-	// us to advertise us again
-	//
-	device_manager = get_device_manager_from_adapter(gattlib_adapter);
+	return GATTLIB_SUCCESS;
+}
+
+/*
+ * The signals of a Device Manager are emitted in the thread-default main context of the thread
+ * that has created it. The scan uses a Device Manager created in the main context the results
+ * must be delivered on.
+ */
+static GDBusObjectManager *get_scan_device_manager(struct gattlib_adapter *gattlib_adapter, GMainContext *context)
+{
+	GError *error = NULL;
+
+	if (gattlib_adapter->scan_device_manager) {
+		if (gattlib_adapter->scan_device_manager_context == context) {
+			return gattlib_adapter->scan_device_manager;
+		}
+
+		g_object_unref(gattlib_adapter->scan_device_manager);
+		g_main_context_unref(gattlib_adapter->scan_device_manager_context);
+		gattlib_adapter->scan_device_manager = NULL;
+		gattlib_adapter->scan_device_manager_context = NULL;
+	}
+
+	g_main_context_push_thread_default(context);
+	gattlib_adapter->scan_device_manager = g_dbus_object_manager_client_new_for_bus_sync(
+			G_BUS_TYPE_SYSTEM,
+			G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,
+			"org.bluez",
+			"/",
+			NULL, NULL, NULL, NULL,
+			&error);
+	g_main_context_pop_thread_default(context);
+
+	if (gattlib_adapter->scan_device_manager == NULL) {
+		if (error) {
+			fprintf(stderr, "Failed to get Bluez Device Manager: %s\n", error->message);
+			g_error_free(error);
+		} else {
+			fprintf(stderr, "Failed to get Bluez Device Manager.\n");
+		}
+		return NULL;
+	}
+
+	gattlib_adapter->scan_device_manager_context = g_main_context_ref(context);
+	return gattlib_adapter->scan_device_manager;
+}
+
+/*
+ * Report a lost device. The argument of the scan is read again for each device: a previous
+ * callback might have stopped the scan or restarted it.
+ */
+static void on_scan_device_lost(void *adapter, const bdaddr_t *addr, void *user_data)
+{
+	struct gattlib_adapter *gattlib_adapter = adapter;
+
+	if ((gattlib_adapter->scan_arg != NULL) && (gattlib_adapter->device_lost_cb != NULL)) {
+		gattlib_adapter->device_lost_cb(adapter, addr, gattlib_adapter->scan_arg->user_data);
+	}
+}
+
+static gboolean on_scan_expire(gpointer data)
+{
+	struct gattlib_adapter *gattlib_adapter = data;
+
+	gattlib_scan_cache_expire(gattlib_adapter->scan_cache, g_get_monotonic_time() / 1000,
+			on_scan_device_lost, gattlib_adapter, NULL);
+
+	// The scan might have been stopped by the callback
+	return gattlib_adapter->scan_arg != NULL;
+}
+
+static gboolean on_scan_timeout(gpointer data)
+{
+	gattlib_adapter_scan_stop(data);
+	return FALSE;
+}
+
+static struct discovered_device_arg *new_discovered_device_arg(void *adapter, uint32_t enabled_filters,
+		gattlib_discovered_device_t callback, gattlib_discovered_advertisement_t advertisement_callback, void *user_data)
+{
+	struct discovered_device_arg *arg = calloc(1, sizeof(struct discovered_device_arg));
+	if (arg == NULL) {
+		return NULL;
+	}
+
+	arg->adapter = adapter;
+	arg->enabled_filters = enabled_filters;
+	arg->callback = callback;
+	arg->advertisement_callback = advertisement_callback;
+	arg->user_data = user_data;
+	return arg;
+}
+
+/*
+ * Start the scan and return immediately. The results are delivered in 'context'.
+ * The scan takes the ownership of 'arg'.
+ */
+static int scan_start(struct gattlib_adapter *gattlib_adapter, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
+		struct discovered_device_arg *arg, size_t timeout, GMainContext *context)
+{
+	GDBusObjectManager *device_manager;
+	GError *error = NULL;
+	int ret;
+
+	if (gattlib_adapter->scan_arg != NULL) {
+		fprintf(stderr, "Scan is already running.\n");
+		free(arg);
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	if (context == NULL) {
+		context = g_main_context_ref_thread_default();
+	} else {
+		g_main_context_ref(context);
+	}
+
+#if defined(GATTLIB_MGMT)
+	// The discovery falls back to D-Bus when the kernel rejects it (eg: bluetoothd is already discovering)
+	if ((gattlib_adapter->mgmt != NULL) &&
+	    (gattlib_mgmt_start_discovery(gattlib_adapter->mgmt, uuid_list, rssi_threshold, enabled_filters,
+			context, on_mgmt_device_found, arg) == GATTLIB_SUCCESS))
+	{
+		arg->discovered_devices = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+
+		if (gattlib_adapter->scan_cache != NULL) {
+			gattlib_scan_cache_clear(gattlib_adapter->scan_cache);
+		}
+
+		gattlib_adapter->scan_arg = arg;
+		gattlib_adapter->scan_context = context;
+		gattlib_adapter->scan_mgmt = true;
+		goto START_SOURCES;
+	}
+#endif
+
+	ret = set_discovery_filter(gattlib_adapter, uuid_list, rssi_threshold, enabled_filters);
+	if (ret != GATTLIB_SUCCESS) {
+		g_main_context_unref(context);
+		free(arg);
+		return ret;
+	}
+
+	device_manager = get_scan_device_manager(gattlib_adapter, context);
 	if (device_manager == NULL) {
-		goto DISABLE_SCAN;
+		g_main_context_unref(context);
+		free(arg);
+		return GATTLIB_ERROR_DBUS;
+	}
+
+	// Set of the discovered devices shared with the signal handlers
+	arg->discovered_devices = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+
+	if (gattlib_adapter->scan_cache != NULL) {
+		gattlib_scan_cache_clear(gattlib_adapter->scan_cache);
 	}
 
-	// Pass the user callback and the discovered device list pointer to the signal handlers
-	struct discovered_device_arg discovered_device_arg = {
-		.adapter = adapter,
-		.enabled_filters = enabled_filters,
-		.callback = discovered_device_cb,
-		.user_data = user_data,
-		.discovered_devices_ptr = &discovered_devices,
-	};
+	gattlib_adapter->scan_arg = arg;
+	gattlib_adapter->scan_context = context;
 
-	added_signal_id = g_signal_connect(G_DBUS_OBJECT_MANAGER(device_manager),
+	gattlib_adapter->scan_added_signal_id = g_signal_connect(G_DBUS_OBJECT_MANAGER(device_manager),
 	                    "object-added",
 	                    G_CALLBACK (on_dbus_object_added),
-	                    &discovered_device_arg);
+	                    arg);
 
 	// List for object changes to see if there are still devices around
-	changed_signal_id = g_signal_connect(G_DBUS_OBJECT_MANAGER(device_manager),
+	gattlib_adapter->scan_changed_signal_id = g_signal_connect(G_DBUS_OBJECT_MANAGER(device_manager),
 					     "interface-proxy-properties-changed",
 					     G_CALLBACK(on_interface_proxy_properties_changed),
-					     &discovered_device_arg);
+					     arg);
 
 	// Now, start BLE discovery
 	org_bluez_adapter1_call_start_discovery_sync(gattlib_adapter->adapter_proxy, NULL, &error);
 	if (error) {
 		fprintf(stderr, "Failed to start discovery: %s\n", error->message);
 		g_error_free(error);
+		gattlib_adapter_scan_stop(gattlib_adapter);
 		return GATTLIB_ERROR_DBUS;
 	}
 
-	// Run Glib loop for 'timeout' seconds
-	gattlib_adapter->scan_loop = g_main_loop_new(NULL, 0);
+#if defined(GATTLIB_MGMT)
+START_SOURCES:
+#endif
 	if (timeout > 0) {
-		gattlib_adapter->timeout_id = g_timeout_add_seconds(timeout, stop_scan_func, gattlib_adapter->scan_loop);
+		gattlib_adapter->scan_timeout_source = g_timeout_source_new_seconds(timeout);
+		g_source_set_callback(gattlib_adapter->scan_timeout_source, on_scan_timeout, gattlib_adapter, NULL);
+		g_source_attach(gattlib_adapter->scan_timeout_source, context);
+	}
+
+	if ((gattlib_adapter->scan_cache != NULL) && (gattlib_scan_cache_expire_period(gattlib_adapter->scan_cache) > 0)) {
+		gattlib_adapter->scan_expire_source = g_timeout_source_new(gattlib_scan_cache_expire_period(gattlib_adapter->scan_cache));
+		g_source_set_callback(gattlib_adapter->scan_expire_source, on_scan_expire, gattlib_adapter, NULL);
+		g_source_attach(gattlib_adapter->scan_expire_source, context);
+	}
+
+	return GATTLIB_SUCCESS;
+}
+
+/*
+ * Run the scan in the thread-default main context of the caller until the timeout expires or
+ * gattlib_adapter_scan_disable() is called.
+ */
+static int scan_run(struct gattlib_adapter *gattlib_adapter, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
+		struct discovered_device_arg *arg, size_t timeout)
+{
+	GMainContext *context;
+	int ret;
+
+	if (arg == NULL) {
+		return GATTLIB_OUT_OF_MEMORY;
 	}
-	g_main_loop_run(gattlib_adapter->scan_loop);
-	// At this point, either the timeout expired (and automatically was removed) or scan_disable was called, removing the timer.
-	gattlib_adapter->timeout_id = 0;
 
-	// Note: The function only resumes when loop timeout as expired or g_main_loop_quit has been called.
+	context = g_main_context_ref_thread_default();
+
+	ret = scan_start(gattlib_adapter, uuid_list, rssi_threshold, enabled_filters, arg, timeout, context);
+	if (ret == GATTLIB_SUCCESS) {
+		gattlib_adapter->scan_loop = g_main_loop_new(context, FALSE);
+		g_main_loop_run(gattlib_adapter->scan_loop);
+		// Note: The function only resumes when the scan has been stopped (timeout or gattlib_adapter_scan_disable()).
 
-	g_signal_handler_disconnect(G_DBUS_OBJECT_MANAGER(device_manager), added_signal_id);
-	g_signal_handler_disconnect(G_DBUS_OBJECT_MANAGER(device_manager), changed_signal_id);
+		g_main_loop_unref(gattlib_adapter->scan_loop);
+		gattlib_adapter->scan_loop = NULL;
 
-DISABLE_SCAN:
-	// Stop BLE device discovery
-	gattlib_adapter_scan_disable(adapter);
+		// In case the loop has been quit by someone else
+		gattlib_adapter_scan_stop(gattlib_adapter);
+	}
 
-	// Free discovered device list
-	g_slist_foreach(discovered_devices, (GFunc)g_free, NULL);
-	g_slist_free(discovered_devices);
+	g_main_context_unref(context);
 	return ret;
 }
 
-int gattlib_adapter_scan_enable(void* adapter, gattlib_discovered_device_t discovered_device_cb, size_t timeout, void *user_data)
+int gattlib_adapter_scan_enable_with_filter(void *adapter, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
+		gattlib_discovered_device_t discovered_device_cb, size_t timeout, void *user_data)
 {
-	return gattlib_adapter_scan_enable_with_filter(adapter,
-			NULL, 0 /* RSSI Threshold */,
-			GATTLIB_DISCOVER_FILTER_USE_NONE,
-			discovered_device_cb, timeout, user_data);
+	return scan_run(adapter, uuid_list, rssi_threshold, enabled_filters,
+			new_discovered_device_arg(adapter, enabled_filters, discovered_device_cb, NULL, user_data),
+			timeout);
 }
 
-int gattlib_adapter_scan_disable(void* adapter) {
+int gattlib_adapter_scan_advertisements(void *adapter, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
+		gattlib_discovered_advertisement_t discovered_advertisement_cb, size_t timeout, void *user_data)
+{
+	return scan_run(adapter, uuid_list, rssi_threshold, enabled_filters,
+			new_discovered_device_arg(adapter, enabled_filters, NULL, discovered_advertisement_cb, user_data),
+			timeout);
+}
+
+int gattlib_adapter_scan_start(void *adapter, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
+		gattlib_discovered_advertisement_t discovered_advertisement_cb, size_t timeout, void *main_context, void *user_data)
+{
+	struct discovered_device_arg *arg;
+
+	if ((adapter == NULL) || (discovered_advertisement_cb == NULL)) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	arg = new_discovered_device_arg(adapter, enabled_filters, NULL, discovered_advertisement_cb, user_data);
+	if (arg == NULL) {
+		return GATTLIB_OUT_OF_MEMORY;
+	}
+
+	return scan_start(adapter, uuid_list, rssi_threshold, enabled_filters, arg, timeout, main_context);
+}
+
+int gattlib_adapter_scan_stop(void *adapter)
+{
 	struct gattlib_adapter *gattlib_adapter = adapter;
+	struct discovered_device_arg *arg = gattlib_adapter->scan_arg;
+	GError *error = NULL;
 
-	if (gattlib_adapter->scan_loop) {
-		GError *error = NULL;
+	if (arg == NULL) {
+		// Scan not running
+		return GATTLIB_SUCCESS;
+	}
+	gattlib_adapter->scan_arg = NULL;
 
+#if defined(GATTLIB_MGMT)
+	if (gattlib_adapter->scan_mgmt) {
+		gattlib_adapter->scan_mgmt = false;
+		// Ignore the error
+		gattlib_mgmt_stop_discovery(gattlib_adapter->mgmt);
+	} else
+#endif
+	{
 		org_bluez_adapter1_call_stop_discovery_sync(gattlib_adapter->adapter_proxy, NULL, &error);
 		// Ignore the error
+		g_clear_error(&error);
+
+		g_signal_handler_disconnect(G_DBUS_OBJECT_MANAGER(gattlib_adapter->scan_device_manager), gattlib_adapter->scan_added_signal_id);
+		g_signal_handler_disconnect(G_DBUS_OBJECT_MANAGER(gattlib_adapter->scan_device_manager), gattlib_adapter->scan_changed_signal_id);
+	}
+
+	// Remove timeout
+	if (gattlib_adapter->scan_timeout_source) {
+		g_source_destroy(gattlib_adapter->scan_timeout_source);
+		g_source_unref(gattlib_adapter->scan_timeout_source);
+		gattlib_adapter->scan_timeout_source = NULL;
+	}
+	if (gattlib_adapter->scan_expire_source) {
+		g_source_destroy(gattlib_adapter->scan_expire_source);
+		g_source_unref(gattlib_adapter->scan_expire_source);
+		gattlib_adapter->scan_expire_source = NULL;
+	}
+
+	g_hash_table_destroy(arg->discovered_devices);
+	free(arg);
+
+	g_main_context_unref(gattlib_adapter->scan_context);
+	gattlib_adapter->scan_context = NULL;
+
+	// Ensure the loop of the blocking scan is quit
+	if (gattlib_adapter->scan_loop && g_main_loop_is_running(gattlib_adapter->scan_loop)) {
+		g_main_loop_quit(gattlib_adapter->scan_loop);
+	}
+
+	return GATTLIB_SUCCESS;
+}
+
+int gattlib_adapter_scan_set_parameters(void *adapter, uint8_t scan_type, uint16_t interval, uint16_t window, bool filter_duplicates)
+{
+	struct gattlib_adapter *gattlib_adapter = adapter;
+
+	if (gattlib_adapter == NULL) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	// BlueZ always uses active scanning for discovery and manages the scan interval/window itself
+	if (scan_type != GATTLIB_SCAN_TYPE_ACTIVE) {
+		return GATTLIB_NOT_SUPPORTED;
+	}
+
+	if ((interval < 0x0004) || (interval > 0x4000) || (window < 0x0004) || (window > interval)) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
 
-		// Remove timeout
-		if (gattlib_adapter->timeout_id) {
-			g_source_remove(gattlib_adapter->timeout_id);
-			gattlib_adapter->timeout_id = 0;
+#if defined(GATTLIB_MGMT)
+	// The kernel uses the interval and the window for the LE scans it runs
+	if (gattlib_adapter->mgmt != NULL) {
+		int ret = gattlib_mgmt_set_scan_parameters(gattlib_adapter->mgmt, interval, window);
+		if (ret != GATTLIB_SUCCESS) {
+			return ret;
 		}
+	}
+#endif
+
+	gattlib_adapter->scan_filter_duplicates = filter_duplicates;
+	return GATTLIB_SUCCESS;
+}
+
+int gattlib_adapter_scan_set_address_filter(void *adapter, const char **mac_address_list)
+{
+	struct gattlib_adapter *gattlib_adapter = adapter;
+	GHashTable *address_filter = NULL;
+	bdaddr_t bdaddr;
+
+	if (gattlib_adapter == NULL) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	// The addresses are converted once: the advertisements are then filtered on their integer value
+	if ((mac_address_list != NULL) && (mac_address_list[0] != NULL)) {
+		address_filter = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+
+		for (const char **address = mac_address_list; *address != NULL; address++) {
+			gint64 *key;
+
+			// Like the legacy backend, the filter is kept unchanged if an address is malformed
+			if (gattlib_string_to_bdaddr(*address, &bdaddr) != GATTLIB_SUCCESS) {
+				g_hash_table_destroy(address_filter);
+				return GATTLIB_INVALID_PARAMETER;
+			}
 
-		// Ensure the scan loop is quit
-		if (g_main_loop_is_running(gattlib_adapter->scan_loop)) {
-			g_main_loop_quit(gattlib_adapter->scan_loop);
+			key = g_new(gint64, 1);
+			*key = (gint64)gattlib_bdaddr_to_uint64(&bdaddr);
+			g_hash_table_add(address_filter, key);
 		}
-		g_main_loop_unref(gattlib_adapter->scan_loop);
-		gattlib_adapter->scan_loop = NULL;
 	}
 
+	if (gattlib_adapter->address_filter != NULL) {
+		g_hash_table_destroy(gattlib_adapter->address_filter);
+	}
+	gattlib_adapter->address_filter = address_filter;
+
 	return GATTLIB_SUCCESS;
 }
 
+int gattlib_adapter_scan_enable(void* adapter, gattlib_discovered_device_t discovered_device_cb, size_t timeout, void *user_data)
+{
+	return gattlib_adapter_scan_enable_with_filter(adapter,
+			NULL, 0 /* RSSI Threshold */,
+			GATTLIB_DISCOVER_FILTER_USE_NONE,
+			discovered_device_cb, timeout, user_data);
+}
+
+int gattlib_adapter_scan_disable(void* adapter) {
+	return gattlib_adapter_scan_stop(adapter);
+}
+
 int gattlib_adapter_close(void* adapter)
 {
 	struct gattlib_adapter *gattlib_adapter = adapter;
 
-	g_object_unref(gattlib_adapter->device_manager);
+	gattlib_adapter_scan_stop(gattlib_adapter);
+
+	if (gattlib_adapter->scan_device_manager) {
+		g_object_unref(gattlib_adapter->scan_device_manager);
+		g_main_context_unref(gattlib_adapter->scan_device_manager_context);
+	}
+	if (gattlib_adapter->device_manager) {
+		g_object_unref(gattlib_adapter->device_manager);
+	}
 	g_object_unref(gattlib_adapter->adapter_proxy);
+	if (gattlib_adapter->address_filter != NULL) {
+		g_hash_table_destroy(gattlib_adapter->address_filter);
+	}
+	gattlib_match_free(gattlib_adapter->match_program);
+	gattlib_scan_cache_free(gattlib_adapter->scan_cache);
+#if defined(GATTLIB_MGMT)
+	gattlib_mgmt_close(gattlib_adapter->mgmt);
+#endif
 	free(gattlib_adapter);
 
 	return GATTLIB_SUCCESS;
@@ -23,6 +23,230 @@
 
 #include "gattlib_internal.h"
 
+/* Number of property values kept alive without allocation while the advertisement record points into them */
+#define ADVERTISEMENT_INLINE_VARIANTS \
+	(GATTLIB_ADVERTISEMENT_MAX_SERVICE_DATA + GATTLIB_ADVERTISEMENT_MAX_MANUFACTURER_DATA + 10)
+
+struct advertisement_variants {
+	GVariant *variants[ADVERTISEMENT_INLINE_VARIANTS];
+	GPtrArray *more_variants;  // Allocated once 'variants' is full
+	size_t count;
+};
+
+static GVariant *hold_variant(struct advertisement_variants *held, GVariant *variant) {
+	if (variant == NULL) {
+		return NULL;
+	}
+
+	if (held->count < ADVERTISEMENT_INLINE_VARIANTS) {
+		held->variants[held->count++] = variant;
+	} else {
+		if (held->more_variants == NULL) {
+			held->more_variants = g_ptr_array_new_with_free_func((GDestroyNotify)g_variant_unref);
+		}
+		g_ptr_array_add(held->more_variants, variant);
+	}
+	return variant;
+}
+
+static void release_variants(struct advertisement_variants *held) {
+	for (size_t i = 0; i < held->count; i++) {
+		g_variant_unref(held->variants[i]);
+	}
+	held->count = 0;
+
+	if (held->more_variants != NULL) {
+		g_ptr_array_free(held->more_variants, TRUE);
+		held->more_variants = NULL;
+	}
+}
+
+static GVariant *hold_cached_property(struct advertisement_variants *held, GDBusProxy *proxy, const char *property_name) {
+	return hold_variant(held, g_dbus_proxy_get_cached_property(proxy, property_name));
+}
+
+static void advertisement_from_device_proxy(GDBusProxy *device_proxy, struct gattlib_advertisement_storage *storage,
+		struct advertisement_variants *held)
+{
+	gattlib_advertisement_t *advertisement = &storage->advertisement;
+	GVariant *variant;
+	uuid_t uuid;
+
+	variant = hold_cached_property(held, device_proxy, "AddressType");
+	if ((variant != NULL) && (strcmp(g_variant_get_string(variant, NULL), "random") == 0)) {
+		advertisement->addr_type = BDADDR_LE_RANDOM;
+	} else {
+		advertisement->addr_type = BDADDR_LE_PUBLIC;
+	}
+
+	variant = hold_cached_property(held, device_proxy, "Name");
+	if (variant != NULL) {
+		gsize length;
+		const gchar *name = g_variant_get_string(variant, &length);
+		gattlib_advertisement_set_name(storage, name, length);
+	}
+
+	variant = hold_cached_property(held, device_proxy, "RSSI");
+	if (variant != NULL) {
+		advertisement->rssi = g_variant_get_int16(variant);
+		advertisement->present |= GATTLIB_ADVERTISEMENT_HAS_RSSI;
+	}
+
+	variant = hold_cached_property(held, device_proxy, "TxPower");
+	if (variant != NULL) {
+		advertisement->tx_power = g_variant_get_int16(variant);
+		advertisement->present |= GATTLIB_ADVERTISEMENT_HAS_TX_POWER;
+	}
+
+	variant = hold_cached_property(held, device_proxy, "AdvertisingFlags");
+	if (variant != NULL) {
+		gsize n_elements = 0;
+		const guint8 *flags = g_variant_get_fixed_array(variant, &n_elements, sizeof(guint8));
+		if (n_elements > 0) {
+			advertisement->flags = flags[0];
+			advertisement->present |= GATTLIB_ADVERTISEMENT_HAS_FLAGS;
+		}
+	}
+
+	variant = hold_cached_property(held, device_proxy, "UUIDs");
+	if (variant != NULL) {
+		gsize n_uuids = g_variant_n_children(variant);
+
+		for (gsize i = 0; i < n_uuids; i++) {
+			const gchar *uuid_str;
+
+			g_variant_get_child(variant, i, "&s", &uuid_str);
+			if (gattlib_string_to_uuid(uuid_str, strlen(uuid_str) + 1, &uuid) == 0) {
+				gattlib_advertisement_add_service_uuid(storage, &uuid);
+			}
+		}
+	}
+
+	variant = hold_cached_property(held, device_proxy, "ServiceData");
+	if (variant != NULL) {
+		gsize n_entries = g_variant_n_children(variant);
+
+		for (gsize i = 0; i < n_entries; i++) {
+			const gchar *uuid_str;
+			GVariant *value;
+
+			g_variant_get_child(variant, i, "{&sv}", &uuid_str, &value);
+			if (!g_variant_is_of_type(value, G_VARIANT_TYPE_BYTESTRING) ||
+			    (gattlib_string_to_uuid(uuid_str, strlen(uuid_str) + 1, &uuid) != 0) ||
+			    (hold_variant(held, value) == NULL))
+			{
+				g_variant_unref(value);
+				continue;
+			}
+
+			gsize n_elements = 0;
+			const guint8 *data = g_variant_get_fixed_array(value, &n_elements, sizeof(guint8));
+			gattlib_advertisement_add_service_data(storage, &uuid, data, n_elements);
+		}
+	}
+
+	variant = hold_cached_property(held, device_proxy, "ManufacturerData");
+	if (variant != NULL) {
+		gsize n_entries = g_variant_n_children(variant);
+
+		for (gsize i = 0; i < n_entries; i++) {
+			guint16 manufacturer_id;
+			GVariant *value;
+
+			g_variant_get_child(variant, i, "{qv}", &manufacturer_id, &value);
+			if (!g_variant_is_of_type(value, G_VARIANT_TYPE_BYTESTRING) || (hold_variant(held, value) == NULL)) {
+				g_variant_unref(value);
+				continue;
+			}
+
+			gsize n_elements = 0;
+			const guint8 *data = g_variant_get_fixed_array(value, &n_elements, sizeof(guint8));
+			gattlib_advertisement_add_manufacturer_data(storage, manufacturer_id, data, n_elements);
+		}
+	}
+}
+
+/*
+ * Apply the match rules and the change detection to the advertisement
+ */
+gboolean advertisement_filter(struct gattlib_adapter *gattlib_adapter, const gattlib_advertisement_t *advertisement)
+{
+	if ((gattlib_adapter->match_program != NULL) && !gattlib_match_eval(gattlib_adapter->match_program, advertisement)) {
+		return FALSE;
+	}
+
+	if ((gattlib_adapter->scan_cache != NULL) &&
+	    !gattlib_scan_cache_update(gattlib_adapter->scan_cache, advertisement, g_get_monotonic_time() / 1000)) {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void report_advertisement_from_device_proxy(struct gattlib_adapter *gattlib_adapter, GDBusProxy *device_proxy,
+		gattlib_discovered_advertisement_t discovered_advertisement_cb, void *user_data)
+{
+	struct gattlib_advertisement_storage storage;
+	struct advertisement_variants held = { .count = 0 };
+	const gchar *address;
+	GVariant *variant;
+
+	variant = hold_cached_property(&held, device_proxy, "Address");
+	if (variant == NULL) {
+		return;
+	}
+
+	gattlib_advertisement_storage_init(&storage);
+
+	address = g_variant_get_string(variant, NULL);
+	if (gattlib_string_to_bdaddr(address, &storage.advertisement.addr) != GATTLIB_SUCCESS) {
+		goto EXIT;
+	}
+
+	if (!address_filter_match(gattlib_adapter, &storage.advertisement.addr)) {
+		goto EXIT;
+	}
+
+	advertisement_from_device_proxy(device_proxy, &storage, &held);
+
+	if (!advertisement_filter(gattlib_adapter, &storage.advertisement)) {
+		goto EXIT;
+	}
+
+	discovered_advertisement_cb(gattlib_adapter, &storage.advertisement, user_data);
+
+EXIT:
+	gattlib_advertisement_storage_release(&storage);
+	release_variants(&held);
+}
+
+gboolean device_proxy_filter(struct gattlib_adapter *gattlib_adapter, GDBusProxy *device_proxy)
+{
+	struct gattlib_advertisement_storage storage;
+	struct advertisement_variants held = { .count = 0 };
+	gboolean match = FALSE;
+	GVariant *variant;
+
+	if ((gattlib_adapter->match_program == NULL) && (gattlib_adapter->scan_cache == NULL)) {
+		return TRUE;
+	}
+
+	variant = hold_cached_property(&held, device_proxy, "Address");
+	if (variant == NULL) {
+		return FALSE;
+	}
+
+	gattlib_advertisement_storage_init(&storage);
+	if (gattlib_string_to_bdaddr(g_variant_get_string(variant, NULL), &storage.advertisement.addr) == GATTLIB_SUCCESS) {
+		advertisement_from_device_proxy(device_proxy, &storage, &held);
+		match = advertisement_filter(gattlib_adapter, &storage.advertisement);
+	}
+
+	gattlib_advertisement_storage_release(&storage);
+	release_variants(&held);
+	return match;
+}
+
 #if BLUEZ_VERSION < BLUEZ_VERSIONS(5, 40)
 
 int gattlib_get_advertisement_data(gatt_connection_t *connection,
@@ -39,94 +263,140 @@ int gattlib_get_advertisement_data_from_mac(void *adapter, const char *mac_addre
 	return GATTLIB_NOT_SUPPORTED;
 }
 
+int gattlib_get_advertisement(gatt_connection_t *connection, gattlib_advertisement_t **advertisement)
+{
+	return GATTLIB_NOT_SUPPORTED;
+}
+
+int gattlib_get_advertisement_from_mac(void *adapter, const char *mac_address, gattlib_advertisement_t **advertisement)
+{
+	return GATTLIB_NOT_SUPPORTED;
+}
+
 #else
 
+/*
+ * Build the advertisement record of the device in 'storage'. The record points into the
+ * variants kept in 'held'. Both must be released by the caller.
+ */
+static int advertisement_from_device(OrgBluezDevice1 *bluez_device1, struct gattlib_advertisement_storage *storage,
+		struct advertisement_variants *held)
+{
+	GDBusProxy *device_proxy = G_DBUS_PROXY(bluez_device1);
+	GVariant *variant;
+
+	gattlib_advertisement_storage_init(storage);
+
+	variant = hold_cached_property(held, device_proxy, "Address");
+	if (variant == NULL) {
+		return GATTLIB_NOT_FOUND;
+	}
+	if (gattlib_string_to_bdaddr(g_variant_get_string(variant, NULL), &storage->advertisement.addr) != GATTLIB_SUCCESS) {
+		return GATTLIB_ERROR_DBUS;
+	}
+
+	advertisement_from_device_proxy(device_proxy, storage, held);
+	return GATTLIB_SUCCESS;
+}
+
 int get_advertisement_data_from_device(OrgBluezDevice1 *bluez_device1,
 		gattlib_advertisement_data_t **advertisement_data, size_t *advertisement_data_count,
 		uint16_t *manufacturer_id, uint8_t **manufacturer_data, size_t *manufacturer_data_size)
 {
-	GVariant *manufacturer_data_variant;
-	GVariant *service_data_variant;
+	struct gattlib_advertisement_storage storage;
+	struct advertisement_variants held = { .count = 0 };
+	const gattlib_advertisement_t *advertisement = &storage.advertisement;
+	gattlib_advertisement_data_t *service_data = NULL;
+	uint8_t *manufacturer_bytes = NULL;
+	size_t size;
+	int ret;
 
-	if (advertisement_data == NULL) {
+	if ((advertisement_data == NULL) || (advertisement_data_count == NULL) ||
+	    (manufacturer_id == NULL) || (manufacturer_data == NULL) || (manufacturer_data_size == NULL)) {
 		return GATTLIB_INVALID_PARAMETER;
 	}
 
-	*manufacturer_id = 0;
-	*manufacturer_data_size = 0;
-	manufacturer_data_variant = org_bluez_device1_get_manufacturer_data(bluez_device1);
-	if (manufacturer_data_variant != NULL) {
-		if (g_variant_n_children(manufacturer_data_variant) != 1) {
-			fprintf(stderr, "Warning: Manufacturer Data with multiple children: %s\n",
-				g_variant_print(manufacturer_data_variant, TRUE));
-			return GATTLIB_NOT_SUPPORTED;
+	ret = advertisement_from_device(bluez_device1, &storage, &held);
+	if (ret != GATTLIB_SUCCESS) {
+		goto EXIT;
+	}
+
+	// This API only reports the first Manufacturer Specific Data. Use gattlib_get_advertisement() to get all of them.
+	if (advertisement->manufacturer_data_count > 0) {
+		const gattlib_manufacturer_data_t *first = &advertisement->manufacturer_data[0];
+
+		manufacturer_bytes = malloc(first->data_length > 0 ? first->data_length : 1);
+		if (manufacturer_bytes == NULL) {
+			ret = GATTLIB_OUT_OF_MEMORY;
+			goto EXIT;
 		}
-		GVariant* manufacturer_data_dict = g_variant_get_child_value(manufacturer_data_variant, 0);
-		GVariantIter *iter;
-		GVariant* values;
+		memcpy(manufacturer_bytes, first->data, first->data_length);
+	}
 
-		g_variant_get(manufacturer_data_dict, "{qv}", manufacturer_id, &values);
-		*manufacturer_data_size = g_variant_n_children(values);
+	// The Service Data array and the data of its entries are a single allocation
+	if (advertisement->service_data_count > 0) {
+		uint8_t *bytes;
 
-		*manufacturer_data = calloc(*manufacturer_data_size, sizeof(guchar));
-		if (*manufacturer_data == NULL) {
-			return GATTLIB_OUT_OF_MEMORY;
+		size = advertisement->service_data_count * sizeof(gattlib_advertisement_data_t);
+		for (size_t i = 0; i < advertisement->service_data_count; i++) {
+			size += advertisement->service_data[i].data_length;
 		}
 
-		GVariant* value;
-		g_variant_get(values, "ay", &iter);
-		size_t index = 0;
+		service_data = malloc(size);
+		if (service_data == NULL) {
+			free(manufacturer_bytes);
+			ret = GATTLIB_OUT_OF_MEMORY;
+			goto EXIT;
+		}
 
-		while ((value = g_variant_iter_next_value(iter)) != NULL) {
-			g_variant_get(value, "y", &(*manufacturer_data)[index++]);
-			g_variant_unref(value);
+		bytes = (uint8_t*)(service_data + advertisement->service_data_count);
+		for (size_t i = 0; i < advertisement->service_data_count; i++) {
+			service_data[i] = advertisement->service_data[i];
+			service_data[i].data = bytes;
+			memcpy(bytes, advertisement->service_data[i].data, service_data[i].data_length);
+			bytes += service_data[i].data_length;
 		}
-		g_variant_iter_free(iter);
 	}
 
-	service_data_variant = org_bluez_device1_get_service_data(bluez_device1);
-	if (service_data_variant != NULL) {
-		GVariantIter *iter;
-		const gchar *key;
-		GVariant *value;
-		size_t index = 0;
-
-		*advertisement_data_count = g_variant_n_children(service_data_variant);
+	*advertisement_data = service_data;
+	*advertisement_data_count = advertisement->service_data_count;
+	if (manufacturer_bytes != NULL) {
+		*manufacturer_id = advertisement->manufacturer_data[0].manufacturer_id;
+		*manufacturer_data = manufacturer_bytes;
+		*manufacturer_data_size = advertisement->manufacturer_data[0].data_length;
+	} else {
+		*manufacturer_id = 0;
+		*manufacturer_data = NULL;
+		*manufacturer_data_size = 0;
+	}
 
-		gattlib_advertisement_data_t *advertisement_data_ptr = calloc(sizeof(gattlib_advertisement_data_t), *advertisement_data_count);
-		if (advertisement_data_ptr == NULL) {
-			return GATTLIB_OUT_OF_MEMORY;
-		}
+EXIT:
+	gattlib_advertisement_storage_release(&storage);
+	release_variants(&held);
+	return ret;
+}
 
-		g_variant_get(service_data_variant, "a{sv}", &iter);
-		while (g_variant_iter_loop(iter, "{&sv}", &key, &value)) {
-			gattlib_string_to_uuid(key, strlen(key), &advertisement_data_ptr[index].uuid);
+static int get_advertisement_from_device(OrgBluezDevice1 *bluez_device1, gattlib_advertisement_t **advertisement)
+{
+	struct gattlib_advertisement_storage storage;
+	struct advertisement_variants held = { .count = 0 };
+	int ret;
 
-			gsize n_elements = 0;
-			gconstpointer const_buffer = g_variant_get_fixed_array(value, &n_elements, sizeof(guchar));
-			if (const_buffer) {
-				advertisement_data_ptr[index].data = malloc(n_elements);
-				if (advertisement_data_ptr[index].data == NULL) {
-					return GATTLIB_OUT_OF_MEMORY;
-				}
-
-				advertisement_data_ptr[index].data_length = n_elements;
-				memcpy(advertisement_data_ptr[index].data, const_buffer, n_elements);
-			} else {
-				advertisement_data_ptr[index].data_length = 0;
-			}
+	if (advertisement == NULL) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
 
-			index++;
+	ret = advertisement_from_device(bluez_device1, &storage, &held);
+	if (ret == GATTLIB_SUCCESS) {
+		*advertisement = gattlib_advertisement_dup(&storage.advertisement);
+		if (*advertisement == NULL) {
+			ret = GATTLIB_OUT_OF_MEMORY;
 		}
-		g_variant_iter_free(iter);
-
-		*advertisement_data = advertisement_data_ptr;
-	} else {
-		*advertisement_data_count = 0;
-		*advertisement_data = NULL;
 	}
 
-	return GATTLIB_SUCCESS;
+	gattlib_advertisement_storage_release(&storage);
+	release_variants(&held);
+	return ret;
 }
 
 int gattlib_get_advertisement_data(gatt_connection_t *connection,
@@ -155,7 +425,6 @@ int gattlib_get_advertisement_data_from_mac(void *adapter, const char *mac_addre
 
 	ret = get_bluez_device_from_mac(adapter, mac_address, &bluez_device1);
 	if (ret != GATTLIB_SUCCESS) {
-		g_object_unref(bluez_device1);
 		return ret;
 	}
 
@@ -168,4 +437,34 @@ int gattlib_get_advertisement_data_from_mac(void *adapter, const char *mac_addre
 	return ret;
 }
 
+int gattlib_get_advertisement(gatt_connection_t *connection, gattlib_advertisement_t **advertisement)
+{
+	gattlib_context_t* conn_context;
+
+	if (connection == NULL) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	conn_context = connection->context;
+
+	return get_advertisement_from_device(conn_context->device, advertisement);
+}
+
+int gattlib_get_advertisement_from_mac(void *adapter, const char *mac_address, gattlib_advertisement_t **advertisement)
+{
+	OrgBluezDevice1 *bluez_device1;
+	int ret;
+
+	ret = get_bluez_device_from_mac(adapter, mac_address, &bluez_device1);
+	if (ret != GATTLIB_SUCCESS) {
+		return ret;
+	}
+
+	ret = get_advertisement_from_device(bluez_device1, advertisement);
+
+	g_object_unref(bluez_device1);
+
+	return ret;
+}
+
 #endif /* #if BLUEZ_VERSION < BLUEZ_VERSIONS(5, 40) */
@@ -215,24 +215,30 @@ static struct dbus_characteristic get_characteristic_from_handle(gatt_connection
 	return dbus_characteristic;
 }
 
-static int read_gatt_characteristic(struct dbus_characteristic *dbus_characteristic, void **buffer, size_t* buffer_len) {
+static int read_gatt_characteristic(struct dbus_characteristic *dbus_characteristic, void **buffer, size_t* buffer_len,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable)
+{
 	GVariant *out_value;
 	GError *error = NULL;
 	int ret = GATTLIB_SUCCESS;
 
+	// The proxy is only used by this request
+	set_dbus_proxy_timeout(dbus_characteristic->gatt, timeout_ms);
+
 #if BLUEZ_VERSION < BLUEZ_VERSIONS(5, 40)
 	org_bluez_gatt_characteristic1_call_read_value_sync(
-		dbus_characteristic->gatt, &out_value, NULL, &error);
+		dbus_characteristic->gatt, &out_value, GATTLIB_G_CANCELLABLE(cancellable), &error);
 #else
 	GVariantBuilder *options =  g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
 	org_bluez_gatt_characteristic1_call_read_value_sync(
-			dbus_characteristic->gatt, g_variant_builder_end(options), &out_value, NULL, &error);
+			dbus_characteristic->gatt, g_variant_builder_end(options), &out_value, GATTLIB_G_CANCELLABLE(cancellable), &error);
 	g_variant_builder_unref(options);
 #endif
 	if (error != NULL) {
 		fprintf(stderr, "Failed to read DBus GATT characteristic: %s\n", error->message);
+		ret = get_error_from_dbus_error(error);
 		g_error_free(error);
-		return GATTLIB_ERROR_DBUS;
+		return ret;
 	}
 
 	gsize n_elements = 0;
@@ -268,6 +274,12 @@ static int read_battery_level(struct dbus_characteristic *dbus_characteristic, v
 #endif
 
 int gattlib_read_char_by_uuid(gatt_connection_t* connection, uuid_t* uuid, void **buffer, size_t *buffer_len) {
+	return gattlib_read_char_by_uuid_with_timeout(connection, uuid, buffer, buffer_len, 0, NULL);
+}
+
+int gattlib_read_char_by_uuid_with_timeout(gatt_connection_t* connection, uuid_t* uuid, void **buffer, size_t *buffer_len,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable)
+{
 	struct dbus_characteristic dbus_characteristic = get_characteristic_from_uuid(connection, uuid);
 	if (dbus_characteristic.type == TYPE_NONE) {
 		return GATTLIB_NOT_FOUND;
@@ -282,7 +294,7 @@ int gattlib_read_char_by_uuid(gatt_connection_t* connection, uuid_t* uuid, void
 
 		assert(dbus_characteristic.type == TYPE_GATT);
 
-		ret = read_gatt_characteristic(&dbus_characteristic, buffer, buffer_len);
+		ret = read_gatt_characteristic(&dbus_characteristic, buffer, buffer_len, timeout_ms, cancellable);
 
 		g_object_unref(dbus_characteristic.gatt);
 
@@ -344,14 +356,18 @@ EXIT:
 	return ret;
 }
 
-static int write_char(struct dbus_characteristic *dbus_characteristic, const void* buffer, size_t buffer_len, uint32_t options)
+static int write_char(struct dbus_characteristic *dbus_characteristic, const void* buffer, size_t buffer_len, uint32_t options,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable)
 {
 	GVariant *value = g_variant_new_from_data(G_VARIANT_TYPE ("ay"), buffer, buffer_len, TRUE, NULL, NULL);
 	GError *error = NULL;
 	int ret = GATTLIB_SUCCESS;
 
+	// The proxy is only used by this request
+	set_dbus_proxy_timeout(dbus_characteristic->gatt, timeout_ms);
+
 #if BLUEZ_VERSION < BLUEZ_VERSIONS(5, 40)
-	org_bluez_gatt_characteristic1_call_write_value_sync(dbus_characteristic->gatt, value, NULL, &error);
+	org_bluez_gatt_characteristic1_call_write_value_sync(dbus_characteristic->gatt, value, GATTLIB_G_CANCELLABLE(cancellable), &error);
 #else
 	GVariantBuilder *variant_options = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
 
@@ -359,14 +375,16 @@ static int write_char(struct dbus_characteristic *dbus_characteristic, const voi
 		g_variant_builder_add(variant_options, "{sv}", "type", g_variant_new("s", "command"));
 	}
 
-	org_bluez_gatt_characteristic1_call_write_value_sync(dbus_characteristic->gatt, value, g_variant_builder_end(variant_options), NULL, &error);
+	org_bluez_gatt_characteristic1_call_write_value_sync(dbus_characteristic->gatt, value, g_variant_builder_end(variant_options),
+			GATTLIB_G_CANCELLABLE(cancellable), &error);
 	g_variant_builder_unref(variant_options);
 #endif
 
 	if (error != NULL) {
 		fprintf(stderr, "Failed to write DBus GATT characteristic: %s\n", error->message);
+		ret = get_error_from_dbus_error(error);
 		g_error_free(error);
-		return GATTLIB_ERROR_DBUS;
+		return ret;
 	}
 
 	//
@@ -378,6 +396,12 @@ static int write_char(struct dbus_characteristic *dbus_characteristic, const voi
 }
 
 int gattlib_write_char_by_uuid(gatt_connection_t* connection, uuid_t* uuid, const void* buffer, size_t buffer_len)
+{
+	return gattlib_write_char_by_uuid_with_timeout(connection, uuid, buffer, buffer_len, 0, NULL);
+}
+
+int gattlib_write_char_by_uuid_with_timeout(gatt_connection_t* connection, uuid_t* uuid, const void* buffer, size_t buffer_len,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable)
 {
 	int ret;
 
@@ -390,7 +414,7 @@ int gattlib_write_char_by_uuid(gatt_connection_t* connection, uuid_t* uuid, cons
 		assert(dbus_characteristic.type == TYPE_GATT);
 	}
 
-	ret = write_char(&dbus_characteristic, buffer, buffer_len, BLUEZ_GATT_WRITE_VALUE_TYPE_WRITE_WITH_RESPONSE);
+	ret = write_char(&dbus_characteristic, buffer, buffer_len, BLUEZ_GATT_WRITE_VALUE_TYPE_WRITE_WITH_RESPONSE, timeout_ms, cancellable);
 
 	g_object_unref(dbus_characteristic.gatt);
 	return ret;
@@ -405,7 +429,7 @@ int gattlib_write_char_by_handle(gatt_connection_t* connection, uint16_t handle,
 		return GATTLIB_NOT_FOUND;
 	}
 
-	ret = write_char(&dbus_characteristic, buffer, buffer_len, BLUEZ_GATT_WRITE_VALUE_TYPE_WRITE_WITH_RESPONSE);
+	ret = write_char(&dbus_characteristic, buffer, buffer_len, BLUEZ_GATT_WRITE_VALUE_TYPE_WRITE_WITH_RESPONSE, 0, NULL);
 
 	g_object_unref(dbus_characteristic.gatt);
 	return ret;
@@ -424,7 +448,7 @@ int gattlib_write_without_response_char_by_uuid(gatt_connection_t* connection, u
 		assert(dbus_characteristic.type == TYPE_GATT);
 	}
 
-	ret = write_char(&dbus_characteristic, buffer, buffer_len, BLUEZ_GATT_WRITE_VALUE_TYPE_WRITE_WITHOUT_RESPONSE);
+	ret = write_char(&dbus_characteristic, buffer, buffer_len, BLUEZ_GATT_WRITE_VALUE_TYPE_WRITE_WITHOUT_RESPONSE, 0, NULL);
 
 	g_object_unref(dbus_characteristic.gatt);
 	return ret;
@@ -439,7 +463,7 @@ int gattlib_write_without_response_char_by_handle(gatt_connection_t* connection,
 		return GATTLIB_NOT_FOUND;
 	}
 
-	ret = write_char(&dbus_characteristic, buffer, buffer_len, BLUEZ_GATT_WRITE_VALUE_TYPE_WRITE_WITHOUT_RESPONSE);
+	ret = write_char(&dbus_characteristic, buffer, buffer_len, BLUEZ_GATT_WRITE_VALUE_TYPE_WRITE_WITHOUT_RESPONSE, 0, NULL);
 
 	g_object_unref(dbus_characteristic.gatt);
 	return ret;
@@ -46,22 +46,49 @@
 
 #define GATTLIB_DEFAULT_ADAPTER "hci0"
 
+#if defined(GATTLIB_MGMT)
+/* RSSI value meaning 'no RSSI' for the mgmt interface */
+#define GATTLIB_MGMT_RSSI_INVALID 127
+
+typedef void (*gattlib_mgmt_device_found_t)(const bdaddr_t *addr, uint8_t addr_type, int8_t rssi,
+		const uint8_t *eir, size_t eir_length, void *user_data);
+
+/*
+ * Open the kernel management interface of the adapter. Return NULL if the interface cannot be
+ * used (eg: missing CAP_NET_ADMIN). The D-Bus API is then used for the adapter control.
+ */
+struct gattlib_mgmt *gattlib_mgmt_open(const char *adapter_name);
+void gattlib_mgmt_close(struct gattlib_mgmt *mgmt);
+int gattlib_mgmt_set_powered(struct gattlib_mgmt *mgmt, bool powered);
+int gattlib_mgmt_set_scan_parameters(struct gattlib_mgmt *mgmt, uint16_t interval, uint16_t window);
+
+/*
+ * Start the LE discovery. The Device Found events are reported to 'device_found_cb' from 'context'.
+ */
+int gattlib_mgmt_start_discovery(struct gattlib_mgmt *mgmt, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
+		GMainContext *context, gattlib_mgmt_device_found_t device_found_cb, void *user_data);
+int gattlib_mgmt_stop_discovery(struct gattlib_mgmt *mgmt);
+#endif
+
 typedef struct {
 	struct gattlib_adapter *adapter;
 
 	char* device_object_path;
 	OrgBluezDevice1* device;
 
-	// This attribute is only used during the connection stage. By placing the attribute here, we can pass
-	// `gatt_connection_t` to
-	GMainLoop *connection_loop;
-	// ID of the timeout to know if we managed to connect to the device
-	guint connection_timeout;
+	// Handler of the 'g-properties-changed' signal of 'device'
+	gulong device_signal_id;
+
+	// Set from the gattlib thread when the services of the device have been resolved. This attribute is
+	// only used during the connection stage (see gattlib_dbus_thread_wait()).
+	bool services_resolved;
 
 	// List of DBUS Object managed by 'adapter->device_manager'
 	GList *dbus_objects;
 
-	// List of 'OrgBluezGattCharacteristic1*' which has an attached notification
+	// Protect 'notified_characteristics' against concurrent calls from different threads
+	GMutex lock;
+	// List of 'struct gattlib_notification_handle*' which has an attached notification
 	GList *notified_characteristics;
 } gattlib_context_t;
 
@@ -71,8 +98,39 @@ struct gattlib_adapter {
 	OrgBluezAdapter1 *adapter_proxy;
 	char* adapter_name;
 
+	// Loop of the blocking scan functions
 	GMainLoop *scan_loop;
-	guint timeout_id;
+
+	// Scan started by gattlib_adapter_scan_start() or by the blocking scan functions
+	struct discovered_device_arg *scan_arg;
+	GMainContext *scan_context;
+	GSource *scan_timeout_source;
+	GSource *scan_expire_source;
+	gulong scan_added_signal_id;
+	gulong scan_changed_signal_id;
+
+	// Device Manager emitting the scan signals in 'scan_device_manager_context'
+	GDBusObjectManager *scan_device_manager;
+	GMainContext *scan_device_manager_context;
+
+	// Scan parameters (see gattlib_adapter_scan_set_parameters())
+	bool scan_filter_duplicates;
+	// Set of the addresses to report, keyed by their 48-bit value (see gattlib_adapter_scan_set_address_filter()).
+	// NULL to report all the devices.
+	GHashTable *address_filter;
+	// Rules set by gattlib_adapter_scan_set_match_rules()
+	struct gattlib_match_program *match_program;
+
+	// Change detection (see gattlib_adapter_scan_enable_change_detection())
+	struct gattlib_scan_cache *scan_cache;
+	gattlib_device_lost_t device_lost_cb;
+
+#if defined(GATTLIB_MGMT)
+	// Kernel management interface. NULL when the adapter is controlled through D-Bus.
+	struct gattlib_mgmt *mgmt;
+	// True when the running scan uses the mgmt discovery
+	bool scan_mgmt;
+#endif
 };
 
 struct dbus_characteristic {
@@ -93,15 +151,66 @@ extern const uuid_t m_battery_level_uuid;
 
 gboolean stop_scan_func(gpointer data);
 
+/*
+ * Context from which the signals of the connection proxies are emitted. The first call starts the
+ * gattlib thread dispatching this context unless the application dispatches it (see gattlib_dispatch()).
+ */
+GMainContext *gattlib_dbus_thread_context(void);
+
+/*
+ * Run 'func' from the thread dispatching the gattlib context with the context as thread-default
+ * and wait for its completion. D-Bus proxies created by 'func' emit their signals in this context.
+ */
+void gattlib_dbus_thread_invoke(GSourceFunc func, gpointer data);
+
+/*
+ * Wait up to 'timeout_ms' for 'condition' to be set by gattlib_dbus_thread_signal() from the
+ * gattlib context or for 'cancellable' (optional) to be cancelled. Return the value of 'condition'.
+ */
+bool gattlib_dbus_thread_wait(bool *condition, guint timeout_ms, GCancellable *cancellable);
+void gattlib_dbus_thread_signal(bool *condition);
+
+/* 'gattlib_cancellable_t' is a 'GCancellable' with the D-Bus backend */
+#define GATTLIB_G_CANCELLABLE(cancellable) ((GCancellable*)(cancellable))
+
+/*
+ * Set the timeout of the next method calls of the proxy. 0 restores the default D-Bus timeout.
+ */
+void set_dbus_proxy_timeout(gpointer proxy, unsigned int timeout_ms);
+
+/*
+ * Convert the error of a D-Bus call into GATTLIB_TIMEOUT, GATTLIB_CANCELLED or GATTLIB_ERROR_DBUS
+ */
+int get_error_from_dbus_error(const GError *error);
+
 struct gattlib_adapter *init_default_adapter(void);
 GDBusObjectManager *get_device_manager_from_adapter(struct gattlib_adapter *gattlib_adapter);
 
 void get_device_path_from_mac_with_adapter(OrgBluezAdapter1* adapter, const char *mac_address, char *object_path, size_t object_path_len);
 void get_device_path_from_mac(const char *adapter_name, const char *mac_address, char *object_path, size_t object_path_len);
+void get_device_path_from_bdaddr(const char *adapter_name, const bdaddr_t *bdaddr, char *object_path, size_t object_path_len);
 int get_bluez_device_from_mac(struct gattlib_adapter *adapter, const char *mac_address, OrgBluezDevice1 **bluez_device1);
 
 struct dbus_characteristic get_characteristic_from_uuid(gatt_connection_t* connection, const uuid_t* uuid);
 
 void disconnect_all_notifications(gattlib_context_t* conn_context);
 
+/*
+ * Check the address filter of the scan. The address is compared as an integer.
+ */
+gboolean address_filter_match(struct gattlib_adapter *gattlib_adapter, const bdaddr_t *bdaddr);
+
+/*
+ * Apply the match rules and the change detection to an advertisement or to the properties cached
+ * by a device proxy
+ */
+gboolean advertisement_filter(struct gattlib_adapter *gattlib_adapter, const gattlib_advertisement_t *advertisement);
+gboolean device_proxy_filter(struct gattlib_adapter *gattlib_adapter, GDBusProxy *device_proxy);
+
+/*
+ * Report the advertisement of a device from the properties cached by its 'org.bluez.Device1' proxy
+ */
+void report_advertisement_from_device_proxy(struct gattlib_adapter *gattlib_adapter, GDBusProxy *device_proxy,
+		gattlib_discovered_advertisement_t discovered_advertisement_cb, void *user_data);
+
 #endif
@@ -0,0 +1,447 @@
+/*
+ *
+ *  GattLib - GATT Library
+ *
+ *  Copyright (C) 2016-2020 Olivier Martin <olivier@labapart.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Adapter control through the kernel Bluetooth management interface
+ *
+ * The power state, the scan parameters and the discovery are driven with mgmt commands sent on
+ * a HCI_CHANNEL_CONTROL socket. The Device Found events are read from the same socket. They do
+ * not go through bluetoothd and D-Bus. The GATT operations still use the D-Bus API.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib-unix.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+
+#include "lib/mgmt.h"
+
+#include "gattlib_internal.h"
+
+/* Timeout (in ms) to receive the completion of a mgmt command */
+#define MGMT_COMMAND_TIMEOUT       2000
+/* Maximum number of events read on each wake up of the event source */
+#define MGMT_MAX_EVENTS_PER_WAKEUP 32
+
+/* Maximum number of UUIDs passed to the kernel discovery filter */
+#define MGMT_MAX_FILTER_UUIDS      32
+
+/* LE discovery: bit (1 << BDADDR_LE_PUBLIC) | (1 << BDADDR_LE_RANDOM) */
+#define MGMT_DISCOVERY_TYPE_LE     ((1 << BDADDR_LE_PUBLIC) | (1 << BDADDR_LE_RANDOM))
+
+struct gattlib_mgmt {
+	// The event handler holds a reference while it reports the events: the callback might close
+	// the adapter.
+	int ref;
+	int fd;
+	uint16_t index;
+
+	// Discovery command kept to restart the discovery when the kernel stops it
+	uint16_t discovery_opcode;
+	uint8_t discovery_param[sizeof(struct mgmt_cp_start_service_discovery) + MGMT_MAX_FILTER_UUIDS * 16];
+	uint16_t discovery_param_length;
+
+	// Source reading the events of the running discovery
+	GSource *event_source;
+	gattlib_mgmt_device_found_t device_found_cb;
+	void *user_data;
+};
+
+static int64_t get_monotonic_time_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int mgmt_status_to_gattlib_error(uint8_t status) {
+	switch (status) {
+	case MGMT_STATUS_SUCCESS:
+		return GATTLIB_SUCCESS;
+	case MGMT_STATUS_UNKNOWN_COMMAND:
+	case MGMT_STATUS_NOT_SUPPORTED:
+		return GATTLIB_NOT_SUPPORTED;
+	case MGMT_STATUS_INVALID_PARAMS:
+	case MGMT_STATUS_INVALID_INDEX:
+		return GATTLIB_INVALID_PARAMETER;
+	case MGMT_STATUS_NO_RESOURCES:
+		return GATTLIB_OUT_OF_MEMORY;
+	default:
+		return GATTLIB_DEVICE_ERROR;
+	}
+}
+
+static int mgmt_send(struct gattlib_mgmt *mgmt, uint16_t opcode, const void *param, uint16_t length) {
+	uint8_t buffer[MGMT_HDR_SIZE + sizeof(mgmt->discovery_param)];
+	struct mgmt_hdr *hdr = (struct mgmt_hdr *)buffer;
+	ssize_t ret;
+
+	if (length > sizeof(buffer) - MGMT_HDR_SIZE) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	hdr->opcode = htobs(opcode);
+	hdr->index = htobs(mgmt->index);
+	hdr->len = htobs(length);
+	if (length > 0) {
+		memcpy(buffer + MGMT_HDR_SIZE, param, length);
+	}
+
+	do {
+		ret = write(mgmt->fd, buffer, MGMT_HDR_SIZE + length);
+	} while ((ret < 0) && (errno == EINTR));
+
+	if (ret < 0) {
+		fprintf(stderr, "Failed to send mgmt command 0x%04x: %s\n", opcode, strerror(errno));
+		return GATTLIB_DEVICE_ERROR;
+	}
+
+	return GATTLIB_SUCCESS;
+}
+
+/*
+ * Dispatch one event of our controller. Return the status when it is the completion of 'opcode'
+ * and -1 otherwise.
+ */
+static int mgmt_process_event(struct gattlib_mgmt *mgmt, const uint8_t *buffer, size_t length, uint16_t opcode) {
+	const struct mgmt_hdr *hdr = (const struct mgmt_hdr *)buffer;
+	const uint8_t *param = buffer + MGMT_HDR_SIZE;
+	uint16_t param_length;
+
+	if (length < MGMT_HDR_SIZE) {
+		return -1;
+	}
+
+	param_length = btohs(hdr->len);
+	if ((btohs(hdr->index) != mgmt->index) || (MGMT_HDR_SIZE + param_length > length)) {
+		return -1;
+	}
+
+	switch (btohs(hdr->opcode)) {
+	case MGMT_EV_CMD_COMPLETE:
+	case MGMT_EV_CMD_STATUS:
+		// Both events start with the opcode and the status of the command
+		if (param_length < sizeof(struct mgmt_ev_cmd_status)) {
+			return -1;
+		} else {
+			const struct mgmt_ev_cmd_status *ev = (const struct mgmt_ev_cmd_status *)param;
+
+			if (btohs(ev->opcode) == opcode) {
+				return ev->status;
+			} else {
+				return -1;
+			}
+		}
+	case MGMT_EV_DEVICE_FOUND:
+		if ((mgmt->device_found_cb != NULL) && (param_length >= sizeof(struct mgmt_ev_device_found))) {
+			const struct mgmt_ev_device_found *ev = (const struct mgmt_ev_device_found *)param;
+			uint16_t eir_length = btohs(ev->eir_len);
+
+			if (sizeof(struct mgmt_ev_device_found) + eir_length <= param_length) {
+				mgmt->device_found_cb(&ev->addr.bdaddr, ev->addr.type, ev->rssi, ev->eir, eir_length, mgmt->user_data);
+			}
+		}
+		return -1;
+	case MGMT_EV_DISCOVERING:
+		// The kernel ends the LE discovery after a while. Restart it as long as the scan is running.
+		if ((mgmt->device_found_cb != NULL) && (param_length >= sizeof(struct mgmt_ev_discovering))) {
+			const struct mgmt_ev_discovering *ev = (const struct mgmt_ev_discovering *)param;
+
+			if (!ev->discovering) {
+				mgmt_send(mgmt, mgmt->discovery_opcode, mgmt->discovery_param, mgmt->discovery_param_length);
+			}
+		}
+		return -1;
+	default:
+		return -1;
+	}
+}
+
+/*
+ * Send a command and wait for its completion. The events received meanwhile are not reported.
+ */
+static int mgmt_command(struct gattlib_mgmt *mgmt, uint16_t opcode, const void *param, uint16_t length) {
+	gattlib_mgmt_device_found_t device_found_cb = mgmt->device_found_cb;
+	uint8_t buffer[HCI_MAX_FRAME_SIZE];
+	int64_t deadline;
+	int ret;
+
+	ret = mgmt_send(mgmt, opcode, param, length);
+	if (ret != GATTLIB_SUCCESS) {
+		return ret;
+	}
+
+	mgmt->device_found_cb = NULL;
+	deadline = get_monotonic_time_ms() + MGMT_COMMAND_TIMEOUT;
+
+	while (1) {
+		struct pollfd fds = { .fd = mgmt->fd, .events = POLLIN };
+		int64_t remaining = deadline - get_monotonic_time_ms();
+		ssize_t len;
+		int status;
+
+		if (remaining <= 0) {
+			fprintf(stderr, "Timeout on mgmt command 0x%04x\n", opcode);
+			ret = GATTLIB_DEVICE_ERROR;
+			break;
+		}
+
+		if (poll(&fds, 1, remaining) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ret = GATTLIB_DEVICE_ERROR;
+			break;
+		}
+
+		len = read(mgmt->fd, buffer, sizeof(buffer));
+		if (len < 0) {
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+				continue;
+			}
+			ret = GATTLIB_DEVICE_ERROR;
+			break;
+		}
+
+		status = mgmt_process_event(mgmt, buffer, len, opcode);
+		if (status >= 0) {
+			ret = mgmt_status_to_gattlib_error(status);
+			break;
+		}
+	}
+
+	mgmt->device_found_cb = device_found_cb;
+	return ret;
+}
+
+static void mgmt_unref(struct gattlib_mgmt *mgmt) {
+	if (--mgmt->ref > 0) {
+		return;
+	}
+
+	close(mgmt->fd);
+	free(mgmt);
+}
+
+static gboolean on_mgmt_event(gint fd, GIOCondition condition, gpointer user_data) {
+	struct gattlib_mgmt *mgmt = user_data;
+	uint8_t buffer[HCI_MAX_FRAME_SIZE];
+
+	if (condition & (G_IO_HUP | G_IO_ERR)) {
+		fprintf(stderr, "mgmt socket has been closed\n");
+		return G_SOURCE_REMOVE;
+	}
+
+	mgmt->ref++;
+
+	for (int i = 0; i < MGMT_MAX_EVENTS_PER_WAKEUP; i++) {
+		ssize_t len = read(mgmt->fd, buffer, sizeof(buffer));
+		if (len < 0) {
+			break;
+		}
+
+		mgmt_process_event(mgmt, buffer, len, 0);
+
+		// The callback might have stopped the discovery or closed the adapter
+		if (mgmt->device_found_cb == NULL) {
+			break;
+		}
+	}
+
+	mgmt_unref(mgmt);
+	// The source has been destroyed if the discovery has been stopped
+	return G_SOURCE_CONTINUE;
+}
+
+/*
+ * Convert a UUID into the 128-bit little-endian form used by the mgmt interface
+ */
+static void mgmt_uuid_to_le128(const uuid_t *uuid, uint8_t *le128) {
+	// Bluetooth Base UUID: 00000000-0000-1000-8000-00805F9B34FB
+	uint8_t be128[16] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+	                      0x80, 0x00, 0x00, 0x80, 0x5F, 0x9B, 0x34, 0xFB };
+
+	switch (uuid->type) {
+	case SDP_UUID16:
+		be128[2] = uuid->value.uuid16 >> 8;
+		be128[3] = uuid->value.uuid16 & 0xFF;
+		break;
+	case SDP_UUID32:
+		be128[0] = uuid->value.uuid32 >> 24;
+		be128[1] = (uuid->value.uuid32 >> 16) & 0xFF;
+		be128[2] = (uuid->value.uuid32 >> 8) & 0xFF;
+		be128[3] = uuid->value.uuid32 & 0xFF;
+		break;
+	default:
+		memcpy(be128, &uuid->value.uuid128, sizeof(be128));
+		break;
+	}
+
+	for (int i = 0; i < 16; i++) {
+		le128[i] = be128[15 - i];
+	}
+}
+
+struct gattlib_mgmt *gattlib_mgmt_open(const char *adapter_name) {
+	struct sockaddr_hci addr;
+	struct gattlib_mgmt *mgmt;
+	int fd;
+
+	if ((adapter_name == NULL) || (strncmp(adapter_name, "hci", 3) != 0)) {
+		return NULL;
+	}
+
+	fd = socket(PF_BLUETOOTH, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, BTPROTO_HCI);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.hci_family = AF_BLUETOOTH;
+	addr.hci_dev = HCI_DEV_NONE;
+	addr.hci_channel = HCI_CHANNEL_CONTROL;
+
+	// Binding the control channel requires CAP_NET_ADMIN
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	mgmt = calloc(1, sizeof(struct gattlib_mgmt));
+	if (mgmt == NULL) {
+		close(fd);
+		return NULL;
+	}
+
+	mgmt->ref = 1;
+	mgmt->fd = fd;
+	mgmt->index = atoi(adapter_name + 3);
+	return mgmt;
+}
+
+void gattlib_mgmt_close(struct gattlib_mgmt *mgmt) {
+	if (mgmt == NULL) {
+		return;
+	}
+
+	gattlib_mgmt_stop_discovery(mgmt);
+	mgmt_unref(mgmt);
+}
+
+int gattlib_mgmt_set_powered(struct gattlib_mgmt *mgmt, bool powered) {
+	uint8_t mode = powered ? 0x01 : 0x00;
+
+	return mgmt_command(mgmt, MGMT_OP_SET_POWERED, &mode, sizeof(mode));
+}
+
+int gattlib_mgmt_set_scan_parameters(struct gattlib_mgmt *mgmt, uint16_t interval, uint16_t window) {
+	struct mgmt_cp_set_scan_params cp = {
+		.interval = htobs(interval),
+		.window = htobs(window)
+	};
+
+	return mgmt_command(mgmt, MGMT_OP_SET_SCAN_PARAMS, &cp, sizeof(cp));
+}
+
+int gattlib_mgmt_start_discovery(struct gattlib_mgmt *mgmt, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
+		GMainContext *context, gattlib_mgmt_device_found_t device_found_cb, void *user_data)
+{
+	int ret;
+
+	if (mgmt->event_source != NULL) {
+		return GATTLIB_INVALID_PARAMETER;
+	}
+
+	if (enabled_filters & (GATTLIB_DISCOVER_FILTER_USE_UUID | GATTLIB_DISCOVER_FILTER_USE_RSSI)) {
+		// Let the kernel drop the advertisements that do not match the filters
+		struct mgmt_cp_start_service_discovery *cp = (struct mgmt_cp_start_service_discovery *)mgmt->discovery_param;
+		uint16_t uuid_count = 0;
+
+		cp->type = MGMT_DISCOVERY_TYPE_LE;
+		cp->rssi = GATTLIB_MGMT_RSSI_INVALID;
+		if (enabled_filters & GATTLIB_DISCOVER_FILTER_USE_RSSI) {
+			cp->rssi = (rssi_threshold < -127) ? -127 : ((rssi_threshold > 20) ? 20 : rssi_threshold);
+		}
+
+		if ((enabled_filters & GATTLIB_DISCOVER_FILTER_USE_UUID) && (uuid_list != NULL)) {
+			for (uuid_t **uuid_ptr = uuid_list; *uuid_ptr != NULL; uuid_ptr++) {
+				if (uuid_count == MGMT_MAX_FILTER_UUIDS) {
+					return GATTLIB_NOT_SUPPORTED;
+				}
+				mgmt_uuid_to_le128(*uuid_ptr, cp->uuids[uuid_count++]);
+			}
+		}
+		cp->uuid_count = htobs(uuid_count);
+
+		mgmt->discovery_opcode = MGMT_OP_START_SERVICE_DISCOVERY;
+		mgmt->discovery_param_length = sizeof(*cp) + uuid_count * 16;
+	} else {
+		struct mgmt_cp_start_discovery *cp = (struct mgmt_cp_start_discovery *)mgmt->discovery_param;
+
+		cp->type = MGMT_DISCOVERY_TYPE_LE;
+
+		mgmt->discovery_opcode = MGMT_OP_START_DISCOVERY;
+		mgmt->discovery_param_length = sizeof(*cp);
+	}
+
+	ret = mgmt_command(mgmt, mgmt->discovery_opcode, mgmt->discovery_param, mgmt->discovery_param_length);
+	if (ret != GATTLIB_SUCCESS) {
+		return ret;
+	}
+
+	mgmt->device_found_cb = device_found_cb;
+	mgmt->user_data = user_data;
+
+	mgmt->event_source = g_unix_fd_source_new(mgmt->fd, G_IO_IN | G_IO_HUP | G_IO_ERR);
+	g_source_set_callback(mgmt->event_source, (GSourceFunc)on_mgmt_event, mgmt, NULL);
+	g_source_attach(mgmt->event_source, context);
+
+	return GATTLIB_SUCCESS;
+}
+
+int gattlib_mgmt_stop_discovery(struct gattlib_mgmt *mgmt) {
+	struct mgmt_cp_stop_discovery cp = {
+		.type = MGMT_DISCOVERY_TYPE_LE
+	};
+
+	if (mgmt->event_source == NULL) {
+		// Discovery not running
+		return GATTLIB_SUCCESS;
+	}
+
+	g_source_destroy(mgmt->event_source);
+	g_source_unref(mgmt->event_source);
+	mgmt->event_source = NULL;
+	mgmt->device_found_cb = NULL;
+	mgmt->user_data = NULL;
+
+	return mgmt_command(mgmt, MGMT_OP_STOP_DISCOVERY, &cp, sizeof(cp));
+}
@@ -29,11 +29,21 @@
 #include "gattlib_internal.h"
 
 struct gattlib_notification_handle {
-	OrgBluezGattCharacteristic1 *gatt;
+	// 'OrgBluezGattCharacteristic1' or 'OrgBluezBattery1' proxy created from the gattlib thread
+	GDBusProxy *proxy;
+	int type;
 	gulong signal_id;
 	uuid_t uuid;
 };
 
+struct notification_signal_arg {
+	gatt_connection_t* connection;
+	struct gattlib_notification_handle *handle;
+	const char *object_path;
+	GCallback callback;
+	GError *error;
+};
+
 #if BLUEZ_VERSION > BLUEZ_VERSIONS(5, 40)
 gboolean on_handle_battery_level_property_change(
 		OrgBluezBattery1 *object,
@@ -147,8 +157,71 @@ static gboolean on_handle_characteristic_indication(
 	return TRUE;
 }
 
-static int connect_signal_to_characteristic_uuid(gatt_connection_t* connection, const uuid_t* uuid, void *callback) {
+/*
+ * Create the proxy of the characteristic from the gattlib thread and connect its signal.
+ * The signal is then emitted in the gattlib context.
+ */
+static gboolean connect_notification_signal(gpointer user_data) {
+	struct notification_signal_arg *arg = user_data;
+	struct gattlib_notification_handle *notification_handle = arg->handle;
+
+#if BLUEZ_VERSION > BLUEZ_VERSIONS(5, 40)
+	if (notification_handle->type == TYPE_BATTERY_LEVEL) {
+		notification_handle->proxy = (GDBusProxy*)org_bluez_battery1_proxy_new_for_bus_sync(
+				G_BUS_TYPE_SYSTEM,
+				G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,
+				"org.bluez",
+				arg->object_path,
+				NULL,
+				&arg->error);
+	} else
+#endif
+	{
+		notification_handle->proxy = (GDBusProxy*)org_bluez_gatt_characteristic1_proxy_new_for_bus_sync(
+				G_BUS_TYPE_SYSTEM,
+				G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,
+				"org.bluez",
+				arg->object_path,
+				NULL,
+				&arg->error);
+	}
+
+	if (notification_handle->proxy != NULL) {
+		// Register a handle for notification
+		notification_handle->signal_id = g_signal_connect(notification_handle->proxy,
+			"g-properties-changed",
+			arg->callback,
+			arg->connection);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+/*
+ * Disconnect the signals of the list of 'struct gattlib_notification_handle*' from the gattlib thread.
+ * Once done, their handlers cannot be running anymore.
+ */
+static gboolean disconnect_notification_signals(gpointer user_data) {
+	for (GList *l = user_data; l != NULL; l = l->next) {
+		struct gattlib_notification_handle *notification_handle = l->data;
+
+		g_signal_handler_disconnect(notification_handle->proxy, notification_handle->signal_id);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+static void free_notification_handle(gpointer data) {
+	struct gattlib_notification_handle *notification_handle = data;
+
+	g_object_unref(notification_handle->proxy);
+	free(notification_handle);
+}
+
+static int connect_signal_to_characteristic_uuid(gatt_connection_t* connection, const uuid_t* uuid, void *callback,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable)
+{
 	gattlib_context_t* conn_context = connection->context;
+	struct notification_signal_arg arg = { .connection = connection, .callback = G_CALLBACK(callback), .error = NULL };
+	char object_path[100];
 
 	struct dbus_characteristic dbus_characteristic = get_characteristic_from_uuid(connection, uuid);
 	if (dbus_characteristic.type == TYPE_NONE) {
@@ -157,45 +230,77 @@ static int connect_signal_to_characteristic_uuid(gatt_connection_t* connection,
 	}
 #if BLUEZ_VERSION > BLUEZ_VERSIONS(5, 40)
 	else if (dbus_characteristic.type == TYPE_BATTERY_LEVEL) {
-		// Register a handle for notification
-		g_signal_connect(dbus_characteristic.battery,
-			"g-properties-changed",
-			G_CALLBACK (on_handle_battery_level_property_change),
-			connection);
-
-		return GATTLIB_SUCCESS;
+		strncpy(object_path, g_dbus_proxy_get_object_path(G_DBUS_PROXY(dbus_characteristic.battery)), sizeof(object_path) - 1);
+		g_object_unref(dbus_characteristic.battery);
 	} else {
 		assert(dbus_characteristic.type == TYPE_GATT);
 	}
 #endif
-
-	// Register a handle for notification
-	gulong signal_id = g_signal_connect(dbus_characteristic.gatt,
-		"g-properties-changed",
-		G_CALLBACK(callback),
-		connection);
-	if (signal_id == 0) {
-		fprintf(stderr, "Failed to connect signal to DBus GATT notification\n");
-		return GATTLIB_ERROR_DBUS;
+	if (dbus_characteristic.type == TYPE_GATT) {
+		strncpy(object_path, g_dbus_proxy_get_object_path(G_DBUS_PROXY(dbus_characteristic.gatt)), sizeof(object_path) - 1);
+		g_object_unref(dbus_characteristic.gatt);
 	}
+	object_path[sizeof(object_path) - 1] = '\0';
 
-	// Add signal to the list
-	struct gattlib_notification_handle *notification_handle = malloc(sizeof(struct gattlib_notification_handle));
+	// The proxy found on this thread emits its signals in our thread-default context. We need
+	// a proxy created from the gattlib thread.
+	struct gattlib_notification_handle *notification_handle = calloc(1, sizeof(struct gattlib_notification_handle));
 	if (notification_handle == NULL) {
 		return GATTLIB_OUT_OF_MEMORY;
 	}
-	notification_handle->gatt = dbus_characteristic.gatt;
-	notification_handle->signal_id = signal_id;
+	notification_handle->type = dbus_characteristic.type;
 	memcpy(&notification_handle->uuid, uuid, sizeof(*uuid));
+
+	arg.handle = notification_handle;
+	arg.object_path = object_path;
+	gattlib_dbus_thread_invoke(connect_notification_signal, &arg);
+
+	if (notification_handle->proxy == NULL) {
+		if (arg.error) {
+			fprintf(stderr, "Failed to connect to DBus GATT characteristic: %s\n", arg.error->message);
+			g_error_free(arg.error);
+		}
+		free(notification_handle);
+		return GATTLIB_ERROR_DBUS;
+	} else if (notification_handle->signal_id == 0) {
+		fprintf(stderr, "Failed to connect signal to DBus GATT notification\n");
+		g_object_unref(notification_handle->proxy);
+		free(notification_handle);
+		return GATTLIB_ERROR_DBUS;
+	}
+
+	// Add signal to the list
+	g_mutex_lock(&conn_context->lock);
 	conn_context->notified_characteristics = g_list_append(conn_context->notified_characteristics, notification_handle);
+	g_mutex_unlock(&conn_context->lock);
+
+	// Bluez notifies the battery level through the properties of 'org.bluez.Battery1'
+	if (notification_handle->type != TYPE_GATT) {
+		return GATTLIB_SUCCESS;
+	}
 
 	GError *error = NULL;
-	org_bluez_gatt_characteristic1_call_start_notify_sync(dbus_characteristic.gatt, NULL, &error);
+	set_dbus_proxy_timeout(notification_handle->proxy, timeout_ms);
+	org_bluez_gatt_characteristic1_call_start_notify_sync(
+			ORG_BLUEZ_GATT_CHARACTERISTIC1(notification_handle->proxy), GATTLIB_G_CANCELLABLE(cancellable), &error);
+	set_dbus_proxy_timeout(notification_handle->proxy, 0);
 
 	if (error) {
+		int ret = get_error_from_dbus_error(error);
+
 		fprintf(stderr, "Failed to start DBus GATT notification: %s\n", error->message);
 		g_error_free(error);
-		return GATTLIB_ERROR_DBUS;
+
+		// Do not leave the signal connected to a characteristic that does not notify
+		GList notification_link = { .data = notification_handle };
+
+		g_mutex_lock(&conn_context->lock);
+		conn_context->notified_characteristics = g_list_remove(conn_context->notified_characteristics, notification_handle);
+		g_mutex_unlock(&conn_context->lock);
+
+		gattlib_dbus_thread_invoke(disconnect_notification_signals, &notification_link);
+		free_notification_handle(notification_handle);
+		return ret;
 	} else {
 		return GATTLIB_SUCCESS;
 	}
@@ -204,8 +309,10 @@ static int connect_signal_to_characteristic_uuid(gatt_connection_t* connection,
 static int disconnect_signal_to_characteristic_uuid(gatt_connection_t* connection, const uuid_t* uuid, void *callback) {
 	gattlib_context_t* conn_context = connection->context;
 	struct gattlib_notification_handle *notification_handle = NULL;
+	GList notification_link = { 0 };
 
 	// Find notification handle
+	g_mutex_lock(&conn_context->lock);
 	for (GList *l = conn_context->notified_characteristics; l != NULL; l = l->next) {
 		struct gattlib_notification_handle *notification_handle_ptr = l->data;
 		if (gattlib_uuid_cmp(&notification_handle_ptr->uuid, uuid) == GATTLIB_SUCCESS) {
@@ -215,18 +322,22 @@ static int disconnect_signal_to_characteristic_uuid(gatt_connection_t* connectio
 			break;
 		}
 	}
+	g_mutex_unlock(&conn_context->lock);
 
 	if (notification_handle == NULL) {
 		return GATTLIB_NOT_FOUND;
 	}
 
-	g_signal_handler_disconnect(notification_handle->gatt, notification_handle->signal_id);
+	notification_link.data = notification_handle;
+	gattlib_dbus_thread_invoke(disconnect_notification_signals, &notification_link);
 
 	GError *error = NULL;
-	org_bluez_gatt_characteristic1_call_stop_notify_sync(
-			notification_handle->gatt, NULL, &error);
+	if (notification_handle->type == TYPE_GATT) {
+		org_bluez_gatt_characteristic1_call_stop_notify_sync(
+				ORG_BLUEZ_GATT_CHARACTERISTIC1(notification_handle->proxy), NULL, &error);
+	}
 
-	free(notification_handle);
+	free_notification_handle(notification_handle);
 
 	if (error) {
 		fprintf(stderr, "Failed to stop DBus GATT notification: %s\n", error->message);
@@ -238,7 +349,14 @@ static int disconnect_signal_to_characteristic_uuid(gatt_connection_t* connectio
 }
 
 int gattlib_notification_start(gatt_connection_t* connection, const uuid_t* uuid) {
-	return connect_signal_to_characteristic_uuid(connection, uuid, on_handle_characteristic_property_change);
+	return connect_signal_to_characteristic_uuid(connection, uuid, on_handle_characteristic_property_change, 0, NULL);
+}
+
+int gattlib_notification_start_with_timeout(gatt_connection_t* connection, const uuid_t* uuid,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable)
+{
+	return connect_signal_to_characteristic_uuid(connection, uuid, on_handle_characteristic_property_change,
+			timeout_ms, cancellable);
 }
 
 int gattlib_notification_stop(gatt_connection_t* connection, const uuid_t* uuid) {
@@ -246,7 +364,7 @@ int gattlib_notification_stop(gatt_connection_t* connection, const uuid_t* uuid)
 }
 
 int gattlib_indication_start(gatt_connection_t* connection, const uuid_t* uuid) {
-	return connect_signal_to_characteristic_uuid(connection, uuid, on_handle_characteristic_indication);
+	return connect_signal_to_characteristic_uuid(connection, uuid, on_handle_characteristic_indication, 0, NULL);
 }
 
 int gattlib_indication_stop(gatt_connection_t* connection, const uuid_t* uuid) {
@@ -254,13 +372,14 @@ int gattlib_indication_stop(gatt_connection_t* connection, const uuid_t* uuid) {
 }
 
 void disconnect_all_notifications(gattlib_context_t* conn_context) {
-	// Find notification handle
-	for (GList *l = conn_context->notified_characteristics; l != NULL; l = l->next) {
-		struct gattlib_notification_handle *notification_handle = l->data;
+	GList *notified_characteristics;
 
-		g_signal_handler_disconnect(notification_handle->gatt, notification_handle->signal_id);
-		free(notification_handle);
-	}
+	g_mutex_lock(&conn_context->lock);
+	notified_characteristics = conn_context->notified_characteristics;
+	conn_context->notified_characteristics = NULL;
+	g_mutex_unlock(&conn_context->lock);
+
+	gattlib_dbus_thread_invoke(disconnect_notification_signals, notified_characteristics);
 
-	g_list_free_full(conn_context->notified_characteristics, g_object_unref);
+	g_list_free_full(notified_characteristics, free_notification_handle);
 }
@@ -0,0 +1,226 @@
+/*
+ *
+ *  GattLib - GATT Library
+ *
+ *  Copyright (C) 2016-2020 Olivier Martin <olivier@labapart.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "gattlib_internal.h"
+
+/*
+ * The D-Bus proxies of the connections are created from the gattlib main context. Their signals
+ * (disconnection, notifications, indications) are then emitted from the thread dispatching this
+ * context: either an internal thread started with the first connection or the application when
+ * it uses gattlib_get_pollfd()/gattlib_dispatch().
+ */
+struct gattlib_dbus_thread {
+	// Protect the fields of this structure and the conditions of gattlib_dbus_thread_wait()
+	GMutex        mutex;
+	GCond         cond;
+	GThread*      thread;
+	GMainContext* loop_context;
+	GMainLoop*    loop;
+	bool          running;
+	// True when 'loop_context' is dispatched by the application (see gattlib_dispatch())
+	bool          external;
+};
+
+struct gattlib_dbus_thread_call {
+	GSourceFunc func;
+	gpointer    data;
+	bool        done;
+};
+
+static struct gattlib_dbus_thread m_dbus_thread;
+
+static gpointer dbus_thread(gpointer arg) {
+	struct gattlib_dbus_thread* loop_thread = arg;
+
+	// The loop keeps running for the lifetime of the process
+	g_main_loop_run(loop_thread->loop);
+	return NULL;
+}
+
+static gboolean dbus_thread_started(gpointer user_data) {
+	gattlib_dbus_thread_signal(&m_dbus_thread.running);
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean dbus_thread_timeout(gpointer user_data) {
+	bool *timed_out = user_data;
+
+	*timed_out = true;
+	return G_SOURCE_REMOVE;
+}
+
+static void dbus_thread_cancelled(GCancellable *cancellable, gpointer user_data) {
+	// Wake up the waiting threads to let them check the cancellation
+	g_mutex_lock(&m_dbus_thread.mutex);
+	g_cond_broadcast(&m_dbus_thread.cond);
+	g_mutex_unlock(&m_dbus_thread.mutex);
+
+	g_main_context_wakeup(m_dbus_thread.loop_context);
+}
+
+static gboolean dbus_thread_call(gpointer user_data) {
+	struct gattlib_dbus_thread_call *call = user_data;
+
+	g_main_context_push_thread_default(m_dbus_thread.loop_context);
+	call->func(call->data);
+	g_main_context_pop_thread_default(m_dbus_thread.loop_context);
+
+	gattlib_dbus_thread_signal(&call->done);
+	return G_SOURCE_REMOVE;
+}
+
+GMainContext *gattlib_dbus_thread_context(void) {
+	GMainContext *context;
+
+	g_mutex_lock(&m_dbus_thread.mutex);
+
+	if (m_dbus_thread.loop_context == NULL) {
+		m_dbus_thread.loop_context = g_main_context_new();
+	}
+
+	if (!m_dbus_thread.external && (m_dbus_thread.thread == NULL)) {
+		GSource *source;
+
+		m_dbus_thread.loop = g_main_loop_new(m_dbus_thread.loop_context, FALSE);
+
+		// Notify us once the loop dispatches the context
+		source = g_idle_source_new();
+		g_source_set_callback(source, dbus_thread_started, NULL, NULL);
+		g_source_attach(source, m_dbus_thread.loop_context);
+		g_source_unref(source);
+
+		m_dbus_thread.thread = g_thread_new("gattlib", dbus_thread, &m_dbus_thread);
+
+		// Wait for the loop to be started
+		while (!m_dbus_thread.running) {
+			g_cond_wait(&m_dbus_thread.cond, &m_dbus_thread.mutex);
+		}
+	}
+
+	context = m_dbus_thread.loop_context;
+	g_mutex_unlock(&m_dbus_thread.mutex);
+	return context;
+}
+
+GMainContext *gattlib_get_main_context(void) {
+	GMainContext *context = NULL;
+
+	g_mutex_lock(&m_dbus_thread.mutex);
+
+	// Once started, the internal thread dispatches the context
+	if (m_dbus_thread.thread == NULL) {
+		if (m_dbus_thread.loop_context == NULL) {
+			m_dbus_thread.loop_context = g_main_context_new();
+		}
+
+		// No internal thread will be started. The application dispatches the events.
+		m_dbus_thread.external = true;
+		context = m_dbus_thread.loop_context;
+	}
+
+	g_mutex_unlock(&m_dbus_thread.mutex);
+	return context;
+}
+
+void gattlib_dbus_thread_invoke(GSourceFunc func, gpointer data) {
+	GMainContext *context = gattlib_dbus_thread_context();
+	struct gattlib_dbus_thread_call call = { .func = func, .data = data, .done = false };
+	GSource *source;
+
+	if (g_main_context_acquire(context)) {
+		// The context is not dispatched by another thread. We can run the function from here.
+		g_main_context_push_thread_default(context);
+		func(data);
+		g_main_context_pop_thread_default(context);
+		g_main_context_release(context);
+		return;
+	}
+
+	source = g_idle_source_new();
+	g_source_set_priority(source, G_PRIORITY_HIGH);
+	g_source_set_callback(source, dbus_thread_call, &call, NULL);
+	g_source_attach(source, context);
+	g_source_unref(source);
+
+	g_mutex_lock(&m_dbus_thread.mutex);
+	while (!call.done) {
+		g_cond_wait(&m_dbus_thread.cond, &m_dbus_thread.mutex);
+	}
+	g_mutex_unlock(&m_dbus_thread.mutex);
+}
+
+bool gattlib_dbus_thread_wait(bool *condition, guint timeout_ms, GCancellable *cancellable) {
+	GMainContext *context = gattlib_dbus_thread_context();
+	gulong cancelled_id = 0;
+	bool ret;
+
+	if (cancellable != NULL) {
+		cancelled_id = g_cancellable_connect(cancellable, G_CALLBACK(dbus_thread_cancelled), NULL, NULL);
+	}
+
+	if (g_main_context_acquire(context)) {
+		// We are the thread dispatching the context (eg: from a callback or with an external
+		// event loop). The condition can only be set if we dispatch the context ourself.
+		bool timed_out = false;
+		GSource *timeout_source = g_timeout_source_new(timeout_ms);
+
+		g_source_set_callback(timeout_source, dbus_thread_timeout, &timed_out, NULL);
+		g_source_attach(timeout_source, context);
+
+		while (!*condition && !timed_out && !g_cancellable_is_cancelled(cancellable)) {
+			g_main_context_iteration(context, TRUE);
+		}
+
+		g_source_destroy(timeout_source);
+		g_source_unref(timeout_source);
+
+		ret = *condition;
+		g_main_context_release(context);
+	} else {
+		gint64 end_time = g_get_monotonic_time() + (gint64)timeout_ms * G_TIME_SPAN_MILLISECOND;
+
+		g_mutex_lock(&m_dbus_thread.mutex);
+		while (!*condition && !g_cancellable_is_cancelled(cancellable)) {
+			if (!g_cond_wait_until(&m_dbus_thread.cond, &m_dbus_thread.mutex, end_time)) {
+				break;
+			}
+		}
+		ret = *condition;
+		g_mutex_unlock(&m_dbus_thread.mutex);
+	}
+
+	// It waits for the completion of the callback if it is running
+	g_cancellable_disconnect(cancellable, cancelled_id);
+	return ret;
+}
+
+void gattlib_dbus_thread_signal(bool *condition) {
+	g_mutex_lock(&m_dbus_thread.mutex);
+	*condition = true;
+	g_cond_broadcast(&m_dbus_thread.cond);
+	g_mutex_unlock(&m_dbus_thread.mutex);
+}
@@ -7,16 +7,10 @@
 #define BLE_SCAN_TIMEOUT   60
 
 static void ble_advertising_device(void *adapter, const char* addr, const char* name, void *user_data) {
-	gattlib_advertisement_data_t *advertisement_data;
-	size_t advertisement_data_count;
-	uint16_t manufacturer_id;
-	uint8_t *manufacturer_data;
-	size_t manufacturer_data_size;
+	gattlib_advertisement_t *advertisement;
 	int ret;
 
-	ret = gattlib_get_advertisement_data_from_mac(adapter, addr,
-			&advertisement_data, &advertisement_data_count,
-			&manufacturer_id, &manufacturer_data, &manufacturer_data_size);
+	ret = gattlib_get_advertisement_from_mac(adapter, addr, &advertisement);
 	if (ret != 0) {
 		return;
 	}
@@ -27,10 +21,17 @@ static void ble_advertising_device(void *adapter, const char* addr, const char*
 		printf("Device %s: ", addr);
 	}
 
-	for (size_t i = 0; i < manufacturer_data_size; i++) {
-		printf("%02x ", manufacturer_data[i]);
+	for (size_t i = 0; i < advertisement->manufacturer_data_count; i++) {
+		const gattlib_manufacturer_data_t *manufacturer_data = &advertisement->manufacturer_data[i];
+
+		printf("[%04x] ", manufacturer_data->manufacturer_id);
+		for (size_t j = 0; j < manufacturer_data->data_length; j++) {
+			printf("%02x ", manufacturer_data->data[j]);
+		}
 	}
 	printf("\n");
+
+	gattlib_advertisement_free(advertisement);
 }
 
 int main(int argc, const char *argv[]) {
@@ -8,6 +8,9 @@
 
 #define BLE_SCAN_TIMEOUT   4
 
+// Only the devices of this list are reported by the scan
+static const char* m_scan_addresses[] = { "D1:A6:5A:2C:B0:36", NULL };
+
 typedef void (*ble_discovered_device_t)(const char* addr, const char* name);
 
 // We use a mutex to make the BLE connections synchronous
@@ -30,8 +33,6 @@ static void *ble_connect_device(void *arg) {
 	char uuid_str[MAX_LEN_UUID_STR + 1];
 	int ret, i;
 
-	if(strcmp(addr, "D1:A6:5A:2C:B0:36") != 0)
-		return NULL;
 	pthread_mutex_lock(&g_mutex);
 
 	printf("------------START %s ---------------\n", addr);
@@ -151,6 +152,12 @@ int main(int argc, const char *argv[]) {
 		return 1;
 	}
 
+	ret = gattlib_adapter_scan_set_address_filter(adapter, m_scan_addresses);
+	if (ret) {
+		fprintf(stderr, "ERROR: Failed to set the scan address filter.\n");
+		goto EXIT;
+	}
+
 	pthread_mutex_lock(&g_mutex);
 	ret = gattlib_adapter_scan_enable(adapter, ble_discovered_device, BLE_SCAN_TIMEOUT, NULL /* user_data */);
 	if (ret) {
@@ -34,9 +34,15 @@
 #include <sys/time.h>
 
 #include <glib.h>
+#include <glib-unix.h>
 
 #include "iot_slave.h"
 #include "gattlib.h"
+#include "framer.h"
+#include "record.h"
+#include "slave_state.h"
+#include "timer_wheel.h"
+#include "uplink.h"
 
 #ifdef WIN32
 #include <windows.h>
@@ -45,17 +51,53 @@
 #else
 #include <unistd.h> // for usleep
 #endif
+#include <time.h>   // for clock_gettime
 
 #define MIN_TIMEOUT 35000
+// Default number of slaves brought up at the same time. Most controllers create one LE connection
+// at a time: the other attempts wait in the kernel and consume their timeout.
+#define SLAVE_CONNECT_IN_FLIGHT 4
+#define SLAVE_CONNECT_IN_FLIGHT_MAX 64
+#define SLAVE_CONNECT_TIMEOUT 10000
+// Slaves waiting for a connection attempt per attempt in flight. The others try again later.
+#define SLAVE_CONNECT_QUEUE 4
+#define SLAVE_CONNECT_RETRY 5000
+// Delay (ms) before a new connection attempt. It doubles on each consecutive failure.
+#define SLAVE_BACKOFF_MIN 1000
+#define SLAVE_BACKOFF_MAX 120000
+// Consecutive failures after which the slave is only tried every SLAVE_BREAKER_PARK ms
+#define SLAVE_BREAKER_FAILURES 8
+#define SLAVE_BREAKER_PARK 600000
+// Number of threads writing the commands. Each slave has one command written at a time.
+#define SLAVE_COMMAND_THREADS 8
+// Records buffered while the collector is slow or unreachable
+#define UPLINK_BUFFER_SIZE (256 * 1024)
+#define COLLECTOR_HOST "127.0.0.1"
+#define COLLECTOR_PORT 1337
+// State of the slaves kept across the restarts
+#define SLAVE_STATE_FILE "slave_state.dat"
+// Slaves not seen for a day are connected after the others on start
+#define SLAVE_STATE_STALE 86400000
+// Period (ms) of the checks of the maintenance: the next slaves are reconnected once the previous ones are back
+#define SLAVE_RECYCLE_STEP 1000
 #define DEF_SESSION 1
 //static GSourceFunc operation;
 // Battery Level UUID
 const uuid_t g_battery_level_uuid = CREATE_UUID16(0x2A19);
 unsigned long g_reboot_time = 2592000000; // 30 day maintenance
+unsigned int g_connect_in_flight = SLAVE_CONNECT_IN_FLIGHT;
+enum record_format g_record_format = RECORD_FORMAT_TEXT;
 //marker
 static int g_slave_from_file = 0;
 static GMainLoop *m_main_loop;
-int socket_idle(const char *);
+// Drive the polling, the timeouts and the reconnections of the slaves
+static struct timer_wheel m_timer_wheel;
+static struct timer_wheel_timer m_recycle_timer;
+static guint m_timer_source = 0;
+static uint64_t m_start_time;
+// Maintenance: slaves [m_recycle_start, m_recycle_index) are being reconnected
+static guint m_recycle_start = 0;
+static guint m_recycle_index = 0;
 
 void sleep_ms(int milliseconds){ // cross-platform sleep function
 #ifdef WIN32
@@ -74,77 +116,104 @@ void sleep_ms(int milliseconds){ // cross-platform sleep function
 #endif
 }
 
-unsigned int timeGetTime()
+// Monotonic time in ms. It is not affected by the changes of the wall clock.
+uint64_t timeGetTime()
 {
-	static unsigned int accum = 0, last = 0, init = 0;
-	struct timeval now;
-	gettimeofday(&now, NULL);
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
 
-	unsigned int cur = now.tv_usec/1000;
-	if(init == 0)
-		last = cur;
-	
-	init = 1;
-	if(cur < last)
-		last = 0;
-	
-	accum += cur - last;
-	//printf("acc %ud,now %lud/", accum, now.tv_usec);
-	
-	last = cur;
-	return accum;
+	return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
 }
 
+// Characteristics of the slaves
+static	uuid_t	g_uuid_noti, g_uuid_write, g_uuid_serialnum;
+
+// Cold data of a slave: used to identify it and to handle its notifications
+typedef struct __iiot_slave_info__{
+	int	state_index;	// record in the state file (-1: none)
+	uint8_t	addr_type;	// BDADDR_LE_* the slave connected with (0: unknown)
+	uint16_t	handle_noti, handle_write;	// value handles of the characteristics (0: unknown)
+	int	radio_pow, battery_lev;
+	char device_str[128];
+	char serial_str[128];
+	const struct framer_config *framer_config;	// framing of the messages of the slave
+	struct framer framer;	// messages spanning several notifications
+} STIIOT_SlaveInfo;
+
+// Data of a slave used by the scheduling. It is kept small: the timers only touch this part.
 typedef struct __iiot_slave__{
-	uuid_t	uuid_noti, uuid_write, uuid_battery, uuid_serialnum;
 	unsigned int	holding_time;
-	unsigned int	last_update_time;
+	uint64_t	last_update_time;
 	unsigned int	time_to_rewrite;
+	struct timer_wheel_timer timer;	// next poll or reconnection of the slave
+	gint	connecting;	// set while the slave is in the connection manager
+	unsigned int	failures;	// consecutive failed connection attempts
+	gboolean	stale;	// restored but not seen lately: connected after the other slaves
+	gboolean	recycling;	// disconnected by the maintenance, not connected again yet
+	uint64_t	retry_time;	// earliest time of the next connection attempt
+	GMutex	command_lock;	// protect the commands and the changes of 'connection'
+	GQueue	commands;	// commands waiting to be written
+	gboolean	command_busy;	// a command is written or its delay is running
+	gboolean	command_writing;	// the command job writes to 'connection'
+	gatt_connection_t*	connection_closing;	// disconnected during a write: released by the command job
+	struct timer_wheel_timer command_timer;	// end of the delay of the last command
 	gatt_connection_t* connection;
-	int	radio_pow, battery_lev;
-	char device_str[128];
-	char serial_str[128];
-	char data[1024];
+	bdaddr_t device_addr;
+	uint64_t device_key;	// device_addr as an integer to look up the slaves
+	uint16_t serial_id;	// serial_str interned for the binary records (0: not yet)
+	STIIOT_SlaveInfo *info;
 } STIIOT_Slave;
 
-#define MAX_SLAVE	100
-static	STIIOT_Slave	g_connections[MAX_SLAVE];
-static	int				g_connection_cnt = 0;
+// Registry of the slaves. They are only added from the main loop and never freed: their address
+// is used by the timers, the notifications and the worker threads.
+static	GPtrArray	*g_slaves = NULL;
+static	GHashTable	*g_slave_index = NULL;	// device_key -> slave
 
 int slave_reconnect(STIIOT_Slave*);
-int socket_disconnect();
+void slave_schedule(STIIOT_Slave*, uint64_t);
+void master_schedule();
+static void slave_timer_cb(struct timer_wheel_timer*, uint64_t, void*);
+static void slave_command_timer_cb(struct timer_wheel_timer*, uint64_t, void*);
 
 int slave_reset()
 {
-	g_connection_cnt = 0;
-
-	uuid_t uuid_noti, uuid_write, uuid_sn;
 	const char *uuid_str = "2a25";
-	if (gattlib_string_to_uuid(uuid_str, strlen(uuid_str) + 1, &uuid_sn) < 0) {
+	if (gattlib_string_to_uuid(uuid_str, strlen(uuid_str) + 1, &g_uuid_serialnum) < 0) {
 		return 0;
 	}
 	uuid_str = "6e400002-b5a3-f393-e0a9-e50e24dcca9e";
-	if (gattlib_string_to_uuid(uuid_str, strlen(uuid_str) + 1, &uuid_write) < 0) {
+	if (gattlib_string_to_uuid(uuid_str, strlen(uuid_str) + 1, &g_uuid_write) < 0) {
 		return 0;
 	}
 	uuid_str = "6e400003-b5a3-f393-e0a9-e50e24dcca9e";
-	if (gattlib_string_to_uuid(uuid_str, strlen(uuid_str) + 1, &uuid_noti) < 0) {
+	if (gattlib_string_to_uuid(uuid_str, strlen(uuid_str) + 1, &g_uuid_noti) < 0) {
 		return 0;
 	}
-	for(int i=0; i<MAX_SLAVE; i++)
-	{
-		g_connections[i].uuid_noti	= uuid_noti;
-		g_connections[i].uuid_write	= uuid_write;
-		g_connections[i].uuid_serialnum	= uuid_sn;
-		g_connections[i].device_str[0] = 0;
-		g_connections[i].serial_str[0] = 0;
-		g_connections[i].holding_time = 2000; //600000; // 60 * 10 sec(10 minute);
-		g_connections[i].time_to_rewrite = MIN_TIMEOUT;
-		g_connections[i].connection = NULL;
-	}
+
+	g_slaves = g_ptr_array_new();
+	g_slave_index = g_hash_table_new(g_int64_hash, g_int64_equal);
 	return 1;
 }
 
+static STIIOT_Slave* slave_new(const bdaddr_t *_device_addr, unsigned int _holding_time)
+{
+	STIIOT_Slave *slave = g_new0(STIIOT_Slave, 1);
+
+	slave->info = g_new0(STIIOT_SlaveInfo, 1);
+	slave->info->state_index = -1;
+	slave->info->framer_config = framer_config_default();
+	framer_init(&slave->info->framer, slave->info->framer_config);
+	bacpy(&slave->device_addr, _device_addr);
+	slave->device_key = gattlib_bdaddr_to_uint64(_device_addr);
+	slave->holding_time = _holding_time;
+	slave->time_to_rewrite = MIN_TIMEOUT;
+	timer_wheel_timer_init(&slave->timer, slave_timer_cb, slave);
+	g_mutex_init(&slave->command_lock);
+	g_queue_init(&slave->commands);
+	timer_wheel_timer_init(&slave->command_timer, slave_command_timer_cb, slave);
+	return slave;
+}
+
 void slave_timeout_update(STIIOT_Slave *_slave)
 {
 	unsigned int timeout = _slave->holding_time * 2;
@@ -154,115 +223,278 @@ void slave_timeout_update(STIIOT_Slave *_slave)
 	_slave->time_to_rewrite = timeout;
 }
 
+// Delay before the next connection attempt of the slave. The slaves failing together (e.g. after
+// a power cut) do not try again together.
+uint64_t slave_backoff(STIIOT_Slave *_slave)
+{
+	uint64_t delay;
+
+	if(_slave->failures >= SLAVE_BREAKER_FAILURES)
+		delay = SLAVE_BREAKER_PARK;
+	else if(_slave->failures > 0 && (SLAVE_BACKOFF_MIN << (_slave->failures - 1)) < SLAVE_BACKOFF_MAX)
+		delay = SLAVE_BACKOFF_MIN << (_slave->failures - 1);
+	else if(_slave->failures > 0)
+		delay = SLAVE_BACKOFF_MAX;
+	else
+		delay = SLAVE_BACKOFF_MIN;
+
+	return delay / 2 + g_random_int_range(0, delay / 2 + 1);
+}
+
+static void slave_connection_release(gatt_connection_t *connection)
+{
+	gattlib_notification_stop(connection, &g_uuid_noti);
+	gattlib_disconnect(connection);
+}
+
+// Called with the command lock held
+static void slave_command_clear(STIIOT_Slave *_slave)
+{
+	void *command;
+
+	while((command = g_queue_pop_head(&_slave->commands)) != NULL)
+		free(command);
+}
+
+void slave_set_connection(STIIOT_Slave *_slave, gatt_connection_t *connection)
+{
+	g_mutex_lock(&_slave->command_lock);
+	_slave->connection = connection;
+	g_mutex_unlock(&_slave->command_lock);
+}
+
 int slave_disconnect(STIIOT_Slave *_slave)
 {
-	if(_slave->connection == NULL)
-		return 0;
+	gatt_connection_t *connection;
+	gboolean writing;
 
-	gattlib_notification_stop(_slave->connection, &_slave->uuid_noti);
-	gattlib_disconnect(_slave->connection);
+	g_mutex_lock(&_slave->command_lock);
+	connection = _slave->connection;
+	if(connection == NULL)
+	{
+		g_mutex_unlock(&_slave->command_lock);
+		return 0;
+	}
 	_slave->connection = NULL;
-	printf("Disconnected(%s)\n", _slave->serial_str);
+	// The commands of this connection are not sent on the next one
+	slave_command_clear(_slave);
+	// The connection cannot be freed under the write: the command job releases it
+	writing = _slave->command_writing;
+	if(writing)
+		_slave->connection_closing = connection;
+	g_mutex_unlock(&_slave->command_lock);
+
+	if(!writing)
+		slave_connection_release(connection);
+	printf("Disconnected(%s)\n", _slave->info->serial_str);
 	return 1;
 }
 
-int slave_init(STIIOT_Slave *_slave)
+/*
+ * Commands to the slaves: they are queued and written one at a time per slave by a pool of
+ * threads. The delay a slave needs after a command is a timer, nobody sleeps.
+ */
+struct slave_command {
+	STIIOT_Slave *slave;
+	char data[8];
+	size_t len;	// 0 for a delay only
+	unsigned int delay;	// time (ms) to wait before writing the next command
+};
+
+static GThreadPool *m_command_pool = NULL;
+
+static gboolean slave_command_done(gpointer user_data)
 {
-	int ret = 1;
-	ret = gattlib_write_char_by_uuid(_slave->connection, &_slave->uuid_write, "rst", 3);
-	if (ret != GATTLIB_SUCCESS) {
-		fprintf(stderr, "Fail to write. %s\n", _slave->serial_str);
+	struct slave_command *command = (struct slave_command*)user_data;
+
+	timer_wheel_add(&m_timer_wheel, &command->slave->command_timer, timeGetTime() + command->delay);
+	master_schedule();
+	free(command);
+	return FALSE;
+}
+
+static void slave_command_job(gpointer data, gpointer user_data)
+{
+	STIIOT_Slave *slave = (STIIOT_Slave*)data;
+	struct slave_command *command;
+	gatt_connection_t *connection, *closing;
+
+	g_mutex_lock(&slave->command_lock);
+	command = (struct slave_command*)g_queue_pop_head(&slave->commands);
+	if(command == NULL)
+	{
+		// The commands were dropped by a disconnection
+		slave->command_busy = FALSE;
+		g_mutex_unlock(&slave->command_lock);
+		return;
+	}
+	connection = slave->connection;
+	slave->command_writing = (command->len > 0 && connection != NULL);
+	g_mutex_unlock(&slave->command_lock);
+
+	if(command->len > 0)
+	{
+		if(connection == NULL || gattlib_write_char_by_uuid(connection, &g_uuid_write, command->data, command->len) != GATTLIB_SUCCESS)
+			fprintf(stderr, "Fail to write. %s\n", slave->info->serial_str);
+	}
+
+	g_mutex_lock(&slave->command_lock);
+	slave->command_writing = FALSE;
+	closing = slave->connection_closing;
+	slave->connection_closing = NULL;
+	g_mutex_unlock(&slave->command_lock);
+
+	if(closing != NULL)
+		slave_connection_release(closing);
+
+	// The delay runs from the main loop
+	g_idle_add(slave_command_done, command);
+}
+
+// The delay of the last command has elapsed
+static void slave_command_timer_cb(struct timer_wheel_timer *timer, uint64_t _cur, void *user_data)
+{
+	STIIOT_Slave *slave = (STIIOT_Slave*)user_data;
+	gboolean next;
+
+	g_mutex_lock(&slave->command_lock);
+	next = !g_queue_is_empty(&slave->commands);
+	slave->command_busy = next;
+	g_mutex_unlock(&slave->command_lock);
+
+	if(next)
+		g_thread_pool_push(m_command_pool, slave, NULL);
+}
+
+// Queue a command to the slave. It can be called from any thread.
+int slave_command(STIIOT_Slave *_slave, const char *data, unsigned int delay)
+{
+	struct slave_command *command;
+	size_t len = strlen(data);
+	gboolean start;
+
+	// The write sends the whole command: a longer one would be truncated
+	if(len > sizeof(command->data))
+	{
+		fprintf(stderr, "command of %zu bytes is longer than %zu bytes\n", len, sizeof(command->data));
 		return 0;
 	}
-	ret = 1;
-	printf("reset: %s\n", _slave->serial_str);
-	sleep_ms(100);
-	return ret;
+
+	command = calloc(1, sizeof(struct slave_command));
+	if(command == NULL)
+		return 0;
+	command->slave = _slave;
+	command->len = len;
+	memcpy(command->data, data, len);
+	command->delay = delay;
+
+	g_mutex_lock(&_slave->command_lock);
+	g_queue_push_tail(&_slave->commands, command);
+	start = !_slave->command_busy;
+	_slave->command_busy = TRUE;
+	g_mutex_unlock(&_slave->command_lock);
+
+	if(start)
+		g_thread_pool_push(m_command_pool, _slave, NULL);
+	return 1;
 }
 
-int slave_return(STIIOT_Slave *_slave)
+int slave_command_start()
 {
-	int ret = 1;
-	ret = gattlib_write_char_by_uuid(_slave->connection, &_slave->uuid_write, "R", 1);
-	if (ret != GATTLIB_SUCCESS) {
-		fprintf(stderr, "Fail to write. %s\n", _slave->serial_str);
+	GError *error = NULL;
+
+	m_command_pool = g_thread_pool_new(slave_command_job, NULL, SLAVE_COMMAND_THREADS, FALSE, &error);
+	if(m_command_pool == NULL)
+	{
+		fprintf(stderr, "fail to start the command queue: %s\n", error->message);
+		g_error_free(error);
 		return 0;
 	}
-	ret = 1;
-	printf("returned: %s\n", _slave->serial_str);
-	sleep_ms(100);
-	return ret;
+	return 1;
 }
-void notification_handler(const uuid_t* uuid, const uint8_t* data, size_t data_length, void* user_data) {
-	STIIOT_Slave *slave = (STIIOT_Slave*)user_data;
-	// marker
-	strncpy(slave->data, (char*)data, data_length);
-	slave->last_update_time = timeGetTime();
-	slave_timeout_update(slave);
-	slave->data[data_length] = 0;
 
-	
+int slave_init(STIIOT_Slave *_slave)
+{
+	printf("reset: %s\n", _slave->info->serial_str);
+	return slave_command(_slave, "rst", 100);
+}
 
-	
-	char buffer[1500];
-	if(strcmp(slave->data, "Initialized\r\n") == 0)
+int slave_return(STIIOT_Slave *_slave)
+{
+	printf("returned: %s\n", _slave->info->serial_str);
+	return slave_command(_slave, "R", 100);
+}
+// Compare a frame made of two segments to a string
+static int frame_equals(const uint8_t *head, size_t head_len, const uint8_t *tail, size_t tail_len, const char *str)
+{
+	size_t len = strlen(str);
+
+	return head_len + tail_len == len
+		&& (head_len == 0 || memcmp(head, str, head_len) == 0)
+		&& memcmp(tail, str + head_len, tail_len) == 0;
+}
+
+// Complete message of a slave. The segments are only valid during the call.
+static void slave_frame_cb(const uint8_t *head, size_t head_len, const uint8_t *tail, size_t tail_len, void *user_data)
+{
+	STIIOT_Slave *slave = (STIIOT_Slave*)user_data;
+
+	// The records are built in the uplink buffer: a slow collector does not hold the notifications.
+	record_send_frame(g_record_format, &slave->device_addr, slave->serial_id, slave->info->serial_str,
+			slave->last_update_time, head, head_len, tail, tail_len);
+	if(frame_equals(head, head_len, tail, tail_len, "Initialized\r\n"))
 	{
 		printf("Initialized\n");
-		sprintf(buffer, "%s %s mac: %s", slave->serial_str, slave->data, slave->device_str);
-		socket_idle(buffer);
 	}else{
-		sprintf(buffer, "%s %s mac: %s", slave->serial_str, slave->data, slave->device_str);	
 		slave_return(slave);
-		socket_idle(buffer);
 	}
+}
+
+void notification_handler(const uuid_t* uuid, const uint8_t* data, size_t data_length, void* user_data) {
+	STIIOT_Slave *slave = (STIIOT_Slave*)user_data;
+	slave->last_update_time = timeGetTime();
+	slave_timeout_update(slave);
+
+	slave_state_set_last_seen(slave->info->state_index, g_get_real_time() / 1000);
+
+	if(slave->serial_id == 0 && slave->info->serial_str[0] != 0)
+		slave->serial_id = record_serial_intern(slave->info->serial_str);
+
+	// A message can span several notifications
+	framer_push(&slave->info->framer, data, data_length, slave_frame_cb, slave);
 #ifndef DEF_SESSION
 	slave_disconnect(slave);
 #endif
 }
 
-int slave_request(STIIOT_Slave *_slave, unsigned int _cur)
+int slave_request(STIIOT_Slave *_slave, uint64_t _cur)
 {
-	int ret = 1;
-	ret = gattlib_write_char_by_uuid(_slave->connection, &_slave->uuid_write, "T", 1);
-	if (ret != GATTLIB_SUCCESS) {
-		fprintf(stderr, "Fail to write. %s\n", _slave->serial_str);
+	if(!slave_command(_slave, "T", 1000))
 		return 0;
-	}
-	ret = 1;
-	printf("requested: %s\n", _slave->serial_str);
+	printf("requested: %s\n", _slave->info->serial_str);
 
 	if(_cur == 0)
 		_cur = timeGetTime();
 	_slave->last_update_time = _cur;
 
-	sleep_ms(1000);
-
-	return ret;
+	return 1;
 }
 
-int slave_on_count(unsigned int _cur)
+// Reconnect the slave if it did not answer in time
+int slave_on_count(STIIOT_Slave *slave, uint64_t _cur)
 {
-	int cnt = 0;
-	for(int i=0; i<g_connection_cnt; i++)
-	{
-		STIIOT_Slave *slave = &g_connections[i];
-		//if(slave->connection != NULL)
-		{
-			cnt++;
-			if(_cur <= slave->last_update_time + slave->time_to_rewrite)
-				continue;
-				
-			fprintf(stderr, "try to reconnect.\n");
-			if(slave->connection != NULL)
-				slave_disconnect(slave);
-		#ifdef DEF_SESSION
-			slave_reconnect(slave);
-		#endif
-			slave->last_update_time = _cur;
-		}
-	}
+	if(_cur <= slave->last_update_time + slave->time_to_rewrite)
+		return 0;
 
-	return cnt;
+	fprintf(stderr, "try to reconnect.\n");
+	if(slave->connection != NULL)
+		slave_disconnect(slave);
+	slave->last_update_time = _cur;
+#ifdef DEF_SESSION
+	// The connection manager connects it again from its timer
+	slave->retry_time = _cur + slave_backoff(slave);
+#endif
+	return 1;
 }
 
 /*
@@ -271,23 +503,23 @@ static void slave_connect_cb(gatt_connection_t* connection, void* user_data)
 	STIIOT_Slave *slave = (STIIOT_Slave*)user_data;
 
 	int ret = 0;
-	unsigned int _cur = timeGetTime();
+	uint64_t _cur = timeGetTime();
 	
 	if (connection == NULL) {
-		fprintf(stderr, "Fail to connect to the bluetooth device. %s\n", slave->device_str);
+		fprintf(stderr, "Fail to connect to the bluetooth device. %s\n", slave->info->device_str);
 		slave->last_update_time = _cur + slave->time_to_rewrite;
 		slave->time_to_rewrite += slave->holding_time;
 		return;
 	}
-	slave->connection = connection;
-	printf("connected. %s %d\n", slave->device_str, g_connection_cnt);
+	slave_set_connection(slave, connection);
+	printf("connected. %s %u\n", slave->info->device_str, g_slaves->len);
 
-	if(slave->serial_str[0] == 0)
+	if(slave->info->serial_str[0] == 0)
 	{
 		size_t len;
 		char *buffer = NULL;
 		ret = gattlib_read_char_by_uuid(slave->connection
-			, &slave->uuid_serialnum, (void **)&buffer, &len);
+			, &g_uuid_serialnum, (void **)&buffer, &len);
 
 		if(ret != GATTLIB_SUCCESS)
 		{
@@ -295,7 +527,7 @@ static void slave_connect_cb(gatt_connection_t* connection, void* user_data)
 			return;
 		}
 		printf("serial: %s\n", buffer);
-		strcpy(slave->serial_str, buffer);
+		strcpy(slave->info->serial_str, buffer);
 		free(buffer);
 	}
 
@@ -306,8 +538,9 @@ static void slave_connect_cb(gatt_connection_t* connection, void* user_data)
 
 	slave_request(slave, _cur);
 
+	framer_init(&slave->info->framer, slave->info->framer_config);
 	gattlib_register_notification(connection, notification_handler, (void*)slave);
-	ret = gattlib_notification_start(connection, &slave->uuid_noti);
+	ret = gattlib_notification_start(connection, &g_uuid_noti);
 	if (ret) {
 		fprintf(stderr, "Fail to start notification.\n");
 		slave_disconnect(slave);
@@ -315,7 +548,7 @@ static void slave_connect_cb(gatt_connection_t* connection, void* user_data)
 	}
 }
 //*/
-int slave_idle(STIIOT_Slave *_slave, unsigned int _cur)
+int slave_idle(STIIOT_Slave *_slave, uint64_t _cur)
 {
 	int ret = 1;
 #ifndef DEF_SESSION
@@ -323,36 +556,36 @@ int slave_idle(STIIOT_Slave *_slave, unsigned int _cur)
 	gatt_connection_t *connection = _slave->connection;
 	if(connection != NULL)
 	{
-		fprintf(stderr, "it's got connection, already.(%s)\n", _slave->serial_str);
+		fprintf(stderr, "it's got connection, already.(%s)\n", _slave->info->serial_str);
 
 		if(_cur <= _slave->last_update_time + _slave->time_to_rewrite)
 			return 0;
 		fprintf(stderr, "try to reconnect.\n");
 		slave_disconnect(_slave);
 	}
-	//connection = gattlib_connect_async(NULL, _slave->device_str, GATTLIB_CONNECTION_OPTIONS_LEGACY_BDADDR_LE_RANDOM
+	//connection = gattlib_connect_async(NULL, _slave->info->device_str, GATTLIB_CONNECTION_OPTIONS_LEGACY_BDADDR_LE_RANDOM
 	//		| GATTLIB_CONNECTION_OPTIONS_LEGACY_BT_SEC_LOW
 	//		//| GATTLIB_CONNECTION_OPTIONS_LEGACY_BT_SEC_HIGH
 	//		, slave_connect_cb, _slave);
-	connection = gattlib_connect(NULL, _slave->device_str, GATTLIB_CONNECTION_OPTIONS_LEGACY_BDADDR_LE_RANDOM
-			| GATTLIB_CONNECTION_OPTIONS_LEGACY_BT_SEC_LOW);
+	connection = gattlib_connect_bdaddr(NULL, &_slave->device_addr, BDADDR_LE_RANDOM,
+			GATTLIB_CONNECTION_OPTIONS_LEGACY_BT_SEC_LOW);
 			//| GATTLIB_CONNECTION_OPTIONS_LEGACY_BT_SEC_HIGH);
 			
 	if (connection == NULL) {
-		fprintf(stderr, "-Fail to connect to the bluetooth device. %s\n", _slave->device_str);
+		fprintf(stderr, "-Fail to connect to the bluetooth device. %s\n", _slave->info->device_str);
 		_slave->last_update_time = _cur + _slave->time_to_rewrite;
 		_slave->time_to_rewrite += _slave->holding_time;
 		return 2;
 	}
-	_slave->connection = connection;
-	printf("-connected. %s %d\n", _slave->device_str, g_connection_cnt);
+	slave_set_connection(_slave, connection);
+	printf("-connected. %s %u\n", _slave->info->device_str, g_slaves->len);
 
 	if(_cur == 0)
 	{
 		size_t len;
 		char *buffer = NULL;
 		ret = gattlib_read_char_by_uuid(_slave->connection
-			, &_slave->uuid_serialnum, (void **)&buffer, &len);
+			, &g_uuid_serialnum, (void **)&buffer, &len);
 
 		if(ret != GATTLIB_SUCCESS)
 		{
@@ -360,7 +593,7 @@ int slave_idle(STIIOT_Slave *_slave, unsigned int _cur)
 			return 0;
 		}
 		printf("serial: %s\n", buffer);
-		strcpy(_slave->serial_str, buffer);
+		strcpy(_slave->info->serial_str, buffer);
 		free(buffer);
 	}
 #else
@@ -369,8 +602,9 @@ int slave_idle(STIIOT_Slave *_slave, unsigned int _cur)
 #endif
 	slave_request(_slave, _cur);
 #ifndef DEF_SESSION
+	framer_init(&_slave->info->framer, _slave->info->framer_config);
 	gattlib_register_notification(connection, notification_handler, (void*)_slave);
-	ret = gattlib_notification_start(connection, &_slave->uuid_noti);
+	ret = gattlib_notification_start(connection, &g_uuid_noti);
 	if (ret) {
 		fprintf(stderr, "Fail to start notification.\n");
 		slave_disconnect(_slave);
@@ -382,59 +616,137 @@ int slave_idle(STIIOT_Slave *_slave, unsigned int _cur)
 	return ret;
 }
 
-int slave_find(const char *_device_str)
+STIIOT_Slave* slave_find(uint64_t _device_key)
+{
+	return (STIIOT_Slave*)g_hash_table_lookup(g_slave_index, &_device_key);
+}
+
+// Time of the next action on the slave: its polling (slave_idle) or its reconnection (slave_on_count)
+uint64_t slave_next_deadline(STIIOT_Slave *_slave, uint64_t _cur)
 {
-	for(int i=0; i<g_connection_cnt; i++)
+	uint64_t poll = _slave->last_update_time + _slave->holding_time + 1;
+	uint64_t rewrite = _slave->last_update_time + _slave->time_to_rewrite + 1;
+
+#ifdef DEF_SESSION
+	// A slave without connection waits for its next connection attempt
+	if(_slave->connection == NULL)
+		return _slave->retry_time > _cur ? _slave->retry_time : _cur + 1;
+#endif
+
+	// A slave without connection is not polled: its poll time is not moved forward
+	if(poll > _cur && poll < rewrite)
+		return poll;
+	if(rewrite > _cur)
+		return rewrite;
+	return _cur + 1;
+}
+
+void slave_schedule(STIIOT_Slave *_slave, uint64_t _cur)
+{
+	timer_wheel_add(&m_timer_wheel, &_slave->timer, slave_next_deadline(_slave, _cur));
+}
+
+// The notifications only move 'last_update_time' forward. A timer firing too early reschedules itself.
+static void slave_timer_cb(struct timer_wheel_timer *timer, uint64_t _cur, void *user_data)
+{
+	STIIOT_Slave *slave = (STIIOT_Slave*)user_data;
+
+	// The connection manager reschedules the slave once it is set up
+	if(g_atomic_int_get(&slave->connecting))
+		return;
+
+#ifdef DEF_SESSION
+	if(slave->connection == NULL)
 	{
-		if(strcmp(_device_str, g_connections[i].device_str)==0)
-			return i;
+		if(_cur >= slave->retry_time)
+			slave_reconnect(slave);
+		slave_schedule(slave, _cur);
+		return;
 	}
-	return -1;
+#endif
+
+	if(slave->last_update_time + slave->holding_time < _cur)
+		slave_idle(slave, _cur);
+	slave_on_count(slave, _cur);
+
+	// The requests to the slave block for a while
+	slave_schedule(slave, timeGetTime());
+}
+
+static gboolean slave_schedule_new(gpointer user_data)
+{
+	slave_schedule((STIIOT_Slave*)user_data, timeGetTime());
+	master_schedule();
+	return FALSE;
 }
 
 #ifdef DEF_SESSION
-int slave_reconnect(STIIOT_Slave *_slave)
+// Give the characteristics of the slave to the connection: from the state if they are known,
+// otherwise from a discovery. The backends discovering the characteristics on connection
+// (GATTLIB_NOT_SUPPORTED) keep theirs.
+static int slave_characteristics(STIIOT_Slave *_slave, gatt_connection_t *connection)
 {
-	int ret = 1, _cur = 0;
-	gatt_connection_t *connection = _slave->connection;
+	STIIOT_SlaveInfo *info = _slave->info;
+	gattlib_characteristic_t *characteristics = NULL;
+	int count = 0, ret;
 
-	if(connection != NULL)
+	if(info->handle_noti != 0 && info->handle_write != 0)
 	{
-		fprintf(stderr, "it's got connection, already.(%s)\n", _slave->serial_str);
+		gattlib_characteristic_t known[2] = {
+			{ .handle = info->handle_noti - 1, .value_handle = info->handle_noti, .uuid = g_uuid_noti },
+			{ .handle = info->handle_write - 1, .value_handle = info->handle_write, .uuid = g_uuid_write },
+		};
+		ret = gattlib_set_characteristics(connection, known, 2);
+		return ret == GATTLIB_SUCCESS || ret == GATTLIB_NOT_SUPPORTED;
+	}
+
+	ret = gattlib_discover_char(connection, &characteristics, &count);
+	if(ret != GATTLIB_SUCCESS)
+	{
+		fprintf(stderr, "Fail to discover the characteristics. %s\n", info->device_str);
 		return 0;
 	}
-	//connection = gattlib_connect_async(NULL, _slave->device_str, GATTLIB_CONNECTION_OPTIONS_LEGACY_BDADDR_LE_RANDOM
-	//		| GATTLIB_CONNECTION_OPTIONS_LEGACY_BT_SEC_LOW
-	//		//| GATTLIB_CONNECTION_OPTIONS_LEGACY_BT_SEC_HIGH
-	//		, slave_connect_cb, _slave);
-	connection = gattlib_connect(NULL, _slave->device_str, GATTLIB_CONNECTION_OPTIONS_LEGACY_BDADDR_LE_RANDOM
-			| GATTLIB_CONNECTION_OPTIONS_LEGACY_BT_SEC_LOW);
-			//| GATTLIB_CONNECTION_OPTIONS_LEGACY_BT_SEC_HIGH);
-			
+
+	for(int i=0; i<count; i++)
+	{
+		if(gattlib_uuid_cmp(&characteristics[i].uuid, &g_uuid_noti) == 0)
+			info->handle_noti = characteristics[i].value_handle;
+		else if(gattlib_uuid_cmp(&characteristics[i].uuid, &g_uuid_write) == 0)
+			info->handle_write = characteristics[i].value_handle;
+	}
+	ret = gattlib_set_characteristics(connection, characteristics, count);
+	free(characteristics);
+
+	slave_state_set_connection(info->state_index, info->addr_type, info->handle_noti, info->handle_write);
+	return ret == GATTLIB_SUCCESS || ret == GATTLIB_NOT_SUPPORTED;
+}
+
+// Set up the session of a slave once its connection attempt completed
+int slave_setup(STIIOT_Slave *_slave, gatt_connection_t *connection)
+{
+	int ret = 1;
+
+	// The connection manager retries later
 	if (connection == NULL) {
-		fprintf(stderr, "-Fail to connect to the bluetooth device. %s\n", _slave->device_str);
-		_slave->last_update_time = _cur + _slave->time_to_rewrite;
-		//_slave->time_to_rewrite += _slave->holding_time;
+		fprintf(stderr, "-Fail to connect to the bluetooth device. %s\n", _slave->info->device_str);
 		return 2;
 	}
-	_slave->connection = connection;
-	printf("-connected. %s %d\n", _slave->device_str, g_connection_cnt);
+	slave_set_connection(_slave, connection);
+	printf("-connected. %s %u\n", _slave->info->device_str, g_slaves->len);
 
-	if(g_slave_from_file == 0)
+	if(!slave_characteristics(_slave, connection))
 	{
-		FILE *pf = fopen("slave_list.txt", "a");
-		if(pf){
-			fprintf(pf, "%s %d\n", _slave->device_str, _slave->holding_time);
-			fclose(pf);
-		}
+		slave_disconnect(_slave);
+		return 0;
 	}
 
-	if(_cur == 0)
+	// The serial number is kept in the state
+	if(_slave->info->serial_str[0] == 0)
 	{
 		size_t len;
 		char *buffer = NULL;
 		ret = gattlib_read_char_by_uuid(_slave->connection
-			, &_slave->uuid_serialnum, (void **)&buffer, &len);
+			, &g_uuid_serialnum, (void **)&buffer, &len);
 
 		if(ret != GATTLIB_SUCCESS)
 		{
@@ -442,147 +754,250 @@ int slave_reconnect(STIIOT_Slave *_slave)
 			return 0;
 		}
 		printf("serial: %s\n", buffer);
-		strcpy(_slave->serial_str, buffer);
+		snprintf(_slave->info->serial_str, sizeof(_slave->info->serial_str), "%s", buffer);
 		free(buffer);
+		slave_state_set_serial(_slave->info->state_index, _slave->info->serial_str);
 	}
 
 	//slave_request(_slave, _cur);
 	
+	framer_init(&_slave->info->framer, _slave->info->framer_config);
 	gattlib_register_notification(connection, notification_handler, (void*)_slave);
-	ret = gattlib_notification_start(connection, &_slave->uuid_noti);
+	ret = gattlib_notification_start(connection, &g_uuid_noti);
 	if (ret) {
 		fprintf(stderr, "Fail to start notification.\n");
+		// The handles might have changed: discover them again on the next connection
+		_slave->info->handle_noti = _slave->info->handle_write = 0;
+		slave_state_set_connection(_slave->info->state_index, _slave->info->addr_type, 0, 0);
 		slave_disconnect(_slave);
 		return 0;
 	}
 
-	sleep_ms(100);
+	// Let the slave settle before resetting it
+	slave_command(_slave, "", 100);
 	slave_init(_slave);
 	
 	ret = 1;
 	return ret;
 }
-#endif
 
-int slave_add(const char *_device_str, STIIOT_Slave *_slave)
+/*
+ * Connection manager: the slaves are connected, identified (serial number), subscribed and
+ * initialized by a pool of 'g_connect_in_flight' threads. The slaves failing the least are
+ * connected first: a device that is down does not delay the others.
+ */
+static GThreadPool *m_connect_pool = NULL;
+static gint m_connect_pending = 0;	// slaves queued or being connected
+
+static gint slave_connect_compare(gconstpointer a, gconstpointer b, gpointer user_data)
 {
-	int ret = 1;
-	if(slave_find(_device_str) >= 0)
+	const STIIOT_Slave *slave_a = (const STIIOT_Slave*)a;
+	const STIIOT_Slave *slave_b = (const STIIOT_Slave*)b;
+
+	if(slave_a->failures != slave_b->failures)
+		return (slave_a->failures > slave_b->failures) ? 1 : -1;
+	return (slave_a->stale > slave_b->stale) - (slave_a->stale < slave_b->stale);
+}
+
+static void slave_connect_job(gpointer data, gpointer user_data)
+{
+	STIIOT_Slave *_slave = (STIIOT_Slave*)data;
+	gatt_connection_t *connection = NULL;
+	uint8_t addr_type = _slave->info->addr_type;
+
+	// The address type is learned: until then, both are tried in turn
+	if(addr_type == 0)
+		addr_type = (_slave->failures & 1) ? BDADDR_LE_PUBLIC : BDADDR_LE_RANDOM;
+
+	// The characteristics are set by slave_setup()
+	gattlib_connect_with_timeout(NULL, _slave->info->device_str,
+			(addr_type == BDADDR_LE_PUBLIC ? GATTLIB_CONNECTION_OPTIONS_LEGACY_BDADDR_LE_PUBLIC : GATTLIB_CONNECTION_OPTIONS_LEGACY_BDADDR_LE_RANDOM)
+			| GATTLIB_CONNECTION_OPTIONS_LEGACY_BT_SEC_LOW | GATTLIB_CONNECTION_OPTIONS_LEGACY_NO_DISCOVERY,
+			SLAVE_CONNECT_TIMEOUT, NULL, &connection);
+
+	uint64_t _cur;
+	int ret = slave_setup(_slave, connection);
+
+	_cur = timeGetTime();
+	_slave->last_update_time = _cur;
+	if(ret == 1)
 	{
-		fprintf(stderr, "%s is in list.", _device_str);
-		return 0;
+		_slave->failures = 0;
+		_slave->stale = FALSE;
+		if(_slave->info->addr_type != addr_type)
+		{
+			_slave->info->addr_type = addr_type;
+			slave_state_set_connection(_slave->info->state_index, addr_type, _slave->info->handle_noti, _slave->info->handle_write);
+		}
 	}
-
-	if(g_connection_cnt >= MAX_SLAVE)
+	else
 	{
-		fprintf(stderr, "fail to add slave.(over max limit %d)\n", MAX_SLAVE);
-		return 0;
+		_slave->failures++;
+		if(_slave->failures == SLAVE_BREAKER_FAILURES)
+			fprintf(stderr, "%s is unreachable, tried every %d s from now.\n", _slave->info->device_str, SLAVE_BREAKER_PARK / 1000);
+		_slave->retry_time = _cur + slave_backoff(_slave);
 	}
 
-	strcpy(_slave->device_str, _device_str);
-
-#ifndef DEF_SESSION
-	ret = slave_idle(_slave, 0);
-#else
-	return slave_reconnect(_slave);
-#endif
-	
-	return ret;
+	g_atomic_int_add(&m_connect_pending, -1);
+	g_atomic_int_set(&_slave->connecting, 0);
+	g_idle_add(slave_schedule_new, _slave);
 }
 
-int g_sockfd, g_portno = 1337;
-struct sockaddr_in g_serv_addr;
-struct hostent *g_server;
+int slave_manager_start()
+{
+	GError *error = NULL;
+
+	m_connect_pool = g_thread_pool_new(slave_connect_job, NULL, g_connect_in_flight, FALSE, &error);
+	if(m_connect_pool == NULL)
+	{
+		fprintf(stderr, "fail to start the connection manager: %s\n", error->message);
+		g_error_free(error);
+		return 0;
+	}
+	g_thread_pool_set_sort_function(m_connect_pool, slave_connect_compare, NULL);
+	return 1;
+}
 
-int socket_connect()
+// Queue the slave in the connection manager
+int slave_reconnect(STIIOT_Slave *_slave)
 {
-    //g_portno = 1337;//atoi(argv[2]);
-    g_sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (g_sockfd < 0) 
+	if(_slave->connection != NULL)
 	{
-        fprintf(stderr,"ERROR opening socket");
+		fprintf(stderr, "it's got connection, already.(%s)\n", _slave->info->serial_str);
 		return 0;
 	}
-    g_server = gethostbyname("127.0.0.1");
-    //g_server = gethostbyname("172.30.1.39");
-    
-	if (g_server == NULL) {
-        fprintf(stderr,"ERROR, no such host\n");
-        return 0;
-    }
-    bzero((char *) &g_serv_addr, sizeof(g_serv_addr));
-    g_serv_addr.sin_family = AF_INET;
-    bcopy((char *)g_server->h_addr, (char *)&g_serv_addr.sin_addr.s_addr, g_server->h_length);
-    g_serv_addr.sin_port = htons(g_portno);
-    if (connect(g_sockfd,(struct sockaddr *) &g_serv_addr,sizeof(g_serv_addr)) < 0) 
+
+	// The slave is already being connected
+	if(!g_atomic_int_compare_and_exchange(&_slave->connecting, 0, 1))
+		return 1;
+
+	// Admission: the slaves over the limit try again later, spread over SLAVE_CONNECT_RETRY
+	if(g_atomic_int_get(&m_connect_pending) >= (gint)(g_connect_in_flight * SLAVE_CONNECT_QUEUE))
 	{
-        fprintf(stderr,"ERROR connecting");
+		_slave->retry_time = timeGetTime() + SLAVE_CONNECT_RETRY / 2 + g_random_int_range(0, SLAVE_CONNECT_RETRY / 2 + 1);
+		g_atomic_int_set(&_slave->connecting, 0);
 		return 0;
 	}
+
+	g_atomic_int_inc(&m_connect_pending);
+	g_thread_pool_push(m_connect_pool, _slave, NULL);
 	return 1;
 }
+#endif
 
-int socket_idle(const char *_send_data)
+static STIIOT_Slave* slave_insert(const bdaddr_t *_device_addr, unsigned int _holding_time)
 {
-	if(g_sockfd < 0){
-		 socket_connect();
-		return 0;
-	}
+	STIIOT_Slave *slave = slave_new(_device_addr, _holding_time);
+
+	ba2str(_device_addr, slave->info->device_str);
+	slave_timeout_update(slave);
+
+	g_ptr_array_add(g_slaves, slave);
+	g_hash_table_insert(g_slave_index, &slave->device_key, slave);
+	return slave;
+}
 
-	int n = 0;
-	if(_send_data != NULL && *_send_data != 0)
-		n = send(g_sockfd,_send_data,strlen(_send_data), MSG_NOSIGNAL);
-    if (n < 0) 
+// Add the slave to the list without connecting it. The holding time of a known slave is updated.
+// The framing of the messages changes on the next connection of the slave, the default is kept if
+// '_framer_config' is NULL.
+STIIOT_Slave* slave_register(const char *_device_str, unsigned int _holding_time,
+		const struct framer_config *_framer_config)
+{
+	bdaddr_t device_addr;
+	if(gattlib_string_to_bdaddr(_device_str, &device_addr) != GATTLIB_SUCCESS)
 	{
-         fprintf(stderr,"ERROR writing to socket\n");
-		 socket_disconnect();
-		 socket_connect();
-		 return 0;
-	}
-    char buffer[1024];
-	n = recv(g_sockfd, buffer, 1024, MSG_DONTWAIT);
-    if (n < 0) 
+		fprintf(stderr, "%s is not a valid address.\n", _device_str);
+		return NULL;
+	}
+
+	STIIOT_Slave *slave = slave_find(gattlib_bdaddr_to_uint64(&device_addr));
+	if(slave != NULL)
 	{
-         //fprintf(stderr,"ERROR reading from socket");
-		 return 0;
+		if(_framer_config != NULL)
+			slave->info->framer_config = _framer_config;
+		if(slave->holding_time != _holding_time)
+		{
+			slave->holding_time = _holding_time;
+			slave_timeout_update(slave);
+			slave_state_set_holding_time(slave->info->state_index, _holding_time);
+		}
+		return NULL;
 	}
 
-	if(n == 0)
-		return 1;
+	slave = slave_insert(&device_addr, _holding_time);
+	slave->info->state_index = slave_state_add(&device_addr, _holding_time);
+	if(_framer_config != NULL)
+		slave->info->framer_config = _framer_config;
+	return slave;
+}
 
-	if(g_slave_from_file)
-		return 1;
+// Add the slave saved in the state file
+static void slave_restore(const struct slave_state_record *record, uint32_t index, void *user_data)
+{
+	STIIOT_Slave *slave;
+
+	if(slave_find(gattlib_bdaddr_to_uint64(&record->addr)) != NULL)
+		return;
+
+	slave = slave_insert(&record->addr, record->holding_time);
+	slave->info->state_index = index;
+	slave->info->addr_type = record->addr_type;
+	slave->info->handle_noti = record->handle_noti;
+	slave->info->handle_write = record->handle_write;
+	snprintf(slave->info->serial_str, sizeof(slave->info->serial_str), "%s", record->serial);
+
+	// The slaves seen lately are connected first
+	slave->stale = record->last_seen < g_get_real_time() / 1000 - SLAVE_STATE_STALE;
+}
+
+STIIOT_Slave* slave_add(const char *_device_str, unsigned int _holding_time)
+{
+	STIIOT_Slave *slave = slave_register(_device_str, _holding_time, NULL);
+	if(slave == NULL)
+		return NULL;
+
+#ifndef DEF_SESSION
+	slave_idle(slave, 0);
+#else
+	slave_reconnect(slave);
+#endif
+	return slave;
+}
+
+// List of slaves sent by the collector: "<marker><address> <holding time (s)>[,<address> <holding time>...]"
+static void slave_list_frame_cb(const uint8_t *data, size_t len, void *user_data)
+{
+	static char buffer[UPLINK_MAX_FRAME + 1];
+
+	if(g_slave_from_file || len == 0)
+		return;
+
+	memcpy(buffer, data, len);
+	buffer[len] = 0;
 
 	char device_str[255];
 	float holding_time;
+	int n;
 
 	printf("from DB: %s\n", buffer);
 	char *parse = buffer;
-	int ret = 0;
 	do{
 		parse++;
-		n = sscanf(parse, "%s %f", device_str, &holding_time);
+		n = sscanf(parse, "%254s %f", device_str, &holding_time);
 		if(n != 2)
 		{
 			fprintf(stderr, "Fail to parse packet %s.", parse);
-			return 0;
+			return;
 		}
-		STIIOT_Slave *slave = &g_connections[g_connection_cnt];
 		unsigned int holding_msec = (int)(holding_time * 1000);
-		slave->holding_time = holding_msec;
-		slave_timeout_update(slave);
-		ret = slave_add(device_str, slave);
-		if(ret != 0)
-			g_connection_cnt++;
+		STIIOT_Slave *slave = slave_add(device_str, holding_msec);
+		if(slave != NULL)
+		{
+			slave_schedule(slave, timeGetTime());
+			master_schedule();
+		}
 		parse = strchr(parse, ',');
 	}while(parse);
-	return ret;
-}
-
-int socket_disconnect()
-{
-    close(g_sockfd);
-	return 1;
 }
 
 static void on_user_abort(int arg) {
@@ -593,39 +1008,83 @@ static void on_user_abort(int arg) {
 //	printf("%s <device_address>\n", argv[0]);
 //}
 
-gboolean master_idle(gpointer _data)
+static gboolean master_timer(gpointer _data)
 {
-	socket_idle(NULL);
+	m_timer_source = 0;
+	timer_wheel_advance(&m_timer_wheel, timeGetTime());
+	master_schedule();
+	return FALSE;
+}
 
-	unsigned int _time_cur = timeGetTime();
+// Wake up the main loop when the next timer expires
+void master_schedule()
+{
+	uint64_t expires, _cur = timeGetTime(), delay = 0;
 
+	if(m_timer_source != 0)
+		g_source_remove(m_timer_source);
+	m_timer_source = 0;
 
-	if(_time_cur > g_reboot_time) // 86400000: a day, 2592000000: 30 day 
-	{
-		g_main_loop_quit(m_main_loop);
-		return FALSE;
-	}
+	if(!timer_wheel_next_expiry(&m_timer_wheel, &expires))
+		return;
 
-#ifndef DEF_SESSION
-	if(cnt >= 5) // devices what keep connection are over than 5, wait for next turn.
-		return TRUE;
-#endif
+	if(expires > _cur)
+		delay = expires - _cur;
+	if(delay > 86400000) // the wheel is checked again in a day at most
+		delay = 86400000;
+	m_timer_source = g_timeout_add(delay, master_timer, NULL);
+}
 
-	for(int i=0; i<g_connection_cnt; i++)
+/*
+ * Maintenance: the connections are recycled a few slaves at a time (rolling reconnection). The other
+ * slaves keep running: there is no outage of the whole fleet.
+ */
+static void master_recycle_cb(struct timer_wheel_timer *timer, uint64_t _cur, void *user_data)
+{
+	guint batch = g_connect_in_flight;
+
+	if(m_recycle_index == 0)
+		printf("maintenance: recycle %u slaves.\n", g_slaves->len);
+
+	// Wait for the previous slaves to be connected again, or to have failed
+	for(guint i=m_recycle_start; i<m_recycle_index; i++)
 	{
-		STIIOT_Slave *slave = &g_connections[i];
+		STIIOT_Slave *slave = g_ptr_array_index(g_slaves, i);
 
-		if(slave->last_update_time + slave->holding_time < _time_cur)
+		if(!slave->recycling)
+			continue;
+		if(g_atomic_int_get(&slave->connecting) || (slave->connection == NULL && slave->failures == 0))
 		{
-			slave_idle(slave, _time_cur);
+			timer_wheel_add(&m_timer_wheel, timer, _cur + SLAVE_RECYCLE_STEP);
+			return;
 		}
+		slave->recycling = FALSE;
 	}
 
-	//int cnt = 
-	slave_on_count(_time_cur);
+	if(m_recycle_index >= g_slaves->len)
+	{
+		printf("maintenance: done.\n");
+		m_recycle_start = m_recycle_index = 0;
+		timer_wheel_add(&m_timer_wheel, timer, _cur + g_reboot_time);
+		return;
+	}
 
-	//return 1;
-	return TRUE;
+	m_recycle_start = m_recycle_index;
+	while(batch > 0 && m_recycle_index < g_slaves->len)
+	{
+		STIIOT_Slave *slave = g_ptr_array_index(g_slaves, m_recycle_index++);
+
+		// The slaves not connected are left to their reconnection
+		if(slave->connection == NULL || g_atomic_int_get(&slave->connecting))
+			continue;
+
+		slave_disconnect(slave);
+		slave->recycling = TRUE;
+		slave->retry_time = _cur;
+		slave_schedule(slave, _cur);
+		batch--;
+	}
+	timer_wheel_add(&m_timer_wheel, timer, _cur + SLAVE_RECYCLE_STEP);
 }
 
 void config_load()
@@ -633,99 +1092,169 @@ void config_load()
 	FILE *pf = fopen("/etc/coint/bleserver.config", "r");
 	if(pf){
 		unsigned long looptime = 0;
+		unsigned int in_flight = 0;
+		unsigned int format = 0;
 		int cnt;
-		cnt = fscanf(pf, "%lu", &looptime);
+		cnt = fscanf(pf, "%lu %u %u", &looptime, &in_flight, &format);
 		//marker
-		if(cnt == 1 && looptime >= 30000 && looptime <= 2592000000)
+		if(cnt >= 1 && looptime >= 30000 && looptime <= 2592000000)
 		{
 			g_reboot_time = looptime;
 			printf("maintenance loop is %lu.\n", g_reboot_time);
 		}
 		else
 			printf("configure file error looptime is %lu, lower than 30,000 or over than 30 day.\n", looptime);
-			
+
+		// Optional number of slaves connected at the same time
+		if(cnt >= 2 && in_flight >= 1 && in_flight <= SLAVE_CONNECT_IN_FLIGHT_MAX)
+		{
+			g_connect_in_flight = in_flight;
+			printf("%u slaves are connected at the same time.\n", g_connect_in_flight);
+		}
+
+		// Optional format of the records sent to the collector: 0 text (default), 1 binary
+		g_record_format = (cnt == 3 && format == RECORD_FORMAT_BINARY) ? RECORD_FORMAT_BINARY : RECORD_FORMAT_TEXT;
+		printf("records are sent as %s.\n", g_record_format == RECORD_FORMAT_TEXT ? "text" : "binary");
+
 		fclose(pf);
 	}else{
 		printf("fail to open 'bleserver.config' file.\n");
 	}
 }
 
-int slave_load()
+// Static list of slaves: "<address> <holding time> [<framer>]" per line. The lists of the collector
+// are then ignored. The framer is the type of the messages of the slave (see framer.c).
+// The new slaves are connected if '_connect' is set.
+void slave_list_load(int _connect)
 {
 	FILE *pf = fopen("/etc/coint/slave_list.txt", "r");
 	if(pf){
-		char buf[255];
+		char line[512], buf[255], framer[32];
+		unsigned int holding_time;
 		int cnt = 0;
-		do{
-			STIIOT_Slave *slave = &g_connections[g_connection_cnt];
-			cnt = fscanf(pf, "%s %d", buf, &slave->holding_time);
-			if(cnt == 2)
+		while(fgets(line, sizeof(line), pf) != NULL){
+			cnt = sscanf(line, "%254s %u %31s", buf, &holding_time, framer);
+			if(cnt >= 2)
 			{
+				const struct framer_config *framer_config = NULL;
+				if(cnt == 3 && (framer_config = framer_config_find(framer)) == NULL)
+					fprintf(stderr, "%s: unknown framer '%s'.\n", buf, framer);
+
 				g_slave_from_file = 1;
-				slave_timeout_update(slave);
-				if(slave_add(buf, slave)){
-					g_connection_cnt++;
-					slave->last_update_time = timeGetTime();
-				}else{
-					printf("fail to add %s\n", buf);
+				STIIOT_Slave *slave = slave_register(buf, holding_time, framer_config);
+				if(slave != NULL && _connect)
+				{
+#ifdef DEF_SESSION
+					slave_reconnect(slave);
+#endif
+					slave_schedule(slave, timeGetTime());
 				}
-				sleep_ms(1000);
 			}
-		}while(cnt == 2);
+		}
 		fclose(pf);
-		if(g_connection_cnt == 0)
-			return 0;
 	}else{
 		printf("fail to open 'slave_list.txt'.\n");
+	}
+}
+
+int slave_load()
+{
+	// The slaves known from the previous runs
+	if(slave_state_open(SLAVE_STATE_FILE))
+		slave_state_foreach(slave_restore, NULL);
+	printf("%u slaves restored.\n", g_slaves->len);
+
+	slave_list_load(0);
+
+	if(g_slaves->len == 0)
 		return 0;
+
+	// Bring up all the slaves with a few connection attempts at a time
+#ifdef DEF_SESSION
+	for(guint i=0; i<g_slaves->len; i++)
+		slave_reconnect(g_ptr_array_index(g_slaves, i));
+#else
+	for(guint i=0; i<g_slaves->len; i++)
+	{
+		STIIOT_Slave *slave = g_ptr_array_index(g_slaves, i);
+		slave_idle(slave, 0);
+		slave->last_update_time = timeGetTime();
 	}
+#endif
 	return 1;
 }
 
+// SIGHUP: reload the configuration and the static list of slaves without stopping
+static gboolean master_reload_cb(gpointer user_data)
+{
+	unsigned long reboot_time = g_reboot_time;
+
+	printf("reload the configuration.\n");
+	config_load();
+#ifdef DEF_SESSION
+	g_thread_pool_set_max_threads(m_connect_pool, g_connect_in_flight, NULL);
+#endif
+	slave_list_load(1);
+
+	// The next maintenance follows the new period
+	if(reboot_time != g_reboot_time && m_recycle_index == 0)
+		timer_wheel_add(&m_timer_wheel, &m_recycle_timer, timeGetTime() + g_reboot_time);
+	master_schedule();
+	return TRUE;
+}
+
 int main(int argc, char *argv[]) {
 	int ret=1;
-	int initialdelay = 60000;
+	int initialdelay = 0;
 
 	if(argc>1)
 		sscanf(argv[1], "%d", &initialdelay);
 
 	printf("delay %d\n", initialdelay);
-	sleep_ms(initialdelay); // for auto restart delay
+	sleep_ms(initialdelay); // e.g. for the Bluetooth stack to start on boot
+	m_start_time = timeGetTime();
+	timer_wheel_init(&m_timer_wheel, m_start_time);
 	system("pwd");
-	socket_connect();
+	if(uplink_start(COLLECTOR_HOST, COLLECTOR_PORT, UPLINK_BUFFER_SIZE, UPLINK_DROP_OLDEST, slave_list_frame_cb, NULL) != UPLINK_SUCCESS)
+		return 0;
 	//mark_
 	// Catch CTRL-C
 	
 	slave_reset();
 	config_load();
+	if(slave_command_start() == 0)
+		return 0;
+#ifdef DEF_SESSION
+	if(slave_manager_start() == 0)
+		return 0;
+#endif
 	if(slave_load() == 0)
 		return 0;
 
 	signal(SIGINT, on_user_abort);
+	g_unix_signal_add(SIGHUP, master_reload_cb, NULL);
 	m_main_loop = g_main_loop_new(NULL, 0);
 	
-	g_idle_add(master_idle, NULL);
+	// 86400000: a day, 2592000000: 30 day
+	timer_wheel_timer_init(&m_recycle_timer, master_recycle_cb, NULL);
+	timer_wheel_add(&m_timer_wheel, &m_recycle_timer, m_start_time + g_reboot_time);
+	for(guint i=0; i<g_slaves->len; i++)
+		slave_schedule(g_ptr_array_index(g_slaves, i), timeGetTime());
+	master_schedule();
+
 	g_main_loop_run(m_main_loop);
 	
 	// In case we quit the main loop, clean the connection
 	g_main_loop_unref(m_main_loop);
 
-	//for(int i=0; i<g_connection_cnt; i++)
-	//	slave_disconnect(&g_connections[i]);
+	//for(guint i=0; i<g_slaves->len; i++)
+	//	slave_disconnect(g_ptr_array_index(g_slaves, i));
 	
-	socket_disconnect();
+	struct uplink_stats stats;
+	uplink_get_stats(&stats);
+	printf("uplink: %llu records sent, %llu dropped\n", (unsigned long long)stats.records_sent, (unsigned long long)stats.records_dropped);
+	uplink_stop();
+	slave_state_close();
 	puts("Done");
-
-
-	pid_t pid;
-
-	printf("restart\n");
-    pid = fork();
-
-    if(pid == 0){
-        system("/home/pi/InsightIoT/iot_ble_server/cmd_restart");
-		return ret;
-	}else{
-		return ret;
-	}
+	return ret;
 }
@@ -0,0 +1,192 @@
+/*
+ * Reassembly of the messages of the slaves from their notifications
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "framer.h"
+
+static const struct framer_config m_configs[] = {
+	// The messages of the slaves fit in a notification: it is the behaviour of the first firmwares
+	{ .name = "notification", .type = FRAMER_NOTIFICATION, .max_frame = 1023 },
+	{ .name = "line",  .type = FRAMER_DELIMITER, .delimiter = '\n', .max_frame = 4096 },
+	{ .name = "len8",  .type = FRAMER_LENGTH, .length_size = 1, .max_frame = 0xFF },
+	{ .name = "len16", .type = FRAMER_LENGTH, .length_size = 2, .max_frame = 4096 },
+};
+
+const struct framer_config *framer_config_find(const char *name) {
+	for (size_t i = 0; i < sizeof(m_configs) / sizeof(m_configs[0]); i++) {
+		if (strcmp(m_configs[i].name, name) == 0) {
+			return &m_configs[i];
+		}
+	}
+	return NULL;
+}
+
+const struct framer_config *framer_config_default(void) {
+	return &m_configs[0];
+}
+
+void framer_init(struct framer *framer, const struct framer_config *config) {
+	// The size of the buffer depends on the configuration
+	if (framer->config != config) {
+		g_free(framer->buffer);
+		framer->buffer = NULL;
+	}
+	framer->config = config;
+	framer->len = 0;
+	framer->discarding = false;
+}
+
+/*
+ * Keep the start of an incomplete frame for the next notifications
+ */
+static bool framer_buffer(struct framer *framer, const uint8_t *data, size_t len) {
+	// The buffer also holds the length prefix
+	size_t capacity = framer->config->max_frame + framer->config->length_size;
+
+	if (framer->len + len > capacity) {
+		return false;
+	}
+
+	if (framer->buffer == NULL) {
+		framer->buffer = g_malloc(capacity);
+	}
+	memcpy(framer->buffer + framer->len, data, len);
+	framer->len += len;
+	return true;
+}
+
+static void framer_drop(struct framer *framer, size_t len) {
+	fprintf(stderr, "framer: drop %zu bytes of an oversized or invalid frame\n", framer->len + len);
+	framer->dropped_bytes += framer->len + len;
+	framer->len = 0;
+}
+
+static void push_delimiter(struct framer *framer, const uint8_t *data, size_t len,
+		framer_frame_cb_t frame_cb, void *user_data)
+{
+	const uint8_t *end;
+	size_t frame_len;
+
+	while (len > 0) {
+		end = memchr(data, framer->config->delimiter, len);
+		if (end == NULL) {
+			if (!framer->discarding && !framer_buffer(framer, data, len)) {
+				framer_drop(framer, len);
+				// Resynchronize on the next delimiter
+				framer->discarding = true;
+			} else if (framer->discarding) {
+				framer->dropped_bytes += len;
+			}
+			return;
+		}
+
+		frame_len = end - data + 1;
+		if (framer->discarding) {
+			framer->dropped_bytes += frame_len;
+			framer->discarding = false;
+		} else if (framer->len + frame_len > framer->config->max_frame) {
+			framer_drop(framer, frame_len);
+		} else {
+			// The buffered start of the frame comes from the previous notifications
+			frame_cb(framer->buffer, framer->len, data, frame_len, user_data);
+			framer->frames++;
+			framer->len = 0;
+		}
+		data += frame_len;
+		len -= frame_len;
+	}
+}
+
+static size_t read_length(const uint8_t *prefix, uint8_t size) {
+	size_t length = 0;
+
+	for (uint8_t i = 0; i < size; i++) {
+		length = (length << 8) | prefix[i];
+	}
+	return length;
+}
+
+static void push_length(struct framer *framer, const uint8_t *data, size_t len,
+		framer_frame_cb_t frame_cb, void *user_data)
+{
+	const uint8_t size = framer->config->length_size;
+	size_t frame_len, missing;
+
+	// Complete the frame started by the previous notifications
+	if (framer->len > 0) {
+		if (framer->len < size) {
+			missing = MIN(size - framer->len, len);
+			framer_buffer(framer, data, missing);
+			data += missing;
+			len -= missing;
+			if (framer->len < size) {
+				return;
+			}
+		}
+
+		frame_len = read_length(framer->buffer, size);
+		if (frame_len > framer->config->max_frame) {
+			// The stream cannot be resynchronized in the middle of this notification
+			framer_drop(framer, len);
+			return;
+		}
+
+		missing = size + frame_len - framer->len;
+		if (len < missing) {
+			framer_buffer(framer, data, len);
+			return;
+		}
+
+		frame_cb(framer->buffer + size, framer->len - size, data, missing, user_data);
+		framer->frames++;
+		framer->len = 0;
+		data += missing;
+		len -= missing;
+	}
+
+	// The frames entirely in the notification are not copied
+	while (len >= size) {
+		frame_len = read_length(data, size);
+		if (frame_len > framer->config->max_frame) {
+			framer_drop(framer, len);
+			return;
+		}
+		if (len < size + frame_len) {
+			break;
+		}
+
+		frame_cb(NULL, 0, data + size, frame_len, user_data);
+		framer->frames++;
+		data += size + frame_len;
+		len -= size + frame_len;
+	}
+
+	if (len > 0) {
+		framer_buffer(framer, data, len);
+	}
+}
+
+void framer_push(struct framer *framer, const uint8_t *data, size_t len, framer_frame_cb_t frame_cb, void *user_data) {
+	switch (framer->config->type) {
+	case FRAMER_NOTIFICATION:
+		// Longer notifications are truncated as before the framers
+		if (len > framer->config->max_frame) {
+			framer->dropped_bytes += len - framer->config->max_frame;
+			len = framer->config->max_frame;
+		}
+		frame_cb(NULL, 0, data, len, user_data);
+		framer->frames++;
+		break;
+	case FRAMER_DELIMITER:
+		push_delimiter(framer, data, len, frame_cb, user_data);
+		break;
+	case FRAMER_LENGTH:
+		push_length(framer, data, len, frame_cb, user_data);
+		break;
+	}
+}
@@ -0,0 +1,63 @@
+/*
+ * Reassembly of the messages of the slaves from their notifications
+ *
+ * A message can span several notifications and a notification can hold several messages. The
+ * framer hands each complete message (frame) to a callback as at most two segments: the start of
+ * the frame buffered from the previous notifications and the part found in the current one. Only
+ * the start of an incomplete frame is copied.
+ */
+
+#ifndef __FRAMER_H__
+#define __FRAMER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum framer_type {
+	FRAMER_NOTIFICATION,  // Each notification is a frame
+	FRAMER_DELIMITER,     // Frames end with a delimiter. It is kept in the frame.
+	FRAMER_LENGTH,        // Frames are prefixed by their big endian length. The prefix is not passed.
+};
+
+struct framer_config {
+	const char *name;
+	enum framer_type type;
+	uint8_t delimiter;    // FRAMER_DELIMITER
+	uint8_t length_size;  // FRAMER_LENGTH: size of the length prefix (1 or 2 bytes)
+	size_t max_frame;     // Longer frames are dropped (truncated for FRAMER_NOTIFICATION)
+};
+
+struct framer {
+	const struct framer_config *config;
+	uint8_t *buffer;      // Start of the incomplete frame. Allocated on first use.
+	size_t len;
+	bool discarding;      // FRAMER_DELIMITER: drop the bytes up to the next delimiter
+	unsigned long frames;
+	unsigned long dropped_bytes;
+};
+
+typedef void (*framer_frame_cb_t)(const uint8_t *head, size_t head_len, const uint8_t *tail, size_t tail_len,
+		void *user_data);
+
+/**
+ * Get the configuration of a type of device
+ *
+ * @return NULL if 'name' is unknown
+ */
+const struct framer_config *framer_config_find(const char *name);
+
+const struct framer_config *framer_config_default(void);
+
+/**
+ * Start the reassembly, e.g. when the slave is connected again. An incomplete frame is dropped.
+ * 'framer' is zeroed before the first call. It must not be called during framer_push().
+ */
+void framer_init(struct framer *framer, const struct framer_config *config);
+
+/**
+ * Reassemble the frames of a notification. 'frame_cb' is called for each complete frame.
+ */
+void framer_push(struct framer *framer, const uint8_t *data, size_t len, framer_frame_cb_t frame_cb, void *user_data);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * Telemetry records sent by the connector to the collector
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "record.h"
+#include "uplink.h"
+
+#define RECORD_MAX_SERIALS    0xFFFF
+
+struct record_serial {
+	char *serial;
+	uint64_t declared_epoch;  // Uplink epoch the id was last declared on (0: never)
+};
+
+// Protect the interned serial numbers
+static GMutex m_lock;
+static GHashTable *m_serial_ids = NULL;
+// Indexed by id - 1
+static GPtrArray *m_serials = NULL;
+
+uint16_t record_serial_intern(const char *serial) {
+	struct record_serial *entry;
+	gpointer value;
+	uint16_t id = 0;
+
+	g_mutex_lock(&m_lock);
+
+	if (m_serial_ids == NULL) {
+		m_serial_ids = g_hash_table_new(g_str_hash, g_str_equal);
+		m_serials = g_ptr_array_new();
+	}
+
+	if (g_hash_table_lookup_extended(m_serial_ids, serial, NULL, &value)) {
+		id = GPOINTER_TO_UINT(value);
+	} else if (m_serials->len < RECORD_MAX_SERIALS) {
+		entry = g_new0(struct record_serial, 1);
+		entry->serial = g_strdup(serial);
+		g_ptr_array_add(m_serials, entry);
+
+		id = m_serials->len;
+		g_hash_table_insert(m_serial_ids, entry->serial, GUINT_TO_POINTER(id));
+	}
+
+	g_mutex_unlock(&m_lock);
+	return id;
+}
+
+static void put_header(struct uplink_record *record, uint8_t type, size_t body_len) {
+	uplink_record_put_u8(record, RECORD_VERSION);
+	uplink_record_put_u8(record, type);
+	uplink_record_put_be16(record, body_len);
+}
+
+/*
+ * Declare the id of the serial number if the collector connection has changed since the last time
+ */
+static void record_declare_serial(uint16_t serial_id) {
+	struct record_serial *entry;
+	struct uplink_record record;
+	uint64_t epoch;
+	size_t len;
+
+	g_mutex_lock(&m_lock);
+
+	if ((m_serials == NULL) || (serial_id > m_serials->len)) {
+		g_mutex_unlock(&m_lock);
+		return;
+	}
+
+	entry = g_ptr_array_index(m_serials, serial_id - 1);
+	epoch = uplink_epoch();
+	if (entry->declared_epoch != epoch) {
+		len = strlen(entry->serial);
+		if (len > RECORD_MAX_BODY - 2) {
+			len = RECORD_MAX_BODY - 2;
+		}
+
+		if (uplink_record_begin(&record, RECORD_HEADER_SIZE + 2 + len) == UPLINK_SUCCESS) {
+			put_header(&record, RECORD_TYPE_SERIAL, 2 + len);
+			uplink_record_put_be16(&record, serial_id);
+			uplink_record_put(&record, entry->serial, len);
+			uplink_record_commit(&record);
+
+			entry->declared_epoch = epoch;
+		}
+	}
+
+	g_mutex_unlock(&m_lock);
+}
+
+static int send_binary(const bdaddr_t *addr, uint16_t serial_id, uint64_t timestamp,
+		const uint8_t *head, size_t head_len, const uint8_t *tail, size_t tail_len)
+{
+	size_t len = head_len + tail_len;
+	struct uplink_record record;
+	int ret;
+
+	if (serial_id != 0) {
+		record_declare_serial(serial_id);
+	}
+
+	if (len > RECORD_MAX_BODY - RECORD_NOTIFICATION_SIZE) {
+		len = RECORD_MAX_BODY - RECORD_NOTIFICATION_SIZE;
+		head_len = MIN(head_len, len);
+		tail_len = len - head_len;
+	}
+
+	ret = uplink_record_begin(&record, RECORD_HEADER_SIZE + RECORD_NOTIFICATION_SIZE + len);
+	if (ret != UPLINK_SUCCESS) {
+		return ret;
+	}
+
+	put_header(&record, RECORD_TYPE_NOTIFICATION, RECORD_NOTIFICATION_SIZE + len);
+	// bdaddr_t holds the least significant byte first
+	for (int i = 5; i >= 0; i--) {
+		uplink_record_put_u8(&record, addr->b[i]);
+	}
+	uplink_record_put_be16(&record, serial_id);
+	uplink_record_put_be64(&record, timestamp);
+	if (head_len > 0) {
+		uplink_record_put(&record, head, head_len);
+	}
+	uplink_record_put(&record, tail, tail_len);
+	uplink_record_commit(&record);
+	return UPLINK_SUCCESS;
+}
+
+static int send_text(const bdaddr_t *addr, const char *serial,
+		const uint8_t *head, size_t head_len, const uint8_t *tail, size_t tail_len)
+{
+	static const char separator[] = " mac: ";
+	struct uplink_record record;
+	char address[18];
+	size_t serial_len = strlen(serial);
+	int ret;
+
+	ba2str(addr, address);
+
+	// The payload is text: it ends at its first null character
+	if (head_len > 0) {
+		size_t len = strnlen((const char*)head, head_len);
+		if (len < head_len) {
+			head_len = len;
+			tail_len = 0;
+		}
+	}
+	if (tail_len > 0) {
+		tail_len = strnlen((const char*)tail, tail_len);
+	}
+
+	ret = uplink_record_begin(&record, serial_len + 1 + head_len + tail_len + strlen(separator) + strlen(address));
+	if (ret != UPLINK_SUCCESS) {
+		return ret;
+	}
+
+	// Same bytes as the first connectors: the collectors of the text format do not expect a separator
+	uplink_record_put(&record, serial, serial_len);
+	uplink_record_put_u8(&record, ' ');
+	if (head_len > 0) {
+		uplink_record_put(&record, head, head_len);
+	}
+	uplink_record_put(&record, tail, tail_len);
+	uplink_record_put(&record, separator, strlen(separator));
+	uplink_record_put(&record, address, strlen(address));
+	uplink_record_commit(&record);
+	return UPLINK_SUCCESS;
+}
+
+int record_send_frame(enum record_format format, const bdaddr_t *addr, uint16_t serial_id,
+		const char *serial, uint64_t timestamp,
+		const uint8_t *head, size_t head_len, const uint8_t *tail, size_t tail_len)
+{
+	if (format == RECORD_FORMAT_TEXT) {
+		return send_text(addr, serial, head, head_len, tail, tail_len);
+	} else {
+		return send_binary(addr, serial_id, timestamp, head, head_len, tail, tail_len);
+	}
+}
@@ -0,0 +1,69 @@
+/*
+ * Telemetry records sent by the connector to the collector
+ *
+ * In the binary format, each record is:
+ *
+ *   version (1 byte, RECORD_VERSION) | type (1 byte) | length of the body (16-bit big endian) | body
+ *
+ * RECORD_TYPE_NOTIFICATION body:
+ *   address (6 bytes, most significant byte first as in "AA:BB:CC:DD:EE:FF") |
+ *   serial id (16-bit big endian, 0 when the serial number is unknown) |
+ *   monotonic timestamp in ms (64-bit big endian) | message of the slave
+ *
+ * RECORD_TYPE_SERIAL body:
+ *   serial id (16-bit big endian) | serial number (not terminated)
+ *
+ * The serial numbers are interned to a small id. The id of a serial number is declared before
+ * its first notification on each connection to the collector. A collector receiving an unknown
+ * id can still identify the slave with its address.
+ *
+ * In the text format, the default, each record is "<serial> <payload> mac: <address>" without a
+ * separator, as sent by the first connectors.
+ */
+
+#ifndef __RECORD_H__
+#define __RECORD_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <bluetooth/bluetooth.h>
+
+#define RECORD_VERSION              1
+
+#define RECORD_TYPE_NOTIFICATION    1
+#define RECORD_TYPE_SERIAL          2
+
+#define RECORD_HEADER_SIZE          4
+#define RECORD_MAX_BODY             0xFFFF
+#define RECORD_NOTIFICATION_SIZE    (6 + 2 + 8)
+
+enum record_format {
+	RECORD_FORMAT_TEXT,
+	RECORD_FORMAT_BINARY,
+};
+
+/**
+ * Intern a serial number. It can be called from any thread.
+ *
+ * @return the id of the serial number or 0 if there is no id left
+ */
+uint16_t record_serial_intern(const char *serial);
+
+/**
+ * Queue a message of a slave to the collector. It can be called from any thread.
+ *
+ * The message is made of two segments, e.g. its start buffered from the previous notifications
+ * and its end in the last notification. They are copied once, to the uplink.
+ *
+ * @param serial_id is the id returned by record_serial_intern() or 0
+ * @param serial is the serial number, only used by the text format
+ * @param head can be NULL if 'head_len' is 0
+ *
+ * @return UPLINK_SUCCESS, UPLINK_DROPPED or UPLINK_ERROR
+ */
+int record_send_frame(enum record_format format, const bdaddr_t *addr, uint16_t serial_id,
+		const char *serial, uint64_t timestamp,
+		const uint8_t *head, size_t head_len, const uint8_t *tail, size_t tail_len);
+
+#endif
@@ -0,0 +1,283 @@
+/*
+ * State of the slaves kept across the restarts of the connector
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "slave_state.h"
+
+#define SLAVE_STATE_INITIAL_CAPACITY  256
+
+struct slave_state {
+	// Protect the mapping (it moves when the file grows) and serialize the updates
+	GMutex lock;
+	int fd;
+	struct slave_state_header *header;
+	struct slave_state_record *records;
+	size_t size;
+	uint32_t count;  // Records in use. They are never freed.
+};
+
+static struct slave_state m_state = { .fd = -1 };
+
+static size_t state_size(uint32_t capacity) {
+	return sizeof(struct slave_state_header) + (size_t)capacity * sizeof(struct slave_state_record);
+}
+
+static bool state_map(struct slave_state *state, uint32_t capacity) {
+	size_t size = state_size(capacity);
+	void *map;
+
+	if (ftruncate(state->fd, size) < 0) {
+		fprintf(stderr, "slave state: fail to resize the file: %s\n", strerror(errno));
+		return false;
+	}
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, state->fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "slave state: fail to map the file: %s\n", strerror(errno));
+		return false;
+	}
+
+	if (state->header != NULL) {
+		munmap(state->header, state->size);
+	}
+	state->header = map;
+	state->records = (struct slave_state_record*)(state->header + 1);
+	state->size = size;
+	return true;
+}
+
+/*
+ * An update is surrounded by two increments of the sequence: it is odd while the record is updated.
+ * Called with the lock held.
+ */
+static inline void record_begin(struct slave_state_record *record) {
+	g_atomic_int_inc((gint*)&record->sequence);
+}
+
+static inline void record_end(struct slave_state_record *record) {
+	g_atomic_int_inc((gint*)&record->sequence);
+}
+
+bool slave_state_open(const char *path) {
+	struct slave_state *state = &m_state;
+	struct stat st;
+
+	g_mutex_init(&state->lock);
+
+	state->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (state->fd < 0) {
+		fprintf(stderr, "slave state: fail to open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	if (fstat(state->fd, &st) < 0) {
+		goto ON_ERROR;
+	}
+
+	if (st.st_size > 0) {
+		struct slave_state_header header;
+
+		// The slaves of an older layout are found again from the static list and the collector
+		if ((pread(state->fd, &header, sizeof(header), 0) == sizeof(header)) &&
+			(header.magic == SLAVE_STATE_MAGIC) && (header.version != SLAVE_STATE_VERSION))
+		{
+			fprintf(stderr, "slave state: %s has the layout of version %u, start a new one.\n",
+					path, header.version);
+			if (ftruncate(state->fd, 0) < 0) {
+				goto ON_ERROR;
+			}
+			st.st_size = 0;
+		}
+	}
+
+	if (st.st_size == 0) {
+		// New file
+		if (!state_map(state, SLAVE_STATE_INITIAL_CAPACITY)) {
+			goto ON_ERROR;
+		}
+		state->header->magic = SLAVE_STATE_MAGIC;
+		state->header->version = SLAVE_STATE_VERSION;
+		state->header->record_size = sizeof(struct slave_state_record);
+		state->header->capacity = SLAVE_STATE_INITIAL_CAPACITY;
+	} else {
+		struct slave_state_header header;
+
+		if ((pread(state->fd, &header, sizeof(header), 0) != sizeof(header)) ||
+			(header.magic != SLAVE_STATE_MAGIC) || (header.version != SLAVE_STATE_VERSION) ||
+			(header.record_size != sizeof(struct slave_state_record)) ||
+			((size_t)st.st_size < state_size(header.capacity)))
+		{
+			fprintf(stderr, "slave state: %s is not a valid state file.\n", path);
+			goto ON_ERROR;
+		}
+
+		if (!state_map(state, header.capacity)) {
+			goto ON_ERROR;
+		}
+	}
+
+	// The records are used in order
+	state->count = 0;
+	while ((state->count < state->header->capacity) && state->records[state->count].used) {
+		struct slave_state_record *record = &state->records[state->count];
+
+		// Interrupted update: only the fields written when the record was added are trusted
+		if (record->sequence & 1) {
+			record->addr_type = 0;
+			record->handle_noti = 0;
+			record->handle_write = 0;
+			record->last_seen = 0;
+			record->serial[0] = 0;
+			record->sequence++;
+		}
+		// Make sure the serial number is terminated
+		record->serial[SLAVE_STATE_SERIAL_SIZE - 1] = 0;
+
+		state->count++;
+	}
+	return true;
+
+ON_ERROR:
+	close(state->fd);
+	state->fd = -1;
+	return false;
+}
+
+void slave_state_close(void) {
+	struct slave_state *state = &m_state;
+
+	g_mutex_lock(&state->lock);
+	if (state->header != NULL) {
+		msync(state->header, state->size, MS_SYNC);
+		munmap(state->header, state->size);
+		state->header = NULL;
+		state->records = NULL;
+	}
+	if (state->fd >= 0) {
+		close(state->fd);
+		state->fd = -1;
+	}
+	g_mutex_unlock(&state->lock);
+}
+
+void slave_state_foreach(slave_state_cb_t callback, void *user_data) {
+	struct slave_state *state = &m_state;
+
+	g_mutex_lock(&state->lock);
+	for (uint32_t i = 0; (state->records != NULL) && (i < state->count); i++) {
+		callback(&state->records[i], i, user_data);
+	}
+	g_mutex_unlock(&state->lock);
+}
+
+int slave_state_add(const bdaddr_t *addr, uint32_t holding_time) {
+	struct slave_state *state = &m_state;
+	struct slave_state_record *record;
+	int index = -1;
+
+	g_mutex_lock(&state->lock);
+
+	if (state->header == NULL) {
+		goto EXIT;
+	}
+
+	if (state->count == state->header->capacity) {
+		uint32_t capacity = state->header->capacity * 2;
+
+		if (!state_map(state, capacity)) {
+			goto EXIT;
+		}
+		state->header->capacity = capacity;
+	}
+
+	index = state->count++;
+	record = &state->records[index];
+	record_begin(record);
+	bacpy(&record->addr, addr);
+	record->holding_time = holding_time;
+	record->addr_type = 0;
+	record->handle_noti = 0;
+	record->handle_write = 0;
+	record->last_seen = 0;
+	record->serial[0] = 0;
+	// The record is only found at the next start once completely written
+	__atomic_store_n(&record->used, 1, __ATOMIC_RELEASE);
+	record_end(record);
+
+	// The new slaves are worth to write early. The other updates are written back by the kernel.
+	msync(state->header, state->size, MS_ASYNC);
+
+EXIT:
+	g_mutex_unlock(&state->lock);
+	return index;
+}
+
+/*
+ * Get the record to update. It returns with the lock held if the record exists.
+ */
+static struct slave_state_record *record_get(int index) {
+	struct slave_state *state = &m_state;
+
+	g_mutex_lock(&state->lock);
+	if ((state->records == NULL) || (index < 0) || ((uint32_t)index >= state->count)) {
+		g_mutex_unlock(&state->lock);
+		return NULL;
+	}
+	return &state->records[index];
+}
+
+void slave_state_set_holding_time(int index, uint32_t holding_time) {
+	struct slave_state_record *record = record_get(index);
+
+	if (record != NULL) {
+		record_begin(record);
+		record->holding_time = holding_time;
+		record_end(record);
+		g_mutex_unlock(&m_state.lock);
+	}
+}
+
+void slave_state_set_serial(int index, const char *serial) {
+	struct slave_state_record *record = record_get(index);
+
+	if (record != NULL) {
+		record_begin(record);
+		snprintf(record->serial, sizeof(record->serial), "%s", serial);
+		record_end(record);
+		g_mutex_unlock(&m_state.lock);
+	}
+}
+
+void slave_state_set_connection(int index, uint8_t addr_type, uint16_t handle_noti, uint16_t handle_write) {
+	struct slave_state_record *record = record_get(index);
+
+	if (record != NULL) {
+		record_begin(record);
+		record->addr_type = addr_type;
+		record->handle_noti = handle_noti;
+		record->handle_write = handle_write;
+		record_end(record);
+		g_mutex_unlock(&m_state.lock);
+	}
+}
+
+void slave_state_set_last_seen(int index, int64_t last_seen) {
+	struct slave_state_record *record = record_get(index);
+
+	if (record != NULL) {
+		record_begin(record);
+		record->last_seen = last_seen;
+		record_end(record);
+		g_mutex_unlock(&m_state.lock);
+	}
+}
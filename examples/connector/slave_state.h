@@ -0,0 +1,80 @@
+/*
+ * State of the slaves kept across the restarts of the connector
+ *
+ * The state is a file of fixed-size records mapped in memory: an update is a few stores, the file
+ * is never opened again. Each record has a sequence number that is odd while the record is updated.
+ * A record found with an odd sequence (the connector stopped during the update) only keeps its
+ * address and holding time.
+ *
+ * The header and the records are aligned on SLAVE_STATE_ALIGN bytes: a record never crosses a disk
+ * sector, so the kernel writes it back whole even if the system stops during the write back.
+ */
+
+#ifndef __SLAVE_STATE_H__
+#define __SLAVE_STATE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <bluetooth/bluetooth.h>
+
+#define SLAVE_STATE_MAGIC       0x53544e43  // "CNTS"
+#define SLAVE_STATE_VERSION     2
+
+#define SLAVE_STATE_ALIGN       128
+
+#define SLAVE_STATE_SERIAL_SIZE 64
+
+struct slave_state_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t capacity;  // Number of records in the file
+	uint32_t reserved;
+} __attribute__((aligned(SLAVE_STATE_ALIGN)));
+
+struct slave_state_record {
+	int32_t  sequence;
+	uint8_t  used;
+	uint8_t  addr_type;      // BDADDR_LE_PUBLIC, BDADDR_LE_RANDOM or 0 if unknown
+	bdaddr_t addr;
+	uint32_t holding_time;   // ms
+	uint16_t handle_noti;    // Value handle of the notification characteristic (0 if unknown)
+	uint16_t handle_write;   // Value handle of the write characteristic (0 if unknown)
+	uint32_t reserved;
+	int64_t  last_seen;      // Wall clock (ms since the Epoch) of the last notification (0: never)
+	char     serial[SLAVE_STATE_SERIAL_SIZE];
+} __attribute__((aligned(SLAVE_STATE_ALIGN)));
+
+typedef void (*slave_state_cb_t)(const struct slave_state_record *record, uint32_t index, void *user_data);
+
+/**
+ * Map the state file. It is created if it does not exist or has the layout of an older version.
+ *
+ * @return false if the file cannot be mapped or is not a state file
+ */
+bool slave_state_open(const char *path);
+
+void slave_state_close(void);
+
+/**
+ * Call 'callback' for each slave of the state. The callback must not update the state.
+ */
+void slave_state_foreach(slave_state_cb_t callback, void *user_data);
+
+/**
+ * Add a slave to the state. The file grows if needed.
+ *
+ * @return the index of its record or -1 on error
+ */
+int slave_state_add(const bdaddr_t *addr, uint32_t holding_time);
+
+/*
+ * Update the record 'index'. They can be called from any thread.
+ */
+void slave_state_set_holding_time(int index, uint32_t holding_time);
+void slave_state_set_serial(int index, const char *serial);
+void slave_state_set_connection(int index, uint8_t addr_type, uint16_t handle_noti, uint16_t handle_write);
+void slave_state_set_last_seen(int index, int64_t last_seen);
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * Tests of the timer wheel
+ */
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "timer_wheel.h"
+
+struct fired {
+	unsigned int count;
+	uint64_t now;
+	unsigned int rearm;  // Number of times the callback schedules the timer again in the past
+};
+
+static void fired_cb(struct timer_wheel_timer *timer, uint64_t now, void *user_data) {
+	struct fired *fired = user_data;
+
+	fired->count++;
+	fired->now = now;
+}
+
+static void test_expiry(void) {
+	struct timer_wheel wheel;
+	struct timer_wheel_timer timer;
+	struct fired fired = { 0 };
+	uint64_t expires;
+
+	timer_wheel_init(&wheel, 1000);
+	timer_wheel_timer_init(&timer, fired_cb, &fired);
+	timer_wheel_add(&wheel, &timer, 1010);
+
+	assert(timer_wheel_next_expiry(&wheel, &expires) && (expires == 1010));
+	timer_wheel_advance(&wheel, 1009);
+	assert(fired.count == 0);
+	timer_wheel_advance(&wheel, 1010);
+	assert((fired.count == 1) && (fired.now == 1010));
+	assert(!timer_wheel_is_pending(&timer));
+	assert(!timer_wheel_next_expiry(&wheel, &expires));
+}
+
+static void test_cascade(void) {
+	struct timer_wheel wheel;
+	struct timer_wheel_timer timer;
+	struct fired fired = { 0 };
+
+	timer_wheel_init(&wheel, 0);
+	timer_wheel_timer_init(&timer, fired_cb, &fired);
+	// Beyond the first two levels
+	timer_wheel_add(&wheel, &timer, 300000);
+
+	timer_wheel_advance(&wheel, 299999);
+	assert(fired.count == 0);
+	timer_wheel_advance(&wheel, 300000);
+	assert((fired.count == 1) && (fired.now == 300000));
+}
+
+/*
+ * Once the wheel has advanced up to 'cur', the timers added at 'cur' or before fire on the next
+ * advance to 'cur'. They must not wait for the next tick.
+ */
+static void test_past(void) {
+	struct timer_wheel wheel;
+	struct timer_wheel_timer at_cur, before_cur;
+	struct fired fired_at_cur = { 0 }, fired_before_cur = { 0 };
+	uint64_t expires;
+
+	timer_wheel_init(&wheel, 0);
+	timer_wheel_advance(&wheel, 100);
+
+	timer_wheel_timer_init(&at_cur, fired_cb, &fired_at_cur);
+	timer_wheel_timer_init(&before_cur, fired_cb, &fired_before_cur);
+	timer_wheel_add(&wheel, &at_cur, 100);
+	timer_wheel_add(&wheel, &before_cur, 50);
+
+	assert(timer_wheel_next_expiry(&wheel, &expires) && (expires == 50));
+
+	timer_wheel_advance(&wheel, 100);
+	assert((fired_at_cur.count == 1) && (fired_at_cur.now == 100));
+	assert((fired_before_cur.count == 1) && (fired_before_cur.now == 100));
+	assert(!timer_wheel_next_expiry(&wheel, &expires));
+
+	// A timer removed before the advance does not fire
+	timer_wheel_add(&wheel, &at_cur, 100);
+	timer_wheel_remove(&at_cur);
+	timer_wheel_advance(&wheel, 100);
+	assert(fired_at_cur.count == 1);
+}
+
+static struct timer_wheel m_rearm_wheel;
+
+static void rearm_past_cb(struct timer_wheel_timer *timer, uint64_t now, void *user_data) {
+	struct fired *fired = user_data;
+
+	fired->count++;
+	if (fired->rearm > 0) {
+		fired->rearm--;
+		timer_wheel_add(&m_rearm_wheel, timer, now - 1);
+	}
+}
+
+/*
+ * A callback scheduling its timer in the past gets it fired in the same advance
+ */
+static void test_rearm_past(void) {
+	struct timer_wheel_timer timer;
+	struct fired fired = { .rearm = 2 };
+
+	timer_wheel_init(&m_rearm_wheel, 0);
+	timer_wheel_timer_init(&timer, rearm_past_cb, &fired);
+	timer_wheel_add(&m_rearm_wheel, &timer, 10);
+
+	timer_wheel_advance(&m_rearm_wheel, 20);
+	assert(fired.count == 3);
+	assert(!timer_wheel_is_pending(&timer));
+}
+
+int main(void) {
+	test_expiry();
+	test_cascade();
+	test_past();
+	test_rearm_past();
+
+	printf("timer wheel: all the tests passed\n");
+	return 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * Hierarchical timer wheel
+ */
+
+#include <stddef.h>
+
+#include "timer_wheel.h"
+
+#define TIMER_WHEEL_MASK  (TIMER_WHEEL_SLOTS - 1)
+
+static inline unsigned int level_shift(int level) {
+	return level * TIMER_WHEEL_BITS;
+}
+
+static inline unsigned int slot_index(uint64_t tick, int level) {
+	return (tick >> level_shift(level)) & TIMER_WHEEL_MASK;
+}
+
+static void slot_insert(struct timer_wheel_timer **slot, struct timer_wheel_timer *timer) {
+	timer->next = *slot;
+	if (timer->next != NULL) {
+		timer->next->pprev = &timer->next;
+	}
+	timer->pprev = slot;
+	*slot = timer;
+}
+
+static void timer_wheel_insert(struct timer_wheel *wheel, struct timer_wheel_timer *timer) {
+	uint64_t expires = timer->expires;
+	uint64_t delta;
+	int level;
+
+	// After an advance, 'now' is past the last tick fired: the timers expiring before cannot wait
+	// for their slot to be reached.
+	if (expires < wheel->now) {
+		slot_insert(&wheel->due, timer);
+		return;
+	}
+	delta = expires - wheel->now;
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++) {
+		if (delta < ((uint64_t)1 << level_shift(level + 1))) {
+			break;
+		}
+	}
+
+	if (delta >= ((uint64_t)1 << level_shift(TIMER_WHEEL_LEVELS))) {
+		// Beyond the range of the wheel: park the timer in the last slot of the top level.
+		// It is inserted again when this slot is cascaded.
+		expires = wheel->now + ((uint64_t)1 << level_shift(TIMER_WHEEL_LEVELS)) - 1;
+	}
+
+	slot_insert(&wheel->slots[level][slot_index(expires, level)], timer);
+}
+
+void timer_wheel_init(struct timer_wheel *wheel, uint64_t now) {
+	for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		for (int i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+			wheel->slots[level][i] = NULL;
+		}
+	}
+	wheel->due = NULL;
+	wheel->now = now;
+}
+
+void timer_wheel_timer_init(struct timer_wheel_timer *timer, timer_wheel_cb_t callback, void *user_data) {
+	timer->next = NULL;
+	timer->pprev = NULL;
+	timer->expires = 0;
+	timer->callback = callback;
+	timer->user_data = user_data;
+}
+
+void timer_wheel_remove(struct timer_wheel_timer *timer) {
+	if (timer->pprev == NULL) {
+		return;
+	}
+
+	*timer->pprev = timer->next;
+	if (timer->next != NULL) {
+		timer->next->pprev = timer->pprev;
+	}
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+void timer_wheel_add(struct timer_wheel *wheel, struct timer_wheel_timer *timer, uint64_t expires) {
+	timer_wheel_remove(timer);
+	timer->expires = expires;
+	timer_wheel_insert(wheel, timer);
+}
+
+/*
+ * Move the timers of the current slot of the upper levels down the wheel
+ */
+static void timer_wheel_cascade(struct timer_wheel *wheel) {
+	for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+		unsigned int index = slot_index(wheel->now, level);
+		struct timer_wheel_timer *timer = wheel->slots[level][index];
+
+		wheel->slots[level][index] = NULL;
+		while (timer != NULL) {
+			struct timer_wheel_timer *next = timer->next;
+
+			timer->pprev = NULL;
+			timer_wheel_insert(wheel, timer);
+			timer = next;
+		}
+
+		// The upper level only turns when this level has completed a turn
+		if (index != 0) {
+			break;
+		}
+	}
+}
+
+/*
+ * Next tick the wheel has to stop at: a non-empty slot of the first level to fire or a non-empty
+ * slot of the upper levels to cascade. The ticks in between have nothing to do.
+ */
+static uint64_t timer_wheel_next_tick(const struct timer_wheel *wheel) {
+	uint64_t next = UINT64_MAX;
+
+	for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		unsigned int index = slot_index(wheel->now, level);
+
+		// The current slot (k == TIMER_WHEEL_SLOTS) is reached again after a full turn
+		for (unsigned int k = 1; k <= TIMER_WHEEL_SLOTS; k++) {
+			if (wheel->slots[level][(index + k) & TIMER_WHEEL_MASK] != NULL) {
+				uint64_t tick = ((wheel->now >> level_shift(level)) + k) << level_shift(level);
+				if (tick < next) {
+					next = tick;
+				}
+				break;
+			}
+		}
+	}
+
+	return next;
+}
+
+static void timer_wheel_fire(struct timer_wheel_timer **slot, uint64_t now) {
+	while (*slot != NULL) {
+		struct timer_wheel_timer *timer = *slot;
+
+		timer_wheel_remove(timer);
+		timer->callback(timer, now, timer->user_data);
+	}
+}
+
+void timer_wheel_advance(struct timer_wheel *wheel, uint64_t now) {
+	// The timers added in the past are late: they go first
+	timer_wheel_fire(&wheel->due, now);
+
+	while (wheel->now <= now) {
+		uint64_t next;
+
+		// The callbacks might schedule timers on the current tick or before: they are fired in this pass
+		struct timer_wheel_timer **slot = &wheel->slots[0][slot_index(wheel->now, 0)];
+		while ((*slot != NULL) || (wheel->due != NULL)) {
+			timer_wheel_fire(slot, now);
+			timer_wheel_fire(&wheel->due, now);
+		}
+
+		next = timer_wheel_next_tick(wheel);
+		wheel->now = (next <= now) ? next : now + 1;
+
+		// Cascade as soon as the first level starts a new turn. The current slot of each level
+		// is therefore always empty, except for the timers a full turn ahead.
+		if (slot_index(wheel->now, 0) == 0) {
+			timer_wheel_cascade(wheel);
+		}
+	}
+}
+
+bool timer_wheel_next_expiry(const struct timer_wheel *wheel, uint64_t *expires) {
+	bool found = false;
+
+	for (const struct timer_wheel_timer *timer = wheel->due; timer != NULL; timer = timer->next) {
+		if (!found || (timer->expires < *expires)) {
+			*expires = timer->expires;
+			found = true;
+		}
+	}
+
+	for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		// The timers of the upper levels are at least one slot ahead of the current one
+		unsigned int start = slot_index(wheel->now, level) + (level > 0 ? 1 : 0);
+
+		for (int i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+			const struct timer_wheel_timer *timer = wheel->slots[level][(start + i) & TIMER_WHEEL_MASK];
+			if (timer == NULL) {
+				continue;
+			}
+
+			for (; timer != NULL; timer = timer->next) {
+				if (!found || (timer->expires < *expires)) {
+					*expires = timer->expires;
+					found = true;
+				}
+			}
+
+			// The earliest timer of this level is in its first non-empty slot. This is not true for
+			// the top level: it also holds the timers parked beyond the range of the wheel.
+			if (level < TIMER_WHEEL_LEVELS - 1) {
+				break;
+			}
+		}
+	}
+
+	return found;
+}
@@ -0,0 +1,65 @@
+/*
+ * Hierarchical timer wheel
+ *
+ * The wheel has TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS slots. A slot of the first level
+ * covers one tick (1 ms). A slot of the next levels covers a full turn of the previous level.
+ * Timers are moved (cascaded) to a lower level when the wheel reaches their slot.
+ */
+
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TIMER_WHEEL_BITS    6
+#define TIMER_WHEEL_SLOTS   (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS  5
+
+struct timer_wheel_timer;
+
+typedef void (*timer_wheel_cb_t)(struct timer_wheel_timer *timer, uint64_t now, void *user_data);
+
+struct timer_wheel_timer {
+	struct timer_wheel_timer *next;
+	struct timer_wheel_timer **pprev;  // NULL when the timer is not scheduled
+	uint64_t expires;
+	timer_wheel_cb_t callback;
+	void *user_data;
+};
+
+struct timer_wheel {
+	uint64_t now;  // Current tick. All the timers expiring before have been fired.
+	struct timer_wheel_timer *due;  // Timers added with an expiry before 'now'
+	struct timer_wheel_timer *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+void timer_wheel_init(struct timer_wheel *wheel, uint64_t now);
+
+void timer_wheel_timer_init(struct timer_wheel_timer *timer, timer_wheel_cb_t callback, void *user_data);
+
+/**
+ * Schedule the timer at 'expires'. A timer already scheduled is moved.
+ * A timer expiring in the past fires on the next call of timer_wheel_advance().
+ */
+void timer_wheel_add(struct timer_wheel *wheel, struct timer_wheel_timer *timer, uint64_t expires);
+
+void timer_wheel_remove(struct timer_wheel_timer *timer);
+
+static inline bool timer_wheel_is_pending(const struct timer_wheel_timer *timer) {
+	return timer->pprev != NULL;
+}
+
+/**
+ * Fire the timers expiring up to 'now' (included). The callbacks can add and remove timers.
+ */
+void timer_wheel_advance(struct timer_wheel *wheel, uint64_t now);
+
+/**
+ * Get the expiry of the next timer
+ *
+ * @return false if no timer is scheduled
+ */
+bool timer_wheel_next_expiry(const struct timer_wheel *wheel, uint64_t *expires);
+
+#endif
@@ -0,0 +1,466 @@
+/*
+ * Uplink of the connector to the collector
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <glib.h>
+
+#include "uplink.h"
+
+// Delay (ms) before connecting again to the collector. It doubles on each failure.
+#define UPLINK_RECONNECT_MIN     500
+#define UPLINK_RECONNECT_MAX     30000
+// Average size of a record. It gives the number of record boundaries we keep track of.
+#define UPLINK_RECORD_AVERAGE    32
+
+struct uplink {
+	// Protect the buffer, the record boundaries and the statistics
+	GMutex lock;
+	uint8_t *buffer;
+	size_t size;
+	// Number of bytes queued and written since the start. The ring holds the bytes [tail, head).
+	uint64_t head;
+	uint64_t tail;
+	// End of the records not completely written: [record_tail, record_head)
+	uint64_t *ends;
+	size_t max_records;
+	uint64_t record_head;
+	uint64_t record_tail;
+	// Start of the record 'record_tail'. It differs from 'tail' while a record is partially written.
+	uint64_t record_start;
+	enum uplink_drop_policy policy;
+	struct uplink_stats stats;
+	// Changes when the records queued before might not reach the collector. See uplink_epoch().
+	uint64_t epoch;
+	bool connected;
+	bool flush_scheduled;
+
+	// The fields below are only used from the main loop
+	char *host;
+	uint16_t port;
+	int fd;
+	GIOChannel *channel;
+	guint in_watch;
+	guint out_watch;
+	guint reconnect_source;
+	guint reconnect_delay;
+	uplink_frame_cb_t frame_cb;
+	void *user_data;
+	uint8_t rx[2 + UPLINK_MAX_FRAME];
+	size_t rx_len;
+};
+
+static struct uplink m_uplink = { .fd = -1 };
+
+static void uplink_connect(struct uplink *u);
+
+static void ring_copy(struct uplink *u, uint64_t offset, const void *data, size_t len) {
+	size_t pos = offset % u->size;
+	size_t first = (len < u->size - pos) ? len : u->size - pos;
+
+	memcpy(u->buffer + pos, data, first);
+	memcpy(u->buffer, (const uint8_t*)data + first, len - first);
+}
+
+/*
+ * Release the records written completely. Called with the lock held.
+ */
+static void uplink_complete_records(struct uplink *u) {
+	while ((u->record_tail < u->record_head) && (u->ends[u->record_tail % u->max_records] <= u->tail)) {
+		u->record_start = u->ends[u->record_tail % u->max_records];
+		u->record_tail++;
+		u->stats.records_sent++;
+	}
+}
+
+/*
+ * Drop the oldest record. A record partially written cannot be dropped without corrupting the
+ * stream. Called with the lock held.
+ */
+static bool uplink_drop_oldest(struct uplink *u) {
+	uint64_t end;
+
+	if ((u->record_tail == u->record_head) || (u->tail != u->record_start)) {
+		return false;
+	}
+
+	end = u->ends[u->record_tail % u->max_records];
+	u->stats.records_dropped++;
+	u->stats.bytes_dropped += end - u->record_start;
+	u->tail = u->record_start = end;
+	u->record_tail++;
+	u->epoch++;
+	return true;
+}
+
+/*
+ * Write as much as the socket accepts in a single call
+ *
+ * @param pending is set to the number of bytes left to write
+ *
+ * @return false if the connection is broken
+ */
+static bool uplink_flush(struct uplink *u, uint64_t *pending) {
+	struct iovec iov[2];
+	struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 1 };
+	size_t pos;
+	ssize_t n;
+	int error;
+
+	g_mutex_lock(&u->lock);
+	u->flush_scheduled = false;
+
+	*pending = u->head - u->tail;
+	if (!u->connected || (*pending == 0)) {
+		g_mutex_unlock(&u->lock);
+		return true;
+	}
+
+	// The pending bytes wrap at most once around the ring
+	pos = u->tail % u->size;
+	iov[0].iov_base = u->buffer + pos;
+	iov[0].iov_len = (*pending < u->size - pos) ? *pending : u->size - pos;
+	if (*pending > iov[0].iov_len) {
+		iov[1].iov_base = u->buffer;
+		iov[1].iov_len = *pending - iov[0].iov_len;
+		msg.msg_iovlen = 2;
+	}
+
+	// sendmsg() is writev() with MSG_NOSIGNAL: a closed collector must not raise SIGPIPE
+	n = sendmsg(u->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+	error = errno;
+	if (n > 0) {
+		u->tail += n;
+		u->stats.bytes_sent += n;
+		uplink_complete_records(u);
+	}
+	*pending = u->head - u->tail;
+	g_mutex_unlock(&u->lock);
+
+	if ((n < 0) && (error != EAGAIN) && (error != EWOULDBLOCK) && (error != EINTR)) {
+		fprintf(stderr, "uplink: fail to write: %s\n", strerror(error));
+		return false;
+	}
+
+	return true;
+}
+
+static void uplink_disconnect(struct uplink *u) {
+	if (u->in_watch != 0) {
+		g_source_remove(u->in_watch);
+		u->in_watch = 0;
+	}
+	if (u->out_watch != 0) {
+		g_source_remove(u->out_watch);
+		u->out_watch = 0;
+	}
+	if (u->channel != NULL) {
+		g_io_channel_unref(u->channel);
+		u->channel = NULL;
+	}
+	if (u->fd >= 0) {
+		close(u->fd);
+		u->fd = -1;
+	}
+	u->rx_len = 0;
+
+	g_mutex_lock(&u->lock);
+	if (u->connected) {
+		u->epoch++;
+	}
+	u->connected = false;
+	// The next connection starts on a record boundary: drop the rest of a partially written record
+	if (u->tail != u->record_start) {
+		uint64_t end = u->ends[u->record_tail % u->max_records];
+
+		u->stats.records_dropped++;
+		u->stats.bytes_dropped += end - u->tail;
+		u->tail = u->record_start = end;
+		u->record_tail++;
+	}
+	g_mutex_unlock(&u->lock);
+}
+
+static gboolean uplink_reconnect_cb(gpointer user_data) {
+	struct uplink *u = user_data;
+
+	u->reconnect_source = 0;
+	uplink_connect(u);
+	return FALSE;
+}
+
+static void uplink_reconnect_later(struct uplink *u) {
+	struct uplink_stats stats;
+
+	uplink_disconnect(u);
+
+	uplink_get_stats(&stats);
+	fprintf(stderr, "uplink: not connected, retry in %u ms (%llu records dropped so far)\n",
+			u->reconnect_delay, (unsigned long long)stats.records_dropped);
+
+	u->reconnect_source = g_timeout_add(u->reconnect_delay, uplink_reconnect_cb, u);
+	u->reconnect_delay *= 2;
+	if (u->reconnect_delay > UPLINK_RECONNECT_MAX) {
+		u->reconnect_delay = UPLINK_RECONNECT_MAX;
+	}
+}
+
+static gboolean uplink_out_cb(GIOChannel *source, GIOCondition condition, gpointer user_data);
+
+static gboolean uplink_flush_idle(gpointer user_data) {
+	struct uplink *u = user_data;
+	uint64_t pending;
+
+	if (!uplink_flush(u, &pending)) {
+		uplink_reconnect_later(u);
+	} else if ((pending > 0) && (u->channel != NULL) && (u->out_watch == 0)) {
+		// Wait for the socket to accept more data
+		u->out_watch = g_io_add_watch(u->channel, G_IO_OUT, uplink_out_cb, u);
+	}
+	return FALSE;
+}
+
+static gboolean uplink_out_cb(GIOChannel *source, GIOCondition condition, gpointer user_data) {
+	struct uplink *u = user_data;
+
+	u->out_watch = 0;
+	return uplink_flush_idle(u);
+}
+
+static gboolean uplink_in_cb(GIOChannel *source, GIOCondition condition, gpointer user_data) {
+	struct uplink *u = user_data;
+	size_t offset = 0;
+	ssize_t n;
+
+	n = recv(u->fd, u->rx + u->rx_len, sizeof(u->rx) - u->rx_len, MSG_DONTWAIT);
+	if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))) {
+		return TRUE;
+	} else if (n <= 0) {
+		// The collector closed the connection
+		u->in_watch = 0;
+		uplink_reconnect_later(u);
+		return FALSE;
+	}
+	u->rx_len += n;
+
+	// Hand over the complete frames
+	while (u->rx_len - offset >= 2) {
+		size_t len = (u->rx[offset] << 8) | u->rx[offset + 1];
+		if (u->rx_len - offset - 2 < len) {
+			break;
+		}
+		if (u->frame_cb) {
+			u->frame_cb(u->rx + offset + 2, len, u->user_data);
+		}
+		offset += 2 + len;
+	}
+
+	memmove(u->rx, u->rx + offset, u->rx_len - offset);
+	u->rx_len -= offset;
+	return TRUE;
+}
+
+static gboolean uplink_connect_cb(GIOChannel *source, GIOCondition condition, gpointer user_data) {
+	struct uplink *u = user_data;
+	socklen_t len = sizeof(int);
+	int error = 0;
+
+	u->out_watch = 0;
+
+	if ((getsockopt(u->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0) || (error != 0)) {
+		fprintf(stderr, "uplink: fail to connect: %s\n", strerror(error));
+		uplink_reconnect_later(u);
+		return FALSE;
+	}
+
+	g_mutex_lock(&u->lock);
+	u->connected = true;
+	u->stats.connections++;
+	g_mutex_unlock(&u->lock);
+
+	printf("uplink: connected to %s:%u\n", u->host, u->port);
+	u->reconnect_delay = UPLINK_RECONNECT_MIN;
+	u->in_watch = g_io_add_watch(u->channel, G_IO_IN | G_IO_HUP | G_IO_ERR, uplink_in_cb, u);
+
+	// Write the records queued while we were disconnected
+	uplink_flush_idle(u);
+	return FALSE;
+}
+
+static void uplink_connect(struct uplink *u) {
+	struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+	struct addrinfo *res;
+	char port[8];
+
+	snprintf(port, sizeof(port), "%u", u->port);
+	if (getaddrinfo(u->host, port, &hints, &res) != 0) {
+		fprintf(stderr, "uplink: unknown host %s\n", u->host);
+		uplink_reconnect_later(u);
+		return;
+	}
+
+	u->fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if ((u->fd < 0) || ((connect(u->fd, res->ai_addr, res->ai_addrlen) < 0) && (errno != EINPROGRESS))) {
+		fprintf(stderr, "uplink: fail to connect: %s\n", strerror(errno));
+		freeaddrinfo(res);
+		uplink_reconnect_later(u);
+		return;
+	}
+	freeaddrinfo(res);
+
+	// The connection is established once the socket is writable
+	u->channel = g_io_channel_unix_new(u->fd);
+	u->out_watch = g_io_add_watch(u->channel, G_IO_OUT | G_IO_ERR | G_IO_HUP, uplink_connect_cb, u);
+}
+
+int uplink_start(const char *host, uint16_t port, size_t buffer_size, enum uplink_drop_policy policy,
+		uplink_frame_cb_t frame_cb, void *user_data)
+{
+	struct uplink *u = &m_uplink;
+
+	if ((host == NULL) || (buffer_size == 0)) {
+		return UPLINK_ERROR;
+	}
+
+	g_mutex_init(&u->lock);
+	u->size = buffer_size;
+	u->max_records = buffer_size / UPLINK_RECORD_AVERAGE + 1;
+	u->buffer = malloc(u->size);
+	u->ends = malloc(u->max_records * sizeof(uint64_t));
+	u->host = strdup(host);
+	if ((u->buffer == NULL) || (u->ends == NULL) || (u->host == NULL)) {
+		free(u->buffer);
+		free(u->ends);
+		free(u->host);
+		u->buffer = NULL;
+		return UPLINK_ERROR;
+	}
+
+	u->epoch = 1;
+	u->port = port;
+	u->policy = policy;
+	u->frame_cb = frame_cb;
+	u->user_data = user_data;
+	u->reconnect_delay = UPLINK_RECONNECT_MIN;
+
+	uplink_connect(u);
+	return UPLINK_SUCCESS;
+}
+
+void uplink_stop(void) {
+	struct uplink *u = &m_uplink;
+
+	if (u->reconnect_source != 0) {
+		g_source_remove(u->reconnect_source);
+		u->reconnect_source = 0;
+	}
+	uplink_disconnect(u);
+
+	g_mutex_lock(&u->lock);
+	free(u->buffer);
+	free(u->ends);
+	u->buffer = NULL;
+	u->ends = NULL;
+	g_mutex_unlock(&u->lock);
+
+	free(u->host);
+	u->host = NULL;
+}
+
+int uplink_record_begin(struct uplink_record *record, size_t len) {
+	struct uplink *u = &m_uplink;
+
+	g_mutex_lock(&u->lock);
+
+	if ((u->buffer == NULL) || (len == 0)) {
+		g_mutex_unlock(&u->lock);
+		return UPLINK_ERROR;
+	}
+
+	while ((u->size - (u->head - u->tail) < len) || (u->record_head - u->record_tail >= u->max_records)) {
+		if ((len > u->size) || (u->policy != UPLINK_DROP_OLDEST) || !uplink_drop_oldest(u)) {
+			u->stats.records_dropped++;
+			u->stats.bytes_dropped += len;
+			g_mutex_unlock(&u->lock);
+			return UPLINK_DROPPED;
+		}
+	}
+
+	record->offset = u->head;
+	record->len = len;
+	record->pos = 0;
+	return UPLINK_SUCCESS;
+}
+
+void uplink_record_put(struct uplink_record *record, const void *data, size_t len) {
+	// Never write beyond the reserved space
+	if (len > record->len - record->pos) {
+		len = record->len - record->pos;
+	}
+	ring_copy(&m_uplink, record->offset + record->pos, data, len);
+	record->pos += len;
+}
+
+void uplink_record_commit(struct uplink_record *record) {
+	struct uplink *u = &m_uplink;
+	bool schedule = false;
+
+	u->head += record->len;
+	u->ends[u->record_head++ % u->max_records] = u->head;
+
+	// The records queued until the main loop runs are written together
+	if (!u->flush_scheduled) {
+		u->flush_scheduled = true;
+		schedule = true;
+	}
+	g_mutex_unlock(&u->lock);
+
+	if (schedule) {
+		g_idle_add(uplink_flush_idle, u);
+	}
+}
+
+int uplink_send(const void *data, size_t len) {
+	struct uplink_record record;
+	int ret;
+
+	if (len == 0) {
+		return UPLINK_SUCCESS;
+	}
+
+	ret = uplink_record_begin(&record, len);
+	if (ret != UPLINK_SUCCESS) {
+		return ret;
+	}
+	uplink_record_put(&record, data, len);
+	uplink_record_commit(&record);
+	return UPLINK_SUCCESS;
+}
+
+uint64_t uplink_epoch(void) {
+	struct uplink *u = &m_uplink;
+	uint64_t epoch;
+
+	g_mutex_lock(&u->lock);
+	epoch = u->epoch;
+	g_mutex_unlock(&u->lock);
+	return epoch;
+}
+
+void uplink_get_stats(struct uplink_stats *stats) {
+	struct uplink *u = &m_uplink;
+
+	g_mutex_lock(&u->lock);
+	*stats = u->stats;
+	g_mutex_unlock(&u->lock);
+}
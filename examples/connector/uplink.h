@@ -0,0 +1,110 @@
+/*
+ * Uplink of the connector to the collector
+ *
+ * The records are queued in a ring buffer from any thread and written by the main loop with a
+ * nonblocking socket. The records queued while the collector is slow or unreachable are written
+ * together with a single writev(). The messages from the collector are framed by a 16-bit big
+ * endian length.
+ */
+
+#ifndef __UPLINK_H__
+#define __UPLINK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UPLINK_SUCCESS        0
+#define UPLINK_DROPPED        1
+#define UPLINK_ERROR          2
+
+// Largest message from the collector
+#define UPLINK_MAX_FRAME      0xFFFF
+
+enum uplink_drop_policy {
+	UPLINK_DROP_NEWEST,   // Drop the record being queued when the buffer is full
+	UPLINK_DROP_OLDEST,   // Drop the oldest records that are not being written yet
+};
+
+struct uplink_stats {
+	uint64_t records_sent;
+	uint64_t bytes_sent;
+	uint64_t records_dropped;
+	uint64_t bytes_dropped;
+	uint64_t connections;
+};
+
+/**
+ * Record being built in place in the uplink buffer. See uplink_record_begin().
+ */
+struct uplink_record {
+	uint64_t offset;
+	size_t len;
+	size_t pos;
+};
+
+/**
+ * Handler called from the main loop for each message received from the collector
+ */
+typedef void (*uplink_frame_cb_t)(const uint8_t *data, size_t len, void *user_data);
+
+/**
+ * Start the uplink. The connection is done (and done again on failure) in the background from
+ * the default main context.
+ *
+ * @return UPLINK_SUCCESS or UPLINK_ERROR
+ */
+int uplink_start(const char *host, uint16_t port, size_t buffer_size, enum uplink_drop_policy policy,
+		uplink_frame_cb_t frame_cb, void *user_data);
+
+void uplink_stop(void);
+
+/**
+ * Queue a record to the collector. It can be called from any thread and never blocks on the socket.
+ *
+ * @return UPLINK_SUCCESS, UPLINK_DROPPED if the record does not fit in the buffer or UPLINK_ERROR
+ */
+int uplink_send(const void *record, size_t len);
+
+/**
+ * Reserve 'len' bytes for a record written in place with uplink_record_put().
+ * It can be called from any thread. The uplink is locked until uplink_record_commit(): the record
+ * must be written without delay.
+ *
+ * @return UPLINK_SUCCESS, UPLINK_DROPPED if the record does not fit in the buffer or UPLINK_ERROR
+ */
+int uplink_record_begin(struct uplink_record *record, size_t len);
+
+void uplink_record_put(struct uplink_record *record, const void *data, size_t len);
+
+static inline void uplink_record_put_u8(struct uplink_record *record, uint8_t value) {
+	uplink_record_put(record, &value, 1);
+}
+
+static inline void uplink_record_put_be16(struct uplink_record *record, uint16_t value) {
+	uint8_t bytes[2] = { value >> 8, value & 0xFF };
+	uplink_record_put(record, bytes, sizeof(bytes));
+}
+
+static inline void uplink_record_put_be64(struct uplink_record *record, uint64_t value) {
+	uint8_t bytes[8];
+	for (int i = 0; i < 8; i++) {
+		bytes[i] = value >> (56 - 8 * i);
+	}
+	uplink_record_put(record, bytes, sizeof(bytes));
+}
+
+/**
+ * Queue the record. All the reserved bytes must have been written.
+ */
+void uplink_record_commit(struct uplink_record *record);
+
+/**
+ * Epoch of the stream to the collector. It changes when the records queued before might not reach
+ * the collector: the connection is lost or records are dropped to make room. The state declared
+ * to the collector must then be declared again.
+ */
+uint64_t uplink_epoch(void);
+
+void uplink_get_stats(struct uplink_stats *stats);
+
+#endif
@@ -1,5 +1,5 @@
 //#include <pthread.h>
-//#include <stdio.h>
+#include <stdio.h>
 //#include <stdint.h>
 //#include <stdlib.h>
 //#include <sys/queue.h>
@@ -9,49 +9,34 @@
 #define BLE_SCAN_EDDYSTONE_TIMEOUT   20
 
 /**
- * @brief Handler called on new discovered BLE device
+ * @brief Handler called on each Eddystone frame
  *
  * @param adapter is the adapter that has found the BLE device
- * @param addr is the MAC address of the BLE device
- * @param name is the name of BLE device if advertised
- * @param advertisement_data is an array of Service UUID and their respective data
- * @param advertisement_data_count is the number of elements in the advertisement_data array
- * @param manufacturer_id is the ID of the Manufacturer ID
- * @param manufacturer_data is the data following Manufacturer ID
- * @param manufacturer_data_size is the size of manufacturer_data
- * @param user_data  Data defined when calling `gattlib_register_on_disconnect()`
+ * @param advertisement is the advertisement carrying the Eddystone frame
+ * @param frame is the decoded Eddystone frame
+ * @param user_data  Data defined when calling `gattlib_adapter_scan_eddystone_frames()`
  */
-void on_eddystone_found(void *adapter, const char* addr, const char* name,
-		gattlib_advertisement_data_t *advertisement_data, size_t advertisement_data_count,
-		uint16_t manufacturer_id, uint8_t *manufacturer_data, size_t manufacturer_data_size,
-		void *user_data)
+void on_eddystone_found(void *adapter, const gattlib_advertisement_t *advertisement,
+		const gattlib_eddystone_frame_t *frame, void *user_data)
 {
-	puts("Found Eddystone device");
+	char addr[18];
 
-	// Look for Eddystone Common Data
-	for (size_t i = 0; i < advertisement_data_count; i++) {
-		gattlib_advertisement_data_t *advertisement_data_ptr = &advertisement_data[i];
-		if (gattlib_uuid_cmp(&advertisement_data_ptr->uuid, &gattlib_eddystone_common_data_uuid) == GATTLIB_SUCCESS) {
-			switch (advertisement_data_ptr->data[0]) {
-			case EDDYSTONE_TYPE_UID:
-				puts("\tEddystone UID");
-				break;
-			case EDDYSTONE_TYPE_URL:
-				printf("\tEddystone URL %s%s (TX Power:%d)\n",
-						gattlib_eddystone_url_scheme_prefix[advertisement_data_ptr->data[2]],
-						advertisement_data_ptr->data + 3,
-						advertisement_data_ptr->data[1]);
-				break;
-			case EDDYSTONE_TYPE_TLM:
-				puts("\tEddystone TLM");
-				break;
-			case EDDYSTONE_TYPE_EID:
-				puts("\tEddystone EID");
-				break;
-			default:
-				fprintf(stderr, "\tEddystone ID %d not supported\n", advertisement_data_ptr->data[0]);
-			}
-		}
+	ba2str(&advertisement->addr, addr);
+	printf("Found Eddystone device %s\n", addr);
+
+	switch (frame->frame_type) {
+	case EDDYSTONE_TYPE_UID:
+		puts("\tEddystone UID");
+		break;
+	case EDDYSTONE_TYPE_URL:
+		printf("\tEddystone URL %s (TX Power:%d)\n", frame->url.url, frame->tx_power);
+		break;
+	case EDDYSTONE_TYPE_TLM:
+		printf("\tEddystone TLM (Battery:%umV)\n", frame->tlm.battery_voltage);
+		break;
+	case EDDYSTONE_TYPE_EID:
+		puts("\tEddystone EID");
+		break;
 	}
 
 	// We stop advertising on the first device
@@ -78,7 +63,7 @@ int main(int argc, const char *argv[]) {
 		return 1;
 	}
 
-	ret = gattlib_adapter_scan_eddystone(adapter,
+	ret = gattlib_adapter_scan_eddystone_frames(adapter,
 			0, /* rssi_threshold. The value is not relevant as we do not pass GATTLIB_EDDYSTONE_LIMIT_RSSI */
 			GATTLIB_EDDYSTONE_TYPE_URL,
 			on_eddystone_found, BLE_SCAN_EDDYSTONE_TIMEOUT, NULL);
@@ -28,6 +28,7 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include <bluetooth/bluetooth.h>
@@ -61,6 +62,8 @@ extern "C" {
 #define GATTLIB_ERROR_DBUS          6
 #define GATTLIB_ERROR_BLUEZ         7
 #define GATTLIB_ERROR_INTERNAL      8
+#define GATTLIB_TIMEOUT             9
+#define GATTLIB_CANCELLED           10
 //@}
 
 /**
@@ -92,6 +95,7 @@ extern "C" {
 #define GATTLIB_CONNECTION_OPTIONS_LEGACY_BT_SEC_LOW        (1 << 2)
 #define GATTLIB_CONNECTION_OPTIONS_LEGACY_BT_SEC_MEDIUM     (1 << 3)
 #define GATTLIB_CONNECTION_OPTIONS_LEGACY_BT_SEC_HIGH       (1 << 4)
+#define GATTLIB_CONNECTION_OPTIONS_LEGACY_NO_DISCOVERY      (1 << 5) //< Do not discover the characteristics. See gattlib_set_characteristics()
 #define GATTLIB_CONNECTION_OPTIONS_LEGACY_PSM(value)        (((value) & 0x3FF) << 11) //< We encode PSM on 10 bits (up to 1023)
 #define GATTLIB_CONNECTION_OPTIONS_LEGACY_MTU(value)        (((value) & 0x3FF) << 21) //< We encode MTU on 10 bits (up to 1023)
 
@@ -114,6 +118,14 @@ extern "C" {
 #define GATTLIB_DISCOVER_FILTER_NOTIFY_CHANGE               (1 << 2)
 //@}
 
+/**
+ * @name Scan types
+ */
+//@{
+#define GATTLIB_SCAN_TYPE_PASSIVE                           0x00
+#define GATTLIB_SCAN_TYPE_ACTIVE                            0x01
+//@}
+
 /**
  * @name Gattlib Eddystone types
  */
@@ -138,6 +150,7 @@ extern "C" {
 
 typedef struct _gatt_connection_t gatt_connection_t;
 typedef struct _gatt_stream_t gatt_stream_t;
+typedef struct _gattlib_cancellable_t gattlib_cancellable_t;
 
 /**
  * Structure to represent a GATT Service and its data in the BLE advertisement packet
@@ -148,6 +161,56 @@ typedef struct {
 	size_t   data_length;  /**< Length of data attached to the GATT Service */
 } gattlib_advertisement_data_t;
 
+/**
+ * Structure to represent the Manufacturer Specific Data of a BLE advertisement packet
+ */
+typedef struct {
+	uint16_t       manufacturer_id;  /**< Company Identifier */
+	const uint8_t* data;             /**< Data following the Company Identifier */
+	size_t         data_length;      /**< Length of data */
+} gattlib_manufacturer_data_t;
+
+/**
+ * @name Fields present in the advertisement record
+ */
+//@{
+#define GATTLIB_ADVERTISEMENT_HAS_RSSI                      (1 << 0)
+#define GATTLIB_ADVERTISEMENT_HAS_TX_POWER                  (1 << 1)
+#define GATTLIB_ADVERTISEMENT_HAS_FLAGS                     (1 << 2)
+//@}
+
+/**
+ * Counters of an advertisement match rule (see `gattlib_adapter_scan_set_match_rules()`)
+ */
+typedef struct {
+	uint64_t accepted;  /**< Number of advertisements accepted by the rule */
+	uint64_t rejected;  /**< Number of advertisements evaluated and rejected by the rule */
+} gattlib_match_rule_stats_t;
+
+/**
+ * Structure to represent a parsed BLE advertisement
+ *
+ * When passed to a scan callback, the record and all the data it points to are only valid during
+ * the call of the callback. Records returned by `gattlib_get_advertisement()` are valid until
+ * `gattlib_advertisement_free()` is called.
+ */
+typedef struct {
+	bdaddr_t    addr;                /**< Address of the BLE device */
+	uint8_t     addr_type;           /**< BDADDR_LE_PUBLIC or BDADDR_LE_RANDOM */
+	uint32_t    present;             /**< Optional fields present in the record (GATTLIB_ADVERTISEMENT_HAS_*) */
+	int16_t     rssi;                /**< RSSI in dBm */
+	int8_t      tx_power;            /**< TX power level in dBm */
+	uint8_t     flags;               /**< Advertising flags */
+	const char* name;                /**< Name of the BLE device (NULL if not advertised) */
+
+	const uuid_t*                       service_uuids;            /**< Advertised Service UUIDs */
+	size_t                              service_uuid_count;
+	const gattlib_advertisement_data_t* service_data;             /**< Service Data */
+	size_t                              service_data_count;
+	const gattlib_manufacturer_data_t*  manufacturer_data;        /**< Manufacturer Specific Data */
+	size_t                              manufacturer_data_count;
+} gattlib_advertisement_t;
+
 typedef void (*gattlib_event_handler_t)(const uuid_t* uuid, const uint8_t* data, size_t data_length, void* user_data);
 
 /**
@@ -168,6 +231,18 @@ typedef void (*gattlib_disconnection_handler_t)(void* user_data);
  */
 typedef void (*gattlib_discovered_device_t)(void *adapter, const char* addr, const char* name, void *user_data);
 
+/**
+ * @brief Handler called on new discovered BLE device
+ *
+ * @param adapter is the adapter that has found the BLE device
+ * @param addr is the address of the BLE device
+ * @param addr_type is the address type of the BLE device (BDADDR_LE_PUBLIC or BDADDR_LE_RANDOM)
+ * @param name is the name of BLE device if advertised
+ * @param user_data  Data defined when calling `gattlib_adapter_scan_enable_bdaddr()`
+ */
+typedef void (*gattlib_discovered_device_bdaddr_t)(void *adapter, const bdaddr_t *addr, uint8_t addr_type,
+		const char* name, void *user_data);
+
 /**
  * @brief Handler called on new discovered BLE device
  *
@@ -186,6 +261,67 @@ typedef void (*gattlib_discovered_device_with_data_t)(void *adapter, const char*
 		uint16_t manufacturer_id, uint8_t *manufacturer_data, size_t manufacturer_data_size,
 		void *user_data);
 
+/**
+ * @brief Handler called on each BLE advertisement received during a scan
+ *
+ * @param adapter is the adapter that has received the advertisement
+ * @param advertisement is the parsed advertisement. It is only valid during the call.
+ * @param user_data  Data defined when calling `gattlib_adapter_scan_advertisements()`
+ */
+typedef void (*gattlib_discovered_advertisement_t)(void *adapter, const gattlib_advertisement_t *advertisement, void *user_data);
+
+/**
+ * @brief Handler called when a device has not been seen during the TTL of the change detection
+ *
+ * @param adapter is the adapter that was scanning
+ * @param addr is the address of the lost device
+ * @param user_data  Data defined when starting the scan
+ */
+typedef void (*gattlib_device_lost_t)(void *adapter, const bdaddr_t *addr, void *user_data);
+
+/**
+ * Maximum length of an expanded Eddystone URL (including the NUL terminator)
+ */
+#define GATTLIB_EDDYSTONE_URL_MAX_LENGTH                    144
+
+/**
+ * Structure to represent a decoded Eddystone frame
+ */
+typedef struct {
+	uint8_t frame_type;                      /**< Frame type (EDDYSTONE_TYPE_*) */
+	int8_t  tx_power;                        /**< Calibrated TX power at 0m in dBm (UID, URL and EID frames) */
+	union {
+		struct {
+			uint8_t namespace_id[10];        /**< 10-byte ID Namespace */
+			uint8_t instance_id[6];          /**< 6-byte ID Instance */
+		} uid;
+		struct {
+			char url[GATTLIB_EDDYSTONE_URL_MAX_LENGTH]; /**< URL with its scheme prefix and expansions decoded */
+		} url;
+		struct {
+			uint8_t  version;                /**< TLM version */
+			uint16_t battery_voltage;        /**< Battery voltage in mV (0 if not supported) */
+			int16_t  temperature;            /**< Beacon temperature in signed 8.8 fixed-point Celsius (0x8000 if not supported) */
+			uint32_t advertising_count;      /**< Number of advertising PDUs since power-up or reboot */
+			uint32_t uptime;                 /**< Time since power-up or reboot in 0.1 second */
+		} tlm;
+		struct {
+			uint8_t eid[8];                  /**< 8-byte Ephemeral Identifier */
+		} eid;
+	};
+} gattlib_eddystone_frame_t;
+
+/**
+ * @brief Handler called on each Eddystone frame received during a scan
+ *
+ * @param adapter is the adapter that has received the advertisement
+ * @param advertisement is the parsed advertisement carrying the frame. It is only valid during the call.
+ * @param frame is the decoded Eddystone frame. It is only valid during the call.
+ * @param user_data  Data defined when calling `gattlib_adapter_scan_eddystone_frames()`
+ */
+typedef void (*gattlib_discovered_eddystone_t)(void *adapter, const gattlib_advertisement_t *advertisement,
+		const gattlib_eddystone_frame_t *frame, void *user_data);
+
 /**
  * @brief Handler called on asynchronous connection when connection is ready
  *
@@ -194,6 +330,16 @@ typedef void (*gattlib_discovered_device_with_data_t)(void *adapter, const char*
  */
 typedef void (*gatt_connect_cb_t)(gatt_connection_t* connection, void* user_data);
 
+/**
+ * @brief Handler called by `gattlib_connect_many()` when the connection to a device completes
+ *
+ * @param adapter    is the adapter passed to `gattlib_connect_many()`
+ * @param dst        is the address of the device
+ * @param connection is the new connection or NULL if the connection failed
+ * @param user_data  Data defined when calling `gattlib_connect_many()`
+ */
+typedef void (*gattlib_connect_many_cb_t)(void *adapter, const char *dst, gatt_connection_t* connection, void* user_data);
+
 /**
  * @brief Callback called when GATT characteristic read value has been received
  *
@@ -225,6 +371,105 @@ extern const char *gattlib_eddystone_url_scheme_prefix[];
  */
 int gattlib_adapter_open(const char* adapter_name, void** adapter);
 
+/**
+ * @brief Set the parameters used by the next Bluetooth scans on a given adapter
+ *
+ * By default, scans are active with a scan interval and window of 0x12 (11.25 ms) and
+ * duplicate filtering enabled.
+ *
+ * @param adapter is the context of the newly opened adapter
+ * @param scan_type is either GATTLIB_SCAN_TYPE_PASSIVE or GATTLIB_SCAN_TYPE_ACTIVE.
+ *        Passive scanning does not send any scan request and is only supported by the legacy HCI backend.
+ * @param interval is the scan interval in units of 0.625 ms (from 0x0004 to 0x4000).
+ * @param window is the scan window in units of 0.625 ms. It must be lower or equal to the interval.
+ *        Interval and window are ignored by the D-Bus backend as BlueZ manages them, unless gattlib is
+ *        built with GATTLIB_MGMT and the adapter is controlled through the kernel management interface.
+ * @param filter_duplicates when true, the controller only reports the first advertisement of each device.
+ *        Disable it to receive every advertisement (eg: to track RSSI or changing advertisement data).
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_adapter_scan_set_parameters(void *adapter, uint8_t scan_type, uint16_t interval, uint16_t window, bool filter_duplicates);
+
+/**
+ * @brief Only report the devices of the given list during the next Bluetooth scans on a given adapter
+ *
+ * With the legacy HCI backend, the address filter is compiled with the other scan filters into a
+ * socket filter so the advertisements of the other devices are dropped by the kernel.
+ *
+ * @param adapter is the context of the newly opened adapter
+ * @param mac_address_list is a NULL-terminated list of MAC addresses (eg: "00:11:22:33:44:55").
+ *        With value NULL, the address filter is removed.
+ *
+ * @return GATTLIB_SUCCESS on success, GATTLIB_INVALID_PARAMETER if an address is malformed (the
+ *         filter is then unchanged) or GATTLIB_* error code
+ */
+int gattlib_adapter_scan_set_address_filter(void *adapter, const char **mac_address_list);
+
+/**
+ * @brief Only report the advertisements matching the given rules during the next Bluetooth scans
+ *
+ * The rules are compiled once and evaluated by the scanner before any callback. An advertisement is
+ * reported when it matches any of the rules. A rule matches when all its terms match.
+ * Rules are separated by ';' or new lines and terms by spaces. A term prefixed by '!' is negated:
+ *   - `rssi>=<dBm>`, `rssi<=<dBm>`: RSSI bounds
+ *   - `uuid=<uuid>`: advertised Service UUID or Service Data UUID
+ *   - `name=<pattern>`: device name matching a shell wildcard pattern (eg: `name=Sensor-*`)
+ *   - `mfg=<id>[:<hex prefix>]`: Manufacturer Specific Data with an optional payload prefix (eg: `mfg=0x0059:0102`)
+ *   - `ibeacon`, `ibeacon.uuid=<uuid>`, `ibeacon.major=<min>[-<max>]`, `ibeacon.minor=<min>[-<max>]`: iBeacon fields
+ *
+ * The rules must not be changed while a scan is running.
+ *
+ * @param adapter is the context of the newly opened adapter
+ * @param rules is the rule source (eg: "ibeacon.major=100-199 rssi>=-80; name=Sensor-*").
+ *        With value NULL, the rules are removed.
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_adapter_scan_set_match_rules(void *adapter, const char *rules);
+
+/**
+ * @brief Only report the devices whose advertisement changed during the next Bluetooth scans
+ *
+ * The scanner keeps a digest of the advertisement payload, the last reported RSSI and the last-seen
+ * time of each device. A device is reported when it is seen for the first time, when its payload
+ * changes, when its RSSI moves by `rssi_delta` dBm or more from the last reported value, or when it
+ * comes back after `ttl`. It replaces the behaviour of GATTLIB_DISCOVER_FILTER_NOTIFY_CHANGE.
+ *
+ * @note On the D-Bus backend, a device is only seen when BlueZ signals a change of its properties.
+ *       With a `ttl`, the scan asks BlueZ for the repeated advertisements (BlueZ 5.49 or later),
+ *       which refreshes the devices advertising service or manufacturer data. With an older BlueZ
+ *       or for the other devices, a device still advertising an unchanged payload is reported lost.
+ *
+ * @param adapter is the context of the newly opened adapter
+ * @param rssi_delta is the RSSI change (in dBm) that triggers a report. 0 to ignore RSSI changes.
+ * @param ttl is the time (in ms) after which an unseen device is lost. 0 for devices never to expire.
+ * @param device_lost_cb is the function called for each lost device. It might be NULL.
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_adapter_scan_enable_change_detection(void *adapter, uint8_t rssi_delta, uint32_t ttl, gattlib_device_lost_t device_lost_cb);
+
+/**
+ * @brief Disable the change detection enabled by `gattlib_adapter_scan_enable_change_detection()`
+ *
+ * @param adapter is the context of the newly opened adapter
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_adapter_scan_disable_change_detection(void *adapter);
+
+/**
+ * @brief Get the number of advertisements accepted and rejected by each match rule
+ *
+ * @param adapter is the context of the newly opened adapter
+ * @param stats is the array receiving the counters of the rules in their declaration order
+ * @param stats_count is the number of elements of 'stats' on input and the number of rules on output
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_adapter_scan_get_match_rule_stats(void *adapter, gattlib_match_rule_stats_t *stats, size_t *stats_count);
+
 /**
  * @brief Enable Bluetooth scanning on a given adapter
  *
@@ -255,6 +500,84 @@ int gattlib_adapter_scan_enable(void* adapter, gattlib_discovered_device_t disco
 int gattlib_adapter_scan_enable_with_filter(void *adapter, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
 		gattlib_discovered_device_t discovered_device_cb, size_t timeout, void *user_data);
 
+/**
+ * @brief Enable Bluetooth scanning on a given adapter and report the devices by their binary address
+ *
+ * Same as `gattlib_adapter_scan_enable_with_filter()` but the devices are reported with their
+ * `bdaddr_t` and address type. No MAC address string is formatted.
+ *
+ * @param adapter is the context of the newly opened adapter
+ * @param uuid_list is a NULL-terminated list of UUIDs to filter. The rule only applies to advertised UUID.
+ *        Returned devices would match any of the UUIDs of the list.
+ * @param rssi_threshold is the imposed RSSI threshold for the returned devices.
+ * @param enabled_filters defines the parameters to use for filtering. There are selected by using the macros
+ *        GATTLIB_DISCOVER_FILTER_USE_UUID and GATTLIB_DISCOVER_FILTER_USE_RSSI.
+ * @param discovered_device_cb is the function callback called for each new Bluetooth device discovered
+ * @param timeout defines the duration of the Bluetooth scanning. When timeout=0, we scan indefinitely.
+ * @param user_data is the data passed to the callback `discovered_device_cb()`
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_adapter_scan_enable_bdaddr(void *adapter, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
+		gattlib_discovered_device_bdaddr_t discovered_device_cb, size_t timeout, void *user_data);
+
+/**
+ * @brief Enable Bluetooth scanning on a given adapter and report the content of the advertisements
+ *
+ * Contrary to `gattlib_adapter_scan_enable_with_filter()`, the callback is called for each
+ * advertisement received (or each update of the device properties with the D-Bus backend) and
+ * receives the RSSI and the advertisement data without any additional request to the device.
+ * Use `gattlib_adapter_scan_set_parameters()` to control duplicate filtering.
+ *
+ * @param adapter is the context of the newly opened adapter
+ * @param uuid_list is a NULL-terminated list of UUIDs to filter. The rule only applies to advertised UUID.
+ *        Returned devices would match any of the UUIDs of the list.
+ * @param rssi_threshold is the imposed RSSI threshold for the returned devices.
+ * @param enabled_filters defines the parameters to use for filtering. There are selected by using the macros
+ *        GATTLIB_DISCOVER_FILTER_USE_UUID and GATTLIB_DISCOVER_FILTER_USE_RSSI.
+ * @param discovered_advertisement_cb is the function callback called for each advertisement
+ * @param timeout defines the duration of the Bluetooth scanning. When timeout=0, we scan indefinitely.
+ * @param user_data is the data passed to the callback `discovered_advertisement_cb()`
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_adapter_scan_advertisements(void *adapter, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
+		gattlib_discovered_advertisement_t discovered_advertisement_cb, size_t timeout, void *user_data);
+
+/**
+ * @brief Start Bluetooth scanning on a given adapter without blocking the caller
+ *
+ * The function returns as soon as the scan is started. The advertisements are reported from
+ * the GLib main context `main_context`; the application must run a main loop on this context.
+ * The scan runs until `timeout` expires or `gattlib_adapter_scan_stop()` is called.
+ *
+ * @param adapter is the context of the newly opened adapter
+ * @param uuid_list is a NULL-terminated list of UUIDs to filter. The list is copied.
+ * @param rssi_threshold is the imposed RSSI threshold for the returned devices.
+ * @param enabled_filters defines the parameters to use for filtering. There are selected by using the macros
+ *        GATTLIB_DISCOVER_FILTER_USE_UUID and GATTLIB_DISCOVER_FILTER_USE_RSSI.
+ * @param discovered_advertisement_cb is the function callback called for each advertisement
+ * @param timeout defines the duration of the Bluetooth scanning. When timeout=0, we scan until the scan is stopped.
+ * @param main_context is the `GMainContext*` the callbacks are invoked from. When NULL, the thread-default
+ *        main context of the caller is used.
+ * @param user_data is the data passed to the callback `discovered_advertisement_cb()`
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_adapter_scan_start(void *adapter, uuid_t **uuid_list, int16_t rssi_threshold, uint32_t enabled_filters,
+		gattlib_discovered_advertisement_t discovered_advertisement_cb, size_t timeout, void *main_context, void *user_data);
+
+/**
+ * @brief Stop the Bluetooth scanning started by `gattlib_adapter_scan_start()`
+ *
+ * It is safe to call this function from the advertisement callback.
+ *
+ * @param adapter is the context of the newly opened adapter
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_adapter_scan_stop(void *adapter);
+
 /**
  * @brief Enable Eddystone Bluetooth Device scanning on a given adapter
  *
@@ -263,7 +586,9 @@ int gattlib_adapter_scan_enable_with_filter(void *adapter, uuid_t **uuid_list, i
  * @param eddystone_types defines the type(s) of Eddystone advertisement data type to select.
  *        The types are defined by the macros `GATTLIB_EDDYSTONE_TYPE_*`. The macro `GATTLIB_EDDYSTONE_LIMIT_RSSI`
  *        can also be used to limit RSSI with rssi_threshold.
- * @param discovered_device_cb is the function callback called for each new Bluetooth device discovered
+ * @param discovered_device_cb is the function callback called once per device, on its first Eddystone advertisement
+ *        of the selected types. The data passed to the callback is only valid during the call.
+ *        Use `gattlib_adapter_scan_eddystone_frames()` to receive every frame.
  * @param timeout defines the duration of the Bluetooth scanning. When timeout=0, we scan indefinitely.
  * @param user_data is the data passed to the callback `discovered_device_cb()`
  *
@@ -272,6 +597,36 @@ int gattlib_adapter_scan_enable_with_filter(void *adapter, uuid_t **uuid_list, i
 int gattlib_adapter_scan_eddystone(void *adapter, int16_t rssi_threshold, uint32_t eddystone_types,
 		gattlib_discovered_device_with_data_t discovered_device_cb, size_t timeout, void *user_data);
 
+/**
+ * @brief Enable Eddystone Bluetooth Device scanning on a given adapter and decode the Eddystone frames
+ *
+ * Frames whose type has not been selected in `eddystone_types` are dropped before the callback.
+ *
+ * @param adapter is the context of the newly opened adapter
+ * @param rssi_threshold is the imposed RSSI threshold for the returned devices.
+ * @param eddystone_types defines the type(s) of Eddystone frame to select.
+ *        The types are defined by the macros `GATTLIB_EDDYSTONE_TYPE_*`. The macro `GATTLIB_EDDYSTONE_LIMIT_RSSI`
+ *        can also be used to limit RSSI with rssi_threshold.
+ * @param discovered_eddystone_cb is the function callback called for each Eddystone frame
+ * @param timeout defines the duration of the Bluetooth scanning. When timeout=0, we scan indefinitely.
+ * @param user_data is the data passed to the callback `discovered_eddystone_cb()`
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_adapter_scan_eddystone_frames(void *adapter, int16_t rssi_threshold, uint32_t eddystone_types,
+		gattlib_discovered_eddystone_t discovered_eddystone_cb, size_t timeout, void *user_data);
+
+/**
+ * @brief Decode the Eddystone frame carried in the Service Data of the Eddystone Service UUID
+ *
+ * @param data is the Service Data
+ * @param data_length is the length of the Service Data
+ * @param frame is the decoded frame
+ *
+ * @return GATTLIB_SUCCESS on success, GATTLIB_NOT_SUPPORTED for unknown or encrypted frames or GATTLIB_INVALID_PARAMETER
+ */
+int gattlib_eddystone_parse_frame(const uint8_t *data, size_t data_length, gattlib_eddystone_frame_t *frame);
+
 /**
  * @brief Disable Bluetooth scanning on a given adapter
  *
@@ -290,6 +645,60 @@ int gattlib_adapter_scan_disable(void* adapter);
  */
 int gattlib_adapter_close(void* adapter);
 
+/**
+ * @brief Get a file descriptor to integrate gattlib into an external event loop (eg: epoll)
+ *
+ * The file descriptor becomes readable when gattlib has events to process. The application must
+ * then call `gattlib_dispatch()` from the thread that has called this function. All the callbacks
+ * (connection, notification, disconnection) are invoked from `gattlib_dispatch()`.
+ *
+ * This function must be called before the first connection. No internal thread is started
+ * afterwards. Otherwise the callbacks are invoked from the internal gattlib thread. With the D-Bus
+ * backend, the gattlib functions can be called from any thread in both cases.
+ *
+ * @param fd is the file descriptor to watch for readability
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_get_pollfd(int *fd);
+
+/**
+ * @brief Dispatch the pending gattlib events
+ *
+ * @param timeout_ms is the maximum time to wait for an event (in ms). 0 to only dispatch the
+ *        pending events (eg: when the file descriptor of `gattlib_get_pollfd()` is readable).
+ *        -1 to wait indefinitely.
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_dispatch(int timeout_ms);
+
+/**
+ * @brief Create a cancellation token for the `*_with_timeout()` functions
+ *
+ * A token can be shared by several operations, eg: to abort all the requests to a device.
+ *
+ * @return the new cancellation token or NULL on failure
+ */
+gattlib_cancellable_t *gattlib_cancellable_new(void);
+
+/**
+ * @brief Cancel the operations using the cancellation token
+ *
+ * This function can be called from any thread. The pending operations return GATTLIB_CANCELLED.
+ * The operations started afterwards with the same token fail immediately.
+ *
+ * @param cancellable is the cancellation token
+ */
+void gattlib_cancellable_cancel(gattlib_cancellable_t *cancellable);
+
+/**
+ * @brief Free the cancellation token. It must not be used by any operation anymore.
+ *
+ * @param cancellable is the cancellation token
+ */
+void gattlib_cancellable_free(gattlib_cancellable_t *cancellable);
+
 /**
  * @brief Function to connect to a BLE device
  *
@@ -299,6 +708,37 @@ int gattlib_adapter_close(void* adapter);
  */
 gatt_connection_t *gattlib_connect(void *adapter, const char *dst, unsigned long options);
 
+/**
+ * @brief Function to connect to a BLE device from its binary address
+ *
+ * @param adapter	Local Adaptater interface. When passing NULL, we use default adapter.
+ * @param dst		Remote Bluetooth address
+ * @param dst_type	Address type of the remote device (BDADDR_LE_PUBLIC or BDADDR_LE_RANDOM). It replaces
+ *			GATTLIB_CONNECTION_OPTIONS_LEGACY_BDADDR_LE_* with the legacy backend. The D-Bus
+ *			backend only checks it: Bluez already knows the address type of the discovered device.
+ * @param options	Options to connect to BLE device. See `GATTLIB_CONNECTION_OPTIONS_*`. Like with
+ *			gattlib_connect(), the D-Bus backend ignores the `GATTLIB_CONNECTION_OPTIONS_LEGACY_*`
+ *			options: the device must have been discovered and Bluez negotiates the security.
+ */
+gatt_connection_t *gattlib_connect_bdaddr(void *adapter, const bdaddr_t *dst, uint8_t dst_type, unsigned long options);
+
+/**
+ * @brief Function to connect to a BLE device within a deadline
+ *
+ * The pending connection is aborted when the timeout expires or when `cancellable` is cancelled.
+ *
+ * @param adapter	Local Adaptater interface. When passing NULL, we use default adapter.
+ * @param dst		Remote Bluetooth address
+ * @param options	Options to connect to BLE device. See `GATTLIB_CONNECTION_OPTIONS_*`
+ * @param timeout_ms	Maximum duration of the connection (in ms). 0 to use the default timeout.
+ * @param cancellable	Optional cancellation token. See `gattlib_cancellable_new()`
+ * @param connection	is the new connection
+ *
+ * @return GATTLIB_SUCCESS on success, GATTLIB_TIMEOUT, GATTLIB_CANCELLED or GATTLIB_* error code
+ */
+int gattlib_connect_with_timeout(void *adapter, const char *dst, unsigned long options,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable, gatt_connection_t **connection);
+
 /**
  * @brief Function to asynchronously connect to a BLE device
  *
@@ -314,6 +754,28 @@ gatt_connection_t *gattlib_connect_async(void *adapter, const char *dst,
 		unsigned long options,
 		gatt_connect_cb_t connect_cb, void* user_data);
 
+/**
+ * @brief Function to connect to a list of BLE devices with a bounded number of concurrent attempts
+ *
+ * Up to `max_in_flight` connections are attempted at the same time. The result of each device is
+ * reported to `per_device_cb` as soon as its connection completes. The calls to `per_device_cb` are
+ * serialized but they come from internal threads. The function returns once all the devices have
+ * been reported.
+ *
+ * @param adapter	Local Adaptater interface. When passing NULL, we use default adapter.
+ * @param dst_list	Remote Bluetooth addresses
+ * @param dst_count	Number of addresses in `dst_list`
+ * @param options	Options to connect to BLE devices. See `GATTLIB_CONNECTION_OPTIONS_*`
+ * @param max_in_flight	Maximum number of concurrent connection attempts. Most controllers only
+ *			create one LE connection at a time: more attempts are queued by the kernel.
+ * @param per_device_cb	is the callback to call for each device
+ * @param user_data	is the user specific data to pass to the callback
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_connect_many(void *adapter, const char *dst_list[], size_t dst_count, unsigned long options,
+		size_t max_in_flight, gattlib_connect_many_cb_t per_device_cb, void *user_data);
+
 /**
  * @brief Function to disconnect the GATT connection
  *
@@ -403,6 +865,21 @@ int gattlib_discover_char_range(gatt_connection_t* connection, int start, int en
  */
 int gattlib_discover_char(gatt_connection_t* connection, gattlib_characteristic_t** characteristics, int* characteristics_count);
 
+/**
+ * @brief Function to set the GATT Characteristics of the connection
+ *
+ * @note It replaces the discovery done on connection when the connection has been established with
+ *       GATTLIB_CONNECTION_OPTIONS_LEGACY_NO_DISCOVERY. The characteristics might have been discovered
+ *       on a previous connection to the device. Only supported by the legacy backend.
+ *
+ * @param connection Active GATT connection
+ * @param characteristics array of GATT characteristics. It is copied.
+ * @param characteristics_count Number of GATT characteristics
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_set_characteristics(gatt_connection_t* connection, const gattlib_characteristic_t* characteristics, int characteristics_count);
+
 /**
  * @brief Function to discover GATT Descriptors in a range of handles
  *
@@ -441,6 +918,24 @@ int gattlib_discover_desc(gatt_connection_t* connection, gattlib_descriptor_t**
  */
 int gattlib_read_char_by_uuid(gatt_connection_t* connection, uuid_t* uuid, void** buffer, size_t* buffer_len);
 
+/**
+ * @brief Function to read GATT characteristic within a deadline
+ *
+ * @note buffer is allocated by the function. It is the responsibility of the caller to free the buffer.
+ *
+ * @param connection Active GATT connection
+ * @param uuid UUID of the GATT characteristic to read
+ * @param buffer contains the value to read. It is allocated by the function.
+ * @param buffer_len Length of the read data
+ * @param timeout_ms is the maximum duration of the read (in ms). 0 for no deadline: the legacy backend
+ *        then waits for the completion and the D-Bus backend only applies the default D-Bus timeout.
+ * @param cancellable is an optional cancellation token. See `gattlib_cancellable_new()`
+ *
+ * @return GATTLIB_SUCCESS on success, GATTLIB_TIMEOUT, GATTLIB_CANCELLED or GATTLIB_* error code
+ */
+int gattlib_read_char_by_uuid_with_timeout(gatt_connection_t* connection, uuid_t* uuid, void** buffer, size_t* buffer_len,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable);
+
 /**
  * @brief Function to asynchronously read GATT characteristic
  *
@@ -464,6 +959,22 @@ int gattlib_read_char_by_uuid_async(gatt_connection_t* connection, uuid_t* uuid,
  */
 int gattlib_write_char_by_uuid(gatt_connection_t* connection, uuid_t* uuid, const void* buffer, size_t buffer_len);
 
+/**
+ * @brief Function to write to the GATT characteristic UUID within a deadline
+ *
+ * @param connection Active GATT connection
+ * @param uuid UUID of the GATT characteristic to read
+ * @param buffer contains the values to write to the GATT characteristic
+ * @param buffer_len is the length of the buffer to write
+ * @param timeout_ms is the maximum duration of the write (in ms). 0 for no deadline: the legacy backend
+ *        then waits for the completion and the D-Bus backend only applies the default D-Bus timeout.
+ * @param cancellable is an optional cancellation token. See `gattlib_cancellable_new()`
+ *
+ * @return GATTLIB_SUCCESS on success, GATTLIB_TIMEOUT, GATTLIB_CANCELLED or GATTLIB_* error code
+ */
+int gattlib_write_char_by_uuid_with_timeout(gatt_connection_t* connection, uuid_t* uuid, const void* buffer, size_t buffer_len,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable);
+
 /**
  * @brief Function to write to the GATT characteristic handle
  *
@@ -544,6 +1055,20 @@ int gattlib_write_without_response_char_by_handle(gatt_connection_t* connection,
  */
 int gattlib_notification_start(gatt_connection_t* connection, const uuid_t* uuid);
 
+/*
+ * @brief Enable notification on GATT characteristic represented by its UUID within a deadline
+ *
+ * @param connection Active GATT connection
+ * @param uuid UUID of the characteristic that will trigger the notification
+ * @param timeout_ms is the maximum duration of the request (in ms). 0 for no deadline: the legacy backend
+ *        then waits for the completion and the D-Bus backend only applies the default D-Bus timeout.
+ * @param cancellable is an optional cancellation token. See `gattlib_cancellable_new()`
+ *
+ * @return GATTLIB_SUCCESS on success, GATTLIB_TIMEOUT, GATTLIB_CANCELLED or GATTLIB_* error code
+ */
+int gattlib_notification_start_with_timeout(gatt_connection_t* connection, const uuid_t* uuid,
+		unsigned int timeout_ms, gattlib_cancellable_t *cancellable);
+
 /*
  * @brief Disable notification on GATT characteristic represented by its UUID
  *
@@ -626,10 +1151,11 @@ int gattlib_get_rssi_from_mac(void *adapter, const char *mac_address, int16_t *r
  * @brief Function to retrieve Advertisement Data from a MAC Address
  *
  * @param connection Active GATT connection
- * @param advertisement_data is an array of Service UUID and their respective data
+ * @param advertisement_data is an array of Service UUID and their respective data. The array and the data
+ *        of its entries are a single allocation to release with `free()`.
  * @param advertisement_data_count is the number of elements in the advertisement_data array
- * @param manufacturer_id is the ID of the Manufacturer ID
- * @param manufacturer_data is the data following Manufacturer ID
+ * @param manufacturer_id is the ID of the first Manufacturer Specific Data
+ * @param manufacturer_data is the data following Manufacturer ID. It must be released with `free()`.
  * @param manufacturer_data_size is the size of manufacturer_data
  *
  * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
@@ -643,10 +1169,11 @@ int gattlib_get_advertisement_data(gatt_connection_t *connection,
  *
  * @param adapter is the adapter the new device has been seen
  * @param mac_address is the MAC address of the device to get the RSSI
- * @param advertisement_data is an array of Service UUID and their respective data
+ * @param advertisement_data is an array of Service UUID and their respective data. The array and the data
+ *        of its entries are a single allocation to release with `free()`.
  * @param advertisement_data_count is the number of elements in the advertisement_data array
- * @param manufacturer_id is the ID of the Manufacturer ID
- * @param manufacturer_data is the data following Manufacturer ID
+ * @param manufacturer_id is the ID of the first Manufacturer Specific Data
+ * @param manufacturer_data is the data following Manufacturer ID. It must be released with `free()`.
  * @param manufacturer_data_size is the size of manufacturer_data
  *
  * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
@@ -655,6 +1182,37 @@ int gattlib_get_advertisement_data_from_mac(void *adapter, const char *mac_addre
 		gattlib_advertisement_data_t **advertisement_data, size_t *advertisement_data_count,
 		uint16_t *manufacturer_id, uint8_t **manufacturer_data, size_t *manufacturer_data_size);
 
+/**
+ * @brief Function to retrieve the advertisement of a connected device
+ *
+ * Contrary to `gattlib_get_advertisement_data()`, all the Manufacturer Specific Data are returned.
+ * The record and all the data it points to are stored in a single allocation.
+ *
+ * @param connection Active GATT connection
+ * @param advertisement is the returned advertisement record. It must be released with `gattlib_advertisement_free()`.
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_get_advertisement(gatt_connection_t *connection, gattlib_advertisement_t **advertisement);
+
+/**
+ * @brief Function to retrieve the advertisement of a device from its MAC Address
+ *
+ * @param adapter is the adapter the new device has been seen
+ * @param mac_address is the MAC address of the device
+ * @param advertisement is the returned advertisement record. It must be released with `gattlib_advertisement_free()`.
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_get_advertisement_from_mac(void *adapter, const char *mac_address, gattlib_advertisement_t **advertisement);
+
+/**
+ * @brief Release an advertisement record returned by `gattlib_get_advertisement()`
+ *
+ * @param advertisement is the advertisement record to release
+ */
+void gattlib_advertisement_free(gattlib_advertisement_t *advertisement);
+
 /**
  * @brief Convert a UUID into a string
  *
@@ -687,6 +1245,36 @@ int gattlib_string_to_uuid(const char *str, size_t size, uuid_t *uuid);
  */
 int gattlib_uuid_cmp(const uuid_t *uuid1, const uuid_t *uuid2);
 
+/**
+ * @brief Convert a MAC address string (eg: "00:11:22:33:44:55") into a Bluetooth address
+ *
+ * @param str is the MAC address string
+ * @param bdaddr is the Bluetooth address that would receive the address
+ *
+ * @return GATTLIB_SUCCESS on success or GATTLIB_* error code
+ */
+int gattlib_string_to_bdaddr(const char *str, bdaddr_t *bdaddr);
+
+/**
+ * @brief Convert a Bluetooth address into a 48-bit integer
+ *
+ * The integer can be compared and hashed in place of the address. Its most significant byte is
+ * the first byte of the MAC address string.
+ *
+ * @param bdaddr is the Bluetooth address to convert
+ *
+ * @return the address as an integer
+ */
+uint64_t gattlib_bdaddr_to_uint64(const bdaddr_t *bdaddr);
+
+/**
+ * @brief Convert a 48-bit integer returned by `gattlib_bdaddr_to_uint64()` back into a Bluetooth address
+ *
+ * @param value is the address as an integer
+ * @param bdaddr is the Bluetooth address that would receive the address
+ */
+void gattlib_uint64_to_bdaddr(uint64_t value, bdaddr_t *bdaddr);
+
 #ifdef __cplusplus
 }
 #endif